@@ -107,6 +107,7 @@ extern "C" {
 extern int dlevmar_der(
       void (*func)(double *p, double *hx, int m, int n, void *adata),
       void (*jacf)(double *p, double *j, int m, int n, void *adata),
+      int(*visf)(double *p, double *hx, int m, int n, int iter, double p_eL2, void *adata),
       double *p, double *x, int m, int n, int itmax, double *opts,
       double *info, double *work, double *covar, void *adata);
 
@@ -213,6 +214,7 @@ extern int dlevmar_lic_dif(
 extern int slevmar_der(
       void (*func)(float *p, float *hx, int m, int n, void *adata),
       void (*jacf)(float *p, float *j, int m, int n, void *adata),
+      int(*visf)(float *p, float *hx, int m, int n, int iter, float p_eL2, void *adata),
       float *p, float *x, int m, int n, int itmax, float *opts,
       float *info, float *work, float *covar, void *adata);
 
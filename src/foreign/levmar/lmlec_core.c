@@ -476,7 +476,7 @@ int LEVMAR_LEC_DER(
 
   if(!info) info=locinfo; /* make sure that LEVMAR_DER() is called with non-null info */
   /* note that covariance computation is not requested from LEVMAR_DER() */
-  ret=LEVMAR_DER(LMLEC_FUNC, LMLEC_JACF, pp, x, mm, n, itmax, opts, info, work, NULL, (void *)&data);
+  ret=LEVMAR_DER(LMLEC_FUNC, LMLEC_JACF, NULL, pp, x, mm, n, itmax, opts, info, work, NULL, (void *)&data);
 
   /* p=c + Z*pp */
   for(i=0; i<m; ++i){
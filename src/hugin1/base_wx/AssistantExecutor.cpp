@@ -106,15 +106,16 @@ namespace HuginQueue
         };
         //now optimise all
         commands->push_back(new NormalCommand(GetInternalProgram(ExePath, wxT("checkpto")), quotedProject));
+        const wxString nativeOptimizer = (config->Read(wxT("/Optimizer/UseNative"), HUGIN_OPTIMIZER_USE_NATIVE) != 0) ? wxT("--native-optimizer ") : wxT("");
         if (pano.getNrOfImages() == 1)
         {
             commands->push_back(new NormalCommand(GetInternalProgram(ExePath, wxT("autooptimiser")),
-                wxT("-a -s -o ") + quotedProject + wxT(" ") + quotedProject, _("Optimizing...")));
+                nativeOptimizer + wxT("-a -s -o ") + quotedProject + wxT(" ") + quotedProject, _("Optimizing...")));
         }
         else
         {
             commands->push_back(new NormalCommand(GetInternalProgram(ExePath, wxT("autooptimiser")),
-                wxT("-a -m -l -s -o ") + quotedProject + wxT(" ") + quotedProject, _("Optimizing...")));
+                nativeOptimizer + wxT("-a -m -l -s -o ") + quotedProject + wxT(" ") + quotedProject, _("Optimizing...")));
         };
         wxString panoModifyArgs;
         // if necessary scale down final pano
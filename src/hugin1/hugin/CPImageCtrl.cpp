@@ -808,6 +808,16 @@ public:
         return true;
     }
 
+    void transformImgCoords(const double* x, const double* y, double* sx, double* sy, unsigned char* valid, size_t n)
+    {
+        for (size_t i = 0; i < n; ++i)
+        {
+            sx[i] = m_scale*x[i];
+            sy[i] = m_scale*y[i];
+            valid[i] = 1;
+        }
+    }
+
     double m_scale;
 };
 
@@ -32,6 +32,7 @@
 #include <panotools/PanoToolsOptimizerWrapper.h>
 #include "hugin_base/panotools/PanoToolsUtils.h"
 #include <algorithms/optimizer/PTOptimizer.h>
+#include <algorithms/optimizer/BundleAdjuster.h>
 #include <algorithms/basic/CalculateCPStatistics.h>
 
 #include "hugin/OptimizePanel.h"
@@ -214,6 +215,8 @@ void OptimizePanel::runOptimizer(const HuginBase::UIntSet & imgs, const bool ign
     }
     HuginBase::UIntSet allImg;
     fill_set(allImg,0, imgs.size()-1);
+    // use the native optimizer for supported projects, if enabled in the preferences
+    const bool useNative = wxConfigBase::Get()->Read(wxT("/Optimizer/UseNative"), HUGIN_OPTIMIZER_USE_NATIVE) == 1;
 
     char *p = setlocale(LC_ALL,NULL);
     char *oldlocale = strdup(p);
@@ -227,7 +230,7 @@ void OptimizePanel::runOptimizer(const HuginBase::UIntSet & imgs, const bool ign
         {
             wxBusyCursor bc;
             // run pairwise optimizer
-            HuginBase::AutoOptimise(optPano).run();
+            HuginBase::AutoOptimise(optPano, true, useNative).run();
         }
 #ifdef DEBUG
         // print optimized script to cout
@@ -237,7 +240,7 @@ void OptimizePanel::runOptimizer(const HuginBase::UIntSet & imgs, const bool ign
 
         registerPTWXDlgFcn();
         // do global optimisation
-        HuginBase::PTools::optimize(optPano);
+        HuginBase::BundleAdjuster::optimizePanorama(optPano, useNative);
 #ifdef DEBUG
         // print optimized script to cout
         DEBUG_DEBUG("panorama after optimise():");
@@ -300,7 +303,7 @@ void OptimizePanel::runOptimizer(const HuginBase::UIntSet & imgs, const bool ign
         }
         else
         {
-            HuginBase::PTools::optimize(optPano);
+            HuginBase::BundleAdjuster::optimizePanorama(optPano, useNative);
         }
 #ifdef DEBUG
         // print optimized script to cout
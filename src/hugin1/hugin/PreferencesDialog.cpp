@@ -768,6 +768,9 @@ void PreferencesDialog::UpdateDisplayData(int panel)
         MY_CHOICE_VAL("prefs_celeste_filter", cfg->Read(wxT("/Celeste/Filter"), HUGIN_CELESTE_FILTER));
         // photometric optimizer settings
         MY_SPIN_VAL("prefs_photo_optimizer_nr_points", cfg->Read(wxT("/OptimizePhotometric/nRandomPointsPerImage"), HUGIN_PHOTOMETRIC_OPTIMIZER_NRPOINTS));
+        // geometric optimizer settings
+        t = cfg->Read(wxT("/Optimizer/UseNative"), HUGIN_OPTIMIZER_USE_NATIVE) == 1;
+        MY_BOOL_VAL("prefs_optimizer_use_native", t);
         // warnings
         t = cfg->Read(wxT("/ShowSaveMessage"), 1l) == 1;
         MY_BOOL_VAL("prefs_warning_save", t);
@@ -892,6 +895,7 @@ void PreferencesDialog::OnRestoreDefaults(wxCommandEvent& e)
             cfg->Write(wxT("/Celeste/Threshold"), HUGIN_CELESTE_THRESHOLD);
             cfg->Write(wxT("/Celeste/Filter"), HUGIN_CELESTE_FILTER);
             cfg->Write(wxT("/OptimizePhotometric/nRandomPointsPerImage"), HUGIN_PHOTOMETRIC_OPTIMIZER_NRPOINTS);
+            cfg->Write(wxT("/Optimizer/UseNative"), HUGIN_OPTIMIZER_USE_NATIVE);
             cfg->Write(wxT("/ShowSaveMessage"), 1l);
             cfg->Write(wxT("/ShowExposureWarning"), 1l);
             cfg->Write(wxT("/EditCPAfterAction"), 0l);
@@ -1040,6 +1044,8 @@ void PreferencesDialog::UpdateConfigData()
     cfg->Write(wxT("/Celeste/Filter"), MY_G_CHOICE_VAL("prefs_celeste_filter"));
     //photometric optimizer
     cfg->Write(wxT("/OptimizePhotometric/nRandomPointsPerImage"), MY_G_SPIN_VAL("prefs_photo_optimizer_nr_points"));
+    //geometric optimizer
+    cfg->Write(wxT("/Optimizer/UseNative"), MY_G_BOOL_VAL("prefs_optimizer_use_native"));
     cfg->Write(wxT("/ShowSaveMessage"), MY_G_BOOL_VAL("prefs_warning_save"));
     cfg->Write(wxT("/ShowExposureWarning"), MY_G_BOOL_VAL("prefs_warning_exposure"));
     cfg->Write(wxT("/EditCPAfterAction"), MY_G_CHOICE_VAL("pref_editcp_action"));
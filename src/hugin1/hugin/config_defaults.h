@@ -187,5 +187,7 @@
 
 //photometric optimizer
 #define HUGIN_PHOTOMETRIC_OPTIMIZER_NRPOINTS 200l
+//geometric optimizer, use the native optimizer instead of libpano13
+#define HUGIN_OPTIMIZER_USE_NATIVE      0l    // boolean
 
 #endif // _CONFIG_DEFAULTS_H
@@ -44,6 +44,7 @@
 #include <algorithms/basic/CalculateOptimalScale.h>
 
 #include "base_wx/MyExternalCmdExecDialog.h"
+#include "base_wx/MyProgressDialog.h"
 #include "base_wx/platform.h"
 #include "base_wx/huginConfig.h"
 #include "base_wx/wxPlatform.h"
@@ -59,6 +60,10 @@
 
 #include <wx/cmdline.h>
 
+#include "cpfind/PanoDetector.h"
+#include "cpfind/CPFindOptions.h"
+#include "cpfind/KeypointCache.h"
+
 #if defined MAC_SELF_CONTAINED_BUNDLE
   #include <wx/dir.h>
   #include <CoreFoundation/CFBundle.h>
@@ -89,6 +94,102 @@ int CPExecute(wxString prog, wxString args, wxString caption, wxWindow *parent)
     };
 };
 
+/** returns true, if the given program is cpfind, which can be run in-process */
+bool IsCPFind(const wxString& prog)
+{
+    wxFileName progName(prog);
+    return progName.GetName().CmpNoCase(wxT("cpfind")) == 0;
+};
+
+/** the keypoints of all images analysed by cpfind, kept in memory for later runs */
+KeypointCache& GetCPFindKeypointCache()
+{
+    static KeypointCache cache;
+    return cache;
+};
+
+/** runs cpfind in the same process, the keypoints of the images are cached in memory,
+ *  so a repeated run analyses only new or modified images
+ *  @return false, if the arguments are not supported in-process, in this case
+ *          cpfind should be run as external program */
+bool RunCPFindInProcess(wxString args, HuginBase::Panorama& pano, const HuginBase::UIntSet& imgs, int nFeatures,
+    HuginBase::CPVector& cps, int& ret_value, wxWindow* parent)
+{
+    // the images are read from the project file, the output is returned directly
+    if (imgs.size() < 2 || args.Find(wxT("%s")) == wxNOT_FOUND ||
+        args.Find(wxT("%i")) != wxNOT_FOUND || args.Find(wxT("%namefile")) != wxNOT_FOUND)
+    {
+        return false;
+    };
+    args.Replace(wxT("%o"), wxT("cpfind_output.pto"));
+    args.Replace(wxT("%s"), wxT("cpfind_input.pto"));
+    wxString tmp;
+    tmp.Printf(wxT("%d"), nFeatures);
+    args.Replace(wxT("%p"), tmp);
+    HuginBase::SrcPanoImage firstImg = pano.getSrcImage(*imgs.begin());
+    tmp.Printf(wxT("%f"), firstImg.getHFOV());
+    args.Replace(wxT("%v"), tmp);
+    tmp.Printf(wxT("%d"), (int) firstImg.getProjection());
+    args.Replace(wxT("%f"), tmp);
+
+    wxArrayString arguments = wxCmdLineParser::ConvertStringToArgs(args);
+    std::vector<std::string> argStrings;
+    argStrings.push_back("cpfind");
+    for (size_t i = 0; i < arguments.GetCount(); ++i)
+    {
+        argStrings.push_back(std::string(arguments[i].mb_str(wxConvLocal)));
+    };
+    std::vector<char*> argv;
+    for (size_t i = 0; i < argStrings.size(); ++i)
+    {
+        argv.push_back(&argStrings[i][0]);
+    };
+    argv.push_back(NULL);
+
+    PanoDetector detector;
+    if (!ParseCPFindOptions(argStrings.size(), argv.data(), detector, false))
+    {
+        return false;
+    };
+    // writing and cleaning up of keyfiles is only supported by the external program
+    if (detector.getWriteAllKeyPoints() || !detector.getKeyPointsIdx().empty() || detector.getCleanup() || detector.getTest())
+    {
+        return false;
+    };
+    AppBase::ProgressDisplay* progress;
+    if (parent != NULL)
+    {
+        progress = new ProgressReporterDialog(0, _("Finding control points"), _("Finding control points"), parent);
+    }
+    else
+    {
+        progress = new AppBase::DummyProgressDisplay();
+    };
+    detector.setProgressDisplay(progress);
+    detector.setKeypointCache(&GetCPFindKeypointCache());
+    const bool success = detector.findControlPoints(pano, imgs, cps);
+    // close the progress dialog before showing any message
+    delete progress;
+    if (success)
+    {
+        ret_value = 0;
+    }
+    else
+    {
+        if (detector.wasCancelled())
+        {
+            ret_value = HUGIN_EXIT_CODE_CANCELLED;
+        }
+        else
+        {
+            ret_value = 1;
+            CPMessage(_("Could not find control points.\nOne or more images could not be loaded."),
+                _("Control point detector failure"), parent);
+        };
+    };
+    return true;
+};
+
 HuginBase::CPVector AutoCtrlPointCreator::readUpdatedControlPoints(const std::string & file,
                                                     HuginBase::Panorama & pano, const HuginBase::UIntSet & imgs, bool reordered)
 {
@@ -372,6 +473,11 @@ HuginBase::CPVector AutoPanoSift::automatch(CPDetectorSetting &setting, HuginBas
         Cleanup(setting, pano, imgs, keyFiles, parent);
         return cps;
     };
+    // run cpfind without starting an external process
+    if (IsCPFind(setting.GetProg()) && RunCPFindInProcess(setting.GetArgs(), pano, imgs, nFeatures, cps, ret_value, parent))
+    {
+        return cps;
+    };
     wxString autopanoArgs = setting.GetArgs();
     
     // TODO: create a secure temporary filename here
@@ -982,7 +1088,7 @@ HuginBase::CPVector AutoPanoSiftMultiRow::automatch(CPDetectorSetting &setting,
         }
         optPano.setCtrlPoints(backupNewCPS);
         // do a first pairwise optimisation step
-        HuginBase::AutoOptimise::autoOptimise(optPano,false);
+        HuginBase::AutoOptimise::autoOptimise(optPano, false, wxConfigBase::Get()->Read(wxT("/Optimizer/UseNative"), HUGIN_OPTIMIZER_USE_NATIVE) == 1);
         HuginBase::PTools::optimize(optPano);
         optPano.setCtrlPoints(backupOldCPS);
         //and find cp on overlapping images
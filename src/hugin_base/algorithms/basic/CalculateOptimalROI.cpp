@@ -87,72 +87,108 @@ void CalculateOptimalROI::CleanUp()
 };
 
 //now you can do dynamic programming, look thinks up on fly
-bool CalculateOptimalROI::stackPixel(int i, int j, UIntSet &stack)
+void CalculateOptimalROI::stackPixels(const std::vector<double>& x, const std::vector<double>& y, const UIntSet &stack, std::vector<unsigned char>& inside)
 {
-    bool inside = intersection; // start with true for intersection mode and with false for union mode
-    //check that pixel at each place
+    const size_t n = x.size();
+    // start with true for intersection mode and with false for union mode
+    inside.assign(n, intersection);
+    std::vector<unsigned char> decided(n, 0);
+    std::vector<double> xd(n);
+    std::vector<double> yd(n);
+    std::vector<unsigned char> valid(n);
+    //check the pixels at each place
     for(UIntSet::const_iterator it=stack.begin();it!=stack.end();++it)
     {
-        double xd,yd;
-        if(transfMap[*it]->transformImgCoord(xd,yd,(double)i,(double)j))
+        transfMap[*it]->transformImgCoords(&x[0], &y[0], &xd[0], &yd[0], &valid[0], n);
+        const SrcPanoImage& img = o_panorama.getImage(*it);
+        bool allDecided = true;
+        for (size_t k = 0; k < n; ++k)
         {
-            if(o_panorama.getImage(*it).isInside(vigra::Point2D(xd,yd)))
+            if (decided[k] || !valid[k])
+            {
+                allDecided = allDecided && decided[k];
+                continue;
+            };
+            if(img.isInside(vigra::Point2D(xd[k],yd[k])))
             {
                 if (!intersection) {
                     //if found in a single image, short cut out
-                    inside=true;
-                    break;
+                    inside[k]=true;
+                    decided[k]=true;
                 }
             }
             else {
                 if (intersection) {
-                    //outside of at least one image - return false
-                    inside=false;
-                    break;
+                    //outside of at least one image
+                    inside[k]=false;
+                    decided[k]=true;
                 }
             }
+            allDecided = allDecided && decided[k];
         }
+        if (allDecided)
+        {
+            break;
+        };
     }
-
-    return inside;
 }
 
-bool CalculateOptimalROI::imgPixel(int i, int j)
+void CalculateOptimalROI::testPixels(int i, int j, int di, int dj, int n)
 {
-    if(!testedPixels[j*o_optimalSize.x+i])
+    // collect the pixels, which are not yet tested
+    std::vector<double> x;
+    std::vector<double> y;
+    x.reserve(n);
+    y.reserve(n);
+    for (int k = 0; k < n; ++k, i += di, j += dj)
     {
-        bool inside;
-        
-        if (stacks.empty())
+        if (!testedPixels[j*o_optimalSize.x + i])
         {
-            // no stacks - test all images on union or intersection
-            inside = stackPixel(i, j, activeImages);
-        }
-        else
+            x.push_back(i);
+            y.push_back(j);
+        };
+    };
+    if (x.empty())
+    {
+        return;
+    };
+    std::vector<unsigned char> inside;
+    if (stacks.empty())
+    {
+        // no stacks - test all images on union or intersection
+        stackPixels(x, y, activeImages, inside);
+    }
+    else
+    {
+        inside.assign(x.size(), false);
+        std::vector<unsigned char> insideStack;
+        // pixel must be inside of at least one stack
+        for (unsigned s=0; s < stacks.size(); s++)
         {
-            inside = false;
-            // pixel must be inside of at least one stack
-            for (unsigned s=0; s < stacks.size(); s++)
+            // images in each stack are tested on intersection
+            stackPixels(x, y, stacks[s], insideStack);
+            for (size_t k = 0; k < x.size(); ++k)
             {
-                // images in each stack are tested on intersection
-                if (stackPixel(i, j, stacks[s]))
-                {
-                    inside = true;
-                    break;
-                }
-            }
+                inside[k] = inside[k] || insideStack[k];
+            };
         }
-
-        testedPixels[j*o_optimalSize.x + i] = true;
-        pixels[j*o_optimalSize.x + i] = inside;
-        
-        return inside;
     }
-    //else it is know if this pixel is covered by at least one image
-    else
+    for (size_t k = 0; k < x.size(); ++k)
     {
-        return pixels[j*o_optimalSize.x+i];
+        const size_t index = static_cast<size_t>(y[k])*o_optimalSize.x + static_cast<size_t>(x[k]);
+        testedPixels[index] = true;
+        pixels[index] = inside[k] != 0;
+    };
+}
+
+bool CalculateOptimalROI::imgPixel(int i, int j)
+{
+    if(!testedPixels[j*o_optimalSize.x+i])
+    {
+        testPixels(i, j, 1, 0, 1);
     }
+    //now it is known if this pixel is covered by at least one image
+    return pixels[j*o_optimalSize.x+i];
 }
 
 /** add new rect to list of rects to be check, do some checks before */
@@ -182,19 +218,34 @@ void CalculateOptimalROI::AddCheckingRects(std::list<vigra::Rect2D>& testingRect
 /** check if given rect covers the whole pano */
 bool CalculateOptimalROI::CheckRectCoversPano(const vigra::Rect2D& rect)
 {
-    for (int i = rect.left(); i<rect.right(); i++)
+    // the borders are tested in parts, so the transformation works on several
+    // pixels at once, but stops early at uncovered pixels
+    const int partSize = 64;
+    for (int i = rect.left(); i<rect.right(); i += partSize)
     {
-        if (imgPixel(i, rect.top()) == 0 || imgPixel(i, rect.bottom() - 1) == 0)
+        const int n = std::min(partSize, rect.right() - i);
+        testPixels(i, rect.top(), 1, 0, n);
+        testPixels(i, rect.bottom() - 1, 1, 0, n);
+        for (int k = i; k < i + n; k++)
         {
-            return false;
+            if (imgPixel(k, rect.top()) == 0 || imgPixel(k, rect.bottom() - 1) == 0)
+            {
+                return false;
+            }
         }
     }
 
-    for (int j = rect.top(); j<rect.bottom(); j++)
+    for (int j = rect.top(); j<rect.bottom(); j += partSize)
     {
-        if (imgPixel(rect.left(), j) == 0 || imgPixel(rect.right() - 1, j) == 0)
+        const int n = std::min(partSize, rect.bottom() - j);
+        testPixels(rect.left(), j, 0, 1, n);
+        testPixels(rect.right() - 1, j, 0, 1, n);
+        for (int k = j; k < j + n; k++)
         {
-            return false;
+            if (imgPixel(rect.left(), k) == 0 || imgPixel(rect.right() - 1, k) == 0)
+            {
+                return false;
+            }
         }
     }
     return true;
@@ -98,7 +98,10 @@ class IMPEX CalculateOptimalROI : public TimeConsumingPanoramaAlgorithm
         vigra::Rect2D m_bestRect;
 
         bool imgPixel(int i, int j);
-        bool stackPixel(int i, int j, UIntSet &stack);
+        /** tests the n pixels starting at (i, j) in steps of (di, dj), which are not yet tested */
+        void testPixels(int i, int j, int di, int dj, int n);
+        /** tests, if the pixels are inside the images of stack (union or intersection) */
+        void stackPixels(const std::vector<double>& x, const std::vector<double>& y, const UIntSet &stack, std::vector<unsigned char>& inside);
         
         //local stuff, convert over later
         bool autocrop();
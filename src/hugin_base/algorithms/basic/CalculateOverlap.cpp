@@ -85,41 +85,59 @@ void CalculateImageOverlap::calculate(unsigned int steps)
             frequency=2;
         std::vector<unsigned int> overlapCounter;
         overlapCounter.resize(m_nrImg,0);
-        unsigned int pointCounter=0;
+        // collect the sample points inside the crop, especially for circular crops
+        std::vector<double> xc;
+        std::vector<double> yc;
+        xc.reserve(frequency * frequency);
+        yc.reserve(frequency * frequency);
         for (unsigned int x=0; x<frequency; x++)
         {
             for (unsigned int y=0; y<frequency; y++)
             {
                 // scale (x, y) so it is always within the cropped region of the
                 // image.
-                double xc = double (x) / double (frequency) * double(c.width()) + c.left();
-                double yc = double (y) / double (frequency) * double(c.height()) + c.top();
-                vigra::Point2D p(xc,yc);
-                //check if inside crop, especially for circular crops
-                if(img.isInside(p,true))
+                const double xp = double (x) / double (frequency) * double(c.width()) + c.left();
+                const double yp = double (y) / double (frequency) * double(c.height()) + c.top();
+                if(img.isInside(vigra::Point2D(xp,yp),true))
                 {
-                    pointCounter++;
-                    //transform to panorama coordinates
-                    double xi,yi;
-                    if (m_invTransform[imgNr]->transformImgCoord(xi, yi, xc, yc))
+                    xc.push_back(xp);
+                    yc.push_back(yp);
+                };
+            };
+        };
+        const unsigned int pointCounter=xc.size();
+        if (pointCounter > 0)
+        {
+            //transform all points to panorama coordinates
+            std::vector<double> xi(pointCounter);
+            std::vector<double> yi(pointCounter);
+            std::vector<unsigned char> valid(pointCounter);
+            m_invTransform[imgNr]->transformImgCoords(&xc[0], &yc[0], &xi[0], &yi[0], &valid[0], pointCounter);
+            size_t nrValid = 0;
+            for (size_t k = 0; k < pointCounter; ++k)
+            {
+                if (valid[k])
+                {
+                    xi[nrValid] = xi[k];
+                    yi[nrValid] = yi[k];
+                    ++nrValid;
+                };
+            };
+            std::vector<double> xj(nrValid);
+            std::vector<double> yj(nrValid);
+            //now, check if the points are inside another image
+            for(unsigned int j=0;j<m_nrImg && nrValid>0;j++)
+            {
+                if (imgNr == j)
+                    continue;
+                //transform to image coordinates
+                m_transform[j]->transformImgCoords(&xi[0], &yi[0], &xj[0], &yj[0], &valid[0], nrValid);
+                const SrcPanoImage& img2 = m_pano->getImage(j);
+                for (size_t k = 0; k < nrValid; ++k)
+                {
+                    if (valid[k] && img2.isInside(vigra::Point2D(xj[k], yj[k]), true))
                     {
-                        //now, check if point is inside another image
-                        for(unsigned int j=0;j<m_nrImg;j++)
-                        {
-                            if (imgNr == j)
-                                continue;
-                            double xj,yj;
-                            //transform to image coordinates
-                            if(m_transform[j]->transformImgCoord(xj,yj,xi,yi))
-                            {
-                                p.x=xj;
-                                p.y=yj;
-                                if(m_pano->getImage(j).isInside(p,true))
-                                {
-                                    overlapCounter[j]++;
-                                };
-                            };
-                        };
+                        overlapCounter[j]++;
                     };
                 };
             };
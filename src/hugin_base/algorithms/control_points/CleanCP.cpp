@@ -1,235 +1,439 @@
-// -*- c-basic-offset: 4 -*-
-/**  @file CleanCP.cpp
- *
- *  @brief algorithms for remove control points by statistic method
- *  
- *  the algorithm is based on ptoclean by Bruno Postle
- *
- *  @author Thomas Modes
- *
- *  $Id$
- *
- */
- 
- /*  This is free software; you can redistribute it and/or
- *  modify it under the terms of the GNU General Public
- *  License as published by the Free Software Foundation; either
- *  version 2 of the License, or (at your option) any later version.
- *
- *  This software is distributed in the hope that it will be useful,
- *  but WITHOUT ANY WARRANTY; without even the implied warranty of
- *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
- *  Lesser General Public License for more details.
- *
- *  You should have received a copy of the GNU General Public
- *  License along with this software. If not, see
- *  <http://www.gnu.org/licenses/>.
- *
- */
-
-#include "CleanCP.h"
-#include <algorithms/optimizer/PTOptimizer.h>
-#include "algorithms/basic/CalculateCPStatistics.h"
-#include "hugin_base/panotools/PanoToolsUtils.h"
-
-namespace HuginBase {
-
-UIntSet getCPoutsideLimit_pair(Panorama pano, AppBase::ProgressDisplay& progress, double n)
-{
-    CPVector allCP=pano.getCtrlPoints();
-    unsigned int nrImg=pano.getNrOfImages();
-    PanoramaOptions opts=pano.getOptions();
-    //set projection to equrectangular for optimisation
-    opts.setProjection(PanoramaOptions::EQUIRECTANGULAR);
-    pano.setOptions(opts);
-    UIntSet CPtoRemove;
-
-    // do optimisation of all images pair
-    // after it remove cp with errors > median/mean + n*sigma
-    for (unsigned int image1=0; image1<nrImg-1; image1++)
-    {
-        const SrcPanoImage& img=pano.getImage(image1);
-        for (unsigned int image2=image1+1; image2<nrImg; image2++)
-        {
-            //do not check linked image pairs
-            if(img.YawisLinkedWith(pano.getImage(image2)))
-                continue;
-            UIntSet Images;
-            Images.clear();
-            Images.insert(image1);
-            Images.insert(image2);
-            Panorama clean=pano.getSubset(Images);
-            // pictures should contain at least 2 control points
-            if(clean.getNrOfCtrlPoints()>1)
-            {
-                // remove all horizontal and vertical control points
-                CPVector cpl = clean.getCtrlPoints();
-                CPVector newCP;
-                for (CPVector::const_iterator it = cpl.begin(); it != cpl.end(); ++it) 
-                    if (it->mode == ControlPoint::X_Y)
-                        newCP.push_back(*it);
-                clean.setCtrlPoints(newCP);
-
-                // we need at least 3 cp to optimize 3 variables: yaw, pitch and roll
-                if(clean.getNrOfCtrlPoints()>3)
-                {
-                    //optimize position and hfov
-                    OptimizeVector optvec;
-                    std::set<std::string> imgopt;
-                    //imgopt.insert("v");
-                    optvec.push_back(imgopt);
-                    imgopt.insert("r");
-                    imgopt.insert("p");
-                    imgopt.insert("y");
-                    optvec.push_back(imgopt);
-                    clean.setOptimizeVector(optvec);
-                    PTools::optimize(clean);
-                    cpl.clear();
-                    cpl=clean.getCtrlPoints();
-                    //calculate statistic and determine limit
-                    double min,max,mean,var;
-                    CalculateCPStatisticsError::calcCtrlPntsErrorStats(clean,min,max,mean,var);
-                    // if the standard deviation is bigger than the value, assume we have a lot of
-                    // false cp, in this case take the mean value directly as limit
-                    double limit = (sqrt(var) > mean) ? mean : (mean + n*sqrt(var));
-
-                    //identify cp with big error
-                    unsigned int index=0;
-                    unsigned int cpcounter=0;
-                    for (CPVector::const_iterator it = allCP.begin(); it != allCP.end(); ++it)
-                    {
-                        if(it->mode == ControlPoint::X_Y)
-                            if((it->image1Nr==image1 && it->image2Nr==image2) ||
-                                (it->image1Nr==image2 && it->image2Nr==image1))
-                            {
-                                if (cpl[index].error>limit)
-                                    CPtoRemove.insert(cpcounter);
-                                index++;
-                            };
-                        cpcounter++;
-                    };
-                };
-            };
-            if (!progress.updateDisplayValue())
-            {
-                return CPtoRemove;
-            };
-        };
-    };
-
-    return CPtoRemove;
-};
-
-UIntSet getCPoutsideLimit(Panorama pano, double n, bool skipOptimisation, bool includeLineCp)
-{
-    UIntSet CPtoRemove;
-    if(skipOptimisation)
-    {
-        //calculate current cp errors
-        HuginBase::PTools::calcCtrlPointErrors(pano);
-    }
-    else
-    {
-        //optimize pano, after optimization pano contains the cp errors of the optimized project
-        SmartOptimise::smartOptimize(pano);
-    };
-    CPVector allCP=pano.getCtrlPoints();
-    if(!includeLineCp)
-    {
-        //remove all horizontal and vertical CP for calculation of mean and sigma
-        CPVector CPxy;
-        for (CPVector::const_iterator it = allCP.begin(); it != allCP.end(); ++it)
-        {
-            if(it->mode == ControlPoint::X_Y)
-                CPxy.push_back(*it);
-        };
-        pano.setCtrlPoints(CPxy);
-    };
-    //calculate mean and sigma
-    double min,max,mean,var;
-    CalculateCPStatisticsError::calcCtrlPntsErrorStats(pano,min,max,mean,var);
-    if(!includeLineCp)
-    {
-        pano.setCtrlPoints(allCP);
-    };
-    // if the standard deviation is bigger than the value, assume we have a lot of
-    // false cp, in this case take the mean value directly as limit
-    double limit = (sqrt(var) > mean) ? mean : (mean + n*sqrt(var));
-
-    //now determine all control points with error > limit 
-    unsigned int index=0;
-    for (CPVector::const_iterator it = allCP.begin(); it != allCP.end(); ++it)
-    {
-        if(it->error > limit)
-        {
-            if(includeLineCp)
-            {
-                // all cp are treated the same
-                // no need for further checks
-                CPtoRemove.insert(index);
-            }
-            else
-            {
-                //check only normal cp
-                if(it->mode == ControlPoint::X_Y)
-                {
-                    CPtoRemove.insert(index);
-                };
-            };
-        };
-        index++;
-    };
-
-    return CPtoRemove;
-};
-
-UIntSet getCPinMasks(HuginBase::Panorama pano)
-{
-    HuginBase::UIntSet cps;
-    HuginBase::CPVector cpList=pano.getCtrlPoints();
-    if(cpList.size()>0)
-    {
-        for(unsigned int i=0;i<cpList.size();i++)
-        {
-            HuginBase::ControlPoint cp=cpList[i];
-            // ignore line control points
-            if(cp.mode!=HuginBase::ControlPoint::X_Y)
-                continue;
-            bool insideMask=false;
-            // check first image
-            // remark: we could also use pano.getImage(cp.image1Nr).isInside(vigra::Point2D(cp.x1,cp.y1))
-            //   this would also check the crop rectangles/circles
-            //   but it would require that the pano is correctly align, otherwise the positive masks
-            //   would not correctly checked
-            HuginBase::MaskPolygonVector masks=pano.getImage(cp.image1Nr).getMasks();
-            if(masks.size()>0)
-            {
-                unsigned int j=0;
-                while((!insideMask) && (j<masks.size()))
-                {
-                    insideMask=masks[j].isInside(hugin_utils::FDiff2D(cp.x1,cp.y1));
-                    j++;
-                };
-            };
-            // and now the second
-            if(!insideMask)
-            {
-                masks=pano.getImage(cp.image2Nr).getMasks();
-                if(masks.size()>0)
-                {
-                    unsigned int j=0;
-                    while((!insideMask) && (j<masks.size()))
-                    {
-                        insideMask=masks[j].isInside(hugin_utils::FDiff2D(cp.x2,cp.y2));
-                        j++;
-                    };
-                };
-            };
-            if(insideMask)
-                cps.insert(i);
-        };
-    }
-    return cps;
-};
-
-}  // namespace
+// -*- c-basic-offset: 4 -*-
+/**  @file CleanCP.cpp
+ *
+ *  @brief algorithms for remove control points by statistic method
+ *  
+ *  the algorithm is based on ptoclean by Bruno Postle
+ *
+ *  @author Thomas Modes
+ *
+ *  $Id$
+ *
+ */
+ 
+ /*  This is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This software is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public
+ *  License along with this software. If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "CleanCP.h"
+#include <algorithms/optimizer/PTOptimizer.h>
+#include <algorithms/optimizer/BundleAdjuster.h>
+#include "algorithms/basic/CalculateCPStatistics.h"
+#include "hugin_base/panotools/PanoToolsUtils.h"
+#include "nona/SpaceTransform.h"
+#include <hugin_math/Matrix3.h>
+#include <algorithm>
+#include <map>
+
+namespace HuginBase {
+
+namespace
+{
+    /** directions of a control point on the unit sphere, dir1 in the first image
+     *  and dir2 in the second image of the pair */
+    struct CPDirections
+    {
+        unsigned int cpNr;
+        Vector3 dir1;
+        Vector3 dir2;
+    };
+    typedef std::vector<CPDirections> CPDirectionsVector;
+
+    /** converts a position in an equirectangular image of size width x height and
+     *  360x180 degree field of view into a direction on the unit sphere */
+    Vector3 ErectToDirection(const hugin_utils::FDiff2D& p, const double width, const double height)
+    {
+        const double lon = (p.x + 0.5 - 0.5 * width) * 2.0 * M_PI / width;
+        const double lat = (p.y + 0.5 - 0.5 * height) * M_PI / height;
+        return Vector3(cos(lat) * sin(lon), sin(lat), cos(lat) * cos(lon));
+    };
+
+    /** calculates eigenvalues and eigenvectors of the symmetric 4x4 matrix a with
+     *  the cyclic jacobi method, the eigenvectors are stored in the columns of v,
+     *  a is changed */
+    void SymmetricEigen4(double a[4][4], double v[4][4], double d[4])
+    {
+        for (int i = 0; i < 4; ++i)
+        {
+            for (int j = 0; j < 4; ++j)
+            {
+                v[i][j] = (i == j) ? 1.0 : 0.0;
+            };
+        };
+        for (int sweep = 0; sweep < 50; ++sweep)
+        {
+            double offdiag = 0;
+            double diag = 0;
+            for (int p = 0; p < 4; ++p)
+            {
+                diag += a[p][p] * a[p][p];
+                for (int q = p + 1; q < 4; ++q)
+                {
+                    offdiag += a[p][q] * a[p][q];
+                };
+            };
+            if (offdiag <= 1e-30 * diag)
+            {
+                break;
+            };
+            for (int p = 0; p < 3; ++p)
+            {
+                for (int q = p + 1; q < 4; ++q)
+                {
+                    if (a[p][q] == 0.0)
+                    {
+                        continue;
+                    };
+                    // rotation which zeros a[p][q]
+                    const double theta = (a[q][q] - a[p][p]) / (2.0 * a[p][q]);
+                    const double t = (theta >= 0 ? 1.0 : -1.0) / (fabs(theta) + sqrt(theta * theta + 1.0));
+                    const double c = 1.0 / sqrt(t * t + 1.0);
+                    const double s = t * c;
+                    for (int k = 0; k < 4; ++k)
+                    {
+                        const double akp = a[k][p];
+                        const double akq = a[k][q];
+                        a[k][p] = c * akp - s * akq;
+                        a[k][q] = s * akp + c * akq;
+                    };
+                    for (int k = 0; k < 4; ++k)
+                    {
+                        const double apk = a[p][k];
+                        const double aqk = a[q][k];
+                        a[p][k] = c * apk - s * aqk;
+                        a[q][k] = s * apk + c * aqk;
+                    };
+                    for (int k = 0; k < 4; ++k)
+                    {
+                        const double vkp = v[k][p];
+                        const double vkq = v[k][q];
+                        v[k][p] = c * vkp - s * vkq;
+                        v[k][q] = s * vkp + c * vkq;
+                    };
+                };
+            };
+        };
+        for (int i = 0; i < 4; ++i)
+        {
+            d[i] = a[i][i];
+        };
+    };
+
+    /** estimates the rotation which maps dir1 onto dir2 of all control points in the
+     *  least squares sense (closed form solution with unit quaternions by Horn) */
+    Matrix3 EstimateRotation(const CPDirectionsVector& cps)
+    {
+        double S[3][3] = { { 0, 0, 0 }, { 0, 0, 0 }, { 0, 0, 0 } };
+        for (CPDirectionsVector::const_iterator it = cps.begin(); it != cps.end(); ++it)
+        {
+            const double a[3] = { it->dir1.x, it->dir1.y, it->dir1.z };
+            const double b[3] = { it->dir2.x, it->dir2.y, it->dir2.z };
+            for (int i = 0; i < 3; ++i)
+            {
+                for (int j = 0; j < 3; ++j)
+                {
+                    S[i][j] += a[i] * b[j];
+                };
+            };
+        };
+        double N[4][4];
+        N[0][0] = S[0][0] + S[1][1] + S[2][2];
+        N[0][1] = S[1][2] - S[2][1];
+        N[0][2] = S[2][0] - S[0][2];
+        N[0][3] = S[0][1] - S[1][0];
+        N[1][1] = S[0][0] - S[1][1] - S[2][2];
+        N[1][2] = S[0][1] + S[1][0];
+        N[1][3] = S[2][0] + S[0][2];
+        N[2][2] = -S[0][0] + S[1][1] - S[2][2];
+        N[2][3] = S[1][2] + S[2][1];
+        N[3][3] = -S[0][0] - S[1][1] + S[2][2];
+        for (int i = 1; i < 4; ++i)
+        {
+            for (int j = 0; j < i; ++j)
+            {
+                N[i][j] = N[j][i];
+            };
+        };
+        double v[4][4];
+        double d[4];
+        SymmetricEigen4(N, v, d);
+        // the quaternion is the eigenvector of the largest eigenvalue
+        int maxIndex = 0;
+        for (int i = 1; i < 4; ++i)
+        {
+            if (d[i] > d[maxIndex])
+            {
+                maxIndex = i;
+            };
+        };
+        const double w = v[0][maxIndex];
+        const double x = v[1][maxIndex];
+        const double y = v[2][maxIndex];
+        const double z = v[3][maxIndex];
+        Matrix3 rot;
+        rot.m[0][0] = w * w + x * x - y * y - z * z;
+        rot.m[0][1] = 2.0 * (x * y - w * z);
+        rot.m[0][2] = 2.0 * (x * z + w * y);
+        rot.m[1][0] = 2.0 * (x * y + w * z);
+        rot.m[1][1] = w * w - x * x + y * y - z * z;
+        rot.m[1][2] = 2.0 * (y * z - w * x);
+        rot.m[2][0] = 2.0 * (x * z - w * y);
+        rot.m[2][1] = 2.0 * (y * z + w * x);
+        rot.m[2][2] = w * w - x * x - y * y + z * z;
+        // Matrix3::TransformVector multiplies with the transposed matrix
+        return rot.Transpose();
+    };
+
+    /** aligns both images of a pair and returns the control points with an error
+     *  bigger than mean+n*sigma */
+    std::vector<unsigned int> CheckImagePair(const CPDirectionsVector& cps, const double n)
+    {
+        const Matrix3 rot = EstimateRotation(cps);
+        // the error is the angle between the control points after the alignment,
+        // the limit does not depend on the unit of the error
+        std::vector<double> errors(cps.size());
+        double mean = 0;
+        double var = 0;
+        for (size_t i = 0; i < cps.size(); ++i)
+        {
+            const Vector3 dir = rot.TransformVector(cps[i].dir1);
+            errors[i] = atan2(dir.Cross(cps[i].dir2).Norm(), dir.Dot(cps[i].dir2));
+            const double delta = errors[i] - mean;
+            mean += delta / (i + 1);
+            var += delta * (errors[i] - mean);
+        };
+        var = var / (cps.size() - 1);
+        // if the standard deviation is bigger than the value, assume we have a lot of
+        // false cp, in this case take the mean value directly as limit
+        const double limit = (sqrt(var) > mean) ? mean : (mean + n*sqrt(var));
+        std::vector<unsigned int> outliers;
+        for (size_t i = 0; i < cps.size(); ++i)
+        {
+            if (errors[i] > limit)
+            {
+                outliers.push_back(cps[i].cpNr);
+            };
+        };
+        return outliers;
+    };
+}
+
+UIntSet getCPoutsideLimit_pair(const Panorama& pano, AppBase::ProgressDisplay& progress, double n)
+{
+    const CPVector& allCP = pano.getCtrlPoints();
+    const unsigned int nrImg = pano.getNrOfImages();
+    UIntSet CPtoRemove;
+    if (nrImg < 2)
+    {
+        return CPtoRemove;
+    };
+    // transform all control points into directions on the unit sphere, the transformations
+    // use the same camera model as the remapping and have no global state, so the
+    // image pairs can be checked in parallel
+    PanoramaOptions opts;
+    opts.setProjection(PanoramaOptions::EQUIRECTANGULAR);
+    opts.setWidth(3600);
+    opts.setHeight(1800);
+    opts.setHFOV(360);
+    std::vector<Nona::SpaceTransform> transforms(nrImg);
+    for (unsigned int i = 0; i < nrImg; ++i)
+    {
+        transforms[i].createInvTransform(pano.getImage(i), opts);
+    };
+    // collect the normal control points of each image pair,
+    // linked image pairs are not checked
+    typedef std::map<std::pair<unsigned int, unsigned int>, CPDirectionsVector> PairMap;
+    PairMap pairs;
+    for (unsigned int i = 0; i < allCP.size(); ++i)
+    {
+        const ControlPoint& cp = allCP[i];
+        if (cp.mode != ControlPoint::X_Y || cp.image1Nr == cp.image2Nr)
+        {
+            continue;
+        };
+        if (pano.getImage(cp.image1Nr).YawisLinkedWith(pano.getImage(cp.image2Nr)))
+        {
+            continue;
+        };
+        hugin_utils::FDiff2D p1;
+        hugin_utils::FDiff2D p2;
+        transforms[cp.image1Nr].transformImgCoord(p1, hugin_utils::FDiff2D(cp.x1, cp.y1));
+        transforms[cp.image2Nr].transformImgCoord(p2, hugin_utils::FDiff2D(cp.x2, cp.y2));
+        CPDirections dirs;
+        dirs.cpNr = i;
+        if (cp.image1Nr < cp.image2Nr)
+        {
+            dirs.dir1 = ErectToDirection(p1, opts.getWidth(), opts.getHeight());
+            dirs.dir2 = ErectToDirection(p2, opts.getWidth(), opts.getHeight());
+            pairs[std::make_pair(cp.image1Nr, cp.image2Nr)].push_back(dirs);
+        }
+        else
+        {
+            dirs.dir1 = ErectToDirection(p2, opts.getWidth(), opts.getHeight());
+            dirs.dir2 = ErectToDirection(p1, opts.getWidth(), opts.getHeight());
+            pairs[std::make_pair(cp.image2Nr, cp.image1Nr)].push_back(dirs);
+        };
+    };
+    // we need at least 3 cp to estimate 3 variables: yaw, pitch and roll
+    std::vector<const CPDirectionsVector*> pairList;
+    for (PairMap::const_iterator it = pairs.begin(); it != pairs.end(); ++it)
+    {
+        if (it->second.size() > 3)
+        {
+            pairList.push_back(&(it->second));
+        };
+    };
+    // align all images pairs
+    // after it remove cp with errors > median/mean + n*sigma
+    // the pairs are processed in blocks, so that the progress can be updated
+    // and the user can cancel between the blocks
+    const int blockSize = 256;
+    std::vector<std::vector<unsigned int> > outliers(pairList.size());
+    for (int blockStart = 0; blockStart < static_cast<int>(pairList.size()); blockStart += blockSize)
+    {
+        const int blockEnd = std::min<int>(blockStart + blockSize, pairList.size());
+#pragma omp parallel for schedule(dynamic)
+        for (int i = blockStart; i < blockEnd; ++i)
+        {
+            outliers[i] = CheckImagePair(*pairList[i], n);
+        };
+        for (int i = blockStart; i < blockEnd; ++i)
+        {
+            CPtoRemove.insert(outliers[i].begin(), outliers[i].end());
+        };
+        if (!progress.updateDisplayValue())
+        {
+            return CPtoRemove;
+        };
+    };
+
+    return CPtoRemove;
+};
+
+UIntSet getCPoutsideLimit(Panorama pano, double n, bool skipOptimisation, bool includeLineCp)
+{
+    UIntSet CPtoRemove;
+    // only the relative size of the errors matters, so the native optimizer is used
+    // for the supported projects, it has no global state
+    if(skipOptimisation)
+    {
+        //calculate current cp errors
+        HuginBase::BundleAdjuster::calcCtrlPointErrors(pano, true);
+    }
+    else
+    {
+        //optimize pano, after optimization pano contains the cp errors of the optimized project
+        SmartOptimise::smartOptimize(pano, true);
+    };
+    CPVector allCP=pano.getCtrlPoints();
+    if(!includeLineCp)
+    {
+        //remove all horizontal and vertical CP for calculation of mean and sigma
+        CPVector CPxy;
+        for (CPVector::const_iterator it = allCP.begin(); it != allCP.end(); ++it)
+        {
+            if(it->mode == ControlPoint::X_Y)
+                CPxy.push_back(*it);
+        };
+        pano.setCtrlPoints(CPxy);
+    };
+    //calculate mean and sigma
+    double min,max,mean,var;
+    CalculateCPStatisticsError::calcCtrlPntsErrorStats(pano,min,max,mean,var);
+    if(!includeLineCp)
+    {
+        pano.setCtrlPoints(allCP);
+    };
+    // if the standard deviation is bigger than the value, assume we have a lot of
+    // false cp, in this case take the mean value directly as limit
+    double limit = (sqrt(var) > mean) ? mean : (mean + n*sqrt(var));
+
+    //now determine all control points with error > limit 
+    unsigned int index=0;
+    for (CPVector::const_iterator it = allCP.begin(); it != allCP.end(); ++it)
+    {
+        if(it->error > limit)
+        {
+            if(includeLineCp)
+            {
+                // all cp are treated the same
+                // no need for further checks
+                CPtoRemove.insert(index);
+            }
+            else
+            {
+                //check only normal cp
+                if(it->mode == ControlPoint::X_Y)
+                {
+                    CPtoRemove.insert(index);
+                };
+            };
+        };
+        index++;
+    };
+
+    return CPtoRemove;
+};
+
+UIntSet getCPinMasks(HuginBase::Panorama pano)
+{
+    HuginBase::UIntSet cps;
+    HuginBase::CPVector cpList=pano.getCtrlPoints();
+    if(cpList.size()>0)
+    {
+        for(unsigned int i=0;i<cpList.size();i++)
+        {
+            HuginBase::ControlPoint cp=cpList[i];
+            // ignore line control points
+            if(cp.mode!=HuginBase::ControlPoint::X_Y)
+                continue;
+            bool insideMask=false;
+            // check first image
+            // remark: we could also use pano.getImage(cp.image1Nr).isInside(vigra::Point2D(cp.x1,cp.y1))
+            //   this would also check the crop rectangles/circles
+            //   but it would require that the pano is correctly align, otherwise the positive masks
+            //   would not correctly checked
+            HuginBase::MaskPolygonVector masks=pano.getImage(cp.image1Nr).getMasks();
+            if(masks.size()>0)
+            {
+                unsigned int j=0;
+                while((!insideMask) && (j<masks.size()))
+                {
+                    insideMask=masks[j].isInside(hugin_utils::FDiff2D(cp.x1,cp.y1));
+                    j++;
+                };
+            };
+            // and now the second
+            if(!insideMask)
+            {
+                masks=pano.getImage(cp.image2Nr).getMasks();
+                if(masks.size()>0)
+                {
+                    unsigned int j=0;
+                    while((!insideMask) && (j<masks.size()))
+                    {
+                        insideMask=masks[j].isInside(hugin_utils::FDiff2D(cp.x2,cp.y2));
+                        j++;
+                    };
+                };
+            };
+            if(insideMask)
+                cps.insert(i);
+        };
+    }
+    return cps;
+};
+
+}  // namespace
@@ -0,0 +1,904 @@
+// -*- c-basic-offset: 4 -*-
+/** @file hugin_base/algorithms/optimizer/BundleAdjuster.cpp
+ *
+ *  @brief native geometric optimizer, which works directly on the image variables
+ *
+ *  This is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This software is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public
+ *  License along with this software. If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "BundleAdjuster.h"
+
+#include <algorithm>
+#include <cmath>
+#include <queue>
+#include <sstream>
+#include <hugin_math/hugin_math.h>
+#include <panotools/PanoToolsOptimizerWrapper.h>
+#include <panotools/PanoToolsUtils.h>
+
+namespace HuginBase {
+
+namespace
+{
+    /** number of variables per image handled by the native optimizer */
+    const int NR_IMAGE_VARS = 9;
+    /** names of the variables, the index is used in the jacobian */
+    const char* const ImageVarNames[NR_IMAGE_VARS] = { "y", "p", "r", "v", "a", "b", "c", "d", "e" };
+    /** parameters shared by more images are ordered last in the normal equations */
+    const size_t MAX_LOCAL_PARAM_IMAGES = 8;
+
+    bool IsLinked(const SrcPanoImage& img, int var)
+    {
+        switch (var)
+        {
+            case 0:
+                return img.YawisLinked();
+            case 1:
+                return img.PitchisLinked();
+            case 2:
+                return img.RollisLinked();
+            case 3:
+                return img.HFOVisLinked();
+            case 4:
+            case 5:
+            case 6:
+                return img.RadialDistortionisLinked();
+            default:
+                return img.RadialDistortionCenterShiftisLinked();
+        };
+    }
+
+    bool IsLinkedWith(const SrcPanoImage& img1, const SrcPanoImage& img2, int var)
+    {
+        switch (var)
+        {
+            case 0:
+                return img1.YawisLinkedWith(img2);
+            case 1:
+                return img1.PitchisLinkedWith(img2);
+            case 2:
+                return img1.RollisLinkedWith(img2);
+            case 3:
+                return img1.HFOVisLinkedWith(img2);
+            case 4:
+            case 5:
+            case 6:
+                return img1.RadialDistortionisLinkedWith(img2);
+            default:
+                return img1.RadialDistortionCenterShiftisLinkedWith(img2);
+        };
+    }
+
+    /** camera model of one image, it follows SpaceTransform::InitInv, but provides
+     *  the derivatives of the direction by the image variables */
+    class ImageModel
+    {
+    public:
+        explicit ImageModel(const SrcPanoImage& img)
+        {
+            for (int i = 0; i < NR_IMAGE_VARS; ++i)
+            {
+                value[i] = img.getVar(ImageVarNames[i]);
+                param[i] = -1;
+            };
+            m_width = img.getSize().width();
+            m_centerX = img.getSize().width() / 2.0 - 0.5;
+            m_centerY = img.getSize().height() / 2.0 - 0.5;
+            m_radius = std::min(img.getSize().width(), img.getSize().height()) / 2.0;
+            m_fisheye = img.getProjection() != SrcPanoImage::RECTILINEAR;
+            update();
+        }
+
+        /** recalculates the derived values, needs to be called after changing the values */
+        void update()
+        {
+            const double pitch = DEG_TO_RAD(value[1]);
+            const double roll = DEG_TO_RAD(value[2]);
+            Matrix3 rotX;
+            Matrix3 rotZ;
+            rotX.SetRotationX(pitch);
+            rotZ.SetRotationZ(roll);
+            // derivatives of the rotation matrices
+            Matrix3 dRotX;
+            dRotX.m[1][1] = -sin(pitch);
+            dRotX.m[1][2] = cos(pitch);
+            dRotX.m[2][1] = -cos(pitch);
+            dRotX.m[2][2] = -sin(pitch);
+            Matrix3 dRotZ;
+            dRotZ.m[0][0] = -sin(roll);
+            dRotZ.m[0][1] = cos(roll);
+            dRotZ.m[1][0] = -cos(roll);
+            dRotZ.m[1][1] = -sin(roll);
+            // same as SetMatrix(pitch, 0, roll, 1) in SpaceTransform
+            m_rot = rotZ * rotX;
+            m_rotDPitch = rotZ * dRotX;
+            m_rotDPitch *= PI / 180.0;
+            m_rotDRoll = dRotZ * rotX;
+            m_rotDRoll *= PI / 180.0;
+            m_cosYaw = cos(DEG_TO_RAD(value[0]));
+            m_sinYaw = sin(DEG_TO_RAD(value[0]));
+            // scale from pixel to the tangent plane (rectilinear) or to the angle (fisheye)
+            const double hfov = DEG_TO_RAD(value[3]);
+            if (m_fisheye)
+            {
+                m_scale = hfov / m_width;
+                m_scaleDHFOV = PI / 180.0 / m_width;
+            }
+            else
+            {
+                m_scale = 2.0 * tan(hfov / 2.0) / m_width;
+                m_scaleDHFOV = PI / 180.0 / (m_width * cos(hfov / 2.0) * cos(hfov / 2.0));
+            };
+        }
+
+        /** calculates the direction of the image point (x,y) in the panorama
+         *  @param deriv if not NULL, it receives the derivatives of the direction by the image variables */
+        void direction(double x, double y, Vector3& dir, Vector3* deriv) const
+        {
+            // principal point shift
+            const double xd = x - m_centerX - value[7];
+            const double yd = y - m_centerY - value[8];
+            // inverse radial distortion, see inv_radial
+            const double a = value[4];
+            const double b = value[5];
+            const double c = value[6];
+            const double p0 = 1.0 - a - b - c;
+            const double rd = sqrt(xd * xd + yd * yd) / m_radius;
+            double distScale;
+            double dScaleA;
+            double dScaleB;
+            double dScaleC;
+            double dScaleR;
+            if (rd < 1e-10)
+            {
+                distScale = 1.0 / p0;
+                dScaleA = distScale * distScale;
+                dScaleB = dScaleA;
+                dScaleC = dScaleA;
+                dScaleR = 0;
+            }
+            else
+            {
+                double rs = rd;
+                for (int iter = 0; iter < 100; ++iter)
+                {
+                    const double f = (((a * rs + b) * rs + c) * rs + p0) * rs - rd;
+                    if (std::abs(f) < 1e-12)
+                    {
+                        break;
+                    };
+                    rs -= f / (((4 * a * rs + 3 * b) * rs + 2 * c) * rs + p0);
+                };
+                // implicit derivatives of rs, the polynomial depends on a, b, c also by p0
+                const double df = (((4 * a * rs + 3 * b) * rs + 2 * c) * rs + p0);
+                distScale = rs / rd;
+                dScaleA = -rs * (rs * rs * rs - 1.0) / (df * rd);
+                dScaleB = -rs * (rs * rs - 1.0) / (df * rd);
+                dScaleC = -rs * (rs - 1.0) / (df * rd);
+                dScaleR = (1.0 / df - distScale) / (rd * m_radius * m_radius * rd);
+            };
+            const double xu = xd * distScale;
+            const double yu = yd * distScale;
+            const double sx = m_scale * xu;
+            const double sy = m_scale * yu;
+            // direction in camera coordinates and its derivatives by sx and sy
+            Vector3 cam;
+            Vector3 camDX;
+            Vector3 camDY;
+            if (m_fisheye)
+            {
+                // equidistant fisheye, the length of s is the angle to the optical axis
+                const double theta = sqrt(sx * sx + sy * sy);
+                double g;
+                double h;
+                if (theta < 1e-6)
+                {
+                    g = 1.0 - theta * theta / 6.0;
+                    h = -1.0 / 3.0;
+                }
+                else
+                {
+                    g = sin(theta) / theta;
+                    h = (theta * cos(theta) - sin(theta)) / (theta * theta * theta);
+                };
+                cam = Vector3(g * sx, g * sy, cos(theta));
+                camDX = Vector3(g + h * sx * sx, h * sx * sy, -g * sx);
+                camDY = Vector3(h * sx * sy, g + h * sy * sy, -g * sy);
+            }
+            else
+            {
+                const Vector3 q(sx, sy, 1.0);
+                const double n = q.Norm();
+                cam = q / n;
+                camDX = (Vector3(1.0, 0.0, 0.0) - cam * cam.x) / n;
+                camDY = (Vector3(0.0, 1.0, 0.0) - cam * cam.y) / n;
+            };
+            dir = toPano(m_rot.TransformVector(cam));
+            if (deriv == NULL)
+            {
+                return;
+            };
+            deriv[0] = Vector3(dir.z, 0.0, -dir.x) * (PI / 180.0);
+            deriv[1] = toPano(m_rotDPitch.TransformVector(cam));
+            deriv[2] = toPano(m_rotDRoll.TransformVector(cam));
+            // derivatives of (sx, sy) by v, a, b, c, d, e
+            const double jacXX = distScale + dScaleR * xd * xd;
+            const double jacXY = dScaleR * xd * yd;
+            const double jacYY = distScale + dScaleR * yd * yd;
+            const double dsx[NR_IMAGE_VARS - 3] = { m_scaleDHFOV * xu, m_scale * xd * dScaleA, m_scale * xd * dScaleB,
+                m_scale * xd * dScaleC, -m_scale * jacXX, -m_scale * jacXY };
+            const double dsy[NR_IMAGE_VARS - 3] = { m_scaleDHFOV * yu, m_scale * yd * dScaleA, m_scale * yd * dScaleB,
+                m_scale * yd * dScaleC, -m_scale * jacXY, -m_scale * jacYY };
+            for (int i = 3; i < NR_IMAGE_VARS; ++i)
+            {
+                deriv[i] = toPano(m_rot.TransformVector(camDX * dsx[i - 3] + camDY * dsy[i - 3]));
+            };
+        }
+
+        /** current values of the variables, in the order of ImageVarNames */
+        double value[NR_IMAGE_VARS];
+        /** index of the optimised parameter for each variable, -1 for fixed variables */
+        int param[NR_IMAGE_VARS];
+
+    private:
+        /** rotates the direction by the yaw, same as rotate_erect */
+        Vector3 toPano(const Vector3& v) const
+        {
+            return Vector3(v.x * m_cosYaw + v.z * m_sinYaw, v.y, v.z * m_cosYaw - v.x * m_sinYaw);
+        }
+
+        double m_width;
+        double m_centerX;
+        double m_centerY;
+        double m_radius;
+        bool m_fisheye;
+        Matrix3 m_rot;
+        Matrix3 m_rotDPitch;
+        Matrix3 m_rotDRoll;
+        double m_cosYaw;
+        double m_sinYaw;
+        double m_scale;
+        double m_scaleDHFOV;
+    };
+
+    /** residual of one control point and its derivatives by the parameters */
+    struct CPResidual
+    {
+        double r[3];
+        int nrParams;
+        int param[2 * NR_IMAGE_VARS];
+        Vector3 jac[2 * NR_IMAGE_VARS];
+
+        void addDerivative(int p, const Vector3& d)
+        {
+            for (int i = 0; i < nrParams; ++i)
+            {
+                // parameter is shared by both images
+                if (param[i] == p)
+                {
+                    jac[i] = jac[i] + d;
+                    return;
+                };
+            };
+            param[nrParams] = p;
+            jac[nrParams] = d;
+            ++nrParams;
+        }
+    };
+
+    /** symmetric positive definite matrix in envelope (profile) storage, the
+     *  lower triangle of each row is stored from the first non-zero column */
+    class EnvelopeMatrix
+    {
+    public:
+        void init(const std::vector<size_t>& first)
+        {
+            m_first = first;
+            m_rowStart.resize(first.size() + 1);
+            m_rowStart[0] = 0;
+            for (size_t i = 0; i < first.size(); ++i)
+            {
+                m_rowStart[i + 1] = m_rowStart[i] + (i - first[i] + 1);
+            };
+            m_values.assign(m_rowStart.back(), 0.0);
+        }
+
+        void clear()
+        {
+            std::fill(m_values.begin(), m_values.end(), 0.0);
+        }
+
+        size_t size() const
+        {
+            return m_first.size();
+        }
+
+        /** element (row, col) with col <= row */
+        double& at(size_t row, size_t col)
+        {
+            return m_values[m_rowStart[row] + col - m_first[row]];
+        }
+
+        /** in place Cholesky factorisation, returns false if the matrix is not positive definite */
+        bool factorize()
+        {
+            for (size_t i = 0; i < size(); ++i)
+            {
+                double* rowI = &m_values[m_rowStart[i]] - m_first[i];
+                for (size_t j = m_first[i]; j < i; ++j)
+                {
+                    const double* rowJ = &m_values[m_rowStart[j]] - m_first[j];
+                    double s = rowI[j];
+                    for (size_t k = std::max(m_first[i], m_first[j]); k < j; ++k)
+                    {
+                        s -= rowI[k] * rowJ[k];
+                    };
+                    rowI[j] = s / rowJ[j];
+                };
+                double s = rowI[i];
+                for (size_t k = m_first[i]; k < i; ++k)
+                {
+                    s -= rowI[k] * rowI[k];
+                };
+                if (!(s > 0))
+                {
+                    return false;
+                };
+                rowI[i] = sqrt(s);
+            };
+            return true;
+        }
+
+        /** solves L L^T x = b after factorize, b is overwritten with x */
+        void solve(std::vector<double>& b) const
+        {
+            for (size_t i = 0; i < size(); ++i)
+            {
+                const double* rowI = &m_values[m_rowStart[i]] - m_first[i];
+                double s = b[i];
+                for (size_t k = m_first[i]; k < i; ++k)
+                {
+                    s -= rowI[k] * b[k];
+                };
+                b[i] = s / rowI[i];
+            };
+            for (size_t i = size(); i-- > 0;)
+            {
+                const double* rowI = &m_values[m_rowStart[i]] - m_first[i];
+                b[i] /= rowI[i];
+                for (size_t k = m_first[i]; k < i; ++k)
+                {
+                    b[k] -= rowI[k] * b[i];
+                };
+            };
+        }
+
+    private:
+        std::vector<size_t> m_first;
+        std::vector<size_t> m_rowStart;
+        std::vector<double> m_values;
+    };
+
+    /** the optimisation problem: image models, control points and the parameters */
+    class Problem
+    {
+    public:
+        /** creates the problem for the variables of the optimize vector,
+         *  with useOptimizeVector=false there are no parameters (only for the errors) */
+        explicit Problem(const PanoramaData& pano, bool useOptimizeVector = true) : m_cps(pano.getCtrlPoints())
+        {
+            const OptimizeVector optvec = useOptimizeVector ? pano.getOptimizeVector() : OptimizeVector();
+            for (size_t i = 0; i < pano.getNrOfImages(); ++i)
+            {
+                const SrcPanoImage& img = pano.getImage(i);
+                m_images.push_back(ImageModel(img));
+                for (int var = 0; var < NR_IMAGE_VARS; ++var)
+                {
+                    // linked variables share the parameter of the first image,
+                    // only the optimize vector of this image counts (as in the PTScript)
+                    bool linked = false;
+                    if (IsLinked(img, var))
+                    {
+                        for (size_t j = 0; j < i; ++j)
+                        {
+                            if (IsLinkedWith(img, pano.getImage(j), var))
+                            {
+                                m_images[i].param[var] = m_images[j].param[var];
+                                if (m_images[i].param[var] >= 0)
+                                {
+                                    m_paramUsers[m_images[i].param[var]].push_back(std::make_pair(i, var));
+                                };
+                                linked = true;
+                                break;
+                            };
+                        };
+                    };
+                    if (!linked && i < optvec.size() && set_contains(optvec[i], ImageVarNames[var]))
+                    {
+                        m_images[i].param[var] = m_paramUsers.size();
+                        m_paramUsers.push_back(std::vector<std::pair<size_t, int> >(1, std::make_pair(i, var)));
+                    };
+                };
+            };
+            // residuals in pixel of an equirectangular panorama with the same width and field of view
+            m_distance = pano.getOptions().getWidth() / DEG_TO_RAD(pano.getOptions().getHFOV());
+            m_residuals.resize(m_cps.size());
+        }
+
+        size_t getNrOfParams() const
+        {
+            return m_paramUsers.size();
+        }
+
+        void getParams(std::vector<double>& x) const
+        {
+            x.resize(getNrOfParams());
+            for (size_t p = 0; p < x.size(); ++p)
+            {
+                const std::pair<size_t, int>& user = m_paramUsers[p][0];
+                x[p] = m_images[user.first].value[user.second];
+            };
+        }
+
+        void setParams(const std::vector<double>& x)
+        {
+            UIntSet changedImages;
+            for (size_t p = 0; p < x.size(); ++p)
+            {
+                for (size_t i = 0; i < m_paramUsers[p].size(); ++i)
+                {
+                    const std::pair<size_t, int>& user = m_paramUsers[p][i];
+                    m_images[user.first].value[user.second] = x[p];
+                    changedImages.insert(user.first);
+                };
+            };
+            for (UIntSet::const_iterator it = changedImages.begin(); it != changedImages.end(); ++it)
+            {
+                m_images[*it].update();
+            };
+        }
+
+        /** evaluates the residuals of all control points in parallel, returns the sum of squares */
+        double evaluate(bool withJacobian)
+        {
+#pragma omp parallel for schedule(dynamic, 256)
+            for (int i = 0; i < static_cast<int>(m_cps.size()); ++i)
+            {
+                const ControlPoint& cp = m_cps[i];
+                const ImageModel& img1 = m_images[cp.image1Nr];
+                const ImageModel& img2 = m_images[cp.image2Nr];
+                CPResidual& res = m_residuals[i];
+                Vector3 dir1;
+                Vector3 dir2;
+                Vector3 deriv1[NR_IMAGE_VARS];
+                Vector3 deriv2[NR_IMAGE_VARS];
+                img1.direction(cp.x1, cp.y1, dir1, withJacobian ? deriv1 : NULL);
+                img2.direction(cp.x2, cp.y2, dir2, withJacobian ? deriv2 : NULL);
+                const Vector3 diff = (dir1 - dir2) * m_distance;
+                res.r[0] = diff.x;
+                res.r[1] = diff.y;
+                res.r[2] = diff.z;
+                res.nrParams = 0;
+                if (withJacobian)
+                {
+                    for (int var = 0; var < NR_IMAGE_VARS; ++var)
+                    {
+                        if (img1.param[var] >= 0)
+                        {
+                            res.addDerivative(img1.param[var], deriv1[var] * m_distance);
+                        };
+                        if (img2.param[var] >= 0)
+                        {
+                            res.addDerivative(img2.param[var], deriv2[var] * (-m_distance));
+                        };
+                    };
+                };
+            };
+            // sum in fixed order, so that the result does not depend on the number of threads
+            double sum = 0;
+            for (size_t i = 0; i < m_residuals.size(); ++i)
+            {
+                sum += m_residuals[i].r[0] * m_residuals[i].r[0] + m_residuals[i].r[1] * m_residuals[i].r[1] +
+                    m_residuals[i].r[2] * m_residuals[i].r[2];
+            };
+            return sum;
+        }
+
+        /** Levenberg-Marquardt optimisation of all parameters
+         *  @param maxIterations maximal number of iterations
+         *  @param tolerance stop when the relative decrease of the squared error is smaller
+         *  @param progress progress display, updated after each iteration, can be NULL
+         *  @param iterations returns the number of iterations
+         *  @param cancelled returns true, if the user has cancelled the optimisation
+         *  @return true, if the result is valid */
+        bool solve(int maxIterations, double tolerance, AppBase::ProgressDisplay* progress, int& iterations, bool& cancelled)
+        {
+            iterations = 0;
+            cancelled = false;
+            const size_t n = getNrOfParams();
+            if (n == 0)
+            {
+                return true;
+            };
+            initNormalEquations();
+            std::vector<double> x;
+            getParams(x);
+            double cost = evaluate(true);
+            double lambda = 1e-3;
+            std::vector<double> gradient(n);
+            std::vector<double> diagonal(n);
+            std::vector<double> delta(n);
+            std::vector<double> xNew(n);
+            for (int iter = 0; iter < maxIterations; ++iter)
+            {
+                assemble(gradient, diagonal);
+                // the factorisation overwrites the matrix, keep a copy for the damping loop
+                const EnvelopeMatrix normal(m_normal);
+                bool improved = false;
+                double newCost = cost;
+                while (!improved && lambda < 1e16)
+                {
+                    m_normal = normal;
+                    for (size_t i = 0; i < n; ++i)
+                    {
+                        m_normal.at(i, i) += lambda * std::max(diagonal[i], 1e-12);
+                    };
+                    if (!m_normal.factorize())
+                    {
+                        lambda *= 10;
+                        continue;
+                    };
+                    for (size_t i = 0; i < n; ++i)
+                    {
+                        delta[i] = -gradient[i];
+                    };
+                    m_normal.solve(delta);
+                    for (size_t p = 0; p < n; ++p)
+                    {
+                        xNew[p] = x[p] + delta[m_position[p]];
+                    };
+                    setParams(xNew);
+                    newCost = evaluate(false);
+                    if (newCost < cost)
+                    {
+                        improved = true;
+                        lambda = std::max(lambda / 10, 1e-12);
+                    }
+                    else
+                    {
+                        lambda *= 10;
+                    };
+                };
+                if (!improved)
+                {
+                    // no further improvement possible
+                    setParams(x);
+                    break;
+                };
+                const double decrease = cost - newCost;
+                x.swap(xNew);
+                cost = evaluate(true);
+                iterations = iter + 1;
+                if (progress != NULL)
+                {
+                    std::ostringstream message;
+                    message << "Iteration: " << iterations << ", error: " << sqrt(cost / std::max<size_t>(m_cps.size(), 1));
+                    if (!progress->updateDisplay(message.str()))
+                    {
+                        cancelled = true;
+                        break;
+                    };
+                };
+                if (decrease <= tolerance * cost)
+                {
+                    break;
+                };
+            };
+            setParams(x);
+            return std::isfinite(cost);
+        }
+
+        /** writes the parameters and the control point errors into pano,
+         *  returns the mean control point error */
+        double apply(PanoramaData& pano)
+        {
+            std::vector<double> x;
+            getParams(x);
+            for (size_t p = 0; p < x.size(); ++p)
+            {
+                // linked variables are updated by the panorama
+                const std::pair<size_t, int>& user = m_paramUsers[p][0];
+                pano.updateVariable(user.first, Variable(ImageVarNames[user.second], x[p]));
+            };
+            evaluate(false);
+            double meanError = 0;
+            for (size_t i = 0; i < m_cps.size(); ++i)
+            {
+                // distance on the sphere
+                const double chord = sqrt(m_residuals[i].r[0] * m_residuals[i].r[0] + m_residuals[i].r[1] * m_residuals[i].r[1] +
+                    m_residuals[i].r[2] * m_residuals[i].r[2]) / m_distance;
+                m_cps[i].error = 2.0 * asin(std::min(1.0, chord / 2.0)) * m_distance;
+                meanError += m_cps[i].error;
+            };
+            pano.updateCtrlPointErrors(m_cps);
+            return m_cps.empty() ? 0.0 : meanError / m_cps.size();
+        }
+
+    private:
+        /** orders the parameters and prepares the envelope of the normal equations,
+         *  the images are ordered with the reverse Cuthill-McKee algorithm to keep the
+         *  envelope small, parameters shared by many images are ordered last */
+        void initNormalEquations()
+        {
+            const size_t nImg = m_images.size();
+            std::vector<UIntSet> neighbours(nImg);
+            for (size_t i = 0; i < m_cps.size(); ++i)
+            {
+                if (m_cps[i].image1Nr != m_cps[i].image2Nr)
+                {
+                    neighbours[m_cps[i].image1Nr].insert(m_cps[i].image2Nr);
+                    neighbours[m_cps[i].image2Nr].insert(m_cps[i].image1Nr);
+                };
+            };
+            std::vector<size_t> imageOrder;
+            std::vector<bool> visited(nImg, false);
+            while (imageOrder.size() < nImg)
+            {
+                // start each component at an image with minimal degree
+                size_t start = nImg;
+                for (size_t i = 0; i < nImg; ++i)
+                {
+                    if (!visited[i] && (start == nImg || neighbours[i].size() < neighbours[start].size()))
+                    {
+                        start = i;
+                    };
+                };
+                std::queue<size_t> queue;
+                queue.push(start);
+                visited[start] = true;
+                while (!queue.empty())
+                {
+                    const size_t img = queue.front();
+                    queue.pop();
+                    imageOrder.push_back(img);
+                    std::vector<std::pair<size_t, size_t> > next;
+                    for (UIntSet::const_iterator it = neighbours[img].begin(); it != neighbours[img].end(); ++it)
+                    {
+                        if (!visited[*it])
+                        {
+                            visited[*it] = true;
+                            next.push_back(std::make_pair(neighbours[*it].size(), *it));
+                        };
+                    };
+                    std::sort(next.begin(), next.end());
+                    for (size_t i = 0; i < next.size(); ++i)
+                    {
+                        queue.push(next[i].second);
+                    };
+                };
+            };
+            std::reverse(imageOrder.begin(), imageOrder.end());
+
+            const size_t n = getNrOfParams();
+            const size_t unset = n;
+            m_position.assign(n, unset);
+            size_t nextPos = 0;
+            for (size_t i = 0; i < nImg; ++i)
+            {
+                const ImageModel& img = m_images[imageOrder[i]];
+                for (int var = 0; var < NR_IMAGE_VARS; ++var)
+                {
+                    const int p = img.param[var];
+                    if (p >= 0 && m_position[p] == unset && m_paramUsers[p].size() <= MAX_LOCAL_PARAM_IMAGES)
+                    {
+                        m_position[p] = nextPos++;
+                    };
+                };
+            };
+            for (size_t p = 0; p < n; ++p)
+            {
+                if (m_position[p] == unset)
+                {
+                    m_position[p] = nextPos++;
+                };
+            };
+            // envelope: first column of each row, which can be non-zero
+            std::vector<size_t> first(n);
+            for (size_t i = 0; i < n; ++i)
+            {
+                first[i] = i;
+            };
+            for (size_t i = 0; i < m_cps.size(); ++i)
+            {
+                const ImageModel* imgs[2] = { &m_images[m_cps[i].image1Nr], &m_images[m_cps[i].image2Nr] };
+                size_t minPos = n;
+                for (int j = 0; j < 2; ++j)
+                {
+                    for (int var = 0; var < NR_IMAGE_VARS; ++var)
+                    {
+                        if (imgs[j]->param[var] >= 0)
+                        {
+                            minPos = std::min(minPos, m_position[imgs[j]->param[var]]);
+                        };
+                    };
+                };
+                for (int j = 0; j < 2; ++j)
+                {
+                    for (int var = 0; var < NR_IMAGE_VARS; ++var)
+                    {
+                        if (imgs[j]->param[var] >= 0)
+                        {
+                            size_t& f = first[m_position[imgs[j]->param[var]]];
+                            f = std::min(f, minPos);
+                        };
+                    };
+                };
+            };
+            m_normal.init(first);
+        }
+
+        /** builds the normal equations J^T J and the gradient J^T r from the residuals,
+         *  the diagonal receives the diagonal of J^T J, all in the order of m_position */
+        void assemble(std::vector<double>& gradient, std::vector<double>& diagonal)
+        {
+            m_normal.clear();
+            std::fill(gradient.begin(), gradient.end(), 0.0);
+            for (size_t i = 0; i < m_residuals.size(); ++i)
+            {
+                const CPResidual& res = m_residuals[i];
+                for (int j = 0; j < res.nrParams; ++j)
+                {
+                    const size_t posJ = m_position[res.param[j]];
+                    const Vector3& jacJ = res.jac[j];
+                    gradient[posJ] += jacJ.x * res.r[0] + jacJ.y * res.r[1] + jacJ.z * res.r[2];
+                    for (int k = 0; k < res.nrParams; ++k)
+                    {
+                        const size_t posK = m_position[res.param[k]];
+                        if (posK <= posJ)
+                        {
+                            m_normal.at(posJ, posK) += jacJ.Dot(res.jac[k]);
+                        };
+                    };
+                };
+            };
+            for (size_t i = 0; i < diagonal.size(); ++i)
+            {
+                diagonal[i] = m_normal.at(i, i);
+            };
+        }
+
+        std::vector<ImageModel> m_images;
+        CPVector m_cps;
+        std::vector<CPResidual> m_residuals;
+        /** images and variables, which use the parameter */
+        std::vector<std::vector<std::pair<size_t, int> > > m_paramUsers;
+        /** position of the parameters in the normal equations */
+        std::vector<size_t> m_position;
+        EnvelopeMatrix m_normal;
+        double m_distance;
+    };
+
+    /** checks the projections and control points of pano, with checkOptimizeVector
+     *  also the optimize vector is checked */
+    bool IsSupported(const PanoramaData& pano, bool checkOptimizeVector)
+    {
+        if (pano.getNrOfImages() == 0 || pano.getNrOfCtrlPoints() == 0)
+        {
+            return false;
+        };
+        for (size_t i = 0; i < pano.getNrOfImages(); ++i)
+        {
+            if (!BundleAdjuster::canOptimizeImage(pano.getImage(i)))
+            {
+                return false;
+            };
+        };
+        const OptimizeVector& optvec = pano.getOptimizeVector();
+        for (size_t i = 0; checkOptimizeVector && i < optvec.size(); ++i)
+        {
+            const char* const unsupported[] = { "g", "t", "TrX", "TrY", "TrZ", "Tpy", "Tpp" };
+            for (size_t j = 0; j < sizeof(unsupported) / sizeof(unsupported[0]); ++j)
+            {
+                if (set_contains(optvec[i], unsupported[j]))
+                {
+                    return false;
+                };
+            };
+        };
+        const CPVector& cps = pano.getCtrlPoints();
+        for (CPVector::const_iterator it = cps.begin(); it != cps.end(); ++it)
+        {
+            if (it->mode != ControlPoint::X_Y || it->image1Nr >= pano.getNrOfImages() || it->image2Nr >= pano.getNrOfImages())
+            {
+                return false;
+            };
+        };
+        return true;
+    }
+}
+
+bool BundleAdjuster::runAlgorithm()
+{
+    o_iterations = 0;
+    o_resultError = 0;
+    if (!canOptimize(o_panorama))
+    {
+        o_status = 1;
+        return false;
+    };
+    Problem problem(o_panorama);
+    bool cancelled = false;
+    const bool success = problem.solve(o_maxIterations, o_tolerance, getProgressDisplay(), o_iterations, cancelled);
+    o_resultError = problem.apply(o_panorama);
+    o_status = success ? 0 : 2;
+    if (cancelled)
+    {
+        cancelAlgorithm();
+        return false;
+    };
+    return success;
+}
+
+bool BundleAdjuster::canOptimize(const PanoramaData& pano)
+{
+    return IsSupported(pano, true);
+}
+
+bool BundleAdjuster::canOptimizeImage(const SrcPanoImage& img)
+{
+    if (img.getProjection() != SrcPanoImage::RECTILINEAR && img.getProjection() != SrcPanoImage::FULL_FRAME_FISHEYE &&
+        img.getProjection() != SrcPanoImage::CIRCULAR_FISHEYE)
+    {
+        return false;
+    };
+    // translation and shear are not part of the native camera model
+    return img.getX() == 0 && img.getY() == 0 && img.getZ() == 0 && img.getShear().x == 0 && img.getShear().y == 0;
+}
+
+unsigned int BundleAdjuster::optimize(PanoramaData& pano, AppBase::ProgressDisplay* progress)
+{
+    BundleAdjuster adjuster(pano, progress);
+    adjuster.run();
+    return adjuster.getStatus();
+}
+
+unsigned int BundleAdjuster::optimizePanorama(PanoramaData& pano, bool useNative)
+{
+    if (useNative && canOptimize(pano))
+    {
+        return optimize(pano);
+    };
+    return PTools::optimize(pano);
+}
+
+void BundleAdjuster::calcCtrlPointErrors(PanoramaData& pano, bool useNative)
+{
+    if (pano.getNrOfImages() == 0 || pano.getNrOfCtrlPoints() == 0)
+    {
+        return;
+    };
+    if (useNative && IsSupported(pano, false))
+    {
+        Problem problem(pano, false);
+        problem.apply(pano);
+    }
+    else
+    {
+        PTools::calcCtrlPointErrors(pano);
+    };
+}
+
+}//namespace
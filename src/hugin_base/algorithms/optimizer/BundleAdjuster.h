@@ -0,0 +1,127 @@
+// -*- c-basic-offset: 4 -*-
+/** @file hugin_base/algorithms/optimizer/BundleAdjuster.h
+ *
+ *  @brief native geometric optimizer, which works directly on the image variables
+ *
+ *  This is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This software is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public
+ *  License along with this software. If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _BUNDLEADJUSTER_H
+#define _BUNDLEADJUSTER_H
+
+#include <hugin_shared.h>
+#include <algorithms/PanoramaAlgorithm.h>
+#include <panodata/PanoramaData.h>
+
+namespace HuginBase {
+
+    /** Levenberg-Marquardt optimizer for the geometric image variables.
+     *
+     *  In contrast to PTools::optimize the project is not converted into a PTScript.
+     *  The control point residuals are calculated with the same camera model as the
+     *  remapping (see nona/SpaceTransform.cpp) and analytic derivatives. The residuals
+     *  are evaluated in parallel and the sparse normal equations are solved with a
+     *  sparse Cholesky factorisation.
+     *
+     *  All state of the optimisation is kept in the object, there is no global state.
+     *  So several BundleAdjuster objects can optimise different panoramas (or copies
+     *  of sub-problems) at the same time in different threads.
+     *
+     *  Supported are rectilinear and equidistant fisheye images, the variables
+     *  y, p, r, v, a, b, c, d and e and normal (not line) control points. For other
+     *  projects use optimizePanorama, which falls back to PTools::optimize. The
+     *  libpano13 optimizer uses global state, so these calls are serialised.
+     *
+     *  The residuals are the chords between the unit rays of both points, the control
+     *  point errors the angles between the rays, both multiplied by width/hfov of the
+     *  panorama. libpano13 reports the distance of both points in an equirectangular
+     *  panorama, there the difference in longitude is not scaled with the cosine of
+     *  the latitude. Near the horizon both agree, towards the poles libpano13 reports
+     *  larger errors for horizontal offsets. The results of both optimizers are
+     *  compared in test/BundleAdjusterTest.cpp. So optimizePanorama and
+     *  calcCtrlPointErrors use the native optimizer only if the caller requests it,
+     *  otherwise they call PTools::optimize and PTools::calcCtrlPointErrors.
+     */
+    class IMPEX BundleAdjuster : public TimeConsumingPanoramaAlgorithm
+    {
+        public:
+            ///
+            explicit BundleAdjuster(PanoramaData& panorama, AppBase::ProgressDisplay* progressDisplay = NULL)
+             : TimeConsumingPanoramaAlgorithm(panorama, progressDisplay),
+               o_maxIterations(500), o_tolerance(1e-10), o_resultError(0.0), o_iterations(0), o_status(0)
+            {};
+
+            ///
+            virtual ~BundleAdjuster()
+            {}
+
+        public:
+            ///
+            virtual bool modifiesPanoramaData() const
+                { return true; }
+
+            /** optimises the variables of the optimize vector of the panorama and updates
+             *  the control point errors, the progress display is updated after each iteration
+             *  @return true, if the optimisation was successful and not cancelled */
+            virtual bool runAlgorithm();
+
+            /// sets the maximal number of Levenberg-Marquardt iterations
+            void setMaxIterations(int maxIterations)
+                { o_maxIterations = maxIterations; }
+            /// stops, when the relative decrease of the squared error is smaller than tolerance
+            void setTolerance(double tolerance)
+                { o_tolerance = tolerance; }
+            /// returns the mean control point error after the optimisation
+            double getResultError() const
+                { return o_resultError; }
+            /// returns the number of iterations of the last optimisation
+            int getIterations() const
+                { return o_iterations; }
+            /// returns the result of the last optimisation, same convention as optimize()
+            unsigned int getStatus() const
+                { return o_status; }
+
+        public:
+            /** returns true, if the native optimizer can handle the projections,
+             *  the variables of the optimize vector and the control points of pano */
+            static bool canOptimize(const PanoramaData& pano);
+            /** returns true, if the native camera model supports the image (projection,
+             *  no translation and no shear), independent of the control points */
+            static bool canOptimizeImage(const SrcPanoImage& img);
+            /** optimises the variables of the optimize vector of pano and updates the
+             *  control point errors
+             *  @return 0 on success, 1 if the panorama is not supported, 2 if the
+             *          optimisation failed (same convention as PTools::optimize) */
+            static unsigned int optimize(PanoramaData& pano, AppBase::ProgressDisplay* progress = NULL);
+            /** optimises with the native optimizer, if useNative is true and the panorama
+             *  is supported, otherwise with PTools::optimize */
+            static unsigned int optimizePanorama(PanoramaData& pano, bool useNative);
+            /** calculates the control point errors for the current image variables with
+             *  the native model, if useNative is true and the panorama is supported,
+             *  otherwise PTools::calcCtrlPointErrors is used */
+            static void calcCtrlPointErrors(PanoramaData& pano, bool useNative);
+
+        private:
+            int o_maxIterations;
+            double o_tolerance;
+            double o_resultError;
+            int o_iterations;
+            unsigned int o_status;
+    };
+
+}//namespace
+
+#endif //_BUNDLEADJUSTER_H
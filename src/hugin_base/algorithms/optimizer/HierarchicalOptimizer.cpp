@@ -0,0 +1,606 @@
+// -*- c-basic-offset: 4 -*-
+/** @file hugin_base/algorithms/optimizer/HierarchicalOptimizer.cpp
+ *
+ *  @brief hierarchical geometric optimisation for projects with many images
+ *
+ *  This is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This software is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public
+ *  License along with this software. If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "HierarchicalOptimizer.h"
+
+#include <cmath>
+#include <memory>
+#include <queue>
+#include <sstream>
+#include <hugin_math/hugin_math.h>
+#include <hugin_math/Matrix3.h>
+#include <nona/SpaceTransform.h>
+#include <algorithms/optimizer/BundleAdjuster.h>
+#include <algorithms/optimizer/ImageGraph.h>
+
+namespace HuginBase {
+
+namespace
+{
+    /** names of the position variables */
+    const char* const PositionVarNames[3] = { "y", "p", "r" };
+
+    /** returns true, if the variable (0: yaw, 1: pitch, 2: roll) of image i is optimised,
+     *  for linked variables the optimize vector of the first image counts (as in the PTScript) */
+    bool IsPositionVarOptimized(const PanoramaData& pano, const OptimizeVector& optvec, size_t i, int var)
+    {
+        const SrcPanoImage& img = pano.getImage(i);
+        size_t first = i;
+        for (size_t j = 0; j < i; ++j)
+        {
+            const SrcPanoImage& other = pano.getImage(j);
+            if ((var == 0 && img.YawisLinkedWith(other)) || (var == 1 && img.PitchisLinkedWith(other)) ||
+                (var == 2 && img.RollisLinkedWith(other)))
+            {
+                first = j;
+                break;
+            };
+        };
+        return first < optvec.size() && set_contains(optvec[first], PositionVarNames[var]);
+    }
+
+    /** collects the neighbours of all images and the order of the breadth first search */
+    class NeighbourVisitor : public HuginGraph::BreadthFirstSearchVisitor
+    {
+    public:
+        explicit NeighbourVisitor(size_t nrImages) : neighbours(nrImages) {};
+        void Visit(const size_t vertex, const UIntSet& visitedNeighbors, const UIntSet& unvisitedNeighbors)
+        {
+            order.push_back(vertex);
+            neighbours[vertex] = visitedNeighbors;
+            neighbours[vertex].insert(unvisitedNeighbors.begin(), unvisitedNeighbors.end());
+        };
+        std::vector<UIntSet> neighbours;
+        std::vector<size_t> order;
+    };
+
+    /** splits the images into connected clusters with about maxSize images,
+     *  images with linked positions are always in the same cluster */
+    std::vector<UIntSet> CreateClusters(const PanoramaData& pano, const size_t maxSize)
+    {
+        const size_t nrImages = pano.getNrOfImages();
+        // images with linked yaw form one unit, same as in ImageGraph
+        std::vector<size_t> unit(nrImages, nrImages);
+        std::vector<UIntSet> units;
+        for (size_t i = 0; i < nrImages; ++i)
+        {
+            if (unit[i] < nrImages)
+            {
+                continue;
+            };
+            unit[i] = units.size();
+            units.push_back(UIntSet());
+            units.back().insert(i);
+            const SrcPanoImage& img = pano.getImage(i);
+            if (img.YawisLinked())
+            {
+                for (size_t j = i + 1; j < nrImages; ++j)
+                {
+                    if (unit[j] == nrImages && img.YawisLinkedWith(pano.getImage(j)))
+                    {
+                        unit[j] = unit[i];
+                        units.back().insert(j);
+                    };
+                };
+            };
+        };
+        HuginGraph::ImageGraph graph(pano);
+        NeighbourVisitor visitor(nrImages);
+        graph.VisitAllImages(pano.getOptions().optimizeReferenceImage, true, &visitor);
+        // grow the clusters with a breadth first search, start each cluster at the
+        // first unassigned image in the breadth first order of the whole graph
+        std::vector<UIntSet> clusters;
+        std::vector<bool> assigned(nrImages, false);
+        for (size_t k = 0; k < visitor.order.size(); ++k)
+        {
+            if (assigned[visitor.order[k]])
+            {
+                continue;
+            };
+            UIntSet cluster;
+            std::queue<size_t> queue;
+            queue.push(visitor.order[k]);
+            while (!queue.empty() && cluster.size() < maxSize)
+            {
+                const size_t img = queue.front();
+                queue.pop();
+                if (assigned[img])
+                {
+                    continue;
+                };
+                const UIntSet& imgUnit = units[unit[img]];
+                for (UIntSet::const_iterator it = imgUnit.begin(); it != imgUnit.end(); ++it)
+                {
+                    assigned[*it] = true;
+                    cluster.insert(*it);
+                    for (UIntSet::const_iterator n = visitor.neighbours[*it].begin(); n != visitor.neighbours[*it].end(); ++n)
+                    {
+                        if (!assigned[*n])
+                        {
+                            queue.push(*n);
+                        };
+                    };
+                };
+            };
+            clusters.push_back(cluster);
+        };
+        return clusters;
+    }
+
+    /** control point between two clusters, the directions are relative to the
+     *  current cluster orientation, in the frame of Matrix3::SetRotationPT */
+    struct ClusterCP
+    {
+        size_t cluster1;
+        size_t cluster2;
+        Vector3 dir1;
+        Vector3 dir2;
+    };
+
+    /** sum of the squared distances of the control point directions after rotating the clusters,
+     *  the rotations are applied with Matrix3::TransformVector */
+    double ClusterCost(const std::vector<ClusterCP>& cps, const std::vector<Matrix3>& rotations)
+    {
+        double cost = 0;
+        for (size_t i = 0; i < cps.size(); ++i)
+        {
+            const Vector3 r = rotations[cps[i].cluster1].TransformVector(cps[i].dir1) -
+                rotations[cps[i].cluster2].TransformVector(cps[i].dir2);
+            cost += r.NormSquared();
+        };
+        return cost;
+    }
+
+    /** solves the symmetric positive definite system a x = b (a stored row wise) with
+     *  a Cholesky decomposition, the result is returned in b, a is overwritten */
+    bool SolveCholesky(std::vector<double>& a, std::vector<double>& b, const size_t n)
+    {
+        for (size_t j = 0; j < n; ++j)
+        {
+            double d = a[j * n + j];
+            for (size_t k = 0; k < j; ++k)
+            {
+                d -= a[j * n + k] * a[j * n + k];
+            };
+            if (d <= 0)
+            {
+                return false;
+            };
+            d = sqrt(d);
+            a[j * n + j] = d;
+            for (size_t i = j + 1; i < n; ++i)
+            {
+                double v = a[i * n + j];
+                for (size_t k = 0; k < j; ++k)
+                {
+                    v -= a[i * n + k] * a[j * n + k];
+                };
+                a[i * n + j] = v / d;
+            };
+        };
+        for (size_t i = 0; i < n; ++i)
+        {
+            for (size_t k = 0; k < i; ++k)
+            {
+                b[i] -= a[i * n + k] * b[k];
+            };
+            b[i] /= a[i * n + i];
+        };
+        for (size_t i = n; i-- > 0;)
+        {
+            for (size_t k = i + 1; k < n; ++k)
+            {
+                b[i] -= a[k * n + i] * b[k];
+            };
+            b[i] /= a[i * n + i];
+        };
+        return true;
+    }
+}
+
+bool HierarchicalOptimizer::updateProgress(const std::string& message)
+{
+    if (hasProgressDisplay() && !getProgressDisplay()->updateDisplay(message))
+    {
+        cancelAlgorithm();
+        return false;
+    };
+    return true;
+}
+
+bool HierarchicalOptimizer::optimizeClusters(const std::vector<UIntSet>& clusters, const std::vector<bool>& movable,
+    const std::vector<size_t>& anchors)
+{
+    // create the sub-panoramas serially, the optimisations are independent and run in parallel
+    std::vector<std::unique_ptr<PanoramaData>> subPanos(clusters.size());
+    for (size_t c = 0; c < clusters.size(); ++c)
+    {
+        OptimizeVector optvec;
+        bool optimize = false;
+        for (UIntSet::const_iterator it = clusters[c].begin(); it != clusters[c].end(); ++it)
+        {
+            std::set<std::string> imgopt;
+            // the anchor (and the images linked with it) fixes the orientation of the cluster
+            if (movable[*it] && (anchors[c] == o_panorama.getNrOfImages() ||
+                !o_panorama.getImage(*it).YawisLinkedWith(o_panorama.getImage(anchors[c]))) && *it != anchors[c])
+            {
+                imgopt.insert("y");
+                imgopt.insert("p");
+                imgopt.insert("r");
+                optimize = true;
+            };
+            optvec.push_back(imgopt);
+        };
+        if (optimize)
+        {
+            subPanos[c].reset(o_panorama.getNewSubset(clusters[c]));
+            subPanos[c]->setOptimizeVector(optvec);
+        };
+    };
+#pragma omp parallel for schedule(dynamic)
+    for (int c = 0; c < static_cast<int>(clusters.size()); ++c)
+    {
+        if (subPanos[c])
+        {
+            // clusters without control points are not supported by the BundleAdjuster
+            // and are left unchanged
+            BundleAdjuster adjuster(*subPanos[c]);
+            adjuster.run();
+        };
+    };
+    // copy the optimised positions back
+    for (size_t c = 0; c < clusters.size(); ++c)
+    {
+        if (!subPanos[c])
+        {
+            continue;
+        };
+        size_t subImg = 0;
+        for (UIntSet::const_iterator it = clusters[c].begin(); it != clusters[c].end(); ++it, ++subImg)
+        {
+            if (movable[*it] && subPanos[c]->getNrOfCtrlPoints() > 0)
+            {
+                const SrcPanoImage& img = subPanos[c]->getImage(subImg);
+                o_panorama.updateVariable(*it, Variable("y", img.getYaw()));
+                o_panorama.updateVariable(*it, Variable("p", img.getPitch()));
+                o_panorama.updateVariable(*it, Variable("r", img.getRoll()));
+            };
+        };
+    };
+    std::ostringstream message;
+    message << "Optimised " << clusters.size() << " clusters";
+    return updateProgress(message.str());
+}
+
+bool HierarchicalOptimizer::optimizeClusterRotations(const std::vector<UIntSet>& clusters, const std::vector<bool>& fixedClusters)
+{
+    const size_t nrImages = o_panorama.getNrOfImages();
+    std::vector<size_t> clusterOfImage(nrImages, 0);
+    for (size_t c = 0; c < clusters.size(); ++c)
+    {
+        for (UIntSet::const_iterator it = clusters[c].begin(); it != clusters[c].end(); ++it)
+        {
+            clusterOfImage[*it] = c;
+        };
+    };
+    // parameters: the rotation vector of each movable cluster
+    std::vector<int> paramIndex(clusters.size(), -1);
+    size_t nrParams = 0;
+    for (size_t c = 0; c < clusters.size(); ++c)
+    {
+        if (!fixedClusters[c])
+        {
+            paramIndex[c] = nrParams;
+            nrParams += 3;
+        };
+    };
+    if (nrParams == 0)
+    {
+        return true;
+    };
+    // directions of the control points between the clusters, with the same
+    // transformation as used by the remapping
+    PanoramaOptions opts;
+    opts.setProjection(PanoramaOptions::EQUIRECTANGULAR);
+    opts.setWidth(3600);
+    opts.setHeight(1800);
+    opts.setHFOV(360);
+    std::vector<Nona::SpaceTransform> transforms(nrImages);
+    std::vector<bool> transformReady(nrImages, false);
+    std::vector<ClusterCP> cps;
+    const CPVector& allCPs = o_panorama.getCtrlPoints();
+    for (CPVector::const_iterator it = allCPs.begin(); it != allCPs.end(); ++it)
+    {
+        const size_t c1 = clusterOfImage[it->image1Nr];
+        const size_t c2 = clusterOfImage[it->image2Nr];
+        if (c1 == c2 || (fixedClusters[c1] && fixedClusters[c2]))
+        {
+            continue;
+        };
+        const unsigned int imgs[2] = { it->image1Nr, it->image2Nr };
+        const hugin_utils::FDiff2D points[2] = { hugin_utils::FDiff2D(it->x1, it->y1), hugin_utils::FDiff2D(it->x2, it->y2) };
+        Vector3 dirs[2];
+        for (int j = 0; j < 2; ++j)
+        {
+            if (!transformReady[imgs[j]])
+            {
+                transforms[imgs[j]].createInvTransform(o_panorama.getImage(imgs[j]), opts);
+                transformReady[imgs[j]] = true;
+            };
+            hugin_utils::FDiff2D p;
+            transforms[imgs[j]].transformImgCoord(p, points[j]);
+            const double lon = (p.x + 0.5 - 0.5 * opts.getWidth()) * 2.0 * PI / opts.getWidth();
+            const double lat = (p.y + 0.5 - 0.5 * opts.getHeight()) * PI / opts.getHeight();
+            // x points forward, y to the left and z up, as for Matrix3::SetRotationPT
+            dirs[j] = Vector3(cos(lat) * cos(lon), -cos(lat) * sin(lon), -sin(lat));
+        };
+        ClusterCP cp;
+        cp.cluster1 = c1;
+        cp.cluster2 = c2;
+        cp.dir1 = dirs[0];
+        cp.dir2 = dirs[1];
+        cps.push_back(cp);
+    };
+    if (cps.empty())
+    {
+        return true;
+    };
+    // Levenberg-Marquardt optimisation of the cluster rotations, the rotations are
+    // updated by multiplication with small rotations around the rotation vector w,
+    // TransformVector of GetRotationAroundU(w) rotates u to u + w x u in first order
+    Matrix3 identity;
+    identity.SetIdentity();
+    std::vector<Matrix3> rotations(clusters.size(), identity);
+    double cost = ClusterCost(cps, rotations);
+    double lambda = 1e-3;
+    std::vector<double> normal(nrParams * nrParams);
+    std::vector<double> gradient(nrParams);
+    for (int iter = 0; iter < 100; ++iter)
+    {
+        std::fill(normal.begin(), normal.end(), 0.0);
+        std::fill(gradient.begin(), gradient.end(), 0.0);
+        for (size_t i = 0; i < cps.size(); ++i)
+        {
+            const Vector3 u = rotations[cps[i].cluster1].TransformVector(cps[i].dir1);
+            const Vector3 v = rotations[cps[i].cluster2].TransformVector(cps[i].dir2);
+            const double r[3] = { u.x - v.x, u.y - v.y, u.z - v.z };
+            // derivative of u by a small rotation w is w x u = -[u]_x w
+            double jac[2][3][3] = { { { 0, u.z, -u.y }, { -u.z, 0, u.x }, { u.y, -u.x, 0 } },
+                { { 0, -v.z, v.y }, { v.z, 0, -v.x }, { -v.y, v.x, 0 } } };
+            const int index[2] = { paramIndex[cps[i].cluster1], paramIndex[cps[i].cluster2] };
+            for (int a = 0; a < 2; ++a)
+            {
+                if (index[a] < 0)
+                {
+                    continue;
+                };
+                for (int k = 0; k < 3; ++k)
+                {
+                    gradient[index[a] + k] += jac[a][0][k] * r[0] + jac[a][1][k] * r[1] + jac[a][2][k] * r[2];
+                };
+                for (int b = 0; b < 2; ++b)
+                {
+                    if (index[b] < 0)
+                    {
+                        continue;
+                    };
+                    for (int k = 0; k < 3; ++k)
+                    {
+                        for (int l = 0; l < 3; ++l)
+                        {
+                            normal[(index[a] + k) * nrParams + index[b] + l] +=
+                                jac[a][0][k] * jac[b][0][l] + jac[a][1][k] * jac[b][1][l] + jac[a][2][k] * jac[b][2][l];
+                        };
+                    };
+                };
+            };
+        };
+        bool improved = false;
+        std::vector<Matrix3> newRotations(rotations);
+        double newCost = cost;
+        while (!improved && lambda < 1e16)
+        {
+            std::vector<double> damped(normal);
+            std::vector<double> delta(nrParams);
+            for (size_t i = 0; i < nrParams; ++i)
+            {
+                damped[i * nrParams + i] += lambda * std::max(normal[i * nrParams + i], 1e-12);
+                delta[i] = -gradient[i];
+            };
+            if (!SolveCholesky(damped, delta, nrParams))
+            {
+                lambda *= 10;
+                continue;
+            };
+            for (size_t c = 0; c < clusters.size(); ++c)
+            {
+                if (paramIndex[c] >= 0)
+                {
+                    const Vector3 w(delta[paramIndex[c]], delta[paramIndex[c] + 1], delta[paramIndex[c] + 2]);
+                    newRotations[c] = rotations[c] * GetRotationAroundU(w);
+                };
+            };
+            newCost = ClusterCost(cps, newRotations);
+            if (newCost < cost)
+            {
+                improved = true;
+                lambda = std::max(lambda / 10, 1e-12);
+            }
+            else
+            {
+                lambda *= 10;
+            };
+        };
+        if (!improved)
+        {
+            break;
+        };
+        const double decrease = cost - newCost;
+        rotations.swap(newRotations);
+        cost = newCost;
+        if (decrease <= 1e-10 * cost)
+        {
+            break;
+        };
+    };
+    // rotate the images of the clusters, calculate all new values before updating the
+    // panorama, otherwise linked images would be rotated twice
+    std::vector<double> newValues(3 * nrImages);
+    for (size_t i = 0; i < nrImages; ++i)
+    {
+        const size_t c = clusterOfImage[i];
+        if (paramIndex[c] >= 0)
+        {
+            const SrcPanoImage& img = o_panorama.getImage(i);
+            Matrix3 rot;
+            rot.SetRotationPT(DEG_TO_RAD(img.getYaw()), DEG_TO_RAD(img.getPitch()), DEG_TO_RAD(img.getRoll()));
+            // SetRotationPT rotates column vectors, the cluster rotations are applied
+            // with TransformVector, which multiplies with the transposed matrix
+            rot = rotations[c].Transpose() * rot;
+            rot.GetRotationPT(newValues[3 * i], newValues[3 * i + 1], newValues[3 * i + 2]);
+            for (int var = 0; var < 3; ++var)
+            {
+                newValues[3 * i + var] = RAD_TO_DEG(newValues[3 * i + var]);
+            };
+        };
+    };
+    for (size_t i = 0; i < nrImages; ++i)
+    {
+        if (paramIndex[clusterOfImage[i]] >= 0)
+        {
+            for (int var = 0; var < 3; ++var)
+            {
+                o_panorama.updateVariable(i, Variable(PositionVarNames[var], newValues[3 * i + var]));
+            };
+        };
+    };
+    std::ostringstream message;
+    message << "Aligned clusters, error: " << sqrt(cost / cps.size()) * RAD_TO_DEG(1.0) << " deg";
+    return updateProgress(message.str());
+}
+
+bool HierarchicalOptimizer::runAlgorithm()
+{
+    o_resultError = 0;
+    o_status = 0;
+    if (!BundleAdjuster::canOptimize(o_panorama))
+    {
+        // not supported by the native optimizer
+        o_status = BundleAdjuster::optimizePanorama(o_panorama, false);
+        return o_status == 0;
+    };
+    const size_t nrImages = o_panorama.getNrOfImages();
+    const OptimizeVector& optvec = o_panorama.getOptimizeVector();
+    // images, whose yaw, pitch and roll are all optimised, can be moved in the first stages
+    std::vector<bool> movable(nrImages, false);
+    bool hasMovable = false;
+    for (size_t i = 0; i < nrImages; ++i)
+    {
+        movable[i] = IsPositionVarOptimized(o_panorama, optvec, i, 0) && IsPositionVarOptimized(o_panorama, optvec, i, 1) &&
+            IsPositionVarOptimized(o_panorama, optvec, i, 2);
+        hasMovable = hasMovable || movable[i];
+    };
+    bool hierarchical = false;
+    if (hasMovable && nrImages > 2 * o_maxClusterSize)
+    {
+        const std::vector<UIntSet> clusters = CreateClusters(o_panorama, o_maxClusterSize);
+        if (clusters.size() > 1)
+        {
+            const size_t refImg = o_panorama.getOptions().optimizeReferenceImage;
+            // each cluster needs a fixed image: an image which is not optimised,
+            // the reference image or the first image of the cluster
+            std::vector<size_t> anchors(clusters.size(), nrImages);
+            // the clusters containing fixed images are not rotated in the second stage
+            std::vector<bool> fixedClusters(clusters.size(), false);
+            bool hasFixedCluster = false;
+            for (size_t c = 0; c < clusters.size(); ++c)
+            {
+                for (UIntSet::const_iterator it = clusters[c].begin(); it != clusters[c].end(); ++it)
+                {
+                    if (!movable[*it] || *it == refImg)
+                    {
+                        fixedClusters[c] = true;
+                    };
+                };
+                hasFixedCluster = hasFixedCluster || fixedClusters[c];
+                if (set_contains(clusters[c], refImg))
+                {
+                    anchors[c] = refImg;
+                }
+                else
+                {
+                    if (!fixedClusters[c])
+                    {
+                        anchors[c] = *clusters[c].begin();
+                    };
+                };
+            };
+            if (!hasFixedCluster)
+            {
+                fixedClusters[0] = true;
+            };
+            std::ostringstream message;
+            message << "Optimising " << clusters.size() << " clusters";
+            if (!updateProgress(message.str()))
+            {
+                return false;
+            };
+            if (!optimizeClusters(clusters, movable, anchors))
+            {
+                return false;
+            };
+            if (!optimizeClusterRotations(clusters, fixedClusters))
+            {
+                return false;
+            };
+            hierarchical = true;
+        };
+    };
+    // final optimisation of all variables, after the first stages only a few
+    // iterations are needed, stops earlier when converged
+    if (!updateProgress("Optimising whole project"))
+    {
+        return false;
+    };
+    BundleAdjuster adjuster(o_panorama, getProgressDisplay());
+    if (hierarchical && o_refinementIterations > 0)
+    {
+        adjuster.setMaxIterations(o_refinementIterations);
+    };
+    adjuster.run();
+    o_resultError = adjuster.getResultError();
+    o_status = adjuster.getStatus();
+    if (adjuster.wasCancelled())
+    {
+        cancelAlgorithm();
+        return false;
+    };
+    return o_status == 0;
+}
+
+unsigned int HierarchicalOptimizer::optimizeHierarchical(PanoramaData& pano, AppBase::ProgressDisplay* progress)
+{
+    HierarchicalOptimizer optimizer(pano, progress);
+    optimizer.run();
+    return optimizer.getStatus();
+}
+
+}//namespace
@@ -0,0 +1,102 @@
+// -*- c-basic-offset: 4 -*-
+/** @file hugin_base/algorithms/optimizer/HierarchicalOptimizer.h
+ *
+ *  @brief hierarchical geometric optimisation for projects with many images
+ *
+ *  This is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This software is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public
+ *  License along with this software. If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _HIERARCHICALOPTIMIZER_H
+#define _HIERARCHICALOPTIMIZER_H
+
+#include <hugin_shared.h>
+#include <algorithm>
+#include <algorithms/PanoramaAlgorithm.h>
+#include <panodata/PanoramaData.h>
+
+namespace HuginBase {
+
+    /** optimises the variables of the optimize vector in three stages:
+     *
+     *  1. the images are split into connected clusters (along the control point graph,
+     *     stacks are kept together) and the positions inside each cluster are optimised,
+     *     the clusters are processed in parallel
+     *  2. each cluster is treated as rigid body and the rotations of the clusters are
+     *     optimised with the control points between the clusters
+     *  3. a few iterations of the BundleAdjuster on the whole project with all
+     *     variables of the optimize vector, stops when converged
+     *
+     *  For small projects or projects, which are not supported by the BundleAdjuster,
+     *  the whole project is optimised in one step.
+     */
+    class IMPEX HierarchicalOptimizer : public TimeConsumingPanoramaAlgorithm
+    {
+        public:
+            ///
+            explicit HierarchicalOptimizer(PanoramaData& panorama, AppBase::ProgressDisplay* progressDisplay = NULL)
+             : TimeConsumingPanoramaAlgorithm(panorama, progressDisplay),
+               o_maxClusterSize(50), o_refinementIterations(20), o_resultError(0.0), o_status(0)
+            {};
+
+            ///
+            virtual ~HierarchicalOptimizer()
+            {}
+
+        public:
+            ///
+            virtual bool modifiesPanoramaData() const
+                { return true; }
+
+            ///
+            virtual bool runAlgorithm();
+
+            /// sets the maximal number of images in one cluster
+            void setMaxClusterSize(size_t maxClusterSize)
+                { o_maxClusterSize = std::max<size_t>(maxClusterSize, 2); }
+            /// sets the maximal number of iterations of the final optimisation of the whole project
+            void setRefinementIterations(int iterations)
+                { o_refinementIterations = iterations; }
+            /// returns the mean control point error after the optimisation
+            double getResultError() const
+                { return o_resultError; }
+            /// returns the result of the optimisation, same convention as BundleAdjuster::optimize
+            unsigned int getStatus() const
+                { return o_status; }
+
+        public:
+            /** optimises the variables of the optimize vector of pano hierarchically
+             *  @return 0 on success, 1 if the panorama is not supported, 2 if the
+             *          optimisation failed (same convention as PTools::optimize) */
+            static unsigned int optimizeHierarchical(PanoramaData& pano, AppBase::ProgressDisplay* progress = NULL);
+
+        private:
+            /// optimises the positions inside each cluster, returns false if cancelled
+            bool optimizeClusters(const std::vector<UIntSet>& clusters, const std::vector<bool>& movable,
+                                  const std::vector<size_t>& anchors);
+            /// optimises the rotations of the clusters, returns false if cancelled
+            bool optimizeClusterRotations(const std::vector<UIntSet>& clusters, const std::vector<bool>& fixedClusters);
+            /// updates the progress display, returns false if the user has cancelled
+            bool updateProgress(const std::string& message);
+
+            size_t o_maxClusterSize;
+            int o_refinementIterations;
+            double o_resultError;
+            unsigned int o_status;
+    };
+
+}//namespace
+
+#endif //_HIERARCHICALOPTIMIZER_H
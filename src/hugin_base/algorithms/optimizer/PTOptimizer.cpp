@@ -28,6 +28,7 @@
 #include "PTOptimizer.h"
 
 #include "ImageGraph.h"
+#include "BundleAdjuster.h"
 #include "panodata/StandardImageVariableGroups.h"
 #include <panotools/PanoToolsOptimizerWrapper.h>
 #include <panotools/PanoToolsInterface.h>
@@ -36,6 +37,7 @@
 #include <algorithms/nona/CalculateFOV.h>
 #include <algorithms/basic/LayerStacks.h>
 #include <vigra_ext/ransac.h>
+#include <ctime>
 
 #if DEBUG
 #include <fstream>
@@ -46,7 +48,7 @@ namespace HuginBase {
 
 bool PTOptimizer::runAlgorithm()
 {
-    PTools::optimize(o_panorama);
+    BundleAdjuster::optimizePanorama(o_panorama, o_useNative);
     return true; // let's hope so.
 }
 
@@ -88,6 +90,8 @@ public:
 	m_localPano = (pano.getNewSubset(imgs)); // don't forget to delete
 	m_li1 = (i1 < i2) ? 0 : 1;
 	m_li2 = (i1 < i2) ? 1 : 0;
+	// the native optimizer has no global state, libpano13 is serialised
+	m_useNative = RANSACOptimizer::usesNativeOptimizer(pano, i1, i2);
 	// get control points
 	m_cps  = m_localPano->getCtrlPoints();
 	// only use 2D control points
@@ -174,13 +178,13 @@ public:
     }
 
 	m_localPano->setOptimizeVector(m_opt_first_pass);
-	// optimize parameters using panotools (or use a custom made optimizer here?)
+	// optimize parameters with the native optimizer or with panotools
 	UIntSet imgs;
 	imgs.insert(0);
 	imgs.insert(1);
 	//std::cout << "Optimizing without hfov:" << std::endl;
 	//pano->printPanoramaScript(std::cerr, m_localPano->getOptimizeVector(), pano->getOptions(), imgs, true );
-	PTools::optimize(*pano);
+	optimize(*pano);
 	//std::cout << "result:" << std::endl;
 	//pano->printPanoramaScript(std::cerr, m_localPano->getOptimizeVector(), pano->getOptions(), imgs, true );
 
@@ -188,7 +192,7 @@ public:
 	    m_localPano->setOptimizeVector(m_opt_second_pass);
 	    //std::cout << "Optimizing with hfov" << std::endl;
 	    //pano->printPanoramaScript(std::cerr, m_localPano->getOptimizeVector(), pano->getOptions(), imgs, true );
-	    PTools::optimize(*pano);
+	    optimize(*pano);
 	    //std::cout << "result:" << std::endl;
 	    //pano->printPanoramaScript(std::cerr, m_localPano->getOptimizeVector(), pano->getOptions(), imgs, true );
 	}
@@ -205,18 +209,21 @@ public:
 
     bool agree(std::vector<double> &p, const ControlPoint & cp) const
     {
-	PanoramaData * pano = const_cast<PanoramaData *>(m_localPano);
-	// set parameters in pano object
-    for (size_t i = 0; i < m_optvars.size(); ++i)
-    {
-        m_optvars[i].set(*pano, p[i]);
-    }
-	// TODO: argh, this is slow, we should really construct this only once
-	// and reuse it for all calls...
-	PTools::Transform trafo_i1_to_pano;
-	trafo_i1_to_pano.createInvTransform(m_localPano->getImage(m_li1),m_localPano->getOptions());
-	PTools::Transform trafo_pano_to_i2;
-	trafo_pano_to_i2.createTransform(m_localPano->getImage(m_li2),m_localPano->getOptions());
+	// the transformations depend only on the parameters, so create them
+	// only once for each parameter set and not for each control point
+	if (p != m_trafoParams) {
+	    PanoramaData * pano = const_cast<PanoramaData *>(m_localPano);
+	    // set parameters in pano object
+	    for (size_t i = 0; i < m_optvars.size(); ++i)
+	    {
+	        m_optvars[i].set(*pano, p[i]);
+	    }
+	    m_trafo_i1_to_pano.createInvTransform(m_localPano->getImage(m_li1),m_localPano->getOptions());
+	    m_trafo_pano_to_i2.createTransform(m_localPano->getImage(m_li2),m_localPano->getOptions());
+	    m_trafoParams = p;
+	}
+	const PTools::Transform & trafo_i1_to_pano = m_trafo_i1_to_pano;
+	const PTools::Transform & trafo_pano_to_i2 = m_trafo_pano_to_i2;
 
 	double x1,y1,x2,y2,xt,yt,x2t,y2t;
 	if (cp.image1Nr == m_li1) {
@@ -257,17 +264,36 @@ public:
     std::vector<OptVarSpec> m_optvars;
 
 private:
+    /** optimises the local panorama with a BundleAdjuster instance, if possible */
+    void optimize(PanoramaData & pano) const
+    {
+        if (m_useNative && BundleAdjuster::canOptimize(pano))
+        {
+            BundleAdjuster adjuster(pano);
+            adjuster.run();
+        }
+        else
+        {
+            PTools::optimize(pano);
+        };
+    }
+
     int m_li1, m_li2;
+    bool m_useNative;
     double m_maxError;
     PanoramaData * m_localPano;
     CPVector m_cps;    
     std::vector<std::set<std::string> > m_opt_first_pass;
     std::vector<std::set<std::string> > m_opt_second_pass;
     int m_numForEstimate;
+    // transformations for the parameters of the last call of agree
+    mutable std::vector<double> m_trafoParams;
+    mutable PTools::Transform m_trafo_i1_to_pano;
+    mutable PTools::Transform m_trafo_pano_to_i2;
 };
 
 
-std::vector<int> RANSACOptimizer::findInliers(PanoramaData & pano, int i1, int i2, double maxError, Mode rmode)
+std::vector<int> RANSACOptimizer::findInliers(PanoramaData & pano, int i1, int i2, double maxError, Mode rmode, unsigned int seed)
 {
     bool optHFOV = false;
     bool optB = false;
@@ -291,7 +317,11 @@ std::vector<int> RANSACOptimizer::findInliers(PanoramaData & pano, int i1, int i
     std::copy(estimator.m_initParams.begin(),estimator.m_initParams.end(), parameters.begin());
     std::vector<int> inlier_idx;
     DEBUG_DEBUG("Number of control points: " << estimator.m_xy_cps.size() << " Initial parameter[0]" << parameters[0]);
-    std::vector<const ControlPoint *> inliers = Ransac::compute(parameters, inlier_idx, estimator, estimator.m_xy_cps, 0.999, 0.3);
+    if (seed == 0)
+    {
+        seed = static_cast<unsigned int>(std::time(0));
+    };
+    std::vector<const ControlPoint *> inliers = Ransac::compute(parameters, inlier_idx, estimator, estimator.m_xy_cps, 0.999, 0.3, seed);
     DEBUG_DEBUG("Number of inliers:" << inliers.size() << "optimized parameter[0]" << parameters[0]);
 
     // set parameters in pano object
@@ -307,6 +337,11 @@ std::vector<int> RANSACOptimizer::findInliers(PanoramaData & pano, int i1, int i
 }    
     
 
+bool RANSACOptimizer::usesNativeOptimizer(const PanoramaData & pano, int i1, int i2)
+{
+    return BundleAdjuster::canOptimizeImage(pano.getImage(i1)) && BundleAdjuster::canOptimizeImage(pano.getImage(i2));
+}
+
 bool RANSACOptimizer::runAlgorithm()
 {
     o_inliers = findInliers(o_panorama, o_i1, o_i2, o_maxError, o_mode);
@@ -316,8 +351,8 @@ bool RANSACOptimizer::runAlgorithm()
 class AutoOptimiseVisitor :public HuginGraph::BreadthFirstSearchVisitor
 {
 public:
-    explicit AutoOptimiseVisitor(PanoramaData* pano, const std::set<std::string>& optvec)
-        : m_opt(optvec), m_pano(pano)
+    explicit AutoOptimiseVisitor(PanoramaData* pano, const std::set<std::string>& optvec, bool useNative)
+        : m_opt(optvec), m_pano(pano), m_useNative(useNative)
     {};
     void Visit(const size_t vertex, const HuginBase::UIntSet& visitedNeighbors, const HuginBase::UIntSet& unvisitedNeighbors)
     {
@@ -344,7 +379,7 @@ public:
             OptimizeVector optvec(imgs.size());
             optvec[currImg] = m_opt;
             localPano->setOptimizeVector(optvec);
-            PTools::optimize(*localPano);
+            BundleAdjuster::optimizePanorama(*localPano, m_useNative);
             m_pano->updateVariables(vertex, localPano->getImageVariables(currImg));
             delete localPano;
         };
@@ -352,9 +387,10 @@ public:
 private:
     const std::set<std::string>& m_opt;
     PanoramaData* m_pano;
+    bool m_useNative;
 };
 
-void AutoOptimise::autoOptimise(PanoramaData& pano, bool optRoll)
+void AutoOptimise::autoOptimise(PanoramaData& pano, bool optRoll, bool useNative)
 {
     // remove all connected images, keep only a single image for each connected stack
     UIntSetVector imageGroups;
@@ -372,7 +408,7 @@ void AutoOptimise::autoOptimise(PanoramaData& pano, bool optRoll)
     // start a breadth first traversal of the graph, and optimize
     // the links found (every vertex just once.)
     HuginGraph::ImageGraph graph(*optPano);
-    AutoOptimiseVisitor visitor(optPano, optvars);
+    AutoOptimiseVisitor visitor(optPano, optvars, useNative);
     graph.VisitAllImages(optPano->getOptions().optimizeReferenceImage, true, &visitor);
 
     // now translate to found positions to initial pano
@@ -384,7 +420,7 @@ void AutoOptimise::autoOptimise(PanoramaData& pano, bool optRoll)
 }
 
 
-void SmartOptimise::smartOptimize(PanoramaData& optPano)
+void SmartOptimise::smartOptimize(PanoramaData& optPano, bool useNative)
 {
     // use m-estimator with sigma 2
     PanoramaOptions opts = optPano.getOptions();
@@ -402,13 +438,13 @@ void SmartOptimise::smartOptimize(PanoramaData& optPano)
         }
     }
     optPano.setCtrlPoints(newCP);
-    AutoOptimise::autoOptimise(optPano);
+    AutoOptimise::autoOptimise(optPano, true, useNative);
     
     // do global optimisation of position with all control points.
     optPano.setCtrlPoints(cps);
     OptimizeVector optvars = createOptVars(optPano, OPT_POS, optPano.getOptions().optimizeReferenceImage);
     optPano.setOptimizeVector(optvars);
-    PTools::optimize(optPano);
+    BundleAdjuster::optimizePanorama(optPano, useNative);
     
     //Find lenses.
     StandardImageVariableGroups variable_groups(optPano);
@@ -494,7 +530,7 @@ void SmartOptimise::smartOptimize(PanoramaData& optPano)
         optPano.setOptimizeVector(optvars);
         // global optimisation.
         DEBUG_DEBUG("before opt 1: newVars[0].b: " << const_map_get(optPano.getVariables()[0],"b").getValue());
-        PTools::optimize(optPano);
+        BundleAdjuster::optimizePanorama(optPano, useNative);
         // --------------------------------------------------------------
         // do some plausibility checks and reoptimize with less variables
         // if something smells fishy
@@ -536,7 +572,7 @@ void SmartOptimise::smartOptimize(PanoramaData& optPano)
             optPano.setOptimizeVector(optvars);
             DEBUG_DEBUG("recover optimisation: " << optmode);
             // global optimisation.
-            PTools::optimize(optPano);
+            BundleAdjuster::optimizePanorama(optPano, useNative);
     
             // check again, maybe b shouldn't be optimized either
             bool highDist = false;
@@ -556,7 +592,7 @@ void SmartOptimise::smartOptimize(PanoramaData& optPano)
                 optvars = createOptVars(optPano, optmode, optPano.getOptions().optimizeReferenceImage);
                 optPano.setOptimizeVector(optvars);
                 // global optimisation.
-                PTools::optimize(optPano);
+                BundleAdjuster::optimizePanorama(optPano, useNative);
                 const VariableMapVector & vars = optPano.getVariables();
                 DEBUG_DEBUG("after opt 3: newVars[0].b: " << const_map_get(vars[0],"b").getValue());
                 DEBUG_DEBUG("after opt 3: oldVars[0].b: " << const_map_get(oldVars[0],"b").getValue());
@@ -43,9 +43,10 @@ namespace HuginBase {
     {
     
         public:
-            ///
-            explicit PTOptimizer(PanoramaData& panorama)
-             : PanoramaAlgorithm(panorama)
+            /** @param useNative use the native optimizer (BundleAdjuster) for projects,
+             *                   which it supports, otherwise PTools::optimize */
+            explicit PTOptimizer(PanoramaData& panorama, bool useNative = false)
+             : PanoramaAlgorithm(panorama), o_useNative(useNative)
             {};
         
             ///
@@ -58,8 +59,11 @@ namespace HuginBase {
             virtual bool modifiesPanoramaData() const
                 { return true; }
             
-            /// calls PTools::optimize()
+            /// calls BundleAdjuster::optimizePanorama()
             virtual bool runAlgorithm();
+
+        protected:
+            bool o_useNative;
     };
     
     /// Pairwise ransac optimisation 
@@ -84,8 +88,16 @@ namespace HuginBase {
             virtual bool modifiesPanoramaData() const
                 { return true; }
 
+	    /** returns the indices of the control points between i1 and i2, which agree with the model,
+	     *  if usesNativeOptimizer returns true, this function has no global state and can
+	     *  be called from several threads at the same time
+	     *  @param seed seed for the random number generator, 0 (the default) seeds it from the clock,
+	     *              use a fixed seed for reproducible results */
 	    static std::vector<int> findInliers(PanoramaData & pano, int i1, int i2, double maxError,
-						Mode mode=RPY);
+						Mode mode=RPY, unsigned int seed=0);
+	    /** returns true, if findInliers estimates the parameters of the images i1 and i2 with
+	     *  the native optimizer (BundleAdjuster) instead of the libpano13 optimizer */
+	    static bool usesNativeOptimizer(const PanoramaData & pano, int i1, int i2);
             
             /// calls PTools::optimize()
             virtual bool runAlgorithm();
@@ -104,8 +116,8 @@ namespace HuginBase {
         
         public:
             ///
-            AutoOptimise(PanoramaData& panorama, bool optRoll=true)
-             : PTOptimizer(panorama)
+            AutoOptimise(PanoramaData& panorama, bool optRoll=true, bool useNative=false)
+             : PTOptimizer(panorama, useNative)
             {};
         
             ///
@@ -115,13 +127,13 @@ namespace HuginBase {
         
         public:
             ///
-            static void autoOptimise(PanoramaData& pano, bool optRoll=true);
+            static void autoOptimise(PanoramaData& pano, bool optRoll=true, bool useNative=false);
 
         public:
             ///
             virtual bool runAlgorithm()
             {
-                autoOptimise(o_panorama);
+                autoOptimise(o_panorama, true, o_useNative);
                 return true; // let's hope so.
             }
 
@@ -155,8 +167,8 @@ namespace HuginBase {
         
         public:
             ///
-            explicit SmartOptimise(PanoramaData& panorama)
-             : PTOptimizer(panorama)
+            explicit SmartOptimise(PanoramaData& panorama, bool useNative = false)
+             : PTOptimizer(panorama, useNative)
             {};
         
             ///
@@ -165,14 +177,14 @@ namespace HuginBase {
         
         public:
             ///
-            static void smartOptimize(PanoramaData& pano);
+            static void smartOptimize(PanoramaData& pano, bool useNative = false);
         
             
         public:
             ///
             virtual bool runAlgorithm()
             {
-                smartOptimize(o_panorama);
+                smartOptimize(o_panorama, o_useNative);
                 return true; // let's hope so.
             }
 
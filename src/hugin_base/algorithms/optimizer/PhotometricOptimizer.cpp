@@ -23,7 +23,9 @@
 
 #include "PhotometricOptimizer.h"
 
+#include <algorithm>
 #include <fstream>
+#include <map>
 #include <foreign/levmar/levmar.h>
 #include <photometric/ResponseTransform.h>
 #include <algorithms/basic/LayerStacks.h>
@@ -59,6 +61,17 @@ PhotometricOptimizer::OptimData::OptimData(const PanoramaData & pano, const Opti
         m_imgs.push_back(pano.getSrcImage(i));
     }
 
+    // remember the point pairs of each image for the sparse jacobian
+    m_imagePairs.resize(pano.getNrOfImages());
+    for (size_t i = 0; i < m_data.size(); ++i)
+    {
+        m_imagePairs[m_data[i].imgNr1].push_back(i);
+        if (m_data[i].imgNr2 != m_data[i].imgNr1)
+        {
+            m_imagePairs[m_data[i].imgNr2].push_back(i);
+        };
+    };
+
     std::vector<std::set<std::string> > usedVars(pano.getNrOfImages());
 
     // create variable map with param <-> var assignments
@@ -149,16 +162,69 @@ void PhotometricOptimizer::OptimData::FromX(double * x)
 
 
 
+typedef Photometric::ResponseTransform<vigra::RGBValue<double> > RespFunc;
+typedef Photometric::InvResponseTransform<vigra::RGBValue<double>, vigra::RGBValue<double> > InvRespFunc;
+
+/** initialises the response functions of the image and returns the monotonicity error */
+static double InitResponse(const SrcPanoImage& img, RespFunc& resp, InvRespFunc& invResp)
+{
+    resp = RespFunc(img);
+    invResp = InvRespFunc(img);
+    double monErr = 0;
+    if (img.getResponseType() == SrcPanoImage::RESPONSE_EMOR) {
+        // calculate monotonicity error
+        int lutsize = resp.m_lutR.size();
+        for (int j=0; j < lutsize-1; j++)
+        {
+            double d = resp.m_lutR[j] - resp.m_lutR[j+1];
+            if (d > 0) {
+                monErr += d*d*lutsize;
+            }
+        }
+    }
+    // enforce a montonous response curves
+    resp.enforceMonotonicity();
+    invResp.enforceMonotonicity();
+    return monErr;
+}
+
+/** calculates the 6 residuals of a point pair */
+static void PointPairError(const vigra_ext::PointPairRGB& pair,
+                           const RespFunc& resp1, const InvRespFunc& invResp1,
+                           const RespFunc& resp2, const InvRespFunc& invResp2,
+                           double huberSigma, double* x)
+{
+    vigra::RGBValue<double> l2 = invResp2(pair.i2, pair.p2);
+    vigra::RGBValue<double> i2ini1 = resp1(l2, pair.p1);
+    vigra::RGBValue<double> error = pair.i1 - i2ini1;
+
+    // if requested, calcuate the error in image 2 as well.
+    //TODO: weighting dependent on the pixel value? check if outside of i2 range?
+    vigra::RGBValue<double> l1 = invResp1(pair.i1, pair.p1);
+    vigra::RGBValue<double> i1ini2 = resp2(l1, pair.p2);
+    vigra::RGBValue<double> error2 = pair.i2 - i1ini2;
+
+    // use huber robust estimator
+    if (huberSigma > 0) {
+        for (int i=0; i < 3; i++) {
+            x[2*i] = weightHuber(fabs(error[i]), huberSigma);
+            x[2*i+1] = weightHuber(fabs(error2[i]), huberSigma);
+        }
+    } else {
+        x[0] = error[0];
+        x[1] = error[1];
+        x[2] = error[2];
+        x[3] = error2[0];
+        x[4] = error2[1];
+        x[5] = error2[2];
+    }
+}
+
 void PhotometricOptimizer::photometricError(double *p, double *x, int m, int n, void * data)
 {
 #ifdef DEBUG_LOG_VIG
     static int iter = 0;
 #endif
-    typedef Photometric::ResponseTransform<vigra::RGBValue<double> > RespFunc;
-    typedef Photometric::InvResponseTransform<vigra::RGBValue<double>, vigra::RGBValue<double> > InvRespFunc;
-
-    int xi = 0 ;
-
     OptimData * dat = static_cast<OptimData*>(data);
     dat->FromX(p);
 #ifdef DEBUG_LOG_VIG
@@ -182,76 +248,26 @@ void PhotometricOptimizer::photometricError(double *p, double *x, int m, int n,
     std::vector<RespFunc> resp(nImg);
     std::vector<InvRespFunc> invResp(nImg);
     for (size_t i=0; i < nImg; i++) {
-        resp[i] = RespFunc(dat->m_imgs[i]);
-        invResp[i] = InvRespFunc(dat->m_imgs[i]);
-        // calculate the monotonicity error
-        double monErr = 0;
-        if (dat->m_imgs[i].getResponseType() == SrcPanoImage::RESPONSE_EMOR) {
-            // calculate monotonicity error
-            int lutsize = resp[i].m_lutR.size();
-            for (int j=0; j < lutsize-1; j++)
-            {
-                double d = resp[i].m_lutR[j] - resp[i].m_lutR[j+1];
-                if (d > 0) {
-                    monErr += d*d*lutsize;
-                }
-            }
-        }
-        x[xi++] = monErr;
-		// enforce a montonous response curves
-		resp[i].enforceMonotonicity();
-		invResp[i].enforceMonotonicity();
+        x[i] = InitResponse(dat->m_imgs[i], resp[i], invResp[i]);
     }
 
-#ifdef DEBUG
-    double sqerror=0;
-#endif
-    // loop over all points to calculate the error
+    // loop over all points to calculate the error, each point pair writes
+    // only its own residuals, so the result does not depend on the number of threads
 #ifdef DEBUG_LOG_VIG
     log << "VIGval = [ ";
+#else
+#pragma omp parallel for schedule(static)
 #endif
-
-    for (std::vector<vigra_ext::PointPairRGB>::const_iterator it = dat->m_data.begin();
-         it != dat->m_data.end(); ++it)
+    for (int k = 0; k < static_cast<int>(dat->m_data.size()); ++k)
     {
-        vigra::RGBValue<double> l2 = invResp[it->imgNr2](it->i2, it->p2);
-        vigra::RGBValue<double> i2ini1 = resp[it->imgNr1](l2, it->p1);
-        vigra::RGBValue<double> error = it->i1 - i2ini1;
-
-
-        // if requested, calcuate the error in image 2 as well.
-        //TODO: weighting dependent on the pixel value? check if outside of i2 range?
-        vigra::RGBValue<double> l1 = invResp[it->imgNr1](it->i1, it->p1);
-        vigra::RGBValue<double> i1ini2 = resp[it->imgNr2](l1, it->p2);
-        vigra::RGBValue<double> error2 = it->i2 - i1ini2;
-
-#ifdef DEBUG
-        for (int i=0; i < 3; i++) {
-            sqerror += error[i]*error[i];
-            sqerror += error2[i]*error2[i];
-        }
-#endif
-
-        // use huber robust estimator
-        if (dat->huberSigma > 0) {
-            for (int i=0; i < 3; i++) {
-                x[xi++] = weightHuber(fabs(error[i]), dat->huberSigma);
-                x[xi++] = weightHuber(fabs(error2[i]), dat->huberSigma);
-            }
-        } else {
-            x[xi++] = error[0];
-            x[xi++] = error[1];
-            x[xi++] = error[2];
-            x[xi++] = error2[0];
-            x[xi++] = error2[1];
-            x[xi++] = error2[2];
-        }
-
+        const vigra_ext::PointPairRGB& pair = dat->m_data[k];
+        double* pairError = x + nImg + 6 * k;
+        PointPairError(pair, resp[pair.imgNr1], invResp[pair.imgNr1], resp[pair.imgNr2], invResp[pair.imgNr2],
+                       dat->huberSigma, pairError);
 #ifdef DEBUG_LOG_VIG
-        log << it->i1.green()  << " "<< l1.green()  << " " << i1ini2.green() << "   " 
-             << it->i2.green()  << " "<< l2.green()  << " " << i2ini1.green() << ";  " << std::endl;
+        log << pair.i1.green() << " " << pair.i2.green() << "   "
+            << pairError[0] << " " << pairError[1] << " " << pairError[2] << ";  " << std::endl;
 #endif
-
     }
 #ifdef DEBUG_LOG_VIG
     log << std::endl << "VIGerr = [";
@@ -261,10 +277,81 @@ void PhotometricOptimizer::photometricError(double *p, double *x, int m, int n,
     log << " ]; " << std::endl;
 #endif
 #ifdef DEBUG
+    double sqerror=0;
+    for (int i = nImg; i < n; i++) {
+        sqerror += x[i]*x[i];
+    }
     DEBUG_DEBUG("squared error: " << sqerror);
 #endif
 }
 
+void PhotometricOptimizer::photometricJacobian(double *p, double *jac, int m, int n, void * data)
+{
+    OptimData * dat = static_cast<OptimData*>(data);
+    dat->FromX(p);
+    // residuals at p
+    const size_t nImg = dat->m_imgs.size();
+    std::vector<RespFunc> resp(nImg);
+    std::vector<InvRespFunc> invResp(nImg);
+    std::vector<double> x(n);
+    for (size_t i = 0; i < nImg; i++)
+    {
+        x[i] = InitResponse(dat->m_imgs[i], resp[i], invResp[i]);
+    };
+#pragma omp parallel for schedule(static)
+    for (int k = 0; k < static_cast<int>(dat->m_data.size()); ++k)
+    {
+        const vigra_ext::PointPairRGB& pair = dat->m_data[k];
+        PointPairError(pair, resp[pair.imgNr1], invResp[pair.imgNr1], resp[pair.imgNr2], invResp[pair.imgNr2],
+                       dat->huberSigma, &x[nImg + 6 * k]);
+    };
+
+    std::fill(jac, jac + static_cast<size_t>(n) * m, 0.0);
+    // forward differences (as in dlevmar_dif), each column is calculated independently
+#pragma omp parallel for schedule(dynamic)
+    for (int j = 0; j < m; ++j)
+    {
+        const VarMapping& var = dat->m_vars[j];
+        double delta = LM_DIFF_DELTA * fabs(p[j]);
+        if (delta < LM_DIFF_DELTA)
+        {
+            delta = LM_DIFF_DELTA;
+        };
+        // response functions of the images affected by the parameter
+        std::map<unsigned, std::pair<RespFunc, InvRespFunc> > changedResp;
+        std::vector<size_t> pairs;
+        for (std::set<unsigned>::const_iterator it = var.imgs.begin(); it != var.imgs.end(); ++it)
+        {
+            SrcPanoImage img(dat->m_imgs[*it]);
+            img.setVar(var.type, p[j] + delta);
+            std::pair<RespFunc, InvRespFunc>& changed = changedResp[*it];
+            jac[*it * m + j] = (InitResponse(img, changed.first, changed.second) - x[*it]) / delta;
+            pairs.insert(pairs.end(), dat->m_imagePairs[*it].begin(), dat->m_imagePairs[*it].end());
+        };
+        // a pair can contain two images with a linked parameter
+        std::sort(pairs.begin(), pairs.end());
+        pairs.erase(std::unique(pairs.begin(), pairs.end()), pairs.end());
+        for (size_t k = 0; k < pairs.size(); ++k)
+        {
+            const vigra_ext::PointPairRGB& pair = dat->m_data[pairs[k]];
+            std::map<unsigned, std::pair<RespFunc, InvRespFunc> >::const_iterator it1 = changedResp.find(pair.imgNr1);
+            std::map<unsigned, std::pair<RespFunc, InvRespFunc> >::const_iterator it2 = changedResp.find(pair.imgNr2);
+            double pairError[6];
+            PointPairError(pair,
+                           it1 != changedResp.end() ? it1->second.first : resp[pair.imgNr1],
+                           it1 != changedResp.end() ? it1->second.second : invResp[pair.imgNr1],
+                           it2 != changedResp.end() ? it2->second.first : resp[pair.imgNr2],
+                           it2 != changedResp.end() ? it2->second.second : invResp[pair.imgNr2],
+                           dat->huberSigma, pairError);
+            const size_t row = nImg + 6 * pairs[k];
+            for (int i = 0; i < 6; ++i)
+            {
+                jac[(row + i) * m + j] = (pairError[i] - x[row + i]) / delta;
+            };
+        };
+    };
+}
+
 int PhotometricOptimizer::photometricVis(double *p, double *x, int m, int n, int iter, double sqerror, void * data)
 {
     OptimData * dat = static_cast<OptimData*>(data);
@@ -336,7 +423,7 @@ void PhotometricOptimizer::optimizePhotometric(PanoramaData & pano, const Optimi
     // difference mode
     optimOpts[4] = LM_DIFF_DELTA;
     
-    dlevmar_dif(&photometricError, &photometricVis, &(p[0]), &(x[0]), m, n, nMaxIter, optimOpts, info, NULL,NULL, &data);  // no jacobian
+    dlevmar_der(&photometricError, &photometricJacobian, &photometricVis, &(p[0]), &(x[0]), m, n, nMaxIter, optimOpts, info, NULL, NULL, &data);
 
     // copy to source images (data.m_imgs)
     data.FromX(p.begin());
@@ -79,6 +79,8 @@ namespace HuginBase
                 std::vector<SrcPanoImage> m_imgs;
                 std::vector<VarMapping> m_vars;
                 std::vector<vigra_ext::PointPairRGB> m_data;
+                /// indices of the point pairs in m_data, which contain the image
+                std::vector<std::vector<size_t> > m_imagePairs;
                 double huberSigma;
                 bool symmetricError;
 
@@ -105,6 +107,10 @@ namespace HuginBase
             ///
             static void photometricError(double* p, double* x, int m, int n, void* data);
 
+            /** calculates the jacobian by finite differences, a parameter changes only the
+             *  residuals of the point pairs with its images, so only these are evaluated */
+            static void photometricJacobian(double* p, double* jac, int m, int n, void* data);
+
 
         public:
             ///
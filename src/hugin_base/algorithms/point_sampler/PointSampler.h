@@ -33,6 +33,8 @@
 
 #include <random>
 #include <functional>
+#include <vector>
+#include <algorithm>
 #include <vigra_ext/utils.h>
 #include <appbase/ProgressDisplay.h>
 #include <panodata/PanoramaData.h>
@@ -336,14 +338,28 @@ void AllPointSampler::sampleAllPanoPoints(const std::vector<Img> &imgs,
     }
 
     const vigra::Rect2D roi = pano.getOptions().getROI();
+    // x coordinates are the same for all rows
+    const int width = roi.width();
+    std::vector<double> xpos(width);
+    for (int x = 0; x < width; ++x) {
+        xpos[x] = roi.left() + x;
+    }
+    // image coordinates of the current row in all images
+    std::vector<double> ypos(width);
+    std::vector<std::vector<double> > xImg(nImg, std::vector<double>(width));
+    std::vector<std::vector<double> > yImg(nImg, std::vector<double>(width));
+    std::vector<std::vector<unsigned char> > valid(nImg, std::vector<unsigned char>(width));
     for (int y=roi.top(); y < roi.bottom(); ++y) {
-        for (int x=roi.left(); x < roi.right(); ++x) {
-            hugin_utils::FDiff2D panoPnt(x,y);
+        // transform the complete row
+        std::fill(ypos.begin(), ypos.end(), y);
+        for (unsigned i=0; i < nImg; i++) {
+            transf[i]->transformImgCoords(&xpos[0], &ypos[0], &xImg[i][0], &yImg[i][0], &valid[i][0], width);
+        }
+        for (int x=0; x < width; ++x) {
             for (unsigned i=0; i< nImg-1; i++) {
-            // transform pixel
-                hugin_utils::FDiff2D p1;
-                if(!transf[i]->transformImgCoord(p1, panoPnt))
+                if(!valid[i][x])
                     continue;
+                const hugin_utils::FDiff2D p1(xImg[i][x], yImg[i][x]);
                 vigra::Point2D p1Int(p1.toDiff2D());
                 // is inside:
                 if (!pano.getImage(i).isInside(p1Int)) {
@@ -362,9 +378,9 @@ void AllPointSampler::sampleAllPanoPoints(const std::vector<Img> &imgs,
 
                     // check inner image
                     for (unsigned j=i+1; j < nImg; j++) {
-                        hugin_utils::FDiff2D p2;
-                        if(!transf[j]->transformImgCoord(p2, panoPnt))
+                        if(!valid[j][x])
                             continue;
+                        const hugin_utils::FDiff2D p2(xImg[j][x], yImg[j][x]);
                         vigra::Point2D p2Int(p2.toDiff2D());
                         if (!pano.getImage(j).isInside(p2Int)) {
                             // point is outside image
@@ -479,104 +495,119 @@ void RandomPointSampler::sampleRandomPanoPoints(const std::vector<Img>& imgs,
     auto randX = std::bind(distribx, std::ref(rng));
     auto randY = std::bind(distriby, std::ref(rng));
 
-    for (unsigned maxTry = nPoints*5; nPoints > 0 && maxTry > 0; maxTry--) {
-        unsigned x = randX();
-        unsigned y = randY();
-        hugin_utils::FDiff2D panoPnt(x,y);
-        for (unsigned i=0; i< nImg-1; i++) {
-            // transform pixel
-            PixelType i1;
-            hugin_utils::FDiff2D p1;
-            if(!transf[i]->transformImgCoord(p1, panoPnt))
-                continue;
-            vigra::Point2D p1Int(p1.toDiff2D());
-            // check if pixel is valid
-            if (!pano.getImage(i).isInside(p1Int)) {
-                // point is outside image
-                continue;
-            }
-            vigra::UInt8 maskI;
-            if ( imgs[i](p1.x,p1.y, i1, maskI)){
-                float im1 = vigra_ext::getMaxComponent(i1);
-                if (limitI[i].GetMinI() > im1 || limitI[i].GetMaxI() < im1) {
-                    // ignore pixels that are too dark or bright
+    // the points are transformed in blocks
+    const unsigned blockSize = 256;
+    std::vector<double> xpos(blockSize);
+    std::vector<double> ypos(blockSize);
+    std::vector<std::vector<double> > xImg(nImg, std::vector<double>(blockSize));
+    std::vector<std::vector<double> > yImg(nImg, std::vector<double>(blockSize));
+    std::vector<std::vector<unsigned char> > valid(nImg, std::vector<unsigned char>(blockSize));
+    unsigned maxTry = nPoints*5;
+    while (nPoints > 0 && maxTry > 0) {
+        const unsigned n = std::min(blockSize, maxTry);
+        for (unsigned k = 0; k < n; k++) {
+            xpos[k] = randX();
+            ypos[k] = randY();
+        }
+        for (unsigned i = 0; i < nImg; i++) {
+            transf[i]->transformImgCoords(&xpos[0], &ypos[0], &xImg[i][0], &yImg[i][0], &valid[i][0], n);
+        }
+        for (unsigned k = 0; k < n && nPoints > 0; k++, maxTry--) {
+            for (unsigned i=0; i< nImg-1; i++) {
+                // transform pixel
+                PixelType i1;
+                if(!valid[i][k])
+                    continue;
+                const hugin_utils::FDiff2D p1(xImg[i][k], yImg[i][k]);
+                vigra::Point2D p1Int(p1.toDiff2D());
+                // check if pixel is valid
+                if (!pano.getImage(i).isInside(p1Int)) {
+                    // point is outside image
                     continue;
                 }
-                double r1 = hugin_utils::norm((p1 - pano.getImage(i).getRadialVigCorrCenter()) / maxr[i]);
-                for (unsigned j=i+1; j < nImg; j++) {
-                    PixelType i2;
-                    hugin_utils::FDiff2D p2;
-                    if(!transf[j]->transformImgCoord(p2, panoPnt))
-                        continue;
-                    // check if a pixel is inside the source image
-                    vigra::Point2D p2Int(p2.toDiff2D());
-                    if (!pano.getImage(j).isInside(p2Int)) {
-                        // point is outside image
+                vigra::UInt8 maskI;
+                if ( imgs[i](p1.x,p1.y, i1, maskI)){
+                    float im1 = vigra_ext::getMaxComponent(i1);
+                    if (limitI[i].GetMinI() > im1 || limitI[i].GetMaxI() < im1) {
+                        // ignore pixels that are too dark or bright
                         continue;
                     }
-                    vigra::UInt8 maskI2;
-                    if (imgs[j](p2.x, p2.y, i2, maskI2)){
-                        float im2 = vigra_ext::getMaxComponent(i2);
-                        if (limitI[j].GetMinI() > im2 || limitI[j].GetMaxI() < im2) {
-                            // ignore pixels that are too dark or bright
+                    double r1 = hugin_utils::norm((p1 - pano.getImage(i).getRadialVigCorrCenter()) / maxr[i]);
+                    for (unsigned j=i+1; j < nImg; j++) {
+                        PixelType i2;
+                        if(!valid[j][k])
+                            continue;
+                        const hugin_utils::FDiff2D p2(xImg[j][k], yImg[j][k]);
+                        // check if a pixel is inside the source image
+                        vigra::Point2D p2Int(p2.toDiff2D());
+                        if (!pano.getImage(j).isInside(p2Int)) {
+                            // point is outside image
                             continue;
                         }
-                        // TODO: add check for gradient radius.
-                        double r2 = hugin_utils::norm((p2 - pano.getImage(j).getRadialVigCorrCenter()) / maxr[j]);
-#if 0
-                        // add pixel
-                        if (im1 <= im2) {
-                            points.push_back(PP(i, i1, p1, r1,   j, i2, p2, r2) );
-                        } else {
-                            points.push_back(PP(j, i2, p2, r2,   i, i1, p1, r1) );
-                        }
-#else
+                        vigra::UInt8 maskI2;
+                        if (imgs[j](p2.x, p2.y, i2, maskI2)){
+                            float im2 = vigra_ext::getMaxComponent(i2);
+                            if (limitI[j].GetMinI() > im2 || limitI[j].GetMaxI() < im2) {
+                                // ignore pixels that are too dark or bright
+                                continue;
+                            }
+                            // TODO: add check for gradient radius.
+                            double r2 = hugin_utils::norm((p2 - pano.getImage(j).getRadialVigCorrCenter()) / maxr[j]);
+    #if 0
                             // add pixel
-                            const VoteImg & vimg1 =  *voteImgs[i];
-                            const VoteImg & vimg2 =  *voteImgs[j];
-                            double laplace = hugin_utils::sqr(vimg1[p1Int]) + hugin_utils::sqr(vimg2[p2Int]);
-                            size_t bin1 = (size_t)(r1*nBins);
-                            size_t bin2 = (size_t)(r2*nBins);
-                            // a center shift might lead to radi > 1.
-                            if (bin1+1 > nBins) bin1 = nBins-1;
-                            if (bin2+1 > nBins) bin2 = nBins-1;
-
-                            PP pp;
                             if (im1 <= im2) {
-                                // choose i1 to be smaller than i2
-                                pp = PP(i, i1, p1, r1,   j, i2, p2, r2);
+                                points.push_back(PP(i, i1, p1, r1,   j, i2, p2, r2) );
                             } else {
-                                pp = PP(j, i2, p2, r2,   i, i1, p1, r1);
+                                points.push_back(PP(j, i2, p2, r2,   i, i1, p1, r1) );
                             }
-
-                            // decide which bin should be used.
-                            std::multimap<double, PP> * map1 = &radiusHist[bin1];
-                            std::multimap<double, PP> * map2 = &radiusHist[bin2];
-                            std::multimap<double, PP> * destMap;
-                            if (map1->empty()) {
-                                destMap = map1;
-                            } else if (map2->empty()) {
-                                destMap = map2;
-                            } else if (map1->size() < map2->size()) {
-                                destMap = map1;
-                            } else if (map1->size() > map2->size()) {
-                                destMap = map2;
-							} else if (map1->rbegin()->first > map2->rbegin()->first) {
-                                // heuristic: insert into bin with higher maximum laplacian filter response
-                                // (higher probablity of misregistration).
-                                destMap = map1;
-                            } else {
-                                destMap = map2;
-                            }
-                            // insert
-                            destMap->insert(std::make_pair(laplace,pp));
-                            // remove last element if too many elements have been gathered
-                            if (destMap->size() > pairsPerBin) {
-                                destMap->erase((--(destMap->end())));
-                            }
-//                            nGoodPoints++;
-#endif
-                        nPoints--;
+    #else
+                                // add pixel
+                                const VoteImg & vimg1 =  *voteImgs[i];
+                                const VoteImg & vimg2 =  *voteImgs[j];
+                                double laplace = hugin_utils::sqr(vimg1[p1Int]) + hugin_utils::sqr(vimg2[p2Int]);
+                                size_t bin1 = (size_t)(r1*nBins);
+                                size_t bin2 = (size_t)(r2*nBins);
+                                // a center shift might lead to radi > 1.
+                                if (bin1+1 > nBins) bin1 = nBins-1;
+                                if (bin2+1 > nBins) bin2 = nBins-1;
+
+                                PP pp;
+                                if (im1 <= im2) {
+                                    // choose i1 to be smaller than i2
+                                    pp = PP(i, i1, p1, r1,   j, i2, p2, r2);
+                                } else {
+                                    pp = PP(j, i2, p2, r2,   i, i1, p1, r1);
+                                }
+
+                                // decide which bin should be used.
+                                std::multimap<double, PP> * map1 = &radiusHist[bin1];
+                                std::multimap<double, PP> * map2 = &radiusHist[bin2];
+                                std::multimap<double, PP> * destMap;
+                                if (map1->empty()) {
+                                    destMap = map1;
+                                } else if (map2->empty()) {
+                                    destMap = map2;
+                                } else if (map1->size() < map2->size()) {
+                                    destMap = map1;
+                                } else if (map1->size() > map2->size()) {
+                                    destMap = map2;
+    							} else if (map1->rbegin()->first > map2->rbegin()->first) {
+                                    // heuristic: insert into bin with higher maximum laplacian filter response
+                                    // (higher probablity of misregistration).
+                                    destMap = map1;
+                                } else {
+                                    destMap = map2;
+                                }
+                                // insert
+                                destMap->insert(std::make_pair(laplace,pp));
+                                // remove last element if too many elements have been gathered
+                                if (destMap->size() > pairsPerBin) {
+                                    destMap->erase((--(destMap->end())));
+                                }
+    //                            nGoodPoints++;
+    #endif
+                            nPoints--;
+                        }
                     }
                 }
             }
@@ -164,9 +164,20 @@ void Matrix3::GetRotationPT( double & Yaw, double & Pitch, double & Roll )
     return ($roll, $pitch, $yaw);
 
     */
-    Roll = atan2 (m[2][1], m[2][2]);
-    Pitch = - asin (- m[2][0]);
-    Yaw = atan2 (- m[1][0], m[0][0]);
+    // atan2 instead of asin, rounding errors can push m[2][0] slightly beyond +-1
+    const double cosPitch = hypot (m[0][0], m[1][0]);
+    Pitch = atan2 (m[2][0], cosPitch);
+    if (cosPitch < 1e-12)
+    {
+        // pitch is +-90 deg, only the combination of yaw and roll is defined
+        Roll = 0;
+        Yaw = atan2 (m[0][1], m[1][1]);
+    }
+    else
+    {
+        Roll = atan2 (m[2][1], m[2][2]);
+        Yaw = atan2 (- m[1][0], m[0][0]);
+    };
 }
 
 /** set the matrice to rotation around X */
@@ -0,0 +1,427 @@
+// -*- c-basic-offset: 4 -*-
+/** @file nona/CoordinateMap.cpp
+ *
+ *  Precalculated source coordinates for remapping, which can be stored
+ *  in a cache directory and reused for later stitches with the same geometry.
+ *
+ *  This is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This software is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public
+ *  License along with this software. If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "CoordinateMap.h"
+#include "GridTransform.h"
+
+#include <hugin_config.h>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <iterator>
+#include <locale>
+#include <cmath>
+#include <atomic>
+#ifdef _WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+#ifdef HAVE_STD_FILESYSTEM
+#include <filesystem>
+namespace fs = std::tr2::sys;
+#else
+#define BOOST_FILESYSTEM_VERSION 3
+#include <boost/filesystem.hpp>
+namespace fs = boost::filesystem;
+#endif
+
+namespace HuginBase
+{
+namespace Nona
+{
+
+namespace
+{
+/** magic bytes at the start of a coordinate map file */
+const char MapFileMagic[8] = { 'H', 'U', 'G', 'I', 'N', 'M', 'A', 'P' };
+/** version of the file format, increase when changing the format
+ *  or the parameters used for the key */
+const uint32_t MapFileVersion = 1;
+
+/** buffered little endian writer for the coordinate map file */
+class MapWriter
+{
+public:
+    void writeUInt32(uint32_t value)
+    {
+        for (int i = 0; i < 4; ++i)
+        {
+            m_buffer.push_back(static_cast<char>((value >> (8 * i)) & 0xFF));
+        };
+    };
+    void writeVarUInt(uint64_t value)
+    {
+        while (value >= 0x80)
+        {
+            m_buffer.push_back(static_cast<char>((value & 0x7F) | 0x80));
+            value >>= 7;
+        };
+        m_buffer.push_back(static_cast<char>(value));
+    };
+    void writeVarInt(int64_t value)
+    {
+        // zigzag encoding, so that small negative values need also only few bytes
+        writeVarUInt((static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63));
+    };
+    void writeString(const std::string & s)
+    {
+        writeUInt32(static_cast<uint32_t>(s.size()));
+        m_buffer.insert(m_buffer.end(), s.begin(), s.end());
+    };
+    void writeBytes(const char* data, size_t size)
+    {
+        m_buffer.insert(m_buffer.end(), data, data + size);
+    };
+    const std::vector<char> & getBuffer() const { return m_buffer; };
+private:
+    std::vector<char> m_buffer;
+};
+
+/** reader for data written by MapWriter, all functions return false
+ *  if the data is truncated or corrupted */
+class MapReader
+{
+public:
+    explicit MapReader(const std::vector<char> & buffer) : m_buffer(buffer), m_pos(0) {};
+    bool readUInt32(uint32_t & value)
+    {
+        if (m_pos + 4 > m_buffer.size())
+        {
+            return false;
+        };
+        value = 0;
+        for (int i = 0; i < 4; ++i)
+        {
+            value |= static_cast<uint32_t>(static_cast<unsigned char>(m_buffer[m_pos++])) << (8 * i);
+        };
+        return true;
+    };
+    bool readVarUInt(uint64_t & value)
+    {
+        value = 0;
+        for (int shift = 0; shift < 64; shift += 7)
+        {
+            if (m_pos >= m_buffer.size())
+            {
+                return false;
+            };
+            const unsigned char byte = static_cast<unsigned char>(m_buffer[m_pos++]);
+            value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+            if ((byte & 0x80) == 0)
+            {
+                return true;
+            };
+        };
+        return false;
+    };
+    bool readVarInt(int64_t & value)
+    {
+        uint64_t v;
+        if (!readVarUInt(v))
+        {
+            return false;
+        };
+        value = static_cast<int64_t>(v >> 1) ^ -static_cast<int64_t>(v & 1);
+        return true;
+    };
+    bool readString(std::string & s)
+    {
+        uint32_t size;
+        if (!readUInt32(size) || m_pos + size > m_buffer.size())
+        {
+            return false;
+        };
+        s.assign(m_buffer.begin() + m_pos, m_buffer.begin() + m_pos + size);
+        m_pos += size;
+        return true;
+    };
+    bool readBytes(char* data, size_t size)
+    {
+        if (m_pos + size > m_buffer.size())
+        {
+            return false;
+        };
+        std::copy(m_buffer.begin() + m_pos, m_buffer.begin() + m_pos + size, data);
+        m_pos += size;
+        return true;
+    };
+private:
+    const std::vector<char> & m_buffer;
+    size_t m_pos;
+};
+
+/** predict the next coordinate from the two previous valid coordinates of the run */
+inline int64_t predictCoord(const int32_t* values, size_t pos, size_t runStart)
+{
+    if (pos >= runStart + 2)
+    {
+        return 2 * static_cast<int64_t>(values[pos - 1]) - values[pos - 2];
+    };
+    if (pos >= runStart + 1)
+    {
+        return values[pos - 1];
+    };
+    return 0;
+}
+
+} // namespace
+
+const int32_t CoordinateMap::CoordScale;
+const int32_t CoordinateMap::InvalidCoord;
+
+void CoordinateMap::resize(const vigra::Rect2D & rect)
+{
+    m_rect = rect;
+    const size_t size = static_cast<size_t>(rect.width()) * rect.height();
+    m_x.assign(size, InvalidCoord);
+    m_y.assign(size, InvalidCoord);
+}
+
+void CoordinateMap::setRow(int y, const double* srcX, const double* srcY, const unsigned char* valid)
+{
+    // limit coordinates to a range, which fits into the fixed point representation
+    const double maxCoord = 4.0e6;
+    const int width = m_rect.width();
+    int32_t* xRow = &m_x[static_cast<size_t>(y - m_rect.top()) * width];
+    int32_t* yRow = &m_y[static_cast<size_t>(y - m_rect.top()) * width];
+    for (int x = 0; x < width; ++x)
+    {
+        if (valid[x] && std::abs(srcX[x]) < maxCoord && std::abs(srcY[x]) < maxCoord)
+        {
+            xRow[x] = static_cast<int32_t>(std::floor(srcX[x] * CoordScale + 0.5));
+            yRow[x] = static_cast<int32_t>(std::floor(srcY[x] * CoordScale + 0.5));
+        }
+        else
+        {
+            xRow[x] = InvalidCoord;
+            yRow[x] = InvalidCoord;
+        };
+    };
+}
+
+bool CoordinateMap::save(const std::string & filename, const std::string & key) const
+{
+    MapWriter writer;
+    writer.writeBytes(MapFileMagic, sizeof(MapFileMagic));
+    writer.writeUInt32(MapFileVersion);
+    writer.writeString(key);
+    writer.writeUInt32(static_cast<uint32_t>(m_rect.left()));
+    writer.writeUInt32(static_cast<uint32_t>(m_rect.top()));
+    writer.writeUInt32(static_cast<uint32_t>(m_rect.width()));
+    writer.writeUInt32(static_cast<uint32_t>(m_rect.height()));
+    // each row is stored as alternating runs of invalid and valid pixels,
+    // the valid coordinates are stored as difference to a linear prediction
+    const size_t width = m_rect.width();
+    for (int y = 0; y < m_rect.height(); ++y)
+    {
+        const int32_t* xRow = &m_x[y * width];
+        const int32_t* yRow = &m_y[y * width];
+        size_t pos = 0;
+        while (pos < width)
+        {
+            size_t runStart = pos;
+            while (pos < width && xRow[pos] == InvalidCoord)
+            {
+                ++pos;
+            };
+            writer.writeVarUInt(pos - runStart);
+            runStart = pos;
+            while (pos < width && xRow[pos] != InvalidCoord)
+            {
+                ++pos;
+            };
+            writer.writeVarUInt(pos - runStart);
+            for (size_t i = runStart; i < pos; ++i)
+            {
+                writer.writeVarInt(xRow[i] - predictCoord(xRow, i, runStart));
+                writer.writeVarInt(yRow[i] - predictCoord(yRow, i, runStart));
+            };
+        };
+    };
+    // write to a temporary file and rename it afterwards, so that concurrent
+    // processes never see a partially written map
+    try
+    {
+        const fs::path path(filename);
+        if (path.has_parent_path() && !fs::exists(path.parent_path()))
+        {
+            fs::create_directories(path.parent_path());
+        };
+        std::ostringstream tempName;
+        // the process id and a counter give a unique name for all processes and threads
+        static std::atomic<unsigned int> tempCounter(0);
+        tempName << filename << "." << getpid() << "." << tempCounter++ << ".tmp";
+        {
+            std::ofstream file(tempName.str().c_str(), std::ios::binary | std::ios::trunc);
+            if (!file.good())
+            {
+                return false;
+            };
+            file.write(&writer.getBuffer()[0], writer.getBuffer().size());
+            if (!file.good())
+            {
+                file.close();
+                fs::remove(fs::path(tempName.str()));
+                return false;
+            };
+        }
+        fs::rename(fs::path(tempName.str()), path);
+    }
+    catch (const std::exception & e)
+    {
+        DEBUG_ERROR("Could not write coordinate map: " << e.what());
+        return false;
+    };
+    return true;
+}
+
+bool CoordinateMap::load(const std::string & filename, const std::string & key)
+{
+    std::vector<char> buffer;
+    {
+        std::ifstream file(filename.c_str(), std::ios::binary);
+        if (!file.good())
+        {
+            return false;
+        };
+        buffer.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    }
+    MapReader reader(buffer);
+    char magic[sizeof(MapFileMagic)];
+    if (!reader.readBytes(magic, sizeof(magic)) || !std::equal(magic, magic + sizeof(magic), MapFileMagic))
+    {
+        return false;
+    };
+    uint32_t version;
+    std::string fileKey;
+    if (!reader.readUInt32(version) || version != MapFileVersion || !reader.readString(fileKey) || fileKey != key)
+    {
+        return false;
+    };
+    uint32_t left, top, width, height;
+    if (!reader.readUInt32(left) || !reader.readUInt32(top) || !reader.readUInt32(width) || !reader.readUInt32(height))
+    {
+        return false;
+    };
+    const int32_t x0 = static_cast<int32_t>(left);
+    const int32_t y0 = static_cast<int32_t>(top);
+    const vigra::Rect2D rect(x0, y0, x0 + static_cast<int>(width), y0 + static_cast<int>(height));
+    if (rect.isEmpty())
+    {
+        return false;
+    };
+    resize(rect);
+    for (size_t y = 0; y < height; ++y)
+    {
+        int32_t* xRow = &m_x[y * width];
+        int32_t* yRow = &m_y[y * width];
+        size_t pos = 0;
+        while (pos < width)
+        {
+            uint64_t invalidRun, validRun;
+            if (!reader.readVarUInt(invalidRun) || invalidRun > width - pos)
+            {
+                m_rect = vigra::Rect2D();
+                return false;
+            };
+            pos += invalidRun;
+            if (!reader.readVarUInt(validRun) || validRun > width - pos)
+            {
+                m_rect = vigra::Rect2D();
+                return false;
+            };
+            const size_t runStart = pos;
+            for (; pos < runStart + validRun; ++pos)
+            {
+                int64_t dx, dy;
+                if (!reader.readVarInt(dx) || !reader.readVarInt(dy))
+                {
+                    m_rect = vigra::Rect2D();
+                    return false;
+                };
+                xRow[pos] = static_cast<int32_t>(predictCoord(xRow, pos, runStart) + dx);
+                yRow[pos] = static_cast<int32_t>(predictCoord(yRow, pos, runStart) + dy);
+            };
+        };
+    };
+    return true;
+}
+
+std::string GetCoordinateMapKey(const SrcPanoImage & src, const PanoramaOptions & dest,
+                                const vigra::Rect2D & rect, const AdvancedOptions & advOptions)
+{
+    std::ostringstream key;
+    key.imbue(std::locale::classic());
+    key << std::setprecision(17);
+    key << "v" << MapFileVersion;
+    key << " src " << src.getSize().width() << "x" << src.getSize().height()
+        << " f" << src.getProjection() << " v" << src.getHFOV();
+    const std::vector<double> & dist = src.getRadialDistortion();
+    key << " abc";
+    for (size_t i = 0; i < dist.size(); ++i)
+    {
+        key << " " << dist[i];
+    };
+    key << " d" << src.getRadialDistortionCenterShift().x << " e" << src.getRadialDistortionCenterShift().y
+        << " g" << src.getShear().x << " t" << src.getShear().y
+        << " r" << src.getRoll() << " p" << src.getPitch() << " y" << src.getYaw()
+        << " TrX" << src.getX() << " TrY" << src.getY() << " TrZ" << src.getZ()
+        << " Tpy" << src.getTranslationPlaneYaw() << " Tpp" << src.getTranslationPlanePitch();
+    key << " dest " << dest.getWidth() << "x" << dest.getHeight()
+        << " f" << dest.getProjection() << " v" << dest.getHFOV();
+    const std::vector<double> & projParams = dest.getProjectionParameters();
+    key << " P";
+    for (size_t i = 0; i < projParams.size(); ++i)
+    {
+        key << " " << projParams[i];
+    };
+    key << " rect " << rect.left() << "," << rect.top() << "," << rect.right() << "," << rect.bottom();
+    if (GetAdvancedOption(advOptions, "gridRemap", false))
+    {
+        key << " grid " << GetAdvancedOption(advOptions, "gridRemapTolerance", NONA_DEFAULT_GRID_REMAP_TOLERANCE);
+    };
+    return key.str();
+}
+
+std::string GetCoordinateMapFilename(const std::string & cacheDir, const std::string & key)
+{
+    // 64 bit FNV-1a hash of the key
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < key.size(); ++i)
+    {
+        hash ^= static_cast<unsigned char>(key[i]);
+        hash *= 1099511628211ULL;
+    };
+    std::ostringstream filename;
+    filename << cacheDir;
+    if (!cacheDir.empty() && cacheDir[cacheDir.size() - 1] != '/' && cacheDir[cacheDir.size() - 1] != '\\')
+    {
+        filename << "/";
+    };
+    filename << std::hex << std::setw(16) << std::setfill('0') << hash << ".hmap";
+    return filename.str();
+}
+
+} // namespace Nona
+} // namespace HuginBase
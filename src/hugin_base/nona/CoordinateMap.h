@@ -0,0 +1,228 @@
+// -*- c-basic-offset: 4 -*-
+/** @file nona/CoordinateMap.h
+ *
+ *  Precalculated source coordinates for remapping, which can be stored
+ *  in a cache directory and reused for later stitches with the same geometry.
+ *
+ *  This is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This software is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public
+ *  License along with this software. If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _NONA_COORDINATEMAP_H
+#define _NONA_COORDINATEMAP_H
+
+#include <hugin_shared.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+
+#include <vigra/diff2d.hxx>
+#include <panodata/SrcPanoImage.h>
+#include <panodata/PanoramaOptions.h>
+#include <nona/StitcherOptions.h>
+#include <hugin_utils/utils.h>
+
+namespace HuginBase {
+namespace Nona {
+
+/** stores the source coordinates for all pixels of a rectangle in the panorama.
+ *
+ *  The coordinates are rounded to 1/256 pixel, so a freshly calculated map and
+ *  a map loaded from disc give identical results. On disc the coordinates are
+ *  delta encoded (against a linear prediction from the left neighbours) and
+ *  written as variable length integers, which needs typically 2-3 bytes
+ *  per pixel instead of 8 bytes.
+ */
+class IMPEX CoordinateMap
+{
+public:
+    CoordinateMap() {};
+
+    /** resize the map to the given rectangle, all pixels are invalid */
+    void resize(const vigra::Rect2D & rect);
+    /** returns the rectangle (in panorama coordinates) covered by the map */
+    const vigra::Rect2D & getRect() const { return m_rect; };
+
+    /** set the source coordinates of the given row, srcX, srcY and valid contain the
+     *  values for all pixels of the row. Coordinates which can't be represented
+     *  (more than 4 million pixels outside of the image) are stored as invalid */
+    void setRow(int y, const double* srcX, const double* srcY, const unsigned char* valid);
+
+    /** get the source coordinate for panorama pixel (x, y),
+     *  returns false if the pixel is invalid or outside of the map */
+    bool get(int x, int y, double & srcX, double & srcY) const
+    {
+        const int dx = x - m_rect.left();
+        const int dy = y - m_rect.top();
+        if (dx < 0 || dy < 0 || dx >= m_rect.width() || dy >= m_rect.height())
+        {
+            return false;
+        };
+        const size_t index = static_cast<size_t>(dy) * m_rect.width() + dx;
+        if (m_x[index] == InvalidCoord)
+        {
+            return false;
+        };
+        srcX = m_x[index] / static_cast<double>(CoordScale);
+        srcY = m_y[index] / static_cast<double>(CoordScale);
+        return true;
+    };
+
+    /** load the map from the given file, the key must match the key stored in the file */
+    bool load(const std::string & filename, const std::string & key);
+    /** save the map together with the key to the given file */
+    bool save(const std::string & filename, const std::string & key) const;
+
+private:
+    /** coordinates are stored as fixed point numbers with this scale */
+    static const int32_t CoordScale = 256;
+    /** marker for pixels without valid source coordinate */
+    static const int32_t InvalidCoord = INT32_MIN;
+
+    vigra::Rect2D m_rect;
+    std::vector<int32_t> m_x;
+    std::vector<int32_t> m_y;
+};
+
+/** returns a string which describes all parameters, which influence the source
+ *  coordinates of the given image in the given rectangle of the panorama */
+IMPEX std::string GetCoordinateMapKey(const SrcPanoImage & src, const PanoramaOptions & dest,
+                                      const vigra::Rect2D & rect, const AdvancedOptions & advOptions);
+
+/** returns the filename in the cache directory for the given key */
+IMPEX std::string GetCoordinateMapFilename(const std::string & cacheDir, const std::string & key);
+
+/** wrapper around a transform, which uses a precalculated coordinate map.
+ *
+ *  As long as setup() has not been called, all calls are forwarded to the
+ *  wrapped transform.
+ */
+template <class TRANSFORM>
+class CachedTransform
+{
+public:
+    /** create a cached transform for the given (initialized) transform */
+    explicit CachedTransform(const TRANSFORM & transf) : m_transf(transf), m_useMap(false) {};
+
+    /** load the coordinate map for destRect from the given file, if the file
+     *  does not exist or belongs to a different geometry the map is calculated
+     *  and saved to the file.
+     *  @return true, if the map was loaded from the cache
+     */
+    bool setup(const std::string & filename, const std::string & key, const vigra::Rect2D & destRect)
+    {
+        if (load(filename, key, destRect))
+        {
+            return true;
+        };
+        create(filename, key, destRect);
+        return false;
+    };
+
+    /** load the coordinate map for destRect from the given file
+     *  @return true, if the file exists and belongs to the same geometry
+     */
+    bool load(const std::string & filename, const std::string & key, const vigra::Rect2D & destRect)
+    {
+        if (destRect.isEmpty())
+        {
+            return false;
+        };
+        if (m_map.load(filename, key) && m_map.getRect() == destRect)
+        {
+            m_useMap = true;
+            return true;
+        };
+        return false;
+    };
+
+    /** calculate the coordinate map for destRect with the wrapped transform
+     *  and save it to the given file */
+    void create(const std::string & filename, const std::string & key, const vigra::Rect2D & destRect)
+    {
+        if (destRect.isEmpty())
+        {
+            return;
+        };
+        m_map.resize(destRect);
+        const int width = destRect.width();
+#pragma omp parallel
+        {
+            std::vector<double> xpos(width);
+            std::vector<double> ypos(width);
+            std::vector<double> sx(width);
+            std::vector<double> sy(width);
+            std::vector<unsigned char> valid(width);
+            for (int x = 0; x < width; ++x)
+            {
+                xpos[x] = destRect.left() + x;
+            };
+#pragma omp for schedule(dynamic)
+            for (int y = destRect.top(); y < destRect.bottom(); ++y)
+            {
+                std::fill(ypos.begin(), ypos.end(), y);
+                m_transf.transformImgCoords(&xpos[0], &ypos[0], &sx[0], &sy[0], &valid[0], width);
+                m_map.setRow(y, &sx[0], &sy[0], &valid[0]);
+            };
+        }
+        m_useMap = true;
+        if (!m_map.save(filename, key))
+        {
+            DEBUG_ERROR("Could not save coordinate map to " << filename);
+        };
+    };
+
+    /** like TRANSFORM::transformImgCoord, but uses the coordinate map for
+     *  integer positions inside the map */
+    bool transformImgCoord(double & x_dest, double & y_dest, double x_src, double y_src) const
+    {
+        if (m_useMap)
+        {
+            const int x = static_cast<int>(x_src);
+            const int y = static_cast<int>(y_src);
+            if (x == x_src && y == y_src && m_map.getRect().contains(vigra::Point2D(x, y)))
+            {
+                return m_map.get(x, y, x_dest, y_dest);
+            };
+        };
+        return m_transf.transformImgCoord(x_dest, y_dest, x_src, y_src);
+    };
+
+    /** transform n points at once, see transformImgCoord */
+    void transformImgCoords(const double* x, const double* y, double* x_dest, double* y_dest,
+                            unsigned char* valid, size_t n) const
+    {
+        if (!m_useMap)
+        {
+            m_transf.transformImgCoords(x, y, x_dest, y_dest, valid, n);
+            return;
+        };
+        for (size_t i = 0; i < n; ++i)
+        {
+            valid[i] = transformImgCoord(x_dest[i], y_dest[i], x[i], y[i]) ? 1 : 0;
+        };
+    };
+
+private:
+    const TRANSFORM & m_transf;
+    CoordinateMap m_map;
+    bool m_useMap;
+};
+
+} // namespace
+} // namespace
+
+#endif // _NONA_COORDINATEMAP_H
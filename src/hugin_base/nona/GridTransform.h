@@ -0,0 +1,272 @@
+// -*- c-basic-offset: 4 -*-
+/** @file nona/GridTransform.h
+ *
+ *  Approximates a coordinate transform by bilinear interpolation on
+ *  an adaptively refined grid.
+ *
+ *  This is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This software is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public
+ *  License along with this software. If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _NONA_GRIDTRANSFORM_H
+#define _NONA_GRIDTRANSFORM_H
+
+#include <vector>
+#include <algorithm>
+
+#include <vigra/diff2d.hxx>
+#include <hugin_math/hugin_math.h>
+
+// default value for the maximal error of the grid remapping (in pixel)
+#define NONA_DEFAULT_GRID_REMAP_TOLERANCE 0.05f
+
+namespace HuginBase {
+namespace Nona {
+
+/** wrapper around a transform, which evaluates the exact transform only
+ *  on a coarse grid and interpolates the source coordinates in between.
+ *
+ *  The destination rectangle is divided into blocks of blockSize x blockSize
+ *  pixels. For each block the grid spacing is halved until the bilinear
+ *  interpolation of the coarser grid matches the exact transform at all
+ *  nodes of the finer grid within the given tolerance (in source pixels).
+ *  The finer grid is then used for the interpolation. Blocks, in which the
+ *  transformation is not continuous (e.g. at the 360 degree seam) or not
+ *  defined for all grid nodes, fall back to the exact transform.
+ *
+ *  As long as build() has not been called, all calls are forwarded to the
+ *  wrapped transform.
+ */
+template <class TRANSFORM>
+class GridTransform
+{
+public:
+    /** create a grid transform for the given (initialized) transform */
+    explicit GridTransform(const TRANSFORM & transf)
+        : m_transf(transf), m_blockShift(0), m_nBlocksX(0), m_nBlocksY(0)
+    {
+    };
+
+    /** precalculate the grid for all pixels in destRect
+     *  @param destRect rectangle in destination (panorama) coordinates,
+     *                  for which the grid is calculated
+     *  @param tolerance maximal allowed deviation from the exact transform
+     *                   in source image pixels
+     *  @param blockShift log2 of the block size (and initial grid spacing)
+     */
+    void build(const vigra::Rect2D & destRect, double tolerance, int blockShift = 6)
+    {
+        m_blocks.clear();
+        m_destRect = destRect;
+        m_blockShift = blockShift;
+        if (destRect.isEmpty() || tolerance <= 0)
+        {
+            m_nBlocksX = 0;
+            m_nBlocksY = 0;
+            return;
+        };
+        const int blockSize = 1 << m_blockShift;
+        m_nBlocksX = (destRect.width() + blockSize - 1) >> m_blockShift;
+        m_nBlocksY = (destRect.height() + blockSize - 1) >> m_blockShift;
+        m_blocks.resize(m_nBlocksX * m_nBlocksY);
+        const double tolerance2 = tolerance * tolerance;
+#pragma omp parallel for schedule(dynamic)
+        for (int i = 0; i < m_nBlocksX * m_nBlocksY; ++i)
+        {
+            const vigra::Point2D ul(destRect.left() + (i % m_nBlocksX) * blockSize,
+                                    destRect.top() + (i / m_nBlocksX) * blockSize);
+            buildBlock(m_blocks[i], ul, tolerance2);
+        };
+    };
+
+    /** returns the share of blocks, which could be interpolated */
+    double getInterpolatedRatio() const
+    {
+        if (m_blocks.empty())
+        {
+            return 0;
+        };
+        size_t nrInterpolated = 0;
+        for (size_t i = 0; i < m_blocks.size(); ++i)
+        {
+            if (m_blocks[i].step > 0)
+            {
+                ++nrInterpolated;
+            };
+        };
+        return static_cast<double>(nrInterpolated) / m_blocks.size();
+    };
+
+    /** like TRANSFORM::transformImgCoord, but uses the interpolated grid
+     *  if possible */
+    bool transformImgCoord(double & x_dest, double & y_dest, double x_src, double y_src) const
+    {
+        if (!m_blocks.empty())
+        {
+            const double dx = x_src - m_destRect.left();
+            const double dy = y_src - m_destRect.top();
+            if (dx >= 0 && dy >= 0)
+            {
+                const int ix = static_cast<int>(dx);
+                const int iy = static_cast<int>(dy);
+                const int bx = ix >> m_blockShift;
+                const int by = iy >> m_blockShift;
+                if (bx < m_nBlocksX && by < m_nBlocksY)
+                {
+                    const GridBlock & block = m_blocks[by * m_nBlocksX + bx];
+                    if (block.step > 0)
+                    {
+                        // position inside block in units of the grid spacing
+                        const double fx = (dx - (bx << m_blockShift)) / block.step;
+                        const double fy = (dy - (by << m_blockShift)) / block.step;
+                        const int cx = std::min(static_cast<int>(fx), block.nodes - 2);
+                        const int cy = std::min(static_cast<int>(fy), block.nodes - 2);
+                        const double wx = fx - cx;
+                        const double wy = fy - cy;
+                        const hugin_utils::FDiff2D * p = &block.coords[cy * block.nodes + cx];
+                        const hugin_utils::FDiff2D & p00 = p[0];
+                        const hugin_utils::FDiff2D & p10 = p[1];
+                        const hugin_utils::FDiff2D & p01 = p[block.nodes];
+                        const hugin_utils::FDiff2D & p11 = p[block.nodes + 1];
+                        x_dest = (1 - wy) * ((1 - wx) * p00.x + wx * p10.x) + wy * ((1 - wx) * p01.x + wx * p11.x);
+                        y_dest = (1 - wy) * ((1 - wx) * p00.y + wx * p10.y) + wy * ((1 - wx) * p01.y + wx * p11.y);
+                        return true;
+                    };
+                };
+            };
+        };
+        return m_transf.transformImgCoord(x_dest, y_dest, x_src, y_src);
+    };
+
+    /** transform n points at once, see transformImgCoord */
+    void transformImgCoords(const double* x, const double* y, double* x_dest, double* y_dest,
+                            unsigned char* valid, size_t n) const
+    {
+        if (m_blocks.empty())
+        {
+            m_transf.transformImgCoords(x, y, x_dest, y_dest, valid, n);
+            return;
+        };
+        for (size_t i = 0; i < n; ++i)
+        {
+            valid[i] = transformImgCoord(x_dest[i], y_dest[i], x[i], y[i]) ? 1 : 0;
+        };
+    };
+
+private:
+    /** grid data for a single block, step==0 means use exact transform */
+    struct GridBlock
+    {
+        GridBlock() : step(0), nodes(0) {};
+        int step;
+        int nodes;
+        std::vector<hugin_utils::FDiff2D> coords;
+    };
+
+    /** sample the exact transform on a grid with the given spacing,
+     *  returns false if the transform failed for a grid node */
+    bool sampleGrid(const vigra::Point2D & ul, int step, std::vector<hugin_utils::FDiff2D> & coords) const
+    {
+        const int nodes = (1 << m_blockShift) / step + 1;
+        coords.resize(nodes * nodes);
+        for (int y = 0; y < nodes; ++y)
+        {
+            for (int x = 0; x < nodes; ++x)
+            {
+                hugin_utils::FDiff2D & p = coords[y * nodes + x];
+                if (!m_transf.transformImgCoord(p.x, p.y, ul.x + x * step, ul.y + y * step))
+                {
+                    return false;
+                };
+            };
+        };
+        return true;
+    };
+
+    /** check if the bilinear interpolation of the coarse grid reproduces all nodes
+     *  of the fine grid, which has half of the spacing */
+    static bool checkGrid(const std::vector<hugin_utils::FDiff2D> & coarse, const std::vector<hugin_utils::FDiff2D> & fine,
+                          int fineNodes, double tolerance2)
+    {
+        const int coarseNodes = (fineNodes - 1) / 2 + 1;
+        for (int y = 0; y < fineNodes; ++y)
+        {
+            const int cy0 = y / 2;
+            const int cy1 = (y + 1) / 2;
+            for (int x = 0; x < fineNodes; ++x)
+            {
+                if (x % 2 == 0 && y % 2 == 0)
+                {
+                    // node is contained in both grids
+                    continue;
+                };
+                const int cx0 = x / 2;
+                const int cx1 = (x + 1) / 2;
+                const hugin_utils::FDiff2D interpolated = (coarse[cy0 * coarseNodes + cx0] + coarse[cy0 * coarseNodes + cx1] +
+                    coarse[cy1 * coarseNodes + cx0] + coarse[cy1 * coarseNodes + cx1]) * 0.25;
+                if (interpolated.squareDistance(fine[y * fineNodes + x]) > tolerance2)
+                {
+                    return false;
+                };
+            };
+        };
+        return true;
+    };
+
+    /** find the coarsest grid spacing for the block, which fulfills the tolerance */
+    void buildBlock(GridBlock & block, const vigra::Point2D & ul, double tolerance2) const
+    {
+        int step = 1 << m_blockShift;
+        std::vector<hugin_utils::FDiff2D> coarse;
+        std::vector<hugin_utils::FDiff2D> fine;
+        if (!sampleGrid(ul, step, coarse))
+        {
+            return;
+        };
+        // stop refining at a spacing of 2 pixels, finer grids are more expensive
+        // than the exact transform
+        while (step > 2)
+        {
+            if (!sampleGrid(ul, step / 2, fine))
+            {
+                return;
+            };
+            const int fineNodes = (1 << m_blockShift) / (step / 2) + 1;
+            if (checkGrid(coarse, fine, fineNodes, tolerance2))
+            {
+                // the fine grid is already calculated, so use it
+                // this gives an additional safety margin for the interpolation error
+                block.step = step / 2;
+                block.nodes = fineNodes;
+                block.coords.swap(fine);
+                return;
+            };
+            coarse.swap(fine);
+            step /= 2;
+        };
+    };
+
+    const TRANSFORM & m_transf;
+    vigra::Rect2D m_destRect;
+    int m_blockShift;
+    int m_nBlocksX;
+    int m_nBlocksY;
+    std::vector<GridBlock> m_blocks;
+};
+
+} // namespace
+} // namespace
+
+#endif // _NONA_GRIDTRANSFORM_H
@@ -28,9 +28,18 @@
 #define _NONA_IMAGEREMAPPER_H
 
 
+#include <map>
+#include <memory>
+#include <mutex>
 #include <panodata/PanoramaData.h>
 #include <nona/RemappedPanoImage.h>
 #include <vigra_ext/impexalpha.hxx>
+#include <vigra_ext/tiffUtils.h>
+
+// default size of the strip cache for streamed source images (in MB)
+#define NONA_DEFAULT_STREAM_CACHE_SIZE 64.0f
+// default size of the source image cache of the tiled stitcher (in MB)
+#define NONA_DEFAULT_TILE_CACHE_SIZE 1024.0f
 
 namespace HuginBase {
 namespace Nona {
@@ -64,6 +73,26 @@ namespace Nona {
 
             ///
             virtual	void release(RemappedPanoImage<ImageType,AlphaType>* d) = 0;
+
+            /** returns true, if getRemapped and release can be called
+             *  concurrently from several threads */
+            virtual bool isThreadSafe() const
+            {
+                return false;
+            };
+
+            /** prepare for images, which are remapped in several parts (e.g. by the
+             *  tiled stitcher): TIFF files are read row by row, so only the rows needed
+             *  for the part are loaded, other images are kept in memory after they have
+             *  been remapped, up to maxSize bytes. The least recently used images are
+             *  dropped first. maxSize 0 disables it and frees all cached images.
+             *  The default implementation ignores it. */
+            virtual void setSourceImageCache(double maxSize)
+            {};
+
+            /** free the cached source image of the given image */
+            virtual void releaseSourceImage(unsigned int imgNr)
+            {};
         protected:
             HuginBase::Nona::AdvancedOptions m_advancedOptions;
         
@@ -76,9 +105,8 @@ namespace Nona {
     {
         
     public:
-        FileRemapper() : SingleImageRemapper<ImageType, AlphaType>()
+        FileRemapper() : SingleImageRemapper<ImageType, AlphaType>(), m_maxCacheSize(0), m_cacheSize(0), m_cacheCounter(0)
         {
-            m_remapped = 0;
         }
 
         virtual ~FileRemapper() {};
@@ -103,10 +131,91 @@ namespace Nona {
         virtual void release(RemappedPanoImage<ImageType,AlphaType>* d)
             { delete d; }
 
+        /** each call loads its own copy of the image, so several images
+         *  can be remapped in parallel */
+        virtual bool isThreadSafe() const
+            { return true; }
+
+        ///
+        virtual void setSourceImageCache(double maxSize)
+        {
+            std::lock_guard<std::mutex> lock(m_cacheMutex);
+            m_maxCacheSize = maxSize;
+            shrinkSourceCache(maxSize);
+        };
+
+        ///
+        virtual void releaseSourceImage(unsigned int imgNr)
+        {
+            std::lock_guard<std::mutex> lock(m_cacheMutex);
+            eraseCachedImage(imgNr);
+        };
 
     protected:
-        RemappedPanoImage<ImageType,AlphaType> * m_remapped;
+        /** loaded source image with everything needed for remapping it */
+        struct SourceImage
+        {
+            ImageType image;
+            AlphaType alpha;
+            vigra::BasicImage<float> flatfield;
+            vigra::ImageImportInfo::ICCProfile iccProfile;
+        };
+        typedef std::shared_ptr<SourceImage> SourceImagePtr;
+
+        /** load the image, its alpha channel and the flatfield image,
+         *  the image is scaled to the range of ImageType */
+        SourceImagePtr loadSourceImage(const SrcPanoImage & img, const vigra::ImageImportInfo & info,
+                                       AppBase::ProgressDisplay* progress);
+
+        /** removes the image from the cache, m_cacheMutex has to be locked */
+        void eraseCachedImage(unsigned int imgNr)
+        {
+            typename std::map<unsigned int, CacheEntry>::iterator it = m_sourceCache.find(imgNr);
+            if (it != m_sourceCache.end())
+            {
+                m_cacheSize -= it->second.size;
+                m_sourceCache.erase(it);
+            };
+        };
+
+        /** drops the least recently used images from the cache, until it is not
+         *  larger than maxSize, m_cacheMutex has to be locked */
+        void shrinkSourceCache(double maxSize)
+        {
+            while (m_cacheSize > maxSize && !m_sourceCache.empty())
+            {
+                typename std::map<unsigned int, CacheEntry>::iterator oldest = m_sourceCache.begin();
+                for (typename std::map<unsigned int, CacheEntry>::iterator it = m_sourceCache.begin(); it != m_sourceCache.end(); ++it)
+                {
+                    if (it->second.lastUse < oldest->second.lastUse)
+                    {
+                        oldest = it;
+                    };
+                };
+                m_cacheSize -= oldest->second.size;
+                m_sourceCache.erase(oldest);
+            };
+            if (m_sourceCache.empty())
+            {
+                m_cacheSize = 0;
+            };
+        };
 
+        /** cached source image */
+        struct CacheEntry
+        {
+            SourceImagePtr image;
+            /** memory used by the image in bytes */
+            double size;
+            /** value of m_cacheCounter, when the image was used the last time */
+            unsigned long lastUse;
+        };
+
+        double m_maxCacheSize;
+        double m_cacheSize;
+        unsigned long m_cacheCounter;
+        std::map<unsigned int, CacheEntry> m_sourceCache;
+        std::mutex m_cacheMutex;
     };
 
 
@@ -151,47 +260,114 @@ RemappedPanoImage<ImageType, AlphaType>*
 {
     typedef typename ImageType::value_type PixelType;
     
-    //typedef typename vigra::NumericTraits<PixelType>::RealPromote RPixelType;
-    //        typedef typename vigra::BasicImage<RPixelType> RImportImageType;
-    typedef typename vigra::BasicImage<float> FlatImgType;
-    
-    FlatImgType ffImg;
-    AlphaType srcAlpha;
-    
     // choose image type...
     const SrcPanoImage & img = pano.getImage(imgNr);
     
-    vigra::Size2D destSize(opts.getWidth(), opts.getHeight());
-    
-    m_remapped = new RemappedPanoImage<ImageType, AlphaType>;
+    RemappedPanoImage<ImageType, AlphaType>* remapped = new RemappedPanoImage<ImageType, AlphaType>;
     
-    // load image
+    // use the cached image, if it was already loaded
+    SourceImagePtr source;
+    {
+        std::lock_guard<std::mutex> lock(m_cacheMutex);
+        typename std::map<unsigned int, CacheEntry>::iterator it = m_sourceCache.find(imgNr);
+        if (it != m_sourceCache.end())
+        {
+            source = it->second.image;
+            it->second.lastUse = ++m_cacheCounter;
+        };
+    }
+
+    if (!source)
+    {
+        // load image
+        vigra::ImageImportInfo info(img.getFilename().c_str());
+
+        // read only the needed rows of TIFF files, if requested or if the image is remapped in several parts
+        // masks and crops need the full image, so fall back to importing the whole image
+        bool remappedInParts;
+        {
+            std::lock_guard<std::mutex> lock(m_cacheMutex);
+            remappedInParts = m_maxCacheSize > 0;
+        }
+        if ((remappedInParts || GetAdvancedOption(SingleImageRemapper<ImageType, AlphaType>::m_advancedOptions, "streamSourceImages", false)) &&
+            std::string(info.getFileType()) == "TIFF" && !img.hasActiveMasks() && img.getCropMode() == SrcPanoImage::NO_CROP &&
+            !(img.getVigCorrMode() & SrcPanoImage::VIGCORR_FLATFIELD) &&
+            !GetAdvancedOption(SingleImageRemapper<ImageType, AlphaType>::m_advancedOptions, "maskClipExposure", false))
+        {
+            const double maxv = vigra_ext::getMaxValForPixelType(info.getPixelType());
+            const double scale = ((double)vigra_ext::LUTTraits<PixelType>::max()) / maxv;
+            const double cacheSize = GetAdvancedOption(SingleImageRemapper<ImageType, AlphaType>::m_advancedOptions,
+                "streamCacheSize", NONA_DEFAULT_STREAM_CACHE_SIZE) * 1024.0 * 1024.0;
+            vigra_ext::TiffRowReader<PixelType, typename AlphaType::value_type> reader;
+            if (reader.open(img.getFilename(), scale, cacheSize))
+            {
+                remapped->m_ICCProfile = info.getICCProfile();
+                remapped->setAdvancedOptions(SingleImageRemapper<ImageType, AlphaType>::m_advancedOptions);
+                remapped->setPanoImage(pano.getSrcImage(imgNr), opts, outputROI);
+                remapped->remapImageStreamed(reader, opts.interpolator, progress);
+                return remapped;
+            };
+        };
+
+        source = loadSourceImage(img, info, progress);
+        std::lock_guard<std::mutex> lock(m_cacheMutex);
+        const double size = static_cast<double>(source->image.width()) * source->image.height() * sizeof(PixelType) +
+            static_cast<double>(source->alpha.width()) * source->alpha.height() * sizeof(typename AlphaType::value_type) +
+            static_cast<double>(source->flatfield.width()) * source->flatfield.height() * sizeof(float);
+        // images larger than the cache are not kept
+        if (m_maxCacheSize > 0 && size <= m_maxCacheSize)
+        {
+            eraseCachedImage(imgNr);
+            shrinkSourceCache(m_maxCacheSize - size);
+            CacheEntry entry;
+            entry.image = source;
+            entry.size = size;
+            entry.lastUse = ++m_cacheCounter;
+            m_sourceCache[imgNr] = entry;
+            m_cacheSize += size;
+        };
+    };
+
+    remapped->m_ICCProfile = source->iccProfile;
+    remapped->setAdvancedOptions(SingleImageRemapper<ImageType, AlphaType>::m_advancedOptions);
+    // remap the image
     
-    vigra::ImageImportInfo info(img.getFilename().c_str());
+    remapImage(source->image, source->alpha, source->flatfield,
+               pano.getSrcImage(imgNr), opts,
+               outputROI,
+               *remapped,
+               progress);
+    return remapped;
+}
+
+template <typename ImageType, typename AlphaType>
+typename FileRemapper<ImageType, AlphaType>::SourceImagePtr
+    FileRemapper<ImageType, AlphaType>::loadSourceImage(const SrcPanoImage & img, const vigra::ImageImportInfo & info,
+                                                        AppBase::ProgressDisplay* progress)
+{
+    typedef typename ImageType::value_type PixelType;
 
+    SourceImagePtr source(new SourceImage);
     int width = info.width();
     int height = info.height();
 
-    ImageType srcImg(width, height);
-    m_remapped->m_ICCProfile = info.getICCProfile();
+    source->image.resize(width, height);
+    source->iccProfile = info.getICCProfile();
     
     if (info.numExtraBands() > 0) {
-        srcAlpha.resize(width, height);
+        source->alpha.resize(width, height);
     }
     //int nb = info.numBands() - info.numExtraBands();
     bool alpha = info.numExtraBands() > 0;
-    std::string type = info.getPixelType();
-    
-    SrcPanoImage src = pano.getSrcImage(imgNr);
     
     // import the image
     progress->setMessage("loading", hugin_utils::stripPath(img.getFilename()));
     
     if (alpha) {
-        vigra::importImageAlpha(info, vigra::destImage(srcImg),
-                                vigra::destImage(srcAlpha));
+        vigra::importImageAlpha(info, vigra::destImage(source->image),
+                                vigra::destImage(source->alpha));
     } else {
-        vigra::importImage(info, vigra::destImage(srcImg));
+        vigra::importImage(info, vigra::destImage(source->image));
     }
     // check if the image needs to be scaled to 0 .. 1,
     // this only works for int -> float, since the image
@@ -200,7 +376,7 @@ RemappedPanoImage<ImageType, AlphaType>*
     if (maxv != vigra_ext::LUTTraits<PixelType>::max()) {
         double scale = ((double)vigra_ext::LUTTraits<PixelType>::max()) /  maxv;
         //std::cout << "Scaling input image (pixel type: " << info.getPixelType() << " with: " << scale << std::endl;
-        transformImage(vigra::srcImageRange(srcImg), destImage(srcImg),
+        transformImage(vigra::srcImageRange(source->image), destImage(source->image),
                        vigra::functor::Arg1()*vigra::functor::Param(scale));
     }
     
@@ -212,18 +388,10 @@ RemappedPanoImage<ImageType, AlphaType>*
         vigra_precondition(( ffInfo.numBands() == 1),
                            "flatfield vignetting correction: "
                            "Only single channel flatfield images are supported\n");
-        ffImg.resize(ffInfo.width(), ffInfo.height());
-        vigra::importImage(ffInfo, vigra::destImage(ffImg));
+        source->flatfield.resize(ffInfo.width(), ffInfo.height());
+        vigra::importImage(ffInfo, vigra::destImage(source->flatfield));
     }
-    m_remapped->setAdvancedOptions(SingleImageRemapper<ImageType, AlphaType>::m_advancedOptions);
-    // remap the image
-    
-    remapImage(srcImg, srcAlpha, ffImg,
-               pano.getSrcImage(imgNr), opts,
-               outputROI,
-               *m_remapped,
-               progress);
-    return m_remapped;
+    return source;
 }
 
 
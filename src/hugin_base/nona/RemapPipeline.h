@@ -0,0 +1,276 @@
+// -*- c-basic-offset: 4 -*-
+/** @file nona/RemapPipeline.h
+ *
+ *  Remaps several images concurrently and hands them over in a fixed order.
+ *
+ *  This is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This software is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public
+ *  License along with this software. If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _NONA_REMAPPIPELINE_H
+#define _NONA_REMAPPIPELINE_H
+
+#include <hugin_config.h>
+
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <exception>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#ifdef HAVE_OPENMP
+#include <omp.h>
+#endif
+
+#include <nona/RemappedPanoImage.h>
+
+namespace HuginBase {
+namespace Nona {
+
+/** remaps images with a pool of worker threads, while a single consumer
+ *  (e.g. the stitcher, which merges the images into the panorama) gets
+ *  the remapped images in the order of their index.
+ *
+ *  The images are started in the order of their index. A new image is only
+ *  started if less than maxInFlight images are remapped or waiting for the
+ *  consumer and if the estimated memory usage of these images stays below
+ *  the memory limit. If no image is in flight the next image is always
+ *  started, even if its estimate exceeds the limit.
+ *
+ *  Usage: call next() to get the next image and merge it. The image is given
+ *  back to the pipeline, when the returned pointer goes out of scope, this
+ *  needs to happen before next() is called again.
+ */
+template <typename ImageType, typename AlphaType>
+class RemapPipeline
+{
+public:
+    typedef RemappedPanoImage<ImageType, AlphaType> RemappedImage;
+    /** function to remap the image with the given index */
+    typedef std::function<RemappedImage*(size_t)> RemapFunction;
+    /** function to free a remapped image */
+    typedef std::function<void(RemappedImage*)> ReleaseFunction;
+
+    /** gives the image back to the pipeline */
+    class Releaser
+    {
+    public:
+        explicit Releaser(RemapPipeline* pipeline = NULL) : m_pipeline(pipeline) {};
+        void operator()(RemappedImage* image) const
+        {
+            m_pipeline->release(image);
+        };
+    private:
+        RemapPipeline* m_pipeline;
+    };
+    /** remapped image, which is released automatically, also when the merging throws */
+    typedef std::unique_ptr<RemappedImage, Releaser> ImagePtr;
+
+    /** starts the worker threads
+     *  @param remap function to remap a single image, is called from the worker threads
+     *  @param release function to free a remapped image
+     *  @param memoryUsage estimated memory usage for each image in bytes
+     *  @param nrThreads number of worker threads
+     *  @param maxInFlight maximal number of images which are remapped or waiting for the consumer
+     *  @param memoryLimit maximal memory usage of all images in flight in bytes, 0 for no limit
+     */
+    RemapPipeline(const RemapFunction& remap, const ReleaseFunction& release,
+                  const std::vector<double>& memoryUsage, unsigned int nrThreads,
+                  unsigned int maxInFlight, double memoryLimit)
+        : m_remap(remap), m_release(release), m_memoryUsage(memoryUsage),
+          m_slots(memoryUsage.size()), m_nextJob(0), m_nextResult(0), m_current(0),
+          m_inFlight(0), m_usedMemory(0), m_maxInFlight(std::max(1u, maxInFlight)),
+          m_memoryLimit(memoryLimit), m_abort(false)
+    {
+        nrThreads = std::max(1u, std::min(nrThreads, m_maxInFlight));
+#ifdef HAVE_OPENMP
+        // share the cores between the workers, each remapping is itself parallelized
+        m_ompThreads = std::max(1, omp_get_max_threads() / static_cast<int>(nrThreads));
+#else
+        m_ompThreads = 1;
+#endif
+        for (unsigned int i = 0; i < nrThreads; ++i)
+        {
+            m_threads.push_back(std::thread(&RemapPipeline::worker, this));
+        };
+    };
+
+    /** stops the worker threads and frees all images which were not consumed */
+    ~RemapPipeline()
+    {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_abort = true;
+        }
+        m_condition.notify_all();
+        for (size_t i = 0; i < m_threads.size(); ++i)
+        {
+            m_threads[i].join();
+        };
+        for (size_t i = m_nextResult; i < m_slots.size(); ++i)
+        {
+            if (m_slots[i].image != NULL)
+            {
+                m_release(m_slots[i].image);
+            };
+        };
+    };
+
+    /** returns true, if all images have been consumed */
+    bool empty() const
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        return m_nextResult >= m_slots.size();
+    };
+
+    /** returns the next remapped image, waits until it is available.
+     *  Exceptions thrown by the remap function are rethrown here.
+     *  @param index index of the returned image
+     */
+    ImagePtr next(size_t& index)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (m_nextResult >= m_slots.size())
+        {
+            return ImagePtr(NULL, Releaser(this));
+        };
+        Slot& slot = m_slots[m_nextResult];
+        m_condition.wait(lock, [&slot] { return slot.finished; });
+        index = m_nextResult;
+        m_current = m_nextResult;
+        ++m_nextResult;
+        if (slot.error)
+        {
+            freeReservation(m_current);
+            lock.unlock();
+            m_condition.notify_all();
+            std::rethrow_exception(slot.error);
+        };
+        ImagePtr image(slot.image, Releaser(this));
+        slot.image = NULL;
+        return image;
+    };
+
+private:
+    /** frees the image returned by the last call of next(), so the memory
+     *  can be used for the next images */
+    void release(RemappedImage* image)
+    {
+        m_release(image);
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            freeReservation(m_current);
+        }
+        m_condition.notify_all();
+    };
+
+    /** state of a single image */
+    struct Slot
+    {
+        Slot() : image(NULL), finished(false) {};
+        RemappedImage* image;
+        std::exception_ptr error;
+        bool finished;
+    };
+
+    /** check if the image with the given index can be started, m_mutex must be locked */
+    bool canStart(size_t index) const
+    {
+        if (m_inFlight == 0)
+        {
+            return true;
+        };
+        if (m_inFlight >= m_maxInFlight)
+        {
+            return false;
+        };
+        return m_memoryLimit <= 0 || m_usedMemory + m_memoryUsage[index] <= m_memoryLimit;
+    };
+
+    /** free the memory reservation of the given image, m_mutex must be locked */
+    void freeReservation(size_t index)
+    {
+        --m_inFlight;
+        m_usedMemory -= m_memoryUsage[index];
+    };
+
+    /** worker thread, remaps the images one after the other */
+    void worker()
+    {
+#ifdef HAVE_OPENMP
+        omp_set_num_threads(m_ompThreads);
+#endif
+        for (;;)
+        {
+            size_t index;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_condition.wait(lock, [this] { return m_abort || m_nextJob >= m_slots.size() || canStart(m_nextJob); });
+                if (m_abort || m_nextJob >= m_slots.size())
+                {
+                    return;
+                };
+                index = m_nextJob++;
+                ++m_inFlight;
+                m_usedMemory += m_memoryUsage[index];
+            }
+            RemappedImage* image = NULL;
+            std::exception_ptr error;
+            try
+            {
+                image = m_remap(index);
+            }
+            catch (...)
+            {
+                error = std::current_exception();
+            };
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_slots[index].image = image;
+                m_slots[index].error = error;
+                m_slots[index].finished = true;
+            }
+            m_condition.notify_all();
+        };
+    };
+
+    RemapFunction m_remap;
+    ReleaseFunction m_release;
+    std::vector<double> m_memoryUsage;
+    std::vector<Slot> m_slots;
+    size_t m_nextJob;
+    size_t m_nextResult;
+    size_t m_current;
+    unsigned int m_inFlight;
+    double m_usedMemory;
+    unsigned int m_maxInFlight;
+    double m_memoryLimit;
+    bool m_abort;
+    int m_ompThreads;
+    std::vector<std::thread> m_threads;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_condition;
+
+    RemapPipeline(const RemapPipeline&);
+    RemapPipeline& operator=(const RemapPipeline&);
+};
+
+} // namespace
+} // namespace
+
+#endif // _NONA_REMAPPIPELINE_H
@@ -35,6 +35,8 @@
 
 #include <appbase/ProgressDisplay.h>
 #include <nona/StitcherOptions.h>
+#include <nona/GridTransform.h>
+#include <nona/CoordinateMap.h>
 
 #include <panodata/SrcPanoImage.h>
 #include <panodata/Mask.h>
@@ -149,6 +151,18 @@ class RemappedPanoImage : public vigra_ext::ROIImage<RemapImage, AlphaImage>
                         std::pair<AlphaIter, AlphaAccessor> alphaImg,
                         vigra_ext::Interpolator interp,
                         AppBase::ProgressDisplay* progress, bool singleThreaded = false);
+
+        /** remap an image, which is read row by row by the given reader
+         *  (e.g. vigra_ext::TiffRowReader).
+         *
+         *  The output is remapped in blocks of rows, for each block only the
+         *  needed source rows are requested from the reader. Masks and crops
+         *  are not supported, setPanoImage() has to be called before.
+         */
+        template <class RowReader>
+        void remapImageStreamed(RowReader & reader,
+                                vigra_ext::Interpolator interp,
+                                AppBase::ProgressDisplay* progress);
         
         
     public:
@@ -156,6 +170,14 @@ class RemappedPanoImage : public vigra_ext::ROIImage<RemapImage, AlphaImage>
         vigra::ImageImportInfo::ICCProfile m_ICCProfile;
 
     protected:
+        /** load the coordinate map for the current bounding box, if a cache
+         *  directory was given in the advanced options. Otherwise initialize the
+         *  grid transform, if grid remapping was requested, and calculate and
+         *  save the coordinate map, if a cache directory was given.
+         *  cachedTransf has to wrap gridTransf. */
+        void setupTransform(GridTransform<PTools::Transform> & gridTransf,
+                            CachedTransform<GridTransform<PTools::Transform> > & cachedTransf) const;
+
         SrcPanoImage m_srcImg;
         PanoramaOptions m_destImg;
         PTools::Transform m_transf;
@@ -189,6 +211,7 @@ void remapImage(SrcImgType & srcImg,
 
 #include <photometric/ResponseTransform.h>
 #include <vigra_ext/ImageTransforms.h>
+#include <hugin_utils/openmp_lock.h>
 
 // #define DEBUG_REMAP 1
 
@@ -315,6 +338,36 @@ void RemappedPanoImage<RemapImage,AlphaImage>::setPanoImage(const HuginBase::Pan
 #endif
 
 
+template <class RemapImage, class AlphaImage>
+void RemappedPanoImage<RemapImage,AlphaImage>::setupTransform(GridTransform<PTools::Transform> & gridTransf,
+                                                              CachedTransform<GridTransform<PTools::Transform> > & cachedTransf) const
+{
+    const std::string cacheDir = Nona::GetAdvancedOption(m_advancedOptions, "remapCacheDir", std::string());
+    std::string key;
+    std::string filename;
+    if (!cacheDir.empty())
+    {
+        key = GetCoordinateMapKey(m_srcImg, m_destImg, Base::boundingBox(), m_advancedOptions);
+        filename = GetCoordinateMapFilename(cacheDir, key);
+        if (cachedTransf.load(filename, key, Base::boundingBox()))
+        {
+            // the grid is not needed, all coordinates are in the map
+            DEBUG_DEBUG("using cached coordinates from " << filename);
+            return;
+        };
+    };
+    if (Nona::GetAdvancedOption(m_advancedOptions, "gridRemap", false))
+    {
+        const float tolerance = Nona::GetAdvancedOption(m_advancedOptions, "gridRemapTolerance", NONA_DEFAULT_GRID_REMAP_TOLERANCE);
+        gridTransf.build(Base::boundingBox(), tolerance);
+        DEBUG_DEBUG("grid remapping: " << 100.0 * gridTransf.getInterpolatedRatio() << "% of blocks interpolated");
+    };
+    if (!cacheDir.empty())
+    {
+        cachedTransf.create(filename, key, Base::boundingBox());
+    };
+}
+
 /** calculate distance map. pixels contain distance from image center
  *
  *  setPanoImage() has to be called before!
@@ -379,21 +432,35 @@ void RemappedPanoImage<RemapImage,AlphaImage>::calcAlpha()
     int ystart = Base::boundingBox().top();
     int yend   = Base::boundingBox().bottom();
 
+    // x coordinates are the same for all rows
+    const int width = xend - xstart;
+    std::vector<double> xpos(width);
+    for (int x = 0; x < width; ++x)
+    {
+        xpos[x] = xstart + x;
+    }
+
     // loop over the image and transform
-#pragma omp parallel for schedule(dynamic, 10)
-    for(int y=ystart; y < yend; ++y)
+#pragma omp parallel
     {
-        // create dist y iterator
-        typename AlphaImage::Iterator yalpha(Base::m_mask.upperLeft());
-        yalpha.y += y - ystart;
-        // create x iterators
-        typename AlphaImage::Iterator xalpha(yalpha);
-        for(int x=xstart; x < xend; ++x, ++xalpha.x)
+        // buffers for the transformation of a complete row
+        std::vector<double> ypos(width);
+        std::vector<double> sxpos(width);
+        std::vector<double> sypos(width);
+        std::vector<unsigned char> valid(width);
+#pragma omp for schedule(dynamic, 10)
+        for(int y=ystart; y < yend; ++y)
         {
-            double sx,sy;
-            if(m_transf.transformImgCoord(sx,sy,x,y))
+            std::fill(ypos.begin(), ypos.end(), y);
+            m_transf.transformImgCoords(&xpos[0], &ypos[0], &sxpos[0], &sypos[0], &valid[0], width);
+            // create dist y iterator
+            typename AlphaImage::Iterator yalpha(Base::m_mask.upperLeft());
+            yalpha.y += y - ystart;
+            // create x iterators
+            typename AlphaImage::Iterator xalpha(yalpha);
+            for(int x=0; x < width; ++x, ++xalpha.x)
             {
-                if (m_srcImg.isInside(vigra::Point2D(hugin_utils::roundi(sx),hugin_utils::roundi(sy))))
+                if (valid[x] && m_srcImg.isInside(vigra::Point2D(hugin_utils::roundi(sxpos[x]), hugin_utils::roundi(sypos[x]))))
                 {
                     *xalpha = 255;
                 }
@@ -402,10 +469,6 @@ void RemappedPanoImage<RemapImage,AlphaImage>::calcAlpha()
                     *xalpha = 0;
                 };
             }
-            else
-            {
-                *xalpha = 0;
-            };
         }
     }
 }
@@ -458,6 +521,13 @@ void RemappedPanoImage<RemapImage,AlphaImage>::remapImage(vigra::triple<ImgIter,
     } else {
         invResponse.setHDROutput(true,1.0/pow(2.0,m_destImg.outputExposureValue));
     }
+    // use lookup tables for the photometric correction of 8 and 16 bit images
+    invResponse.precompute();
+
+    // use interpolated or cached coordinates if requested, otherwise the exact transform is used
+    GridTransform<PTools::Transform> gridTransf(m_transf);
+    CachedTransform<GridTransform<PTools::Transform> > transf(gridTransf);
+    setupTransform(gridTransf, transf);
 
     if ((m_srcImg.hasActiveMasks()) || (m_srcImg.getCropMode() != SrcPanoImage::NO_CROP) || Nona::GetAdvancedOption(m_advancedOptions, "maskClipExposure", false))
     {
@@ -512,7 +582,7 @@ void RemappedPanoImage<RemapImage,AlphaImage>::remapImage(vigra::triple<ImgIter,
                                 destImageRange(Base::m_image),
                                 destImage(Base::m_mask),
                                 Base::boundingBox().upperLeft(),
-                                m_transf,
+                                transf,
                                 invResponse,
                                 m_srcImg.horizontalWarpNeeded(),
                                 interpol,
@@ -523,7 +593,7 @@ void RemappedPanoImage<RemapImage,AlphaImage>::remapImage(vigra::triple<ImgIter,
                            destImageRange(Base::m_image),
                            destImage(Base::m_mask),
                            Base::boundingBox().upperLeft(),
-                           m_transf,
+                           transf,
                            invResponse,
                            m_srcImg.horizontalWarpNeeded(),
                            interpol,
@@ -579,6 +649,13 @@ void RemappedPanoImage<RemapImage,AlphaImage>::remapImage(vigra::triple<ImgIter,
     } else {
         invResponse.setHDROutput(true,1.0/pow(2.0,m_destImg.outputExposureValue));
     }
+    // use lookup tables for the photometric correction of 8 and 16 bit images
+    invResponse.precompute();
+
+    // use interpolated or cached coordinates if requested, otherwise the exact transform is used
+    GridTransform<PTools::Transform> gridTransf(m_transf);
+    CachedTransform<GridTransform<PTools::Transform> > transf(gridTransf);
+    setupTransform(gridTransf, transf);
 
     if ((m_srcImg.hasActiveMasks()) || (m_srcImg.getCropMode() != SrcPanoImage::NO_CROP) || Nona::GetAdvancedOption(m_advancedOptions, "maskClipExposure", false)) {
         vigra::BImage alpha(srcImgSize);
@@ -636,7 +713,7 @@ void RemappedPanoImage<RemapImage,AlphaImage>::remapImage(vigra::triple<ImgIter,
                                            destImageRange(Base::m_image),
                                            destImage(Base::m_mask),
                                            Base::boundingBox().upperLeft(),
-                                           m_transf,
+                                           transf,
                                            invResponse,
                                            m_srcImg.horizontalWarpNeeded(),
                                            interp,
@@ -648,7 +725,7 @@ void RemappedPanoImage<RemapImage,AlphaImage>::remapImage(vigra::triple<ImgIter,
                                            destImageRange(Base::m_image),
                                            destImage(Base::m_mask),
                                            Base::boundingBox().upperLeft(),
-                                           m_transf,
+                                           transf,
                                            invResponse,
                                            m_srcImg.horizontalWarpNeeded(),
                                            interp,
@@ -662,6 +739,208 @@ void RemappedPanoImage<RemapImage,AlphaImage>::remapImage(vigra::triple<ImgIter,
 
 
 
+namespace detail
+{
+    /** wrapper around a transform, which records all source rows which are
+     *  outside of the row range [firstRow, lastRow) (minus a margin for the
+     *  interpolation kernel). Used to check if all needed rows were loaded.
+     */
+    template <class TRANSFORM>
+    class RowRangeCheckTransform
+    {
+    public:
+        RowRangeCheckTransform(TRANSFORM & transf, int firstRow, int lastRow, int margin, int height)
+            : m_transf(transf), m_firstRow(firstRow), m_lastRow(lastRow), m_margin(margin), m_height(height),
+              m_missed(false), m_minMissed(height), m_maxMissed(-1)
+        {};
+
+        bool transformImgCoord(double & x_dest, double & y_dest, double x_src, double y_src) const
+        {
+            if (!m_transf.transformImgCoord(x_dest, y_dest, x_src, y_src))
+            {
+                return false;
+            };
+            checkRow(y_dest);
+            return true;
+        };
+
+        void transformImgCoords(const double* x, const double* y, double* x_dest, double* y_dest,
+                                unsigned char* valid, size_t n) const
+        {
+            m_transf.transformImgCoords(x, y, x_dest, y_dest, valid, n);
+            for (size_t i = 0; i < n; ++i)
+            {
+                if (valid[i])
+                {
+                    checkRow(y_dest[i]);
+                };
+            };
+        };
+
+        /** returns true, if rows outside of the range were accessed, and the range of these rows */
+        bool getMissedRows(int & minRow, int & maxRow) const
+        {
+            minRow = m_minMissed;
+            maxRow = m_maxMissed;
+            return m_missed;
+        };
+
+    private:
+        void checkRow(double y) const
+        {
+            if (!(y > -m_margin) || !(y < m_height + m_margin))
+            {
+                // outside of image (or NaN), the interpolator does not access any pixel
+                return;
+            };
+            const int row = static_cast<int>(floor(y));
+            if ((m_firstRow > 0 && row - m_margin < m_firstRow) || (m_lastRow < m_height && row + m_margin >= m_lastRow))
+            {
+                hugin_omp::ScopedLock lock(m_lock);
+                m_missed = true;
+                m_minMissed = std::min(m_minMissed, row);
+                m_maxMissed = std::max(m_maxMissed, row);
+            };
+        };
+
+        TRANSFORM & m_transf;
+        int m_firstRow;
+        int m_lastRow;
+        int m_margin;
+        int m_height;
+        mutable bool m_missed;
+        mutable int m_minMissed;
+        mutable int m_maxMissed;
+        mutable hugin_omp::Lock m_lock;
+    };
+}
+
+/** remap an image which is read row by row */
+template<class RemapImage, class AlphaImage>
+template<class RowReader>
+void RemappedPanoImage<RemapImage,AlphaImage>::remapImageStreamed(RowReader & reader,
+                                                                  vigra_ext::Interpolator interp,
+                                                                  AppBase::ProgressDisplay* progress)
+{
+    if (Base::boundingBox().isEmpty())
+        return;
+
+    progress->setMessage("remapping", hugin_utils::stripPath(m_srcImg.getFilename()));
+
+    const vigra::Size2D srcImgSize(reader.width(), reader.height());
+    vigra_precondition(srcImgSize == m_srcImg.getSize(),
+                       "RemappedPanoImage<RemapImage,AlphaImage>::remapImageStreamed(): image unexpectedly changed dimensions.");
+
+    typedef typename RemapImage::value_type input_value_type;
+    typedef typename vigra_ext::ValueTypeTraits<input_value_type>::value_type input_component_type;
+
+    // setup photometric transform for this image type
+    Photometric::InvResponseTransform<input_component_type, double> invResponse(m_srcImg);
+    if (m_destImg.outputMode == PanoramaOptions::OUTPUT_LDR) {
+        std::vector<double> outLut;
+        double maxVal = vigra_ext::LUTTraits<input_value_type>::max();
+        if (m_destImg.outputPixelType.size() > 0) {
+            maxVal = vigra_ext::getMaxValForPixelType(m_destImg.outputPixelType);
+        }
+        if (!m_destImg.outputEMoRParams.empty())
+        {
+            vigra_ext::EMoR::createEMoRLUT(m_destImg.outputEMoRParams, outLut);
+            vigra_ext::enforceMonotonicity(outLut);
+        };
+        invResponse.setOutput(1.0/pow(2.0,m_destImg.outputExposureValue), outLut,
+                              maxVal);
+    } else {
+        invResponse.setHDROutput(true,1.0/pow(2.0,m_destImg.outputExposureValue));
+    }
+    // use lookup tables for the photometric correction of 8 and 16 bit images
+    invResponse.precompute();
+
+    GridTransform<PTools::Transform> gridTransf(m_transf);
+    CachedTransform<GridTransform<PTools::Transform> > transf(gridTransf);
+    setupTransform(gridTransf, transf);
+
+    // the source image is accessed through the row pointers of the reader
+    typedef typename RemapImage::const_traverser SrcIter;
+    typedef typename AlphaImage::const_traverser SrcAlphaIter;
+    // rows needed around a source coordinate by the largest interpolation kernel
+    const int margin = 18;
+    // number of output rows, which are remapped at once
+    const int blockHeight = 64;
+    const vigra::Rect2D & bbox = Base::boundingBox();
+    for (int blockTop = bbox.top(); blockTop < bbox.bottom(); blockTop += blockHeight)
+    {
+        const int blockBottom = std::min(blockTop + blockHeight, bbox.bottom());
+        // estimate the needed source rows from a sparse sampling of the block
+        int firstRow = srcImgSize.y;
+        int lastRow = 0;
+        for (int y = blockTop; y < blockBottom + 15; y += 16)
+        {
+            const int yy = std::min(y, blockBottom - 1);
+            for (int x = bbox.left(); x < bbox.right() + 15; x += 16)
+            {
+                double sx, sy;
+                if (transf.transformImgCoord(sx, sy, std::min(x, bbox.right() - 1), yy) && sy > -margin && sy < srcImgSize.y + margin)
+                {
+                    firstRow = std::min(firstRow, static_cast<int>(floor(sy)) - margin);
+                    lastRow = std::max(lastRow, static_cast<int>(floor(sy)) + margin + 1);
+                };
+            };
+        };
+        const vigra::Diff2D blockOffset(0, blockTop - bbox.top());
+        const vigra::Diff2D blockSize(bbox.width(), blockBottom - blockTop);
+        // remap the block, if a not loaded row was needed, enlarge the range and repeat
+        for (;;)
+        {
+            firstRow = std::max(0, firstRow);
+            lastRow = std::min(srcImgSize.y, lastRow);
+            if (!reader.setRows(firstRow, lastRow))
+            {
+                UTILS_THROW(std::runtime_error, "Could not read image " << m_srcImg.getFilename());
+            };
+            detail::RowRangeCheckTransform<CachedTransform<GridTransform<PTools::Transform> > > checkedTransf(transf, firstRow, lastRow, margin, srcImgSize.y);
+            SrcIter srcUL(reader.lines());
+            if (reader.hasAlpha())
+            {
+                SrcAlphaIter alphaUL(reader.alphaLines());
+                transformImageAlpha(vigra::make_triple(srcUL, srcUL + srcImgSize, typename RemapImage::ConstAccessor()),
+                                    std::make_pair(alphaUL, typename AlphaImage::ConstAccessor()),
+                                    vigra::make_triple(Base::m_image.upperLeft() + blockOffset,
+                                                       Base::m_image.upperLeft() + blockOffset + blockSize,
+                                                       Base::m_image.accessor()),
+                                    std::make_pair(Base::m_mask.upperLeft() + blockOffset, Base::m_mask.accessor()),
+                                    vigra::Diff2D(bbox.left(), blockTop),
+                                    checkedTransf,
+                                    invResponse,
+                                    m_srcImg.horizontalWarpNeeded(),
+                                    interp,
+                                    progress);
+            }
+            else
+            {
+                transformImage(vigra::make_triple(srcUL, srcUL + srcImgSize, typename RemapImage::ConstAccessor()),
+                               vigra::make_triple(Base::m_image.upperLeft() + blockOffset,
+                                                  Base::m_image.upperLeft() + blockOffset + blockSize,
+                                                  Base::m_image.accessor()),
+                               std::make_pair(Base::m_mask.upperLeft() + blockOffset, Base::m_mask.accessor()),
+                               vigra::Diff2D(bbox.left(), blockTop),
+                               checkedTransf,
+                               invResponse,
+                               m_srcImg.horizontalWarpNeeded(),
+                               interp,
+                               progress);
+            };
+            int minMissed, maxMissed;
+            if (!checkedTransf.getMissedRows(minMissed, maxMissed))
+            {
+                break;
+            };
+            firstRow = std::min(firstRow, minMissed - margin);
+            lastRow = std::max(lastRow, maxMissed + margin + 1);
+        };
+    };
+}
+
+
 /** remap a single image
  */
 template <class SrcImgType, class FlatImgType, class DestImgType, class MaskImgType>
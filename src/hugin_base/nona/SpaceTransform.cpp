@@ -31,7 +31,7 @@ namespace Nona {
         
 
 /// ctor
-SpaceTransform::SpaceTransform() : m_srcTX(0), m_srcTY(0), m_destTX(0), m_destTY(0)
+SpaceTransform::SpaceTransform() : m_srcTX(0), m_srcTY(0), m_destTX(0), m_destTY(0), m_fused(NULL), m_useFused(true)
 {
 
 	m_Initialized = false;
@@ -911,6 +911,139 @@ static void radial_shift( double x_dest, double y_dest, double* x_src, double* y
 }
 
 
+//==============================================================================
+// fused transformation stacks
+
+namespace
+{
+
+/** executes a fixed list of transformation functions. Because the functions
+ *  are known at compile time, the compiler can inline them, which avoids the
+ *  indirect calls of the generic interpreter in SpaceTransform::transform
+ */
+template <trfn... Funcs>
+struct FusedStack;
+
+template <>
+struct FusedStack<>
+{
+    static inline void run(const fDescription* stack, double & x, double & y)
+    {
+    }
+};
+
+template <trfn Func, trfn... Funcs>
+struct FusedStack<Func, Funcs...>
+{
+    static inline void run(const fDescription* stack, double & x, double & y)
+    {
+        double xs, ys;
+        Func(x, y, &xs, &ys, stack->param);
+        x = xs;
+        y = ys;
+        FusedStack<Funcs...>::run(stack + 1, x, y);
+    }
+};
+
+/** entry point for the fused stack */
+template <trfn... Funcs>
+void executeFused(const fDescription* stack, double x_dest, double y_dest, double* x_src, double* y_src)
+{
+    FusedStack<Funcs...>::run(stack, x_dest, y_dest);
+    *x_src = x_dest;
+    *y_src = y_dest;
+}
+
+/** a fused stack and the transformation functions it was compiled for */
+struct FusedDescription
+{
+    std::vector<trfn> funcs;
+    fusedfn func;
+};
+
+template <trfn... Funcs>
+FusedDescription createFusedDescription()
+{
+    FusedDescription desc;
+    const trfn funcs[] = { Funcs... };
+    desc.funcs.assign(funcs, funcs + sizeof...(Funcs));
+    desc.func = &executeFused<Funcs...>;
+    return desc;
+}
+
+/** adds the given head of a stack with all combinations of the optional
+ *  radial distortion and center shift, as added by SpaceTransform::Init */
+template <trfn... Head>
+void addFusedStacks(std::vector<FusedDescription> & fused)
+{
+    fused.push_back(createFusedDescription<Head...>());
+    fused.push_back(createFusedDescription<Head..., vert>());
+    fused.push_back(createFusedDescription<Head..., horiz>());
+    fused.push_back(createFusedDescription<Head..., vert, horiz>());
+    fused.push_back(createFusedDescription<Head..., radial>());
+    fused.push_back(createFusedDescription<Head..., radial, vert>());
+    fused.push_back(createFusedDescription<Head..., radial, horiz>());
+    fused.push_back(createFusedDescription<Head..., radial, vert, horiz>());
+}
+
+/** list of all stacks, for which a fused function exists
+ *  these are the pano->image stacks of SpaceTransform::Init for rectilinear, fisheye and
+ *  equirectangular images and rectilinear, cylindrical, equirectangular and
+ *  stereographic output and the stacks of the radial distortion correction */
+std::vector<FusedDescription> createFusedStacks()
+{
+    std::vector<FusedDescription> fused;
+    // rectilinear output
+    addFusedStacks<erect_rect, rotate_erect, sphere_tp_erect, persp_sphere, rect_sphere_tp, resize>(fused);
+    addFusedStacks<erect_rect, rotate_erect, sphere_tp_erect, persp_sphere, resize>(fused);
+    addFusedStacks<erect_rect, rotate_erect, sphere_tp_erect, persp_sphere, erect_sphere_tp, resize>(fused);
+    // cylindrical output
+    addFusedStacks<erect_pano, rotate_erect, sphere_tp_erect, persp_sphere, rect_sphere_tp, resize>(fused);
+    addFusedStacks<erect_pano, rotate_erect, sphere_tp_erect, persp_sphere, resize>(fused);
+    addFusedStacks<erect_pano, rotate_erect, sphere_tp_erect, persp_sphere, erect_sphere_tp, resize>(fused);
+    // equirectangular output
+    addFusedStacks<rotate_erect, sphere_tp_erect, persp_sphere, rect_sphere_tp, resize>(fused);
+    addFusedStacks<rotate_erect, sphere_tp_erect, persp_sphere, resize>(fused);
+    addFusedStacks<rotate_erect, sphere_tp_erect, persp_sphere, erect_sphere_tp, resize>(fused);
+    // stereographic output
+    addFusedStacks<erect_stereographic, rotate_erect, sphere_tp_erect, persp_sphere, rect_sphere_tp, resize>(fused);
+    addFusedStacks<erect_stereographic, rotate_erect, sphere_tp_erect, persp_sphere, resize>(fused);
+    addFusedStacks<erect_stereographic, rotate_erect, sphere_tp_erect, persp_sphere, erect_sphere_tp, resize>(fused);
+    // radial distortion correction only
+    fused.push_back(createFusedDescription<radial_shift>());
+    fused.push_back(createFusedDescription<radial>());
+    fused.push_back(createFusedDescription<radial, vert>());
+    fused.push_back(createFusedDescription<radial, horiz>());
+    fused.push_back(createFusedDescription<radial, vert, horiz>());
+    return fused;
+}
+
+} // namespace
+
+void SpaceTransform::InitFused()
+{
+    static const std::vector<FusedDescription> fusedStacks = createFusedStacks();
+    m_fused = NULL;
+    for (std::vector<FusedDescription>::const_iterator it = fusedStacks.begin(); it != fusedStacks.end(); ++it)
+    {
+        if (it->funcs.size() != m_Stack.size())
+        {
+            continue;
+        };
+        bool match = true;
+        for (size_t i = 0; i < m_Stack.size() && match; ++i)
+        {
+            match = (it->funcs[i] == m_Stack[i].func);
+        };
+        if (match)
+        {
+            m_fused = it->func;
+            return;
+        };
+    };
+}
+
+
 //==============================================================================
 
 
@@ -1070,6 +1203,7 @@ void SpaceTransform::InitRadialCorrect(const vigra::Size2D & sz, const std::vect
         AddTransform (&radial_shift, mprad[0], mprad[1], mprad[2], mprad[3], mprad[4], mprad[5],
                      centerShift.x, centerShift.y);
     }
+    InitFused();
 }
 
 /** Create a transform stack for distortion & TCA correction only */
@@ -1127,6 +1261,7 @@ void SpaceTransform::InitInvRadialCorrect(const SrcPanoImage & src, int channel)
     if ( mprad[0] != 1.0 || mprad[1] != 0.0 || mprad[2] != 0.0 || mprad[3] != 0.0) {
         AddTransform (&inv_radial, mprad[0], mprad[1], mprad[2], mprad[3], mprad[4], mprad[5]);
     }
+    InitFused();
 }
 
 
@@ -1190,6 +1325,7 @@ void SpaceTransform::InitRadialCorrect(const SrcPanoImage & src, int channel)
     if (src.getRadialDistortionCenterShift().x != 0.0) {
         AddTransform(&horiz, src.getRadialDistortionCenterShift().x);
     }
+    InitFused();
 }
 
 /** Creates the stacks of matrices and flatten them
@@ -1404,6 +1540,7 @@ void SpaceTransform::Init(
 
 	stack[i].func  = (trfn)NULL;*/
 
+    InitFused();
 }
 
 void SpaceTransform::InitInv(
@@ -1437,10 +1574,11 @@ void SpaceTransform::InitInv(
 //    double  pnheight= destSize.y;
 
     m_Stack.clear();
-    m_srcTX = destSize.x/2.0;
-    m_srcTY = destSize.y/2.0;
-    m_destTX = srcSize.x/2.0;
-    m_destTY = srcSize.y/2.0;
+    // image -> pano transformation, the source is the image
+    m_srcTX = srcSize.x/2.0;
+    m_srcTY = srcSize.y/2.0;
+    m_destTX = destSize.x/2.0;
+    m_destTY = destSize.y/2.0;
 
 
     a =	 DEG_TO_RAD( imhfov );	// field of view in rad		
@@ -1600,6 +1738,7 @@ void SpaceTransform::InitInv(
         DEBUG_FATAL("Fatal error: Unknown projection " << destProj);
         break;
     }
+    InitFused();
 }
 
 //
@@ -1692,6 +1831,11 @@ void SpaceTransform::createInvTransform(const vigra::Diff2D & srcSize,
 //
 bool SpaceTransform::transform(hugin_utils::FDiff2D& dest, const hugin_utils::FDiff2D & src) const
 {
+    if (m_useFused && m_fused != NULL)
+    {
+        m_fused(&m_Stack[0], src.x, src.y, &dest.x, &dest.y);
+        return true;
+    };
 	double xd = src.x, yd = src.y;
 	std::vector<fDescription>::const_iterator tI;
 	
@@ -1719,5 +1863,134 @@ bool SpaceTransform::transformImgCoord(double & x_dest, double & y_dest, double
 }
 
 
+// batch versions of the simple transformation functions
+
+static void resizeBatch(double* x, double* y, size_t n, const _FuncParams & params)
+{
+    const double sx = params.var0;
+    const double sy = params.var1;
+    for (size_t i = 0; i < n; ++i)
+    {
+        x[i] *= sx;
+        y[i] *= sy;
+    }
+}
+
+static void shiftBatch(double* v, size_t n, double shift)
+{
+    for (size_t i = 0; i < n; ++i)
+    {
+        v[i] += shift;
+    }
+}
+
+static void radialBatch(double* x, double* y, size_t n, const _FuncParams & params, double shiftX, double shiftY)
+{
+    const double a = params.var0;
+    const double b = params.var1;
+    const double c = params.var2;
+    const double d = params.var3;
+    const double norm = params.var4;
+    const double maxR = params.var5;
+    for (size_t i = 0; i < n; ++i)
+    {
+        const double r = sqrt(x[i] * x[i] + y[i] * y[i]) / norm;
+        const double scale = (r < maxR) ? (((d * r + c) * r + b) * r + a) : 1000.0;
+        x[i] = x[i] * scale + shiftX;
+        y[i] = y[i] * scale + shiftY;
+    }
+}
+
+static void rotateErectBatch(double* x, size_t n, const _FuncParams & params)
+{
+    const double halfTurn = params.var0;
+    const double turn = params.var1;
+    for (size_t i = 0; i < n; ++i)
+    {
+        double v = x[i] + turn;
+        while (v < -halfTurn)
+        {
+            v += 2 * halfTurn;
+        };
+        while (v > halfTurn)
+        {
+            v -= 2 * halfTurn;
+        };
+        x[i] = v;
+    }
+}
+
+void SpaceTransform::transformImgCoords(const double* x, const double* y, double* x_dest, double* y_dest,
+                                        unsigned char* valid, size_t n) const
+{
+    // convert to cartesian coordinates
+    const double srcOffsetX = m_srcTX - 0.5;
+    const double srcOffsetY = m_srcTY - 0.5;
+    for (size_t i = 0; i < n; ++i)
+    {
+        x_dest[i] = x[i] - srcOffsetX;
+        y_dest[i] = y[i] - srcOffsetY;
+    }
+    if (m_useFused && m_fused != NULL)
+    {
+        // the fused function executes the whole stack for one point,
+        // no intermediate results are written to the buffers
+        for (size_t i = 0; i < n; ++i)
+        {
+            m_fused(&m_Stack[0], x_dest[i], y_dest[i], &x_dest[i], &y_dest[i]);
+        }
+    }
+    else
+    {
+        // now execute the stack, one transformation after the other for all points
+        for (std::vector<fDescription>::const_iterator tI = m_Stack.begin(); tI != m_Stack.end(); ++tI)
+        {
+            const trfn func = tI->func;
+            if (func == &resize)
+            {
+                resizeBatch(x_dest, y_dest, n, tI->param);
+            }
+            else if (func == &horiz)
+            {
+                shiftBatch(x_dest, n, tI->param.shift);
+            }
+            else if (func == &vert)
+            {
+                shiftBatch(y_dest, n, tI->param.shift);
+            }
+            else if (func == &radial)
+            {
+                radialBatch(x_dest, y_dest, n, tI->param, 0, 0);
+            }
+            else if (func == &radial_shift)
+            {
+                radialBatch(x_dest, y_dest, n, tI->param, tI->param.var6, tI->param.var7);
+            }
+            else if (func == &rotate_erect)
+            {
+                rotateErectBatch(x_dest, n, tI->param);
+            }
+            else
+            {
+                // no batch version available, call the function for each point
+                for (size_t i = 0; i < n; ++i)
+                {
+                    func(x_dest[i], y_dest[i], &x_dest[i], &y_dest[i], tI->param);
+                }
+            };
+        }
+    };
+    // back to image coordinates
+    const double destOffsetX = m_destTX - 0.5;
+    const double destOffsetY = m_destTY - 0.5;
+    for (size_t i = 0; i < n; ++i)
+    {
+        x_dest[i] += destOffsetX;
+        y_dest[i] += destOffsetY;
+        valid[i] = 1;
+    }
+}
+
+
 } // namespace
 } // namespace
@@ -77,6 +77,13 @@ typedef struct _fDesc
 } fDescription;
 
 
+/** Fused transformation function type
+ *  executes a complete, known stack of transformations with inlined
+ *  transformation functions
+ */
+typedef void (*fusedfn)( const fDescription* stack, double x_dest, double y_dest, double* x_src, double* y_src );
+
+
 
 /**
  *
@@ -170,6 +177,20 @@ class IMPEX SpaceTransform
         {
             return transformImgCoord(dest.x, dest.y, src.x, src.y);
         }
+
+        /** transform n points in image coordinates at once.
+         *  Fused stacks are executed point by point with the fused function.
+         *  Otherwise the transformation stack is executed step by step over all
+         *  points, the simple steps (scaling, shifts, radial distortion, rotation)
+         *  are processed in loops over all points without a call per point.
+         *  There are no hand written SIMD kernels and no runtime dispatch.
+         *  @param x, y input coordinates
+         *  @param x_dest, y_dest output coordinates (can be the same arrays as x,y)
+         *  @param valid set to 1 for each successful transformed point, 0 otherwise
+         *  @param n number of points
+         */
+        void transformImgCoords(const double* x, const double* y, double* x_dest, double* y_dest,
+                                unsigned char* valid, size_t n) const;
         
         
     public:
@@ -179,11 +200,27 @@ class IMPEX SpaceTransform
             return m_Stack.size() == 0;
         }
 
+        /** returns true if the transformation stack is executed by
+         *  a fused (compiled) function instead of the generic interpreter */
+        bool isFused() const
+        {
+            return m_useFused && m_fused != NULL;
+        }
+
+        /** enable or disable the use of the fused transformation functions,
+         *  if disabled the generic interpreter is always used */
+        void setUseFused(bool useFused)
+        {
+            m_useFused = useFused;
+        }
+
         
     private:
         /// add a new transformation
         void AddTransform( trfn function_name, double var0, double var1 = 0.0f, double var2 = 0.0f, double var3 = 0.0f, double var4=0.0f, double var5=0.0f, double var6=0.0f, double var7=0.0f );
         void AddTransform( trfn function_name, Matrix3 m, double var0, double var1=0.0f, double var2=0.0f, double var3=0.0f);
+        /// search a fused function for the current stack
+        void InitFused();
         
         
     private:
@@ -197,6 +234,10 @@ class IMPEX SpaceTransform
         /// vector of transformations
         std::vector<fDescription>	m_Stack;
 
+        /// fused function for the current stack, NULL if not available
+        fusedfn m_fused;
+        bool m_useFused;
+
 };
 
 
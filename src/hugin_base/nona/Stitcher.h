@@ -35,6 +35,7 @@
 #include <utility>
 #include <cctype>
 #include <algorithm>
+#include <limits>
 
 #include <vigra/stdimage.hxx>
 #include <vigra/rgbvalue.hxx>
@@ -52,6 +53,7 @@
 #include <algorithms/nona/ComputeImageROI.h>
 #include <nona/RemappedPanoImage.h>
 #include <nona/ImageRemapper.h>
+#include <nona/RemapPipeline.h>
 #include <nona/StitcherOptions.h>
 #include <algorithms/basic/LayerStacks.h>
 
@@ -119,6 +121,15 @@ protected:
 
 namespace detail
 {
+    /** returns true, if all values of type Src can be stored in type Dest
+     *  without rescaling, like vigra::exportImage does it */
+    template <class Src, class Dest>
+    bool canHoldValues()
+    {
+        return static_cast<double>(std::numeric_limits<Dest>::lowest()) <= static_cast<double>(std::numeric_limits<Src>::lowest()) &&
+            static_cast<double>(std::numeric_limits<Dest>::max()) >= static_cast<double>(std::numeric_limits<Src>::max());
+    };
+
     template<typename ImageType, typename AlphaType>
     void saveRemapped(RemappedPanoImage<ImageType, AlphaType> & remapped,
         unsigned int imgNr, unsigned int nImg,
@@ -508,57 +519,50 @@ public:
         const bool wrap = (opts.getHFOV() == 360.0) && (opts.getWidth()==opts.getROI().width());
         // remap each image and blend into main pano image
         const bool hardSeam = GetAdvancedOption(advOptions, "hardSeam", true);
-        UIntVector images;
-        if(hardSeam)
-        { 
-            std::copy(imgSet.begin(), imgSet.end(), std::back_inserter(images));
-        }
-        else
+        const UIntVector images = getStitchingOrder(opts, imgSet, hardSeam);
+        const unsigned int parallelImages = static_cast<unsigned int>(std::max(0.0f, GetAdvancedOption(advOptions, "parallelImages", 0.0f)));
+        if (parallelImages > 1 && images.size() > 1 && remapper.isThreadSafe())
         {
-            images = HuginBase::getEstimatedBlendingOrder(Base::m_pano, imgSet, opts.colorReferenceImage);
-        };
-        for (UIntVector::const_iterator it = images.begin(); it != images.end(); ++it)
-        {
-            // get a remapped image.
-            DEBUG_DEBUG("remapping image: " << *it);
-            PanoramaOptions modOptions(opts);
-            if (GetAdvancedOption(advOptions, "ignoreExposure", false))
+            // remap several images concurrently, but merge them in the same order
+            // as in the serial case, so the result is identical
+            const double memoryLimit = GetAdvancedOption(advOptions, "parallelImagesMemory", 0.0f) * 1024.0 * 1024.0;
+            std::vector<double> memoryUsage(images.size());
+            for (size_t i = 0; i < images.size(); ++i)
             {
-                modOptions.outputExposureValue = Base::m_pano.getImage(*it).getExposureValue();
+                memoryUsage[i] = estimateMemoryUsage(images[i], getROI(imgSet, images[i]));
             };
-            RemappedPanoImage<ImageType, AlphaType> *
-                remapped = remapper.getRemapped(Base::m_pano, modOptions, *it,
-                    Base::m_rois[std::distance(imgSet.begin(), imgSet.find(*it))], Base::m_progress);
-            if(iccProfile.size()==0)
+            RemapPipeline<ImageType, AlphaType> pipeline(
+                [&](size_t i)
+                {
+                    DEBUG_DEBUG("remapping image: " << images[i]);
+                    AppBase::DummyProgressDisplay progress;
+                    return remapper.getRemapped(Base::m_pano, getModifiedOptions(opts, images[i], advOptions), images[i],
+                        getROI(imgSet, images[i]), &progress);
+                },
+                [&remapper](RemappedPanoImage<ImageType, AlphaType>* remapped) { remapper.release(remapped); },
+                memoryUsage, parallelImages, parallelImages + 1, memoryLimit);
+            while (!pipeline.empty())
             {
-                iccProfile=remapped->m_ICCProfile;
+                size_t index;
+                // the image is given back to the pipeline at the end of the scope
+                typename RemapPipeline<ImageType, AlphaType>::ImagePtr remapped = pipeline.next(index);
+                mergeRemapped(*remapped, opts, images[index], nImg, filename, panoImage, alpha, wrap, hardSeam, advOptions);
             };
-            if (GetAdvancedOption(advOptions, "saveIntermediateImages", false))
-            {
-                modOptions.outputFormat = PanoramaOptions::TIFF_m;
-                modOptions.tiff_saveROI = true;
-                std::string finalFilename(GetAdvancedOption(advOptions, "basename", filename));
-                const std::string suffix(GetAdvancedOption(advOptions, "saveIntermediateImagesSuffix"));
-                if (!suffix.empty())
-                {
-                    finalFilename.append(suffix);
-                };
-                detail::saveRemapped(*remapped, *it, nImg, modOptions, finalFilename, GetAdvancedOption(advOptions, "useBigTIFF", false), Base::m_progress);
-            }
-            Base::m_progress->setMessage("blending", hugin_utils::stripPath(Base::m_pano.getImage(*it).getFilename()));
-            // add image to pano and panoalpha, adjusts panoROI as well.
-            try {
-                vigra_ext::MergeImages<ImageType, AlphaType>(panoImage, alpha, remapped->m_image, remapped->m_mask, vigra::Diff2D(remapped->boundingBox().upperLeft()), wrap, hardSeam);
-                // update bounding box of the panorama
-                m_panoROI |= remapped->boundingBox();
-            } catch (vigra::PreconditionViolation & e) {
-                DEBUG_ERROR("exception during stitching" << e.what());
-                // this can be thrown, if an image
-                // is completely out of the pano
-            }
-            // free remapped image
-            remapper.release(remapped);
         }
+        else
+        {
+            for (UIntVector::const_iterator it = images.begin(); it != images.end(); ++it)
+            {
+                // get a remapped image.
+                DEBUG_DEBUG("remapping image: " << *it);
+                RemappedPanoImage<ImageType, AlphaType> *
+                    remapped = remapper.getRemapped(Base::m_pano, getModifiedOptions(opts, *it, advOptions), *it,
+                        getROI(imgSet, *it), Base::m_progress);
+                mergeRemapped(*remapped, opts, *it, nImg, filename, panoImage, alpha, wrap, hardSeam, advOptions);
+                // free remapped image
+                remapper.release(remapped);
+            };
+        };
         // check if our intermediate image covers whole canvas
         // if not update m_panoROI
         if (m_panoROI.width() < opts.getROI().width() || m_panoROI.height() < opts.getROI().height())
@@ -576,13 +580,6 @@ public:
         Base::stitch(opts, imgSet, filename, remapper);
 
         std::string basename = filename;
-
-	// create panorama canvas
-        ImageType pano(opts.getWidth(), opts.getHeight());
-        AlphaType panoMask(opts.getWidth(), opts.getHeight());
-
-        stitch(opts, imgSet, filename, pano, panoMask, remapper, advOptions);
-	
 	    std::string ext = opts.getOutputExtension();
         std::string cext = hugin_utils::tolower(hugin_utils::getExtension(basename));
         std::transform(cext.begin(),cext.end(), cext.begin(), (int(*)(int))std::tolower);
@@ -592,6 +589,24 @@ public:
             basename = hugin_utils::stripExtension(basename);
         }
         std::string outputfile = basename + "." + ext;
+
+        // tiled stitching, the panorama is never kept completely in memory
+        const int tileSize = static_cast<int>(GetAdvancedOption(advOptions, "tileSize", 0.0f));
+        if (tileSize > 0 && opts.outputFormat == PanoramaOptions::TIFF)
+        {
+            if (stitchTiled(opts, imgSet, outputfile, tileSize, remapper, advOptions))
+            {
+                return;
+            };
+            std::cerr << "Tiled stitching can not convert to pixel type " << opts.outputPixelType
+                << ", stitching without tiles." << std::endl;
+        };
+
+	// create panorama canvas
+        ImageType pano(opts.getWidth(), opts.getHeight());
+        AlphaType panoMask(opts.getWidth(), opts.getHeight());
+
+        stitch(opts, imgSet, filename, pano, panoMask, remapper, advOptions);
         
 	// save the remapped image
         Base::m_progress->setMessage("saving result", hugin_utils::stripPath(outputfile));
@@ -635,6 +650,259 @@ public:
     }
 
 protected:
+    /** returns the output options for the given image */
+    PanoramaOptions getModifiedOptions(const PanoramaOptions & opts, const unsigned int imgNr, const AdvancedOptions& advOptions) const
+    {
+        PanoramaOptions modOptions(opts);
+        if (GetAdvancedOption(advOptions, "ignoreExposure", false))
+        {
+            modOptions.outputExposureValue = Base::m_pano.getImage(imgNr).getExposureValue();
+        };
+        return modOptions;
+    };
+
+    /** returns the output ROI of the given image */
+    vigra::Rect2D getROI(const UIntSet & imgSet, const unsigned int imgNr) const
+    {
+        return Base::m_rois[std::distance(imgSet.begin(), imgSet.find(imgNr))];
+    };
+
+    /** rough estimate of the memory needed to remap the given image */
+    double estimateMemoryUsage(const unsigned int imgNr, const vigra::Rect2D & roi) const
+    {
+        const double pixelSize = sizeof(typename ImageType::value_type) + sizeof(typename AlphaType::value_type);
+        return (static_cast<double>(Base::m_pano.getImage(imgNr).getSize().area()) + roi.area()) * pixelSize;
+    };
+
+    /** saves the intermediate image if requested and merges the remapped image into the panorama */
+    void mergeRemapped(RemappedPanoImage<ImageType, AlphaType> & remapped, const PanoramaOptions & opts,
+                       const unsigned int imgNr, const unsigned int nImg, const std::string & filename,
+                       ImageType& panoImage, AlphaType& alpha, const bool wrap, const bool hardSeam,
+                       const AdvancedOptions& advOptions)
+    {
+        if(iccProfile.size()==0)
+        {
+            iccProfile=remapped.m_ICCProfile;
+        };
+        if (GetAdvancedOption(advOptions, "saveIntermediateImages", false))
+        {
+            PanoramaOptions modOptions(getModifiedOptions(opts, imgNr, advOptions));
+            modOptions.outputFormat = PanoramaOptions::TIFF_m;
+            modOptions.tiff_saveROI = true;
+            std::string finalFilename(GetAdvancedOption(advOptions, "basename", filename));
+            const std::string suffix(GetAdvancedOption(advOptions, "saveIntermediateImagesSuffix"));
+            if (!suffix.empty())
+            {
+                finalFilename.append(suffix);
+            };
+            detail::saveRemapped(remapped, imgNr, nImg, modOptions, finalFilename, GetAdvancedOption(advOptions, "useBigTIFF", false), Base::m_progress);
+        }
+        Base::m_progress->setMessage("blending", hugin_utils::stripPath(Base::m_pano.getImage(imgNr).getFilename()));
+        // add image to pano and panoalpha, adjusts panoROI as well.
+        try {
+            vigra_ext::MergeImages<ImageType, AlphaType>(panoImage, alpha, remapped.m_image, remapped.m_mask, vigra::Diff2D(remapped.boundingBox().upperLeft()), wrap, hardSeam);
+            // update bounding box of the panorama
+            m_panoROI |= remapped.boundingBox();
+        } catch (vigra::PreconditionViolation & e) {
+            DEBUG_ERROR("exception during stitching" << e.what());
+            // this can be thrown, if an image
+            // is completely out of the pano
+        }
+    };
+
+    /** returns the order in which the images are merged into the panorama */
+    UIntVector getStitchingOrder(const PanoramaOptions & opts, const UIntSet & imgSet, const bool hardSeam) const
+    {
+        UIntVector images;
+        if(hardSeam)
+        { 
+            std::copy(imgSet.begin(), imgSet.end(), std::back_inserter(images));
+        }
+        else
+        {
+            images = HuginBase::getEstimatedBlendingOrder(Base::m_pano, imgSet, opts.colorReferenceImage);
+        };
+        return images;
+    };
+
+    /** stitch the panorama tile by tile and stream the finished tiles into
+     *  a tiled tiff file.
+     *
+     *  The output is written with opts.outputPixelType. Conversions, for which
+     *  vigra::exportImage would rescale the values to the range of the whole
+     *  panorama (e.g. float to 16 bit), are not possible tile by tile, in this
+     *  case nothing is written and false is returned.
+     */
+    bool stitchTiled(const PanoramaOptions & opts, UIntSet & imgSet,
+                     const std::string & outputfile, int tileSize,
+                     SingleImageRemapper<ImageType, AlphaType> & remapper,
+                     const AdvancedOptions& advOptions)
+    {
+        const std::string & pixelType = opts.outputPixelType;
+        if (pixelType == "UINT8")
+        {
+            return stitchTiled<vigra::UInt8>(opts, imgSet, outputfile, tileSize, remapper, advOptions);
+        };
+        if (pixelType == "INT16")
+        {
+            return stitchTiled<vigra::Int16>(opts, imgSet, outputfile, tileSize, remapper, advOptions);
+        };
+        if (pixelType == "UINT16")
+        {
+            return stitchTiled<vigra::UInt16>(opts, imgSet, outputfile, tileSize, remapper, advOptions);
+        };
+        if (pixelType == "INT32")
+        {
+            return stitchTiled<vigra::Int32>(opts, imgSet, outputfile, tileSize, remapper, advOptions);
+        };
+        if (pixelType == "UINT32")
+        {
+            return stitchTiled<vigra::UInt32>(opts, imgSet, outputfile, tileSize, remapper, advOptions);
+        };
+        if (pixelType == "FLOAT")
+        {
+            return stitchTiled<float>(opts, imgSet, outputfile, tileSize, remapper, advOptions);
+        };
+        if (pixelType == "DOUBLE")
+        {
+            return stitchTiled<double>(opts, imgSet, outputfile, tileSize, remapper, advOptions);
+        };
+        // no or unknown pixel type, write the stitching pixel type
+        return stitchTiled<typename vigra_ext::TiledAlphaTiffWriter<ImageType, AlphaType>::ComponentType>(
+            opts, imgSet, outputfile, tileSize, remapper, advOptions);
+    };
+
+    /** stitch the panorama tile by tile and write it with the component type OutType.
+     *
+     *  Each tile is enlarged by a margin, only the images which intersect
+     *  the enlarged tile are remapped and only the intersecting part of them.
+     *  So the memory usage depends on the tile size and on the number of
+     *  overlapping images, but not on the size of the panorama.
+     *  TIFF source images are read row by row, only the rows needed for the
+     *  current tile are loaded. Other source images are loaded completely,
+     *  they are kept in a cache limited by the advanced option tileCacheSize
+     *  (in MB) until the last row of tiles, which needs them, is finished.
+     *  Limitation: the seams are calculated for each tile separately, the
+     *  margin reduces discontinuities of the seams at the tile borders, but
+     *  the seams can still differ from stitching without tiles.
+     */
+    template <class OutType>
+    bool stitchTiled(const PanoramaOptions & opts, UIntSet & imgSet,
+                     const std::string & outputfile, int tileSize,
+                     SingleImageRemapper<ImageType, AlphaType> & remapper,
+                     const AdvancedOptions& advOptions)
+    {
+        typedef vigra_ext::TiledAlphaTiffWriter<ImageType, AlphaType, OutType> TiffWriter;
+        if (!detail::canHoldValues<typename TiffWriter::PixelTraits::component_type, OutType>())
+        {
+            return false;
+        };
+        // the stitching tile size needs to be a multiple of the tiff tile size
+        const int tiffTileSize = 256;
+        tileSize = std::max(tiffTileSize, ((tileSize + tiffTileSize - 1) / tiffTileSize) * tiffTileSize);
+        const int margin = std::max(0, static_cast<int>(GetAdvancedOption(advOptions, "tileMargin", 64.0f)));
+        const vigra::Rect2D panoROI(opts.getROI());
+        const bool wrap = (opts.getHFOV() == 360.0) && (opts.getWidth() == panoROI.width());
+        const bool hardSeam = GetAdvancedOption(advOptions, "hardSeam", true);
+        const UIntVector images = getStitchingOrder(opts, imgSet, hardSeam);
+        // the icc profile is needed before the first image is remapped
+        if (!imgSet.empty())
+        {
+            vigra::ImageImportInfo info(Base::m_pano.getImage(*imgSet.begin()).getFilename().c_str());
+            iccProfile = info.getICCProfile();
+        };
+        // switch automatically to BigTIFF if the uncompressed file exceeds 4 GB
+        const double fileSize = static_cast<double>(panoROI.area()) * (TiffWriter::PixelTraits::bands + 1) * sizeof(OutType);
+        const bool useBigTIFF = GetAdvancedOption(advOptions, "useBigTIFF", false) || fileSize > 4.0e9;
+
+        Base::m_progress->setMessage("saving result", hugin_utils::stripPath(outputfile));
+        DEBUG_DEBUG("Saving panorama tile by tile: " << outputfile);
+        TiffWriter writer;
+        if (!writer.open(outputfile, panoROI.size(), tiffTileSize, panoROI.upperLeft(),
+            vigra::Size2D(opts.getWidth(), opts.getHeight()), opts.tiffCompression, iccProfile, useBigTIFF))
+        {
+            UTILS_THROW(std::runtime_error, "Could not create output file " << outputfile);
+        };
+        // the source images are needed for several tiles
+        const double cacheSize = std::max(1.0f, GetAdvancedOption(advOptions, "tileCacheSize", NONA_DEFAULT_TILE_CACHE_SIZE)) * 1024.0 * 1024.0;
+        remapper.setSourceImageCache(cacheSize);
+        try
+        {
+            stitchTiles(opts, imgSet, images, outputfile, writer, tileSize, margin, wrap, hardSeam, remapper, advOptions);
+        }
+        catch (...)
+        {
+            remapper.setSourceImageCache(0);
+            throw;
+        };
+        remapper.setSourceImageCache(0);
+        writer.close();
+        m_panoROI = panoROI;
+        return true;
+    };
+
+    /** stitch and write all tiles */
+    template <class TiffWriter>
+    void stitchTiles(const PanoramaOptions & opts, const UIntSet & imgSet, const UIntVector & images,
+                     const std::string & outputfile, TiffWriter & writer, const int tileSize, const int margin, const bool wrap, const bool hardSeam,
+                     SingleImageRemapper<ImageType, AlphaType> & remapper,
+                     const AdvancedOptions& advOptions)
+    {
+        const vigra::Rect2D panoROI(opts.getROI());
+        const int nTilesX = (panoROI.width() + tileSize - 1) / tileSize;
+        const int nTilesY = (panoROI.height() + tileSize - 1) / tileSize;
+        for (int tileY = 0; tileY < nTilesY; ++tileY)
+        {
+            for (int tileX = 0; tileX < nTilesX; ++tileX)
+            {
+                const vigra::Rect2D tile = vigra::Rect2D(panoROI.upperLeft() + vigra::Diff2D(tileX * tileSize, tileY * tileSize),
+                    vigra::Size2D(tileSize, tileSize)) & panoROI;
+                vigra::Rect2D workRect(tile);
+                workRect.addBorder(margin);
+                workRect &= panoROI;
+                const bool wrapTile = wrap && (workRect.width() == panoROI.width());
+                ImageType tileImg(workRect.size());
+                AlphaType tileAlpha(workRect.size());
+                std::ostringstream tileName;
+                tileName << "tile " << tileY * nTilesX + tileX + 1 << "/" << nTilesX * nTilesY;
+                for (UIntVector::const_iterator it = images.begin(); it != images.end(); ++it)
+                {
+                    const vigra::Rect2D roi = getROI(imgSet, *it) & workRect;
+                    if (roi.isEmpty())
+                    {
+                        continue;
+                    };
+                    RemappedPanoImage<ImageType, AlphaType> *
+                        remapped = remapper.getRemapped(Base::m_pano, getModifiedOptions(opts, *it, advOptions), *it, roi, Base::m_progress);
+                    Base::m_progress->setMessage("blending", tileName.str());
+                    try {
+                        vigra_ext::MergeImages<ImageType, AlphaType>(tileImg, tileAlpha, remapped->m_image, remapped->m_mask,
+                            remapped->boundingBox().upperLeft() - workRect.upperLeft(), wrapTile, hardSeam);
+                    } catch (vigra::PreconditionViolation & e) {
+                        DEBUG_ERROR("exception during stitching" << e.what());
+                    }
+                    remapper.release(remapped);
+                };
+                // write only the inner part, the margin belongs to the neighbouring tiles
+                if (!writer.write(tileImg, tileAlpha, vigra::Rect2D(vigra::Point2D(tile.upperLeft() - workRect.upperLeft()), tile.size()),
+                    vigra::Point2D(tile.upperLeft() - panoROI.upperLeft())))
+                {
+                    UTILS_THROW(std::runtime_error, "Could not write " << tileName.str() << " to " << outputfile);
+                };
+            };
+            // free the source images, which are not needed by the following rows of tiles
+            const int nextTop = panoROI.top() + (tileY + 1) * tileSize - margin;
+            for (UIntVector::const_iterator it = images.begin(); it != images.end(); ++it)
+            {
+                const vigra::Rect2D roi = getROI(imgSet, *it);
+                if (!roi.isEmpty() && roi.bottom() <= nextTop)
+                {
+                    remapper.releaseSourceImage(*it);
+                };
+            };
+        };
+    };
+
     vigra::ImageImportInfo::ICCProfile iccProfile;
     vigra::Rect2D m_panoROI;
 };
@@ -1056,7 +1324,8 @@ static void stitchPanoIntern(const PanoramaData & pano,
 /** stitch a panorama
  *
  * @todo vignetting correction
- * @todo do not keep complete output image in memory
+ * @todo do not keep complete output image in memory (only implemented
+ *       for TIFF output with advanced option tileSize)
  *
  */
 IMPEX void stitchPanorama(const PanoramaData & pano,
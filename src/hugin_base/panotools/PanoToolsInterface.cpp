@@ -281,6 +281,32 @@ bool Transform::transformImgCoord(double & x_dest, double & y_dest,
     return ok;
 }
 
+void Transform::transformImgCoords(const double* x, const double* y, double* x_dest, double* y_dest,
+                                   unsigned char* valid, size_t n) const
+{
+    const double srcOffsetX = m_srcTX - 0.5;
+    const double srcOffsetY = m_srcTY - 0.5;
+    const double destOffsetX = m_destTX - 0.5;
+    const double destOffsetY = m_destTY - 0.5;
+    void * params = (void *) (&m_stack);
+    for (size_t i = 0; i < n; ++i)
+    {
+        if (execute_stack_new(x[i] - srcOffsetX, y[i] - srcOffsetY, &x_dest[i], &y_dest[i], params) != 0)
+        {
+            x_dest[i] += destOffsetX;
+            y_dest[i] += destOffsetY;
+            valid[i] = 1;
+        }
+        else
+        {
+            // same as transformImgCoord: set to a point outside of the image
+            x_dest[i] = -1;
+            y_dest[i] = -1;
+            valid[i] = 0;
+        };
+    };
+}
+
 
 VariableMapVector GetAlignInfoVariables(const AlignInfo& gl)
 {
@@ -215,6 +215,18 @@ class IMPEX Transform
 
         bool transformImgCoordPartial(double & x_dest, double & y_dest, double x_src, double y_src) const;
 
+        /** transform n points in image coordinates at once.
+         *  The stack of libpano13 is opaque, so each point is still transformed
+         *  by execute_stack_new. There are no SIMD kernels, the function only
+         *  provides the same interface as SpaceTransform::transformImgCoords.
+         *  @param x, y input coordinates
+         *  @param x_dest, y_dest output coordinates
+         *  @param valid set to 1 for each successful transformed point, 0 otherwise
+         *  @param n number of points
+         */
+        void transformImgCoords(const double* x, const double* y, double* x_dest, double* y_dest,
+                                unsigned char* valid, size_t n) const;
+
         ///
         bool transformImgCoord(hugin_utils::FDiff2D& dest, const hugin_utils::FDiff2D & src) const
             { return transformImgCoord(dest.x, dest.y, src.x, src.y); }
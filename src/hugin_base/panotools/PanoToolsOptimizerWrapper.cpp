@@ -57,9 +57,16 @@
 
 namespace HuginBase { namespace PTools {
 
+std::mutex& GetOptimizerMutex()
+{
+    static std::mutex optimizerMutex;
+    return optimizerMutex;
+}
+
 unsigned int optimize(PanoramaData& pano,
                       const char * userScript)
 {
+    std::lock_guard<std::mutex> lock(GetOptimizerMutex());
     char * script = 0;
     unsigned int retval = 0;
 
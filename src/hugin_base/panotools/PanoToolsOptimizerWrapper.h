@@ -26,6 +26,7 @@
 #ifndef _PANOTOOLS_PTOPTIMISE_H
 #define _PANOTOOLS_PTOPTIMISE_H
 
+#include <mutex>
 #include <panodata/PanoramaData.h>
 
 
@@ -58,6 +59,12 @@ namespace PTools
     IMPEX unsigned int optimize(PanoramaData & pano,
                   const char * script = 0);
 
+    /** libpano13 keeps the state of the optimizer in global variables (see SetGlobalPtr),
+     *  so optimize and calcCtrlPointErrors lock this mutex and can be called from
+     *  several threads, but run one after the other.
+     *  For concurrent optimisations use BundleAdjuster */
+    IMPEX std::mutex& GetOptimizerMutex();
+
 } // namespace
 } // namespace
 
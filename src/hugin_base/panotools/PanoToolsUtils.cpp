@@ -47,6 +47,7 @@
 
 #include "PanoToolsInterface.h"
 #include "PanoToolsUtils.h"
+#include "PanoToolsOptimizerWrapper.h"
 
 namespace HuginBase { namespace PTools {
 
@@ -54,6 +55,8 @@ void calcCtrlPointErrors (PanoramaData& pano)
 {
     if(pano.getNrOfImages()>0 && pano.getNrOfCtrlPoints()>0)
     {
+        // the global state of libpano13 and the locale are changed
+        std::lock_guard<std::mutex> lock(GetOptimizerMutex());
         char * p=setlocale(LC_ALL,NULL);
         char * oldlocale=strdup(p);
         setlocale(LC_ALL,"C");
@@ -26,6 +26,7 @@
 
 #include <vector>
 #include <functional>
+#include <type_traits>
 #include "hugin_config.h"
 #include <random>
 
@@ -176,6 +177,7 @@ class InvResponseTransform : public ResponseTransform<VTIn>
 				vigra_ext::enforceMonotonicity(Base::m_lutR);
                 invertLUT();
 		        m_lutRInvFunc = vigra_ext::LUTFunctor<VT1, LUT>(m_lutRInv);
+                m_precomputed = false;
 			}
 		}
 
@@ -225,7 +227,25 @@ class InvResponseTransform : public ResponseTransform<VTIn>
         
         void emitGLSL(std::ostringstream& oss, std::vector<double>& invLut, std::vector<double>& destLut) const;
 
+        /** precalculate lookup tables for the remapping of 8 and 16 bit images.
+         *
+         *  The inverse response, the exposure and the white balance are folded
+         *  into a float table per channel, which is indexed by the pixel value.
+         *  The inverse radial vignetting factor is tabulated over the squared
+         *  radius. With the tables the correction of a pixel needs only two
+         *  lookups and a multiplication (plus the output transform).
+         *  Has to be called after setOutput() or setHDROutput(), which discard
+         *  the tables. For other pixel types it does nothing.
+         */
+        void precompute();
+
+        /** returns true, if the precalculated tables are used */
+        bool isPrecomputed() const { return m_precomputed; };
+
     private:
+        /** returns 1/vignetting factor at the given position, uses the table if possible */
+        double invVigFactor(const hugin_utils::FDiff2D & pos) const;
+
         void invertLUT()
         {
             m_lutRInv.clear();
@@ -248,6 +268,11 @@ class InvResponseTransform : public ResponseTransform<VTIn>
         double m_destExposure;
         bool m_hdrMode;
         double m_intScale;
+        /** precalculated tables, see precompute() */
+        bool m_precomputed;
+        std::vector<float> m_precomputedLut[3];
+        std::vector<float> m_invVigLut;
+        double m_invVigLutScale;
         
     private:
         std::mt19937 Twister;
@@ -421,11 +446,13 @@ InvResponseTransform<VTIn,VTOut>::InvResponseTransform()
     m_destExposure = 1.0;
     m_hdrMode = false;
     m_intScale = 1;
+    m_precomputed = false;
+    m_invVigLutScale = 0;
 }
 
 template <class VTIn, class VTOut>
 InvResponseTransform<VTIn,VTOut>::InvResponseTransform(const HuginBase::SrcPanoImage & src)
-: Base(src), m_hdrMode(false)
+: Base(src), m_hdrMode(false), m_precomputed(false), m_invVigLutScale(0)
 {
     m_destExposure = 1.0;
     m_intScale = 1;
@@ -440,6 +467,7 @@ void InvResponseTransform<VTIn,VTOut>::init(const HuginBase::SrcPanoImage & src)
 {
     m_destExposure = 1.0;
     m_intScale = 1;
+    m_precomputed = false;
     Base::init(src);
     if (!Base::m_lutR.empty()) {
         invertLUT();
@@ -454,6 +482,7 @@ void InvResponseTransform<VTIn,VTOut>::setHDROutput(bool hdrMode, double destExp
     m_intScale = 1;
     m_destExposure = destExposure;
     m_destLut.clear();
+    m_precomputed = false;
 }
 
 template <class VTIn, class VTOut>
@@ -466,6 +495,85 @@ void InvResponseTransform<VTIn,VTOut>::setOutput(double destExposure, const LUTD
     }
     m_destExposure = destExposure;
     m_intScale = scale;
+    m_precomputed = false;
+}
+
+template <class VTIn, class VTOut>
+void InvResponseTransform<VTIn,VTOut>::precompute()
+{
+    m_precomputed = false;
+    for (size_t c = 0; c < 3; ++c)
+    {
+        m_precomputedLut[c].clear();
+    };
+    m_invVigLut.clear();
+    // the tables are indexed by the pixel value, so only small unsigned integer types are supported
+    if (!std::is_integral<VT1>::value || !std::is_unsigned<VT1>::value || sizeof(VT1) > 2)
+    {
+        return;
+    };
+    const size_t lutSize = static_cast<size_t>(vigra_ext::LUTTraits<VT1>::max()) + 1;
+    const double exposureScale = m_destExposure / Base::m_srcExposure;
+    const double channelScale[3] = { exposureScale / Base::m_WhiteBalanceRed, exposureScale, exposureScale / Base::m_WhiteBalanceBlue };
+    for (size_t c = 0; c < 3; ++c)
+    {
+        m_precomputedLut[c].resize(lutSize);
+    };
+    for (size_t i = 0; i < lutSize; ++i)
+    {
+        // use the same inverse response as apply()
+        double v;
+        if (!Base::m_lutR.empty()) {
+            v = m_lutRInvFunc(static_cast<VT1>(i));
+        } else {
+            v = static_cast<double>(i) / vigra_ext::LUTTraits<VT1>::max();
+        }
+        for (size_t c = 0; c < 3; ++c)
+        {
+            m_precomputedLut[c][i] = static_cast<float>(v * channelScale[c]);
+        };
+    };
+    if (Base::m_VigCorrMode & HuginBase::SrcPanoImage::VIGCORR_RADIAL)
+    {
+        // tabulate 1/vignetting over the squared (normalized) radius, the table covers
+        // the image with some margin, positions outside are calculated exactly
+        double maxR2 = 0;
+        for (int i = 0; i < 4; ++i)
+        {
+            hugin_utils::FDiff2D corner((i & 1) ? Base::m_src.getSize().x : 0, (i & 2) ? Base::m_src.getSize().y : 0);
+            corner = (corner - Base::m_RadialVigCorrCenter) * Base::m_radiusScale;
+            maxR2 = std::max(maxR2, corner.x * corner.x + corner.y * corner.y);
+        };
+        maxR2 *= 1.1;
+        const size_t vigLutSize = 4096;
+        m_invVigLutScale = vigLutSize / maxR2;
+        m_invVigLut.resize(vigLutSize + 1);
+        for (size_t i = 0; i <= vigLutSize; ++i)
+        {
+            const double r2 = i / m_invVigLutScale;
+            const double vig = Base::m_RadialVigCorrCoeff[0] + r2 * (Base::m_RadialVigCorrCoeff[1] +
+                r2 * (Base::m_RadialVigCorrCoeff[2] + r2 * Base::m_RadialVigCorrCoeff[3]));
+            m_invVigLut[i] = static_cast<float>(1.0 / vig);
+        };
+    };
+    m_precomputed = true;
+}
+
+template <class VTIn, class VTOut>
+double InvResponseTransform<VTIn,VTOut>::invVigFactor(const hugin_utils::FDiff2D & pos) const
+{
+    if (!m_invVigLut.empty())
+    {
+        const hugin_utils::FDiff2D d = (pos - Base::m_RadialVigCorrCenter) * Base::m_radiusScale;
+        const double x = (d.x * d.x + d.y * d.y) * m_invVigLutScale;
+        const size_t i = static_cast<size_t>(x);
+        if (i + 1 < m_invVigLut.size())
+        {
+            const double f = x - i;
+            return (1 - f) * m_invVigLut[i] + f * m_invVigLut[i + 1];
+        };
+    };
+    return 1.0 / Base::calcVigFactor(pos);
 }
 
 
@@ -495,13 +603,18 @@ InvResponseTransform<VTIn,VTOut>::apply(VT1 v, const hugin_utils::FDiff2D & pos,
 {
     // inverse response
     typename vigra::NumericTraits<VT1>::RealPromote ret(v);
-    if (!Base::m_lutR.empty()) {
-        ret = m_lutRInvFunc(v);
+    if (m_precomputed) {
+        // inverse response, exposure and vignetting from the tables
+        ret = m_precomputedLut[1][static_cast<size_t>(v)] * invVigFactor(pos);
     } else {
-        ret /= vigra_ext::LUTTraits<VT1>::max();
+        if (!Base::m_lutR.empty()) {
+            ret = m_lutRInvFunc(v);
+        } else {
+            ret /= vigra_ext::LUTTraits<VT1>::max();
+        }
+        // inverse vignetting and exposure
+        ret *= m_destExposure / (Base::calcVigFactor(pos) * Base::m_srcExposure);
     }
-    // inverse vignetting and exposure
-    ret *= m_destExposure / (Base::calcVigFactor(pos) * Base::m_srcExposure);
     // apply output transform if required
     if (!m_destLut.empty()) {
         ret = m_destLutFunc(ret);
@@ -519,16 +632,24 @@ typename vigra::NumericTraits<vigra::RGBValue<typename InvResponseTransform<VTIn
 InvResponseTransform<VTIn,VTOut>::apply(vigra::RGBValue<VT1> v, const hugin_utils::FDiff2D & pos, vigra::VigraFalseType) const
 {
     typename vigra::NumericTraits<vigra::RGBValue<VT1> >::RealPromote ret(v);
-    if (!Base::m_lutR.empty()) {
-        ret = m_lutRInvFunc(v);
+    if (m_precomputed) {
+        // inverse response, exposure, white balance and vignetting from the tables
+        const double invVig = invVigFactor(pos);
+        for (size_t i = 0; i < 3; i++) {
+            ret[i] = m_precomputedLut[i][static_cast<size_t>(v[i])] * invVig;
+        }
     } else {
-        ret /= vigra_ext::LUTTraits<VT1>::max();
-    }
+        if (!Base::m_lutR.empty()) {
+            ret = m_lutRInvFunc(v);
+        } else {
+            ret /= vigra_ext::LUTTraits<VT1>::max();
+        }
 
-    // inverse vignetting and exposure
-    ret *= m_destExposure/(Base::calcVigFactor(pos)*Base::m_srcExposure);
-    ret.red() /= Base::m_WhiteBalanceRed;
-    ret.blue() /= Base::m_WhiteBalanceBlue;
+        // inverse vignetting and exposure
+        ret *= m_destExposure/(Base::calcVigFactor(pos)*Base::m_srcExposure);
+        ret.red() /= Base::m_WhiteBalanceRed;
+        ret.blue() /= Base::m_WhiteBalanceBlue;
+    }
     // apply output transform if required
     if (!m_destLut.empty()) {
         ret = m_destLutFunc(ret);
@@ -0,0 +1,379 @@
+// -*- c-basic-offset: 4 -*-
+
+/** @file BundleAdjusterTest.cpp
+ *
+ *  @brief comparison of the native optimizer with the libpano13 optimizer
+ *
+ *  Builds synthetic projects for the variable sets supported by the
+ *  BundleAdjuster, the control points are generated from known image
+ *  variables with the remapping transformation. Both optimizers start
+ *  from the same perturbed variables. With exact control points both must
+ *  find the true variables, with noisy control points the variables and
+ *  the control point errors of both results must agree.
+ *
+ *  The errors of both results are compared with PTools::calcCtrlPointErrors.
+ *  The BundleAdjuster reports the angle between the rays in pixels of the
+ *  panorama (see BundleAdjuster.h), libpano13 the distance in the
+ *  equirectangular panorama, which does not scale the difference in
+ *  longitude with the cosine of the latitude. The projects stay near the
+ *  horizon, so both agree within MetricDifference.
+ *
+ */
+
+/*  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This software is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public
+ *  License along with this software. If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <iostream>
+#include <sstream>
+#include <cmath>
+#include <vector>
+#include <string>
+#include <set>
+#include <random>
+#include <algorithm>
+#include <panodata/Panorama.h>
+#include <nona/SpaceTransform.h>
+#include <panotools/PanoToolsOptimizerWrapper.h>
+#include <panotools/PanoToolsUtils.h>
+#include <algorithms/optimizer/BundleAdjuster.h>
+
+/** standard deviation of the noise added to the control points in pixel */
+static const double Noise = 0.5;
+
+/** maximal relative difference of the mean control point errors of both results */
+static const double ErrorDifference = 0.05;
+
+/** maximal relative difference between the native and the libpano13 error metric */
+static const double MetricDifference = 0.15;
+
+/** maximal mean control point error for exact control points in pixel */
+static const double ExactError = 0.02;
+
+/** allowed differences of the variables, for exact and for noisy control points */
+struct Tolerance
+{
+    /** y, p, r and v in degree */
+    double angle;
+    /** a, b and c */
+    double distortion;
+    /** d and e in pixel */
+    double shift;
+};
+
+static const Tolerance ExactTolerance = { 0.005, 5e-5, 0.05 };
+static const Tolerance NoisyTolerance = { 0.02, 5e-4, 0.5 };
+
+/** description of a synthetic project */
+struct TestCase
+{
+    std::string name;
+    HuginBase::SrcPanoImage::Projection projection;
+    double hfov;
+    /** optimized lens variables, y, p and r are optimized for all images except the anchor */
+    std::set<std::string> lensVars;
+    /** yaw and pitch of the images */
+    std::vector<std::pair<double, double> > positions;
+};
+
+/** difference of two angles in degree */
+static double AngleDifference(double a, double b)
+{
+    double diff = std::fmod(std::abs(a - b), 360.0);
+    return std::min(diff, 360.0 - diff);
+}
+
+/** builds the project with the true variables and exact or noisy control points
+ *  and the project with the perturbed start values */
+static void BuildProject(const TestCase& test, double noise, HuginBase::Panorama& truth, HuginBase::Panorama& start)
+{
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<double> offset(-1.0, 1.0);
+    std::normal_distribution<double> cpNoise(0.0, noise > 0 ? noise : 1.0);
+    HuginBase::PanoramaOptions opts;
+    opts.setProjection(HuginBase::PanoramaOptions::EQUIRECTANGULAR);
+    opts.setHFOV(360);
+    opts.setWidth(20000);
+    opts.setHeight(10000);
+    truth.setOptions(opts);
+    start.setOptions(opts);
+
+    // true lens, only the optimized variables differ from the defaults
+    const bool optA = test.lensVars.count("a") > 0;
+    const bool optB = test.lensVars.count("b") > 0;
+    const bool optC = test.lensVars.count("c") > 0;
+    const bool optShift = test.lensVars.count("d") > 0;
+    std::vector<double> trueDist(4, 0.0);
+    trueDist[0] = optA ? 0.002 : 0.0;
+    trueDist[1] = optB ? -0.015 : 0.0;
+    trueDist[2] = optC ? 0.01 : 0.0;
+    trueDist[3] = 1.0 - trueDist[0] - trueDist[1] - trueDist[2];
+    const hugin_utils::FDiff2D trueShift = optShift ? hugin_utils::FDiff2D(12, -9) : hugin_utils::FDiff2D(0, 0);
+    std::vector<double> startDist(trueDist);
+    startDist[0] += optA ? -0.002 : 0.0;
+    startDist[1] += optB ? 0.01 : 0.0;
+    startDist[2] += optC ? -0.005 : 0.0;
+    startDist[3] = 1.0 - startDist[0] - startDist[1] - startDist[2];
+
+    std::vector<HuginBase::SrcPanoImage> images;
+    for (size_t i = 0; i < test.positions.size(); ++i)
+    {
+        HuginBase::SrcPanoImage img;
+        std::ostringstream filename;
+        filename << "image" << i << ".jpg";
+        img.setFilename(filename.str());
+        img.setSize(vigra::Size2D(3000, 2000));
+        img.setProjection(test.projection);
+        img.setHFOV(test.hfov);
+        img.setYaw(test.positions[i].first + 3.0 * offset(rng));
+        img.setPitch(test.positions[i].second + 3.0 * offset(rng));
+        img.setRoll(3.0 * offset(rng));
+        img.setRadialDistortion(trueDist);
+        img.setRadialDistortionCenterShift(trueShift);
+        images.push_back(img);
+        truth.addImage(img);
+        // the anchor image keeps its position
+        if (i > 0)
+        {
+            img.setYaw(img.getYaw() + 1.5 * offset(rng));
+            img.setPitch(img.getPitch() + 1.5 * offset(rng));
+            img.setRoll(img.getRoll() + 1.5 * offset(rng));
+        };
+        if (test.lensVars.count("v") > 0)
+        {
+            img.setHFOV(test.hfov * 1.02);
+        };
+        img.setRadialDistortion(startDist);
+        if (optShift)
+        {
+            img.setRadialDistortionCenterShift(trueShift + hugin_utils::FDiff2D(-4, 4));
+        };
+        start.addImage(img);
+    };
+    for (unsigned int i = 1; i < images.size(); ++i)
+    {
+        start.linkImageVariableHFOV(0, i);
+        start.linkImageVariableRadialDistortion(0, i);
+        start.linkImageVariableRadialDistortionCenterShift(0, i);
+    };
+
+    // control points on a grid of each image, which are also visible in the other image
+    std::vector<HuginBase::Nona::SpaceTransform> toPano(images.size());
+    std::vector<HuginBase::Nona::SpaceTransform> toImage(images.size());
+    for (size_t i = 0; i < images.size(); ++i)
+    {
+        toPano[i].createInvTransform(images[i], opts);
+        toImage[i].createTransform(images[i], opts);
+    };
+    HuginBase::CPVector cps;
+    for (unsigned int i = 0; i < images.size(); ++i)
+    {
+        for (unsigned int j = i + 1; j < images.size(); ++j)
+        {
+            for (int y = 100; y < 2000; y += 150)
+            {
+                for (int x = 100; x < 3000; x += 150)
+                {
+                    hugin_utils::FDiff2D panoPos;
+                    hugin_utils::FDiff2D imgPos;
+                    hugin_utils::FDiff2D panoPos2;
+                    if (!toPano[i].transformImgCoord(panoPos, hugin_utils::FDiff2D(x, y)) ||
+                        !toImage[j].transformImgCoord(imgPos, panoPos) ||
+                        imgPos.x < 50 || imgPos.x > 2950 || imgPos.y < 50 || imgPos.y > 1950 ||
+                        !toPano[j].transformImgCoord(panoPos2, imgPos))
+                    {
+                        continue;
+                    };
+                    // rectilinear images map the directions behind the camera into the image too
+                    const double dx = std::fmod(std::abs(panoPos.x - panoPos2.x), opts.getWidth());
+                    if (std::min(dx, opts.getWidth() - dx) > 1e-3 || std::abs(panoPos.y - panoPos2.y) > 1e-3)
+                    {
+                        continue;
+                    };
+                    if (noise > 0)
+                    {
+                        imgPos.x += cpNoise(rng);
+                        imgPos.y += cpNoise(rng);
+                    };
+                    cps.push_back(HuginBase::ControlPoint(i, x, y, j, imgPos.x, imgPos.y));
+                };
+            };
+        };
+    };
+    truth.setCtrlPoints(cps);
+    start.setCtrlPoints(cps);
+
+    HuginBase::OptimizeVector optvec(images.size(), test.lensVars);
+    for (size_t i = 1; i < images.size(); ++i)
+    {
+        optvec[i].insert("y");
+        optvec[i].insert("p");
+        optvec[i].insert("r");
+    };
+    start.setOptimizeVector(optvec);
+}
+
+/** largest differences of the variables of both projects */
+static Tolerance VariableDifference(const HuginBase::Panorama& pano1, const HuginBase::Panorama& pano2)
+{
+    Tolerance diff = { 0, 0, 0 };
+    for (size_t i = 0; i < pano1.getNrOfImages(); ++i)
+    {
+        const HuginBase::SrcPanoImage& img1 = pano1.getImage(i);
+        const HuginBase::SrcPanoImage& img2 = pano2.getImage(i);
+        diff.angle = std::max({ diff.angle, AngleDifference(img1.getYaw(), img2.getYaw()),
+            AngleDifference(img1.getPitch(), img2.getPitch()), AngleDifference(img1.getRoll(), img2.getRoll()),
+            std::abs(img1.getHFOV() - img2.getHFOV()) });
+        for (size_t k = 0; k < 3; ++k)
+        {
+            diff.distortion = std::max(diff.distortion, std::abs(img1.getRadialDistortion()[k] - img2.getRadialDistortion()[k]));
+        };
+        diff.shift = std::max({ diff.shift, std::abs(img1.getRadialDistortionCenterShift().x - img2.getRadialDistortionCenterShift().x),
+            std::abs(img1.getRadialDistortionCenterShift().y - img2.getRadialDistortionCenterShift().y) });
+    };
+    return diff;
+}
+
+/** mean control point error in the metric of libpano13 */
+static double MeanError(const HuginBase::Panorama& pano)
+{
+    HuginBase::Panorama copy(pano.duplicate());
+    HuginBase::PTools::calcCtrlPointErrors(copy);
+    const HuginBase::CPVector& cps = copy.getCtrlPoints();
+    double error = 0;
+    for (size_t i = 0; i < cps.size(); ++i)
+    {
+        error += cps[i].error;
+    };
+    return cps.empty() ? 0.0 : error / cps.size();
+}
+
+/** mean control point error as stored in the project */
+static double StoredMeanError(const HuginBase::Panorama& pano)
+{
+    const HuginBase::CPVector& cps = pano.getCtrlPoints();
+    double error = 0;
+    for (size_t i = 0; i < cps.size(); ++i)
+    {
+        error += cps[i].error;
+    };
+    return cps.empty() ? 0.0 : error / cps.size();
+}
+
+/** checks the differences of the variables against the tolerance */
+static int CheckVariables(const std::string& name, const std::string& what, const Tolerance& diff, const Tolerance& tolerance)
+{
+    if (diff.angle <= tolerance.angle && diff.distortion <= tolerance.distortion && diff.shift <= tolerance.shift)
+    {
+        return 0;
+    };
+    std::cerr << "FAILED: " << name << ": " << what << " differ by " << diff.angle << " deg, "
+              << diff.distortion << " (a, b, c), " << diff.shift << " pixel (d, e)" << std::endl;
+    return 1;
+}
+
+/** optimizes the project with both optimizers and compares the results,
+ *  returns the number of failed checks */
+static int RunTest(const TestCase& test, double noise, int& tested)
+{
+    std::ostringstream nameStream;
+    nameStream << test.name << (noise > 0 ? ", noisy" : ", exact");
+    const std::string name = nameStream.str();
+    HuginBase::Panorama truth;
+    HuginBase::Panorama native;
+    BuildProject(test, noise, truth, native);
+    HuginBase::Panorama libpano(native.duplicate());
+    tested += 3;
+    if (!HuginBase::BundleAdjuster::canOptimize(native))
+    {
+        std::cerr << "FAILED: " << name << ": project not supported by the BundleAdjuster" << std::endl;
+        return 1;
+    };
+    if (HuginBase::BundleAdjuster::optimize(native) != 0 || HuginBase::PTools::optimize(libpano) != 0)
+    {
+        std::cerr << "FAILED: " << name << ": optimization failed" << std::endl;
+        return 1;
+    };
+    const Tolerance& tolerance = noise > 0 ? NoisyTolerance : ExactTolerance;
+    int failed = 0;
+    failed += CheckVariables(name, "variables of both optimizers", VariableDifference(native, libpano), tolerance);
+    const double nativeError = MeanError(native);
+    const double libpanoError = MeanError(libpano);
+    const double storedError = StoredMeanError(native);
+    if (noise > 0)
+    {
+        if (std::abs(nativeError - libpanoError) > ErrorDifference * libpanoError)
+        {
+            std::cerr << "FAILED: " << name << ": mean control point error " << nativeError
+                      << " (native), " << libpanoError << " (libpano13)" << std::endl;
+            ++failed;
+        };
+        if (std::abs(storedError - nativeError) > MetricDifference * nativeError)
+        {
+            std::cerr << "FAILED: " << name << ": mean control point error of the native metric " << storedError
+                      << ", of libpano13 " << nativeError << std::endl;
+            ++failed;
+        };
+    }
+    else
+    {
+        failed += CheckVariables(name, "native variables and true variables", VariableDifference(native, truth), tolerance);
+        if (nativeError > ExactError || libpanoError > ExactError || storedError > ExactError)
+        {
+            std::cerr << "FAILED: " << name << ": mean control point error " << nativeError << " (native), "
+                      << libpanoError << " (libpano13), " << storedError << " (native metric)" << std::endl;
+            ++failed;
+        };
+    };
+    return failed;
+}
+
+int main()
+{
+    std::vector<std::pair<double, double> > rectilinear;
+    for (int pitch = -12; pitch <= 12; pitch += 24)
+    {
+        for (int yaw = -30; yaw <= 30; yaw += 30)
+        {
+            rectilinear.push_back(std::make_pair(yaw, pitch));
+        };
+    };
+    std::vector<std::pair<double, double> > fisheye;
+    for (int yaw = 0; yaw < 360; yaw += 90)
+    {
+        fisheye.push_back(std::make_pair(yaw, 0));
+    };
+    std::vector<TestCase> tests;
+    tests.push_back({ "rectilinear y, p, r", HuginBase::SrcPanoImage::RECTILINEAR, 50, {}, rectilinear });
+    tests.push_back({ "rectilinear y, p, r, v", HuginBase::SrcPanoImage::RECTILINEAR, 50, { "v" }, rectilinear });
+    tests.push_back({ "rectilinear y, p, r, v, b", HuginBase::SrcPanoImage::RECTILINEAR, 50, { "v", "b" }, rectilinear });
+    tests.push_back({ "rectilinear y, p, r, v, a, b, c", HuginBase::SrcPanoImage::RECTILINEAR, 50,
+        { "v", "a", "b", "c" }, rectilinear });
+    tests.push_back({ "rectilinear y, p, r, v, a, b, c, d, e", HuginBase::SrcPanoImage::RECTILINEAR, 50,
+        { "v", "a", "b", "c", "d", "e" }, rectilinear });
+    tests.push_back({ "fisheye y, p, r, v, b", HuginBase::SrcPanoImage::FULL_FRAME_FISHEYE, 120, { "v", "b" }, fisheye });
+    tests.push_back({ "fisheye y, p, r, v, a, b, c, d, e", HuginBase::SrcPanoImage::FULL_FRAME_FISHEYE, 120,
+        { "v", "a", "b", "c", "d", "e" }, fisheye });
+
+    int failed = 0;
+    int tested = 0;
+    for (size_t i = 0; i < tests.size(); ++i)
+    {
+        failed += RunTest(tests[i], 0.0, tested);
+        failed += RunTest(tests[i], Noise, tested);
+    };
+    std::cout << tested << " comparisons tested, " << failed << " failed" << std::endl;
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,171 @@
+// -*- c-basic-offset: 4 -*-
+
+/** @file RotationTest.cpp
+ *
+ *  @brief round trip test of the panotools style rotation matrices
+ *
+ *  Checks that Matrix3::GetRotationPT recovers the rotation set with
+ *  Matrix3::SetRotationPT, also at pitch +-90 deg, and that the directions
+ *  in the frame of SetRotationPT match the remapping of rotated images, as
+ *  used by the cluster alignment of the HierarchicalOptimizer.
+ *
+ */
+
+/*  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This software is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public
+ *  License along with this software. If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <iostream>
+#include <sstream>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include <hugin_math/hugin_math.h>
+#include <hugin_math/Matrix3.h>
+#include <panodata/SrcPanoImage.h>
+#include <panodata/PanoramaOptions.h>
+#include <nona/SpaceTransform.h>
+
+/** maximal allowed difference of the matrix elements and directions */
+static const double MaxDifference = 1e-9;
+
+/** largest difference of the elements of two matrices */
+static double MatrixDifference(const Matrix3& a, const Matrix3& b)
+{
+    double diff = 0;
+    for (int i = 0; i < 3; ++i)
+    {
+        for (int j = 0; j < 3; ++j)
+        {
+            diff = std::max(diff, std::abs(a.m[i][j] - b.m[i][j]));
+        };
+    };
+    return diff;
+}
+
+/** direction of a point in the image in the frame of Matrix3::SetRotationPT,
+ *  calculated with the remapping into an equirectangular panorama */
+static Vector3 ImageDirection(const HuginBase::SrcPanoImage& img, const HuginBase::PanoramaOptions& opts, const hugin_utils::FDiff2D& point)
+{
+    HuginBase::Nona::SpaceTransform transf;
+    transf.createInvTransform(img, opts);
+    hugin_utils::FDiff2D p;
+    transf.transformImgCoord(p, point);
+    const double lon = (p.x + 0.5 - 0.5 * opts.getWidth()) * 2.0 * PI / opts.getWidth();
+    const double lat = (p.y + 0.5 - 0.5 * opts.getHeight()) * PI / opts.getHeight();
+    return Vector3(cos(lat) * cos(lon), -cos(lat) * sin(lon), -sin(lat));
+}
+
+int main()
+{
+    int failed = 0;
+    int tested = 0;
+    // round trip of the angles, at pitch +-90 deg only the matrix is unique
+    for (int yaw = -180; yaw < 180; yaw += 15)
+    {
+        for (int pitch = -90; pitch <= 90; pitch += 15)
+        {
+            for (int roll = -180; roll < 180; roll += 15)
+            {
+                Matrix3 rot;
+                rot.SetRotationPT(DEG_TO_RAD(yaw), DEG_TO_RAD(pitch), DEG_TO_RAD(roll));
+                double y, p, r;
+                rot.GetRotationPT(y, p, r);
+                Matrix3 rot2;
+                rot2.SetRotationPT(y, p, r);
+                const double diff = MatrixDifference(rot, rot2);
+                ++tested;
+                if (!(diff <= MaxDifference) || std::abs(RAD_TO_DEG(p) - pitch) > 1e-6)
+                {
+                    std::cerr << "FAILED: yaw " << yaw << ", pitch " << pitch << ", roll " << roll
+                              << ": round trip gives yaw " << RAD_TO_DEG(y) << ", pitch " << RAD_TO_DEG(p)
+                              << ", roll " << RAD_TO_DEG(r) << ", matrix difference " << diff << std::endl;
+                    ++failed;
+                };
+            };
+        };
+    };
+    // the rotation of the image maps the direction of the unrotated image to the
+    // direction in the panorama, a cluster rotation applied with TransformVector
+    // gives the same directions as the image rotated by the combined angles
+    HuginBase::PanoramaOptions opts;
+    opts.setProjection(HuginBase::PanoramaOptions::EQUIRECTANGULAR);
+    opts.setWidth(3600);
+    opts.setHeight(1800);
+    opts.setHFOV(360);
+    HuginBase::SrcPanoImage img;
+    img.setSize(vigra::Size2D(600, 400));
+    img.setProjection(HuginBase::SrcPanoImage::RECTILINEAR);
+    img.setHFOV(60);
+    const double angles[][3] = { { 12.5, -7.25, 3.5 }, { -100, 40, 170 }, { 33, 80, -20 }, { 150, -60, -95 } };
+    const Vector3 clusterRotation(0.3, -0.2, 0.5);
+    Matrix3 cluster = GetRotationAroundU(clusterRotation);
+    for (size_t i = 0; i < sizeof(angles) / sizeof(angles[0]); ++i)
+    {
+        img.setYaw(0);
+        img.setPitch(0);
+        img.setRoll(0);
+        std::vector<Vector3> camera;
+        for (int y = 0; y <= 400; y += 100)
+        {
+            for (int x = 0; x <= 600; x += 150)
+            {
+                camera.push_back(ImageDirection(img, opts, hugin_utils::FDiff2D(x, y)));
+            };
+        };
+        img.setYaw(angles[i][0]);
+        img.setPitch(angles[i][1]);
+        img.setRoll(angles[i][2]);
+        Matrix3 rot;
+        rot.SetRotationPT(DEG_TO_RAD(angles[i][0]), DEG_TO_RAD(angles[i][1]), DEG_TO_RAD(angles[i][2]));
+        Matrix3 combined = cluster.Transpose() * rot;
+        double y, p, r;
+        combined.GetRotationPT(y, p, r);
+        HuginBase::SrcPanoImage rotatedImg(img);
+        rotatedImg.setYaw(RAD_TO_DEG(y));
+        rotatedImg.setPitch(RAD_TO_DEG(p));
+        rotatedImg.setRoll(RAD_TO_DEG(r));
+        const Matrix3 rotTransposed = rot.Transpose();
+        double maxDiff = 0;
+        double maxClusterDiff = 0;
+        size_t k = 0;
+        for (int yPos = 0; yPos <= 400; yPos += 100)
+        {
+            for (int xPos = 0; xPos <= 600; xPos += 150, ++k)
+            {
+                const hugin_utils::FDiff2D point(xPos, yPos);
+                const Vector3 dir = ImageDirection(img, opts, point);
+                maxDiff = std::max(maxDiff, (rotTransposed.TransformVector(camera[k]) - dir).Norm());
+                maxClusterDiff = std::max(maxClusterDiff,
+                    (cluster.TransformVector(dir) - ImageDirection(rotatedImg, opts, point)).Norm());
+            };
+        };
+        tested += 2;
+        std::ostringstream name;
+        name << "yaw " << angles[i][0] << ", pitch " << angles[i][1] << ", roll " << angles[i][2];
+        if (!(maxDiff <= MaxDifference))
+        {
+            std::cerr << "FAILED: " << name.str() << ": rotated directions differ by " << maxDiff << std::endl;
+            ++failed;
+        };
+        if (!(maxClusterDiff <= MaxDifference))
+        {
+            std::cerr << "FAILED: " << name.str() << ": directions after the cluster rotation differ by " << maxClusterDiff << std::endl;
+            ++failed;
+        };
+    };
+    std::cout << tested << " rotations tested, " << failed << " failed" << std::endl;
+    return failed == 0 ? 0 : 1;
+}
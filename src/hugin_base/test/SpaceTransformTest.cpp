@@ -0,0 +1,256 @@
+// -*- c-basic-offset: 4 -*-
+
+/** @file SpaceTransformTest.cpp
+ *
+ *  @brief conformance test of the fused transformation stacks
+ *
+ *  Compares the fused functions of SpaceTransform with the generic
+ *  interpreter for all combinations of source and panorama projections
+ *  in both directions and for the radial distortion correction stacks.
+ *  The batch transformation is compared with the single point version.
+ *  The inverse transformation must map the image into the panorama, so that
+ *  the transformation back gives the original image coordinates.
+ *
+ */
+
+/*  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This software is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public
+ *  License along with this software. If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <iostream>
+#include <sstream>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include <panodata/SrcPanoImage.h>
+#include <panodata/PanoramaOptions.h>
+#include <nona/SpaceTransform.h>
+
+/** maximal allowed difference between fused and interpreted results in pixel */
+static const double MaxDifference = 1e-9;
+
+/** maximal allowed difference of the round trip image->pano->image in pixel */
+static const double RoundTripDifference = 1e-6;
+
+/** difference of two results, NaN or inf in both results count as equal */
+static double Difference(double a, double b)
+{
+    if (std::isfinite(a) && std::isfinite(b))
+    {
+        return std::abs(a - b);
+    };
+    if (std::isnan(a) && std::isnan(b))
+    {
+        return 0;
+    };
+    return (a == b) ? 0 : HUGE_VAL;
+}
+
+/** compares the fused transformation with the interpreter and the batch with the
+ *  single point transformation on a grid of points covering the source area and
+ *  a border around it, returns the number of failed comparisons */
+static int CompareTransforms(const HuginBase::Nona::SpaceTransform& transf, const vigra::Size2D& srcSize,
+                             const std::string& name, int& fusedCount)
+{
+    HuginBase::Nona::SpaceTransform interpreted(transf);
+    interpreted.setUseFused(false);
+    if (transf.isFused())
+    {
+        ++fusedCount;
+    };
+    double maxDiff = 0;
+    double maxBatchDiff = 0;
+    const int steps = 40;
+    const size_t n = steps + 5;
+    std::vector<double> xpos(n);
+    std::vector<double> ypos(n);
+    std::vector<double> xBatch(n);
+    std::vector<double> yBatch(n);
+    std::vector<unsigned char> valid(n);
+    for (int j = -2; j <= steps + 2; ++j)
+    {
+        for (int i = -2; i <= steps + 2; ++i)
+        {
+            const double x = i * (srcSize.width() - 1.0) / steps;
+            const double y = j * (srcSize.height() - 1.0) / steps;
+            double x1, y1, x2, y2;
+            transf.transformImgCoord(x1, y1, x, y);
+            interpreted.transformImgCoord(x2, y2, x, y);
+            maxDiff = std::max(maxDiff, std::max(Difference(x1, x2), Difference(y1, y2)));
+            xpos[i + 2] = x;
+            ypos[i + 2] = y;
+        };
+        // the batch versions of both paths against the single point version
+        for (int k = 0; k < 2; ++k)
+        {
+            const HuginBase::Nona::SpaceTransform& t = (k == 0) ? transf : interpreted;
+            t.transformImgCoords(&xpos[0], &ypos[0], &xBatch[0], &yBatch[0], &valid[0], n);
+            for (size_t i = 0; i < n; ++i)
+            {
+                double x1, y1;
+                t.transformImgCoord(x1, y1, xpos[i], ypos[i]);
+                maxBatchDiff = std::max(maxBatchDiff, std::max(Difference(x1, xBatch[i]), Difference(y1, yBatch[i])));
+            };
+        };
+    };
+    int failed = 0;
+    if (maxDiff > MaxDifference)
+    {
+        std::cerr << "FAILED: " << name << ": fused and interpreted transformation differ by " << maxDiff << std::endl;
+        ++failed;
+    };
+    if (maxBatchDiff > MaxDifference)
+    {
+        std::cerr << "FAILED: " << name << ": batch and single point transformation differ by " << maxBatchDiff << std::endl;
+        ++failed;
+    };
+    return failed;
+}
+
+/** transforms a grid of points of the image into the panorama and back, returns the
+ *  number of failed comparisons */
+static int CheckRoundTrip(const HuginBase::SrcPanoImage& img, const HuginBase::PanoramaOptions& opts, const std::string& name)
+{
+    HuginBase::Nona::SpaceTransform transf;
+    transf.createTransform(img, opts);
+    HuginBase::Nona::SpaceTransform invTransf;
+    invTransf.createInvTransform(img, opts);
+    double maxDiff = 0;
+    const int steps = 10;
+    for (int j = 1; j < steps; ++j)
+    {
+        for (int i = 1; i < steps; ++i)
+        {
+            const double x = i * (img.getSize().width() - 1.0) / steps;
+            const double y = j * (img.getSize().height() - 1.0) / steps;
+            double panoX, panoY, x2, y2;
+            invTransf.transformImgCoord(panoX, panoY, x, y);
+            transf.transformImgCoord(x2, y2, panoX, panoY);
+            maxDiff = std::max(maxDiff, std::max(Difference(x, x2), Difference(y, y2)));
+        };
+    };
+    if (maxDiff > RoundTripDifference)
+    {
+        std::cerr << "FAILED: " << name << ": image->pano->image differs by " << maxDiff << std::endl;
+        return 1;
+    };
+    return 0;
+}
+
+int main()
+{
+    const HuginBase::SrcPanoImage::Projection srcProjections[] = {
+        HuginBase::SrcPanoImage::RECTILINEAR,
+        HuginBase::SrcPanoImage::PANORAMIC,
+        HuginBase::SrcPanoImage::CIRCULAR_FISHEYE,
+        HuginBase::SrcPanoImage::FULL_FRAME_FISHEYE,
+        HuginBase::SrcPanoImage::EQUIRECTANGULAR,
+        HuginBase::SrcPanoImage::FISHEYE_ORTHOGRAPHIC,
+        HuginBase::SrcPanoImage::FISHEYE_STEREOGRAPHIC,
+        HuginBase::SrcPanoImage::FISHEYE_EQUISOLID,
+        HuginBase::SrcPanoImage::FISHEYE_THOBY
+    };
+    int failed = 0;
+    int tested = 0;
+    int fused = 0;
+    for (int panoProj = HuginBase::PanoramaOptions::RECTILINEAR; panoProj <= HuginBase::PanoramaOptions::HAMMER_AITOFF; ++panoProj)
+    {
+        HuginBase::PanoramaOptions opts;
+        opts.setProjection(static_cast<HuginBase::PanoramaOptions::ProjectionFormat>(panoProj));
+        opts.setHFOV(std::min(opts.getMaxHFOV(), 120.0), false);
+        opts.setWidth(1200, false);
+        opts.setHeight(800);
+        for (size_t k = 0; k < sizeof(srcProjections) / sizeof(srcProjections[0]); ++k)
+        {
+            // the plain image and an image with all optional steps of the stack
+            for (int variant = 0; variant < 2; ++variant)
+            {
+                HuginBase::SrcPanoImage img;
+                img.setSize(vigra::Size2D(600, 400));
+                img.setProjection(srcProjections[k]);
+                img.setHFOV(srcProjections[k] == HuginBase::SrcPanoImage::EQUIRECTANGULAR ? 90 : 60);
+                img.setYaw(12.5);
+                img.setPitch(-7.25);
+                img.setRoll(3.5);
+                if (variant == 1)
+                {
+                    std::vector<double> distortion(4);
+                    distortion[0] = 0.01;
+                    distortion[1] = -0.02;
+                    distortion[2] = 0.005;
+                    distortion[3] = 1.0 - distortion[0] - distortion[1] - distortion[2];
+                    img.setRadialDistortion(distortion);
+                    img.setRadialDistortionCenterShift(hugin_utils::FDiff2D(3.5, -2.25));
+                };
+                std::ostringstream name;
+                name << "image projection " << srcProjections[k] << ", panorama projection " << panoProj << ", variant " << variant;
+                HuginBase::Nona::SpaceTransform transf;
+                transf.createTransform(img, opts);
+                failed += CompareTransforms(transf, opts.getSize(), name.str() + ", pano->image", fused);
+                HuginBase::Nona::SpaceTransform invTransf;
+                invTransf.createInvTransform(img, opts);
+                failed += CompareTransforms(invTransf, img.getSize(), name.str() + ", image->pano", fused);
+                HuginBase::Nona::SpaceTransform radial;
+                radial.InitRadialCorrect(img, 1);
+                failed += CompareTransforms(radial, img.getSize(), name.str() + ", radial correction", fused);
+                HuginBase::Nona::SpaceTransform invRadial;
+                invRadial.InitInvRadialCorrect(img, 1);
+                failed += CompareTransforms(invRadial, img.getSize(), name.str() + ", inverse radial correction", fused);
+                tested += 4;
+            };
+        };
+    };
+    // round trip through the inverse transformation for the common projections,
+    // panorama and image have different sizes to catch swapped offsets
+    const HuginBase::PanoramaOptions::ProjectionFormat roundTripPanoProjections[] = {
+        HuginBase::PanoramaOptions::RECTILINEAR,
+        HuginBase::PanoramaOptions::CYLINDRICAL,
+        HuginBase::PanoramaOptions::EQUIRECTANGULAR
+    };
+    const HuginBase::SrcPanoImage::Projection roundTripSrcProjections[] = {
+        HuginBase::SrcPanoImage::RECTILINEAR,
+        HuginBase::SrcPanoImage::FULL_FRAME_FISHEYE,
+        HuginBase::SrcPanoImage::EQUIRECTANGULAR
+    };
+    for (size_t p = 0; p < sizeof(roundTripPanoProjections) / sizeof(roundTripPanoProjections[0]); ++p)
+    {
+        HuginBase::PanoramaOptions opts;
+        opts.setProjection(roundTripPanoProjections[p]);
+        opts.setHFOV(120, false);
+        opts.setWidth(1200, false);
+        opts.setHeight(800);
+        for (size_t k = 0; k < sizeof(roundTripSrcProjections) / sizeof(roundTripSrcProjections[0]); ++k)
+        {
+            HuginBase::SrcPanoImage img;
+            img.setSize(vigra::Size2D(600, 400));
+            img.setProjection(roundTripSrcProjections[k]);
+            img.setHFOV(60);
+            img.setYaw(12.5);
+            img.setPitch(-7.25);
+            img.setRoll(3.5);
+            std::ostringstream name;
+            name << "image projection " << roundTripSrcProjections[k] << ", panorama projection " << roundTripPanoProjections[p];
+            failed += CheckRoundTrip(img, opts, name.str());
+            ++tested;
+        };
+    };
+    std::cout << tested << " transformations tested, " << fused << " with a fused stack, " << failed << " failed" << std::endl;
+    if (fused == 0)
+    {
+        std::cerr << "FAILED: no transformation uses a fused stack" << std::endl;
+        return 1;
+    };
+    return failed == 0 ? 0 : 1;
+}
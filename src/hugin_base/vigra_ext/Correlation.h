@@ -472,6 +472,21 @@ public:
         return true;
     }
 
+    void transformImgCoords(const double* srcx, const double* srcy, double* destx, double* desty,
+                            unsigned char* valid, size_t n) const
+    {
+        const double cosPhi = cos(m_phi);
+        const double sinPhi = sin(m_phi);
+        for (size_t i = 0; i < n; ++i)
+        {
+            const double x = srcx[i] - m_origin.x;
+            const double y = srcy[i] - m_origin.y;
+            destx[i] = x * cosPhi + y * sinPhi + m_transl.x;
+            desty[i] = x * -sinPhi + y * cosPhi + m_transl.y;
+            valid[i] = 1;
+        }
+    }
+
     double m_phi;
     hugin_utils::FDiff2D m_origin;
     hugin_utils::FDiff2D m_transl;
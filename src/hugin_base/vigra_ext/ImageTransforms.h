@@ -28,6 +28,8 @@
 #define _VIGRA_EXT_IMAGETRANSFORMS_H
 
 #include <fstream>
+#include <vector>
+#include <algorithm>
 
 #include <vigra/basicimage.hxx>
 #include <vigra_ext/ROIImage.h>
@@ -105,6 +107,11 @@ void transformImageIntern(vigra::triple<SrcImageIterator, SrcImageIterator, SrcA
                           bool singleThreaded)
 {
     const vigra::Diff2D destSize = dest.second - dest.first;
+    if (destSize.x <= 0 || destSize.y <= 0)
+    {
+        // empty roi, nothing to do
+        return;
+    };
 
     const int xstart = destUL.x;
     const int xend = destUL.x + destSize.x;
@@ -114,32 +121,50 @@ void transformImageIntern(vigra::triple<SrcImageIterator, SrcImageIterator, SrcA
     vigra_ext::ImageInterpolator<SrcImageIterator, SrcAccessor, Interpolator>
         interpol(src, interp, warparound);
 
+    // x coordinates are the same for all rows
+    std::vector<double> xpos(destSize.x);
+    for (int x = 0; x < destSize.x; ++x)
+    {
+        xpos[x] = xstart + x;
+    }
+
     // loop over the image and transform
-#pragma omp parallel for if(!singleThreaded) schedule(dynamic) 
-    for (int y = ystart; y < yend; ++y)
+#pragma omp parallel if(!singleThreaded)
     {
-        // create x iterators
-        DestImageIterator xd(dest.first);
-        xd.y += y - ystart;
-        AlphaImageIterator xdm(alpha.first);
-        xdm.y += y - ystart;
-        typename SrcAccessor::value_type tempval;
-        for (int x = xstart; x < xend; ++x, ++xd.x, ++xdm.x)
+        // buffers for the transformation of a complete row
+        std::vector<double> ypos(destSize.x);
+        std::vector<double> sxpos(destSize.x);
+        std::vector<double> sypos(destSize.x);
+        std::vector<unsigned char> valid(destSize.x);
+#pragma omp for schedule(dynamic)
+        for (int y = ystart; y < yend; ++y)
         {
-            double sx, sy;
-            if (transform.transformImgCoord(sx, sy, x, y)) {
-                if (interpol.operator()(sx, sy, tempval)){
-                    // apply pixel transform and write to output
-                    dest.third.set(zeroNegative(pixelTransform(tempval, hugin_utils::FDiff2D(sx, sy))), xd);
-                    alpha.second.set(pixelTransform.hdrWeight(tempval, vigra::UInt8(255)), xdm);
+            std::fill(ypos.begin(), ypos.end(), y);
+            transform.transformImgCoords(&xpos[0], &ypos[0], &sxpos[0], &sypos[0], &valid[0], destSize.x);
+            // create x iterators
+            DestImageIterator xd(dest.first);
+            xd.y += y - ystart;
+            AlphaImageIterator xdm(alpha.first);
+            xdm.y += y - ystart;
+            typename SrcAccessor::value_type tempval;
+            for (int x = 0; x < destSize.x; ++x, ++xd.x, ++xdm.x)
+            {
+                const double sx = sxpos[x];
+                const double sy = sypos[x];
+                if (valid[x]) {
+                    if (interpol.operator()(sx, sy, tempval)){
+                        // apply pixel transform and write to output
+                        dest.third.set(zeroNegative(pixelTransform(tempval, hugin_utils::FDiff2D(sx, sy))), xd);
+                        alpha.second.set(pixelTransform.hdrWeight(tempval, vigra::UInt8(255)), xdm);
+                    }
+                    else {
+                        alpha.second.set(0, xdm);
+                    }
                 }
                 else {
                     alpha.second.set(0, xdm);
                 }
             }
-            else {
-                alpha.second.set(0, xdm);
-            }
         }
     }
 }
@@ -165,6 +190,11 @@ void transformImageAlphaIntern(vigra::triple<SrcImageIterator, SrcImageIterator,
                                bool singleThreaded)
 {
     const vigra::Diff2D destSize = dest.second - dest.first;
+    if (destSize.x <= 0 || destSize.y <= 0)
+    {
+        // empty roi, nothing to do
+        return;
+    };
 
     const int xstart = destUL.x;
     const int xend   = destUL.x + destSize.x;
@@ -175,31 +205,49 @@ void transformImageAlphaIntern(vigra::triple<SrcImageIterator, SrcImageIterator,
                                      SrcAlphaAccessor, Interpolator>
                                     interpol (src, srcAlpha, interp, warparound);
 
+    // x coordinates are the same for all rows
+    std::vector<double> xpos(destSize.x);
+    for (int x = 0; x < destSize.x; ++x)
+    {
+        xpos[x] = xstart + x;
+    }
+
     // loop over the image and transform
-#pragma omp parallel for if(!singleThreaded) schedule(dynamic)
-    for(int y=ystart; y < yend; ++y)
+#pragma omp parallel if(!singleThreaded)
     {
-        // create x iterators
-        DestImageIterator xd(dest.first);
-        xd.y += y - ystart;
-        AlphaImageIterator xdist(alpha.first);
-        xdist.y += y - ystart;
-        typename SrcAccessor::value_type tempval;
-        typename SrcAlphaAccessor::value_type alphaval;
-        for (int x = xstart; x < xend; ++x, ++xd.x, ++xdist.x)
+        // buffers for the transformation of a complete row
+        std::vector<double> ypos(destSize.x);
+        std::vector<double> sxpos(destSize.x);
+        std::vector<double> sypos(destSize.x);
+        std::vector<unsigned char> valid(destSize.x);
+#pragma omp for schedule(dynamic)
+        for(int y=ystart; y < yend; ++y)
         {
-            double sx,sy;
-            if (transform.transformImgCoord(sx,sy,x,y)) {
-                // try to interpolate.
-                if (interpol(sx, sy, tempval, alphaval)) {
-                    dest.third.set(zeroNegative(pixelTransform(tempval, hugin_utils::FDiff2D(sx, sy))), xd);
-                    alpha.second.set(pixelTransform.hdrWeight(tempval, alphaval), xdist);
+            std::fill(ypos.begin(), ypos.end(), y);
+            transform.transformImgCoords(&xpos[0], &ypos[0], &sxpos[0], &sypos[0], &valid[0], destSize.x);
+            // create x iterators
+            DestImageIterator xd(dest.first);
+            xd.y += y - ystart;
+            AlphaImageIterator xdist(alpha.first);
+            xdist.y += y - ystart;
+            typename SrcAccessor::value_type tempval;
+            typename SrcAlphaAccessor::value_type alphaval;
+            for (int x = 0; x < destSize.x; ++x, ++xd.x, ++xdist.x)
+            {
+                const double sx = sxpos[x];
+                const double sy = sypos[x];
+                if (valid[x]) {
+                    // try to interpolate.
+                    if (interpol(sx, sy, tempval, alphaval)) {
+                        dest.third.set(zeroNegative(pixelTransform(tempval, hugin_utils::FDiff2D(sx, sy))), xd);
+                        alpha.second.set(pixelTransform.hdrWeight(tempval, alphaval), xdist);
+                    } else {
+                        // point outside of image or mask
+                        alpha.second.set(0, xdist);
+                    }
                 } else {
-                    // point outside of image or mask
                     alpha.second.set(0, xdist);
                 }
-            } else {
-                alpha.second.set(0, xdist);
             }
         }
     }
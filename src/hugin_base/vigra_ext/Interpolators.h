@@ -33,9 +33,12 @@
 #include <math.h>
 #include <hugin_math/hugin_math.h>
 #include <algorithm>
+#include <vector>
+#include <type_traits>
 
 #include <vigra/accessor.hxx>
 #include <vigra/diff2d.hxx>
+#include <vigra/rgbvalue.hxx>
 
 using std::endl;
 
@@ -281,6 +284,260 @@ struct interp_sinc
 };
 
 
+namespace detail {
+
+/** precalculated interpolator weights for a fixed number of sub-pixel phases.
+ *
+ *  The offset is rounded to the nearest phase, the resulting position error
+ *  is at most 1/(2*Phases) pixel. The table is created on first use and shared
+ *  by all threads.
+ */
+template <class INTERPOLATOR>
+class InterpolatorWeightTable
+{
+public:
+    /** number of sub-pixel phases */
+    static const int Phases = 1024;
+
+    /** returns the table for the interpolator */
+    static const InterpolatorWeightTable & get()
+    {
+        static const InterpolatorWeightTable table;
+        return table;
+    }
+
+    /** returns the weights for offset @p x, 0 <= x <= 1 */
+    const double * weights(double x) const
+    {
+        return &m_weights[static_cast<int>(x * Phases + 0.5) * INTERPOLATOR::size];
+    }
+
+private:
+    InterpolatorWeightTable() : m_weights((Phases + 1) * INTERPOLATOR::size)
+    {
+        INTERPOLATOR inter;
+        for (int i = 0; i <= Phases; ++i)
+        {
+            inter.calc_coeff(static_cast<double>(i) / Phases, &m_weights[i * INTERPOLATOR::size]);
+        }
+    }
+
+    std::vector<double> m_weights;
+};
+
+/** access to the interpolator weights for a given offset.
+ *
+ *  The weights are taken from the precalculated table, only the interpolators
+ *  which are cheaper to evaluate than a table lookup calculate them into
+ *  the given buffer.
+ */
+template <class INTERPOLATOR>
+class InterpolatorWeights
+{
+public:
+    InterpolatorWeights() : m_table(&InterpolatorWeightTable<INTERPOLATOR>::get()) {}
+
+    /** returns the weights for offset @p x, 0 <= x < 1 */
+    const double * get(const INTERPOLATOR &, double x, double * /* buffer */) const
+    {
+        return m_table->weights(x);
+    }
+
+private:
+    const InterpolatorWeightTable<INTERPOLATOR> * m_table;
+};
+
+template <>
+class InterpolatorWeights<interp_nearest>
+{
+public:
+    const double * get(const interp_nearest & inter, double x, double * buffer) const
+    {
+        inter.calc_coeff(x, buffer);
+        return buffer;
+    }
+};
+
+template <>
+class InterpolatorWeights<interp_bilin>
+{
+public:
+    const double * get(const interp_bilin & inter, double x, double * buffer) const
+    {
+        inter.calc_coeff(x, buffer);
+        return buffer;
+    }
+};
+
+/** pixel types, which are interpolated with the fast path working directly
+ *  on the components in memory */
+template <class PixelType>
+struct FastInterpolationPixel
+{
+    static const bool value = false;
+    typedef PixelType component_type;
+    static const int channels = 1;
+};
+
+#define VIGRA_EXT_FAST_INTERPOLATION_PIXEL(T) \
+template <> \
+struct FastInterpolationPixel<T> \
+{ \
+    static const bool value = true; \
+    typedef T component_type; \
+    static const int channels = 1; \
+}; \
+template <> \
+struct FastInterpolationPixel<vigra::RGBValue<T> > \
+{ \
+    static const bool value = true; \
+    typedef T component_type; \
+    static const int channels = 3; \
+};
+
+VIGRA_EXT_FAST_INTERPOLATION_PIXEL(vigra::UInt8)
+VIGRA_EXT_FAST_INTERPOLATION_PIXEL(vigra::UInt16)
+VIGRA_EXT_FAST_INTERPOLATION_PIXEL(float)
+
+#undef VIGRA_EXT_FAST_INTERPOLATION_PIXEL
+
+/** accessors, which return the pixel unchanged */
+template <class ACCESSOR>
+struct IsPlainAccessor : std::false_type {};
+
+template <class T>
+struct IsPlainAccessor<vigra::StandardValueAccessor<T> > : std::true_type {};
+
+template <class T>
+struct IsPlainAccessor<vigra::StandardConstValueAccessor<T> > : std::true_type {};
+
+template <class T>
+struct IsPlainAccessor<vigra::StandardAccessor<T> > : std::true_type {};
+
+template <class T>
+struct IsPlainAccessor<vigra::StandardConstAccessor<T> > : std::true_type {};
+
+template <class T>
+struct IsPlainAccessor<vigra::RGBAccessor<T> > : std::true_type {};
+
+/** convert the per channel sums of the fast path into the pixel type */
+template <class T>
+inline void setFromChannels(T & p, const double * c)
+{
+    p = static_cast<T>(c[0]);
+}
+
+template <class T>
+inline void setFromChannels(vigra::RGBValue<T> & p, const double * c)
+{
+    p.setRed(c[0]);
+    p.setGreen(c[1]);
+    p.setBlue(c[2]);
+}
+
+/** fast path for the interpolation of interior pixels, the pixels are accessed
+ *  directly through the row pointers of the image.
+ *
+ *  The vertical pass accumulates all components of a row at once in a plain
+ *  loop, which the compiler vectorizes, the horizontal pass then combines
+ *  the columns. The sums are calculated in double precision like in the
+ *  generic version.
+ */
+template <class PixelType, int size>
+struct FastInteriorInterpolation
+{
+    typedef FastInterpolationPixel<PixelType> Traits;
+    typedef typename Traits::component_type Component;
+    static const int channels = Traits::channels;
+    static const int n = size * channels;
+
+    /** interpolate without mask, rows points to the first pixel of the neighbourhood */
+    template <class RowIterator, class RealPixelType>
+    static void interpolate(RowIterator rows, const double * wx, const double * wy, RealPixelType & p)
+    {
+        double sum[n];
+        std::fill(sum, sum + n, 0.0);
+        for (int ky = 0; ky < size; ++ky, ++(rows.y))
+        {
+            accumulateRow(reinterpret_cast<const Component *>(&*rows.rowIterator()), wy[ky], sum);
+        }
+        combineColumns(sum, wx, p);
+    }
+
+    /** interpolate with mask, the fast path is only used if all pixels of the
+     *  neighbourhood are valid, otherwise false is returned and the caller
+     *  has to use the generic version, which handles partially masked
+     *  neighbourhoods. On success weightsum contains the sum of the weights
+     *  and m the weighted mask value. */
+    template <class RowIterator, class MaskRowIterator, class RealPixelType>
+    static bool interpolate(RowIterator rows, MaskRowIterator maskRows, const double * wx, const double * wy,
+                            RealPixelType & p, double & m, double & weightsum)
+    {
+        double sum[n];
+        double maskCol[size];
+        std::fill(sum, sum + n, 0.0);
+        std::fill(maskCol, maskCol + size, 0.0);
+        int invalid = 0;
+        for (int ky = 0; ky < size; ++ky, ++(rows.y), ++(maskRows.y))
+        {
+            const typename MaskRowIterator::row_iterator maskRow = maskRows.rowIterator();
+            const double w = wy[ky];
+#pragma omp simd reduction(|:invalid)
+            for (int kx = 0; kx < size; ++kx)
+            {
+                invalid |= (maskRow[kx] == 0);
+                maskCol[kx] += w * static_cast<double>(maskRow[kx]);
+            }
+            accumulateRow(reinterpret_cast<const Component *>(&*rows.rowIterator()), w, sum);
+        }
+        if (invalid)
+        {
+            return false;
+        }
+        combineColumns(sum, wx, p);
+        double sumX = 0.0;
+        double sumY = 0.0;
+        m = 0.0;
+        for (int k = 0; k < size; ++k)
+        {
+            sumX += wx[k];
+            sumY += wy[k];
+            m += wx[k] * maskCol[k];
+        }
+        weightsum = sumX * sumY;
+        return true;
+    }
+
+private:
+    /** vertical pass: add a row of the neighbourhood with weight w */
+    static void accumulateRow(const Component * row, const double w, double * sum)
+    {
+#pragma omp simd
+        for (int j = 0; j < n; ++j)
+        {
+            sum[j] += w * static_cast<double>(row[j]);
+        }
+    }
+
+    /** horizontal pass: combine the columns */
+    template <class RealPixelType>
+    static void combineColumns(const double * sum, const double * wx, RealPixelType & p)
+    {
+        double c[channels];
+        std::fill(c, c + channels, 0.0);
+        for (int kx = 0; kx < size; ++kx)
+        {
+            for (int ch = 0; ch < channels; ++ch)
+            {
+                c[ch] += wx[kx] * sum[kx * channels + ch];
+            }
+        }
+        setFromChannels(p, c);
+    }
+};
+
+} // namespace detail
+
 /** "wrapper" for efficient interpolation access to an image
  *
  *  Tailored for panorama remapping. Supports warparound boundary condition of left and right
@@ -295,6 +552,11 @@ public:
     typedef typename vigra::UInt8 MaskType;
 private:
     typedef typename vigra::NumericTraits<PixelType>::RealPromote RealPixelType;
+    typedef detail::InterpolatorWeights<INTERPOLATOR> Weights;
+    /** use the fast path for interior pixels, if the pixels can be read directly from memory */
+    typedef std::integral_constant<bool, detail::FastInterpolationPixel<PixelType>::value &&
+        detail::IsPlainAccessor<SrcAccessor>::value &&
+        std::is_pointer<typename SrcImageIterator::row_iterator>::value> UseFastPath;
 
     SrcImageIterator m_sIter;
     SrcAccessor m_sAcc;
@@ -303,6 +565,7 @@ private:
     bool m_warparound;
 
     INTERPOLATOR m_inter;
+    Weights m_weights;
 
 public:
     /** Construct interpolator for an given image */
@@ -349,8 +612,9 @@ public:
     {
 
         // skip all further interpolation if we cannot interpolate anything
-        if (x < -INTERPOLATOR::size/2 || x > m_w + INTERPOLATOR::size/2) return false;
-        if (y < -INTERPOLATOR::size/2 || y > m_h + INTERPOLATOR::size/2) return false;
+        // (written as negation to reject also NaN coordinates)
+        if (!(x >= -INTERPOLATOR::size/2 && x <= m_w + INTERPOLATOR::size/2)) return false;
+        if (!(y >= -INTERPOLATOR::size/2 && y <= m_h + INTERPOLATOR::size/2)) return false;
 
         double t = floor(x);
         double dx = x - t;
@@ -365,12 +629,12 @@ public:
             return interpolateNoMaskInside(srcx, srcy, dx, dy, result);
         }
 
-        double wx[INTERPOLATOR::size];
-        double wy[INTERPOLATOR::size];
+        double wxBuffer[INTERPOLATOR::size];
+        double wyBuffer[INTERPOLATOR::size];
 
-        // calculate x interpolation coefficients
-        m_inter.calc_coeff(dx, wx);
-        m_inter.calc_coeff(dy, wy);
+        // get interpolation coefficients
+        const double * wx = m_weights.get(m_inter, dx, wxBuffer);
+        const double * wy = m_weights.get(m_inter, dy, wyBuffer);
 
         RealPixelType p(vigra::NumericTraits<RealPixelType>::zero());
         double weightsum = 0.0;
@@ -423,11 +687,41 @@ public:
     bool interpolateNoMaskInside(int srcx, int srcy, double dx, double dy,
                                     PixelType & result) const
     {
-        double w[INTERPOLATOR::size];
+        return interpolateNoMaskInside(srcx, srcy, dx, dy, result, UseFastPath());
+    }
+
+    void emitGLSL(std::ostringstream& oss) const {
+        m_inter.emitGLSL(oss);
+    }
+
+private:
+    /** Interpolate without boundary check and mask, fast path for plain pixels */
+    bool interpolateNoMaskInside(int srcx, int srcy, double dx, double dy,
+                                    PixelType & result, std::true_type) const
+    {
+        double wxBuffer[INTERPOLATOR::size];
+        double wyBuffer[INTERPOLATOR::size];
+        const double * wx = m_weights.get(m_inter, dx, wxBuffer);
+        const double * wy = m_weights.get(m_inter, dy, wyBuffer);
+
+        RealPixelType p;
+        detail::FastInteriorInterpolation<PixelType, INTERPOLATOR::size>::interpolate(
+            m_sIter + vigra::Diff2D(srcx - INTERPOLATOR::size/2 + 1, srcy - INTERPOLATOR::size/2 + 1),
+            wx, wy, p);
+
+        result = vigra::detail::RequiresExplicitCast<PixelType>::cast(p);
+        return true;
+    }
+
+    /** Interpolate without boundary check and mask, generic version */
+    bool interpolateNoMaskInside(int srcx, int srcy, double dx, double dy,
+                                    PixelType & result, std::false_type) const
+    {
+        double wBuffer[INTERPOLATOR::size];
         RealPixelType resX[INTERPOLATOR::size];
 
-        // calculate x interpolation coefficients
-        m_inter.calc_coeff(dx, w);
+        // get x interpolation coefficients
+        const double * w = m_weights.get(m_inter, dx, wBuffer);
 
         RealPixelType p;
 
@@ -446,7 +740,7 @@ public:
         }
 
         // y pass.
-        m_inter.calc_coeff(dy, w);
+        w = m_weights.get(m_inter, dy, wBuffer);
         p = vigra::NumericTraits<RealPixelType>::zero();
         for (int ky = 0; ky < INTERPOLATOR::size; ky++) {
             p += w[ky] * resX[ky];
@@ -456,10 +750,6 @@ public:
         return true;
     }
 
-    void emitGLSL(std::ostringstream& oss) const {
-        m_inter.emitGLSL(oss);
-    }
-
 };
 
 
@@ -478,6 +768,15 @@ public:
     typedef typename MaskAccessor::value_type MaskType;
 private:
     typedef typename vigra::NumericTraits<PixelType>::RealPromote RealPixelType;
+    typedef detail::InterpolatorWeights<INTERPOLATOR> Weights;
+    /** use the fast path for interior pixels, if the pixels and the mask can be read directly from memory.
+     *  For the small kernels the additional pass over the mask costs more than it saves. */
+    typedef std::integral_constant<bool, (INTERPOLATOR::size >= 6) &&
+        detail::FastInterpolationPixel<PixelType>::value &&
+        detail::IsPlainAccessor<SrcAccessor>::value &&
+        std::is_pointer<typename SrcImageIterator::row_iterator>::value &&
+        std::is_pointer<typename MaskIterator::row_iterator>::value &&
+        std::is_arithmetic<MaskType>::value> UseFastPath;
 
     SrcImageIterator m_sIter;
     SrcAccessor m_sAcc;
@@ -488,6 +787,7 @@ private:
     bool m_warparound;
 
     INTERPOLATOR m_inter;
+    Weights m_weights;
 
 public:
 
@@ -554,8 +854,9 @@ public:
     {
 
         // skip all further interpolation if we cannot interpolate anything
-        if (x < -INTERPOLATOR::size/2 || x > m_w + INTERPOLATOR::size/2) return false;
-        if (y < -INTERPOLATOR::size/2 || y > m_h + INTERPOLATOR::size/2) return false;
+        // (written as negation to reject also NaN coordinates)
+        if (!(x >= -INTERPOLATOR::size/2 && x <= m_w + INTERPOLATOR::size/2)) return false;
+        if (!(y >= -INTERPOLATOR::size/2 && y <= m_h + INTERPOLATOR::size/2)) return false;
 
         double t = floor(x);
         double dx = x - t;
@@ -663,8 +964,9 @@ public:
     {
 
         // skip all further interpolation if we cannot interpolate anything
-        if (x < -INTERPOLATOR::size/2 || x > m_w + INTERPOLATOR::size/2) return false;
-        if (y < -INTERPOLATOR::size/2 || y > m_h + INTERPOLATOR::size/2) return false;
+        // (written as negation to reject also NaN coordinates)
+        if (!(x >= -INTERPOLATOR::size/2 && x <= m_w + INTERPOLATOR::size/2)) return false;
+        if (!(y >= -INTERPOLATOR::size/2 && y <= m_h + INTERPOLATOR::size/2)) return false;
 
         double t = floor(x);
         double dx = x - t;
@@ -679,12 +981,12 @@ public:
             return interpolateInside(srcx, srcy, dx, dy, result, mask);
         }
 
-        double wx[INTERPOLATOR::size];
-        double wy[INTERPOLATOR::size];
+        double wxBuffer[INTERPOLATOR::size];
+        double wyBuffer[INTERPOLATOR::size];
 
-        // calculate x interpolation coefficients
-        m_inter.calc_coeff(dx, wx);
-        m_inter.calc_coeff(dy, wy);
+        // get interpolation coefficients
+        const double * wx = m_weights.get(m_inter, dx, wxBuffer);
+        const double * wy = m_weights.get(m_inter, dy, wyBuffer);
 
         // first pass of separable filter
 
@@ -749,13 +1051,55 @@ public:
     bool interpolateInside(int srcx, int srcy, double dx, double dy,
                                     PixelType & result, MaskType & mask) const
     {
+        return interpolateInside(srcx, srcy, dx, dy, result, mask, UseFastPath());
+    }
 
-        double wx[INTERPOLATOR::size];
-        double wy[INTERPOLATOR::size];
+private:
+    /** Interpolate without boundary check, fast path for plain pixels */
+    bool interpolateInside(int srcx, int srcy, double dx, double dy,
+                                    PixelType & result, MaskType & mask, std::true_type) const
+    {
+        double wxBuffer[INTERPOLATOR::size];
+        double wyBuffer[INTERPOLATOR::size];
+        const double * wx = m_weights.get(m_inter, dx, wxBuffer);
+        const double * wy = m_weights.get(m_inter, dy, wyBuffer);
 
-        // calculate x interpolation coefficients
-        m_inter.calc_coeff(dx, wx);
-        m_inter.calc_coeff(dy, wy);
+        const vigra::Diff2D offset(srcx - INTERPOLATOR::size/2 + 1,
+                                   srcy - INTERPOLATOR::size/2 + 1);
+        RealPixelType p;
+        double m;
+        double weightsum;
+        if (!detail::FastInteriorInterpolation<PixelType, INTERPOLATOR::size>::interpolate(
+                m_sIter + offset, m_mIter + offset, wx, wy, p, m, weightsum))
+        {
+            // some pixels are masked out
+            return interpolateInside(srcx, srcy, dx, dy, result, mask, std::false_type());
+        }
+
+        // force a certain weight
+        if (weightsum <= 0.2) return false;
+        // Adjust filter for any ignored transparent pixels.
+        if (weightsum != 1.0) {
+            p /= weightsum;
+            m /= weightsum;
+        }
+
+        result = vigra::detail::RequiresExplicitCast<PixelType>::cast(p);
+        mask = vigra::detail::RequiresExplicitCast<MaskType>::cast(m);
+        return true;
+    }
+
+    /** Interpolate without boundary check, generic version */
+    bool interpolateInside(int srcx, int srcy, double dx, double dy,
+                                    PixelType & result, MaskType & mask, std::false_type) const
+    {
+
+        double wxBuffer[INTERPOLATOR::size];
+        double wyBuffer[INTERPOLATOR::size];
+
+        // get interpolation coefficients
+        const double * wx = m_weights.get(m_inter, dx, wxBuffer);
+        const double * wy = m_weights.get(m_inter, dy, wyBuffer);
 
         RealPixelType p(vigra::NumericTraits<RealPixelType>::zero());
         double weightsum = 0.0;
@@ -89,6 +89,8 @@ public:
 	 * @param desiredProbabilityForNoOutliers The probability that at least one of the selected subsets doesn't contains an
 	 *                                        outlier.
 	 * @param maximalOutlierPercentage The maximal expected percentage of outliers.
+	 * @param seed Seed for the random number generator, 0 (the default) seeds it from the clock.
+	 *             Use a fixed seed for reproducible results.
 	 * @return Array with inliers
 	 */
         template<class Estimator, class S, class T>
@@ -97,7 +99,8 @@ public:
 					     const Estimator & paramEstimator ,
 					     const std::vector<T> &data, 
 					     double desiredProbabilityForNoOutliers,
-					     double maximalOutlierPercentage);
+					     double maximalOutlierPercentage,
+					     unsigned int seed = 0);
 
 
 	/**
@@ -177,7 +180,8 @@ std::vector<const T *> Ransac::compute(S &parameters,
 				       const Estimator & paramEstimator,
 				       const std::vector<T> &data,
 				       double desiredProbabilityForNoOutliers,
-				       double maximalOutlierPercentage)
+				       double maximalOutlierPercentage,
+				       unsigned int seed)
 {
     unsigned int numDataObjects = (int) data.size();
     unsigned int numForEstimate = paramEstimator.numForEstimate();
@@ -196,7 +200,7 @@ std::vector<const T *> Ransac::compute(S &parameters,
     SubSetIndexComparator subSetIndexComparator(numForEstimate);
     std::set<int *, SubSetIndexComparator > chosenSubSets(subSetIndexComparator);
     int *curSubSetIndexes;
-    // double outlierPercentage = maximalOutlierPercentage;
+    double outlierPercentage = maximalOutlierPercentage;
     double numerator = log(1.0-desiredProbabilityForNoOutliers);
     double denominator = log(1- pow((double)(1.0-maximalOutlierPercentage), (double)(numForEstimate)));
     int allTries = choose(numDataObjects,numForEstimate);
@@ -208,7 +212,7 @@ std::vector<const T *> Ransac::compute(S &parameters,
     
     // intialize random generator
     maxIndex = numDataObjects - 1;
-    std::mt19937 rng(static_cast<unsigned int>(std::time(0)));
+    std::mt19937 rng(seed != 0 ? seed : static_cast<unsigned int>(std::time(0)));
     std::uniform_int_distribution<> distribIndex(0, maxIndex);
     auto randIndex=std::bind(distribIndex, rng);
 
@@ -279,17 +283,20 @@ std::vector<const T *> Ransac::compute(S &parameters,
                 memcpy(bestVotes,curVotes, numDataObjects*sizeof(short));
 		parameters = exactEstimateParameters;
             }
-	    /*
             //update the estimate of outliers and the number of iterations we need
             outlierPercentage = 1 - (double)numVotesForCur/(double)numDataObjects;
             if(outlierPercentage < maximalOutlierPercentage) {
                 maximalOutlierPercentage = outlierPercentage;
-                denominator = log(1- pow((double)(1.0-maximalOutlierPercentage), (double)(numForEstimate)));
-                numTries = (int)(numerator/denominator + 0.5);
-                //there are cases when the probablistic number of tries is greater than all possible sub-sets
-                numTries = numTries<allTries ? numTries : allTries;
+                if (maximalOutlierPercentage <= 0) {
+                    // all data agrees with this estimate, no need for further tries
+                    numTries = 0;
+                } else {
+                    denominator = log(1- pow((double)(1.0-maximalOutlierPercentage), (double)(numForEstimate)));
+                    numTries = (int)(numerator/denominator + 0.5);
+                    //there are cases when the probablistic number of tries is greater than all possible sub-sets
+                    numTries = numTries<allTries ? numTries : allTries;
+                }
             }
-	    */
         }
         else {  //this sub set already appeared, don't count this iteration
             delete [] curSubSetIndexes;
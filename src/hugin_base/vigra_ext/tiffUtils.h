@@ -30,12 +30,19 @@
 #include <vigra/imageinfo.hxx>
 #include <vigra/transformimage.hxx>
 #include <vigra/functorexpression.hxx>
+#include <vigra/rgbvalue.hxx>
+#include <vigra/numerictraits.hxx>
 
 #include <vigra_ext/FunctorAccessor.h>
 #include <hugin_utils/utils.h>
 
 #include <tiffio.h>
 
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <cmath>
+
 // add this to the vigra_ext namespace
 namespace vigra_ext {
 
@@ -553,6 +560,230 @@ createAlphaTiffImage(vigra::triple<ImageIterator, ImageIterator, ImageAccessor>
 
 
 
+//***************************************************************************
+//
+//  writing of tiled tiff files, tile by tile
+//
+//***************************************************************************
+
+namespace detail
+{
+    /** sample format and scaling of the alpha channel for the component types,
+     *  uses the same values as CreateAlphaTiffImage */
+    template <class T>
+    struct TiffComponentTraits;
+
+    template <>
+    struct TiffComponentTraits<unsigned char>
+    {
+        static int sampleFormat() { return SAMPLEFORMAT_UINT; };
+        static double alphaScale() { return 1.0; };
+    };
+
+    template <>
+    struct TiffComponentTraits<short>
+    {
+        static int sampleFormat() { return SAMPLEFORMAT_INT; };
+        static double alphaScale() { return 128.0; };
+    };
+
+    template <>
+    struct TiffComponentTraits<unsigned short>
+    {
+        static int sampleFormat() { return SAMPLEFORMAT_UINT; };
+        static double alphaScale() { return 256.0; };
+    };
+
+    template <>
+    struct TiffComponentTraits<int>
+    {
+        static int sampleFormat() { return SAMPLEFORMAT_INT; };
+        static double alphaScale() { return 8388608.0; };
+    };
+
+    template <>
+    struct TiffComponentTraits<unsigned int>
+    {
+        static int sampleFormat() { return SAMPLEFORMAT_UINT; };
+        static double alphaScale() { return 16777216.0; };
+    };
+
+    template <>
+    struct TiffComponentTraits<float>
+    {
+        static int sampleFormat() { return SAMPLEFORMAT_IEEEFP; };
+        static double alphaScale() { return 1.0 / 255; };
+    };
+
+    template <>
+    struct TiffComponentTraits<double>
+    {
+        static int sampleFormat() { return SAMPLEFORMAT_IEEEFP; };
+        static double alphaScale() { return 1.0 / 255; };
+    };
+
+    /** access to the components of scalar and RGB pixels */
+    template <class T>
+    struct TiffPixelTraits
+    {
+        typedef T component_type;
+        enum { bands = 1 };
+        static component_type get(const T & v, int) { return v; };
+        static T fromSamples(const double * s)
+        {
+            return vigra::NumericTraits<T>::fromRealPromote(s[0]);
+        };
+    };
+
+    template <class T>
+    struct TiffPixelTraits<vigra::RGBValue<T> >
+    {
+        typedef T component_type;
+        enum { bands = 3 };
+        static component_type get(const vigra::RGBValue<T> & v, int band) { return v[band]; };
+        static vigra::RGBValue<T> fromSamples(const double * s)
+        {
+            return vigra::RGBValue<T>(vigra::NumericTraits<T>::fromRealPromote(s[0]),
+                                      vigra::NumericTraits<T>::fromRealPromote(s[1]),
+                                      vigra::NumericTraits<T>::fromRealPromote(s[2]));
+        };
+    };
+}
+
+/** writes an image with an alpha channel as tiled tiff file.
+ *
+ *  In contrast to createAlphaTiffImage the image does not need to be
+ *  kept in memory as whole, instead it can be written in parts, e.g. by an
+ *  out-of-core stitcher. All parts should be written, otherwise the tiles
+ *  are missing in the output file.
+ *  The pixel values are written as OutComponentType, they are rounded and
+ *  clipped to its range, but not rescaled.
+ */
+template <class ImageType, class AlphaType,
+          class OutComponentType = typename detail::TiffPixelTraits<typename ImageType::value_type>::component_type>
+class TiledAlphaTiffWriter
+{
+public:
+    typedef typename ImageType::value_type PixelType;
+    typedef detail::TiffPixelTraits<PixelType> PixelTraits;
+    typedef OutComponentType ComponentType;
+
+    TiledAlphaTiffWriter() : m_tiff(NULL), m_tileSize(0) {};
+    ~TiledAlphaTiffWriter()
+    {
+        close();
+    };
+
+    /** create the tiff file
+     *  @param filename filename of the output file
+     *  @param size size of the image
+     *  @param tileSize width and height of the tiff tiles, must be a multiple of 16
+     *  @param offset position of the image inside the full canvas
+     *  @param fullSize size of the full canvas
+     *  @param compression compression, as used by createTiffDirectory
+     *  @param icc ICC profile to embed
+     *  @param useBigTIFF write BigTIFF file, needed for files larger than 4 GB
+     *  @return true, if the file could be created
+     */
+    bool open(const std::string & filename, const vigra::Size2D & size, int tileSize,
+              vigra::Diff2D offset, vigra::Size2D fullSize,
+              const std::string & compression,
+              const vigra::ImageExportInfo::ICCProfile & icc,
+              bool useBigTIFF)
+    {
+        close();
+        m_tiff = TIFFOpen(filename.c_str(), useBigTIFF ? "w8" : "w");
+        if (!m_tiff)
+        {
+            return false;
+        };
+        m_size = size;
+        m_tileSize = tileSize;
+        createTiffDirectory(m_tiff, filename, filename, compression, 1, 1, offset, fullSize, icc);
+        TIFFSetField(m_tiff, TIFFTAG_IMAGEWIDTH, m_size.x);
+        TIFFSetField(m_tiff, TIFFTAG_IMAGELENGTH, m_size.y);
+        TIFFSetField(m_tiff, TIFFTAG_TILEWIDTH, m_tileSize);
+        TIFFSetField(m_tiff, TIFFTAG_TILELENGTH, m_tileSize);
+        TIFFSetField(m_tiff, TIFFTAG_BITSPERSAMPLE, sizeof(ComponentType) * 8);
+        TIFFSetField(m_tiff, TIFFTAG_SAMPLESPERPIXEL, PixelTraits::bands + 1);
+        TIFFSetField(m_tiff, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
+        TIFFSetField(m_tiff, TIFFTAG_SAMPLEFORMAT, detail::TiffComponentTraits<ComponentType>::sampleFormat());
+        TIFFSetField(m_tiff, TIFFTAG_PHOTOMETRIC, PixelTraits::bands == 1 ? PHOTOMETRIC_MINISBLACK : PHOTOMETRIC_RGB);
+        // for alpha stuff, do not uses premultilied data
+        uint16 nextra_samples = 1;
+        uint16 extra_samples = EXTRASAMPLE_UNASSALPHA;
+        TIFFSetField(m_tiff, TIFFTAG_EXTRASAMPLES, nextra_samples, &extra_samples);
+        m_buffer.resize(m_tileSize * m_tileSize * (PixelTraits::bands + 1));
+        return true;
+    };
+
+    /** write a part of the image
+     *  @param image image data, can be larger than the written area
+     *  @param alpha alpha channel, same size as image
+     *  @param srcRect area of image, which should be written
+     *  @param destPos position of the area in the output image,
+     *                 must be aligned to the tile size
+     *  @return true, if all tiles could be written
+     */
+    bool write(const ImageType & image, const AlphaType & alpha, const vigra::Rect2D & srcRect, vigra::Point2D destPos)
+    {
+        if (!m_tiff)
+        {
+            return false;
+        };
+        DEBUG_ASSERT(destPos.x % m_tileSize == 0 && destPos.y % m_tileSize == 0);
+        const int nrComponents = PixelTraits::bands + 1;
+        const double alphaScale = detail::TiffComponentTraits<ComponentType>::alphaScale();
+        for (int ty = 0; ty < srcRect.height(); ty += m_tileSize)
+        {
+            for (int tx = 0; tx < srcRect.width(); tx += m_tileSize)
+            {
+                // tiles at the border are padded with transparent pixels
+                std::fill(m_buffer.begin(), m_buffer.end(), ComponentType());
+                const int w = std::min(m_tileSize, srcRect.width() - tx);
+                const int h = std::min(m_tileSize, srcRect.height() - ty);
+                for (int y = 0; y < h; ++y)
+                {
+                    ComponentType * p = &m_buffer[y * m_tileSize * nrComponents];
+                    const int srcY = srcRect.top() + ty + y;
+                    for (int x = 0; x < w; ++x)
+                    {
+                        const int srcX = srcRect.left() + tx + x;
+                        const PixelType & v = image(srcX, srcY);
+                        for (int b = 0; b < PixelTraits::bands; ++b)
+                        {
+                            *p++ = vigra::NumericTraits<ComponentType>::fromRealPromote(PixelTraits::get(v, b));
+                        };
+                        *p++ = static_cast<ComponentType>(alpha(srcX, srcY) * alphaScale);
+                    };
+                };
+                if (TIFFWriteTile(m_tiff, &m_buffer[0], destPos.x + tx, destPos.y + ty, 0, 0) < 0)
+                {
+                    return false;
+                };
+            };
+        };
+        return true;
+    };
+
+    /** finish the tiff file */
+    void close()
+    {
+        if (m_tiff)
+        {
+            TIFFClose(m_tiff);
+            m_tiff = NULL;
+        };
+    };
+
+private:
+    vigra::TiffImage * m_tiff;
+    vigra::Size2D m_size;
+    int m_tileSize;
+    std::vector<ComponentType> m_buffer;
+};
+
+
 //***************************************************************************
 //
 //  functions to read tiff files with a single alpha channel,
@@ -560,6 +791,391 @@ createAlphaTiffImage(vigra::triple<ImageIterator, ImageIterator, ImageAccessor>
 //
 //***************************************************************************
 
+/** reads a tiff file strip by strip, so only the needed rows of a large
+ *  image are kept in memory.
+ *
+ *  Stripped and tiled files are supported, for tiled files one row of
+ *  tiles is handled as a strip. The decoded strips are converted to
+ *  PixelType and kept in a least recently used cache, which holds at most
+ *  cacheSize bytes (except the strips which are currently in use).
+ *  The pixel values are multiplied by the given scale factor, the first
+ *  extra sample is used as alpha channel and scaled to 0...255.
+ *
+ *  Only contiguous (interleaved) files with a single band or 3 bands
+ *  (matching PixelType), and top-left orientation are supported.
+ */
+template <class PixelType, class AlphaPixelType>
+class TiffRowReader
+{
+public:
+    typedef detail::TiffPixelTraits<PixelType> PixelTraits;
+
+    TiffRowReader() : m_tiff(NULL), m_width(0), m_height(0), m_stripHeight(0),
+        m_samplesPerPixel(0), m_bitsPerSample(0), m_sampleFormat(SAMPLEFORMAT_UINT),
+        m_tiled(false), m_tileWidth(0), m_hasAlpha(false), m_scale(1.0), m_alphaScale(1.0),
+        m_cacheSize(0), m_usedCache(0), m_useCounter(0), m_firstRow(0), m_lastRow(0)
+    {};
+
+    ~TiffRowReader()
+    {
+        close();
+    };
+
+    /** open the given file
+     *  @param filename name of the tiff file
+     *  @param scale factor to scale the pixel values
+     *  @param cacheSize maximal size of the strip cache in bytes
+     *  @return false, if the file could not be opened or is not supported
+     */
+    bool open(const std::string & filename, double scale, double cacheSize)
+    {
+        close();
+        m_tiff = TIFFOpen(filename.c_str(), "r");
+        if (!m_tiff)
+        {
+            return false;
+        };
+        uint32 width = 0, height = 0;
+        uint16 bitsPerSample = 1, samplesPerPixel = 1, sampleFormat = SAMPLEFORMAT_UINT;
+        uint16 planarConfig = PLANARCONFIG_CONTIG, photometric = PHOTOMETRIC_MINISBLACK, orientation = ORIENTATION_TOPLEFT;
+        uint16 nrExtraSamples = 0;
+        uint16 * extraSamples = NULL;
+        TIFFGetField(m_tiff, TIFFTAG_IMAGEWIDTH, &width);
+        TIFFGetField(m_tiff, TIFFTAG_IMAGELENGTH, &height);
+        TIFFGetFieldDefaulted(m_tiff, TIFFTAG_BITSPERSAMPLE, &bitsPerSample);
+        TIFFGetFieldDefaulted(m_tiff, TIFFTAG_SAMPLESPERPIXEL, &samplesPerPixel);
+        TIFFGetFieldDefaulted(m_tiff, TIFFTAG_SAMPLEFORMAT, &sampleFormat);
+        TIFFGetFieldDefaulted(m_tiff, TIFFTAG_PLANARCONFIG, &planarConfig);
+        TIFFGetFieldDefaulted(m_tiff, TIFFTAG_ORIENTATION, &orientation);
+        TIFFGetFieldDefaulted(m_tiff, TIFFTAG_EXTRASAMPLES, &nrExtraSamples, &extraSamples);
+        TIFFGetField(m_tiff, TIFFTAG_PHOTOMETRIC, &photometric);
+        const int colorBands = samplesPerPixel - nrExtraSamples;
+        if (width == 0 || height == 0 || colorBands != PixelTraits::bands ||
+            (planarConfig != PLANARCONFIG_CONTIG && samplesPerPixel > 1) ||
+            orientation != ORIENTATION_TOPLEFT ||
+            (photometric != PHOTOMETRIC_MINISBLACK && photometric != PHOTOMETRIC_RGB) ||
+            !isSupportedSampleType(bitsPerSample, sampleFormat))
+        {
+            close();
+            return false;
+        };
+        m_width = width;
+        m_height = height;
+        m_samplesPerPixel = samplesPerPixel;
+        m_bitsPerSample = bitsPerSample;
+        m_sampleFormat = sampleFormat;
+        m_hasAlpha = nrExtraSamples > 0;
+        m_scale = scale;
+        m_alphaScale = 255.0 / getMaxSampleValue(bitsPerSample, sampleFormat);
+        m_tiled = TIFFIsTiled(m_tiff) != 0;
+        if (m_tiled)
+        {
+            uint32 tileWidth = 0, tileLength = 0;
+            TIFFGetField(m_tiff, TIFFTAG_TILEWIDTH, &tileWidth);
+            TIFFGetField(m_tiff, TIFFTAG_TILELENGTH, &tileLength);
+            m_tileWidth = tileWidth;
+            m_stripHeight = tileLength;
+        }
+        else
+        {
+            uint32 rowsPerStrip = height;
+            TIFFGetFieldDefaulted(m_tiff, TIFFTAG_ROWSPERSTRIP, &rowsPerStrip);
+            m_stripHeight = std::min<uint32>(rowsPerStrip, height);
+        };
+        if (m_stripHeight <= 0 || (m_tiled && m_tileWidth <= 0))
+        {
+            close();
+            return false;
+        };
+        m_cacheSize = cacheSize;
+        // rows outside of the requested range point to an empty row
+        m_emptyRow.resize(m_width, vigra::NumericTraits<PixelType>::zero());
+        m_emptyAlphaRow.resize(m_width, vigra::NumericTraits<AlphaPixelType>::zero());
+        m_lines.resize(m_height, &m_emptyRow[0]);
+        m_alphaLines.resize(m_height, &m_emptyAlphaRow[0]);
+        return true;
+    };
+
+    /** close the file and free the cache */
+    void close()
+    {
+        if (m_tiff)
+        {
+            TIFFClose(m_tiff);
+            m_tiff = NULL;
+        };
+        m_cache.clear();
+        m_usedCache = 0;
+        m_lines.clear();
+        m_alphaLines.clear();
+        m_firstRow = 0;
+        m_lastRow = 0;
+    };
+
+    int width() const { return m_width; };
+    int height() const { return m_height; };
+    bool hasAlpha() const { return m_hasAlpha; };
+
+    /** make the rows firstRow...lastRow-1 available in lines() and alphaLines(),
+     *  all other rows are empty (zero)
+     *  @return false, if a strip could not be read
+     */
+    bool setRows(int firstRow, int lastRow)
+    {
+        firstRow = std::max(0, firstRow);
+        lastRow = std::min(m_height, lastRow);
+        // reset the previous range
+        for (int y = m_firstRow; y < m_lastRow; ++y)
+        {
+            m_lines[y] = &m_emptyRow[0];
+            m_alphaLines[y] = &m_emptyAlphaRow[0];
+        };
+        m_firstRow = firstRow;
+        m_lastRow = std::max(firstRow, lastRow);
+        if (m_firstRow >= m_lastRow)
+        {
+            return true;
+        };
+        const int firstStrip = m_firstRow / m_stripHeight;
+        const int lastStrip = (m_lastRow - 1) / m_stripHeight;
+        for (int strip = firstStrip; strip <= lastStrip; ++strip)
+        {
+            typename StripCache::iterator it = m_cache.find(strip);
+            if (it == m_cache.end())
+            {
+                it = m_cache.insert(std::make_pair(strip, Strip())).first;
+                if (!readStrip(strip, it->second))
+                {
+                    m_usedCache -= it->second.memoryUsage();
+                    m_cache.erase(it);
+                    m_firstRow = 0;
+                    m_lastRow = 0;
+                    return false;
+                };
+            };
+            it->second.lastUse = ++m_useCounter;
+            const int stripStart = strip * m_stripHeight;
+            const int y0 = std::max(m_firstRow, stripStart);
+            const int y1 = std::min(m_lastRow, stripStart + it->second.rows);
+            for (int y = y0; y < y1; ++y)
+            {
+                m_lines[y] = &it->second.pixels[(y - stripStart) * m_width];
+                if (m_hasAlpha)
+                {
+                    m_alphaLines[y] = &it->second.alpha[(y - stripStart) * m_width];
+                };
+            };
+        };
+        // remove the least recently used strips, which are not currently used
+        while (m_usedCache > m_cacheSize)
+        {
+            typename StripCache::iterator oldest = m_cache.end();
+            for (typename StripCache::iterator it = m_cache.begin(); it != m_cache.end(); ++it)
+            {
+                if ((it->first < firstStrip || it->first > lastStrip) &&
+                    (oldest == m_cache.end() || it->second.lastUse < oldest->second.lastUse))
+                {
+                    oldest = it;
+                };
+            };
+            if (oldest == m_cache.end())
+            {
+                break;
+            };
+            m_usedCache -= oldest->second.memoryUsage();
+            m_cache.erase(oldest);
+        };
+        return true;
+    };
+
+    /** row pointers to the pixel data for all rows of the image,
+     *  valid until the next call of setRows() */
+    PixelType ** lines() { return &m_lines[0]; };
+    /** row pointers to the alpha channel, all rows are empty if the image has no alpha channel */
+    AlphaPixelType ** alphaLines() { return &m_alphaLines[0]; };
+
+private:
+    /** a decoded strip */
+    struct Strip
+    {
+        Strip() : rows(0), lastUse(0) {};
+        double memoryUsage() const
+        {
+            return pixels.size() * sizeof(PixelType) + alpha.size() * sizeof(AlphaPixelType);
+        };
+        int rows;
+        unsigned long lastUse;
+        std::vector<PixelType> pixels;
+        std::vector<AlphaPixelType> alpha;
+    };
+    typedef std::map<int, Strip> StripCache;
+
+    static bool isSupportedSampleType(uint16 bits, uint16 format)
+    {
+        if (format == SAMPLEFORMAT_IEEEFP)
+        {
+            return bits == 32 || bits == 64;
+        };
+        if (format == SAMPLEFORMAT_UINT || format == SAMPLEFORMAT_INT)
+        {
+            return bits == 8 || bits == 16 || bits == 32;
+        };
+        return false;
+    };
+
+    static double getMaxSampleValue(uint16 bits, uint16 format)
+    {
+        if (format == SAMPLEFORMAT_IEEEFP)
+        {
+            return 1.0;
+        };
+        if (format == SAMPLEFORMAT_INT)
+        {
+            return std::pow(2.0, bits - 1) - 1;
+        };
+        return std::pow(2.0, bits) - 1;
+    };
+
+    /** read the raw data of a strip (or of a row of tiles) into buffer,
+     *  returns the number of rows */
+    int readRawStrip(int strip, std::vector<unsigned char> & buffer)
+    {
+        const int firstRow = strip * m_stripHeight;
+        const int rows = std::min(m_stripHeight, m_height - firstRow);
+        const size_t pixelSize = m_samplesPerPixel * m_bitsPerSample / 8;
+        buffer.resize(static_cast<size_t>(rows) * m_width * pixelSize);
+        if (m_tiled)
+        {
+            std::vector<unsigned char> tileBuffer(TIFFTileSize(m_tiff));
+            for (int x = 0; x < m_width; x += m_tileWidth)
+            {
+                if (TIFFReadTile(m_tiff, &tileBuffer[0], x, firstRow, 0, 0) < 0)
+                {
+                    return 0;
+                };
+                const size_t copySize = std::min(m_tileWidth, m_width - x) * pixelSize;
+                for (int y = 0; y < rows; ++y)
+                {
+                    std::copy(tileBuffer.begin() + y * m_tileWidth * pixelSize,
+                              tileBuffer.begin() + y * m_tileWidth * pixelSize + copySize,
+                              buffer.begin() + (static_cast<size_t>(y) * m_width + x) * pixelSize);
+                };
+            };
+        }
+        else
+        {
+            if (TIFFReadEncodedStrip(m_tiff, strip, &buffer[0], buffer.size()) < 0)
+            {
+                return 0;
+            };
+        };
+        return rows;
+    };
+
+    /** convert the samples to pixel and alpha values */
+    template <class T>
+    void convertStrip(const T * samples, Strip & s)
+    {
+        double values[3];
+        const size_t nrPixels = static_cast<size_t>(s.rows) * m_width;
+        for (size_t i = 0; i < nrPixels; ++i, samples += m_samplesPerPixel)
+        {
+            for (int b = 0; b < PixelTraits::bands; ++b)
+            {
+                values[b] = samples[b] * m_scale;
+            };
+            s.pixels[i] = PixelTraits::fromSamples(values);
+            if (m_hasAlpha)
+            {
+                s.alpha[i] = vigra::NumericTraits<AlphaPixelType>::fromRealPromote(samples[PixelTraits::bands] * m_alphaScale);
+            };
+        };
+    };
+
+    /** read and decode the given strip */
+    bool readStrip(int strip, Strip & s)
+    {
+        std::vector<unsigned char> buffer;
+        s.rows = readRawStrip(strip, buffer);
+        if (s.rows <= 0)
+        {
+            return false;
+        };
+        s.pixels.resize(static_cast<size_t>(s.rows) * m_width);
+        if (m_hasAlpha)
+        {
+            s.alpha.resize(s.pixels.size());
+        };
+        m_usedCache += s.memoryUsage();
+        const void * data = &buffer[0];
+        switch (m_sampleFormat)
+        {
+            case SAMPLEFORMAT_IEEEFP:
+                if (m_bitsPerSample == 32)
+                {
+                    convertStrip(static_cast<const float *>(data), s);
+                }
+                else
+                {
+                    convertStrip(static_cast<const double *>(data), s);
+                };
+                break;
+            case SAMPLEFORMAT_INT:
+                switch (m_bitsPerSample)
+                {
+                    case 8:
+                        convertStrip(static_cast<const int8 *>(data), s);
+                        break;
+                    case 16:
+                        convertStrip(static_cast<const int16 *>(data), s);
+                        break;
+                    default:
+                        convertStrip(static_cast<const int32 *>(data), s);
+                };
+                break;
+            default:
+                switch (m_bitsPerSample)
+                {
+                    case 8:
+                        convertStrip(static_cast<const uint8 *>(data), s);
+                        break;
+                    case 16:
+                        convertStrip(static_cast<const uint16 *>(data), s);
+                        break;
+                    default:
+                        convertStrip(static_cast<const uint32 *>(data), s);
+                };
+        };
+        return true;
+    };
+
+    TIFF * m_tiff;
+    int m_width;
+    int m_height;
+    int m_stripHeight;
+    int m_samplesPerPixel;
+    int m_bitsPerSample;
+    int m_sampleFormat;
+    bool m_tiled;
+    int m_tileWidth;
+    bool m_hasAlpha;
+    double m_scale;
+    double m_alphaScale;
+    double m_cacheSize;
+    double m_usedCache;
+    unsigned long m_useCounter;
+    StripCache m_cache;
+    int m_firstRow;
+    int m_lastRow;
+    std::vector<PixelType> m_emptyRow;
+    std::vector<AlphaPixelType> m_emptyAlphaRow;
+    std::vector<PixelType*> m_lines;
+    std::vector<AlphaPixelType*> m_alphaLines;
+
+    TiffRowReader(const TiffRowReader&);
+    TiffRowReader& operator=(const TiffRowReader&);
+};
+
 
 }
 
@@ -0,0 +1,38 @@
+// -*- c-basic-offset: 4 ; tab-width: 4 -*-
+/*
+* Copyright (C) 2007-2008 Anael Orlinski
+*
+* This file is part of Panomatic.
+*
+* Panomatic is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* Panomatic is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with Panomatic; if not, write to the Free Software
+* <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __detectpano_cpfindoptions_h
+#define __detectpano_cpfindoptions_h
+
+#include <hugin_shared.h>
+#include "PanoDetector.h"
+
+/** prints the version of cpfind to stdout */
+CPFINDIMPEX void PrintCPFindVersion();
+/** prints the help text of cpfind to stdout */
+CPFINDIMPEX void PrintCPFindUsage();
+/** parses the cpfind command line arguments and sets the options in ioPanoDetector
+ *  @param iNeedsProject if true exactly one project file is expected as
+ *                       non-option argument, otherwise non-option arguments are ignored
+ *  @return true, if the arguments could be parsed and the detection should be run */
+CPFINDIMPEX bool ParseCPFindOptions(int argc, char** argv, PanoDetector& ioPanoDetector, bool iNeedsProject = true);
+
+#endif // __detectpano_cpfindoptions_h
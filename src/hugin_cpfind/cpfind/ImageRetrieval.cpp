@@ -0,0 +1,238 @@
+// -*- c-basic-offset: 4 ; tab-width: 4 -*-
+/*
+* This file is part of Panomatic.
+*
+* Panomatic is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* Panomatic is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with Panomatic; if not, write to the Free Software
+* <http://www.gnu.org/licenses/>.
+*/
+
+#include "ImageRetrieval.h"
+#include "PanoDetectorDefs.h"
+
+#include <algorithm>
+#include <cmath>
+
+// number of strongest keypoints per image, which are used for the bag of words
+static const size_t kMaxWordsPerImage = 1000;
+// maximal number of descriptors for training the vocabulary
+static const size_t kMaxTrainingDescriptors = 100000;
+// maximal size of the vocabulary
+static const int kMaxVocabularySize = 10000;
+// branching factor of the hierarchical k-means clustering
+static const int kVocabularyBranching = 10;
+// words which occur in more than this part of all images carry no information
+static const double kMaxWordFrequency = 0.5;
+
+/** returns the indices of the strongest keypoints of the image */
+static std::vector<size_t> GetStrongestKeypoints(const RetrievalImage& image, size_t maxCount)
+{
+    std::vector<size_t> indices(image.descriptors->size());
+    for (size_t i = 0; i < indices.size(); ++i)
+    {
+        indices[i] = i;
+    };
+    if (indices.size() > maxCount)
+    {
+        const lfeat::KeyPointVect_t& kp = *image.keypoints;
+        std::nth_element(indices.begin(), indices.begin() + maxCount, indices.end(),
+            [&kp](size_t a, size_t b) { return kp[a]->_score > kp[b]->_score; });
+        indices.resize(maxCount);
+    };
+    return indices;
+}
+
+/** copy the given descriptor as float values into out */
+static void GetFloatDescriptor(const lfeat::DescriptorSet& descriptors, size_t index, std::vector<double>& buffer, float* out)
+{
+    descriptors.getDescriptor(index, buffer.data());
+    for (size_t i = 0; i < buffer.size(); ++i)
+    {
+        out[i] = static_cast<float>(buffer[i]);
+    };
+}
+
+std::vector<HuginBase::UIntVector> FindCandidateImages(const std::vector<RetrievalImage>& images, size_t nrCandidates)
+{
+    const size_t nrImages = images.size();
+    std::vector<HuginBase::UIntVector> candidates(nrImages);
+    int dims = 0;
+    size_t nrDescriptors = 0;
+    for (size_t i = 0; i < nrImages; ++i)
+    {
+        if (!images[i].descriptors->empty())
+        {
+            dims = images[i].descriptors->getLength();
+            nrDescriptors += std::min(images[i].descriptors->size(), kMaxWordsPerImage);
+        };
+    };
+    if (dims == 0 || nrImages < 2)
+    {
+        return candidates;
+    };
+
+    // select the strongest keypoints of each image
+    std::vector<std::vector<size_t> > selected(nrImages);
+    for (size_t i = 0; i < nrImages; ++i)
+    {
+        selected[i] = GetStrongestKeypoints(images[i], kMaxWordsPerImage);
+    };
+
+    // train the vocabulary with an evenly distributed sample of the selected descriptors
+    const size_t trainStep = std::max<size_t>(1, (nrDescriptors + kMaxTrainingDescriptors - 1) / kMaxTrainingDescriptors);
+    std::vector<float> trainData;
+    trainData.reserve((nrDescriptors / trainStep + 1) * dims);
+    {
+        std::vector<double> buffer(dims);
+        size_t counter = 0;
+        for (size_t i = 0; i < nrImages; ++i)
+        {
+            for (size_t j = 0; j < selected[i].size(); ++j, ++counter)
+            {
+                if (counter % trainStep == 0)
+                {
+                    trainData.resize(trainData.size() + dims);
+                    GetFloatDescriptor(*images[i].descriptors, selected[i][j], buffer, &trainData[trainData.size() - dims]);
+                };
+            };
+        };
+    }
+    const size_t nrTrain = trainData.size() / dims;
+    if (nrTrain < 2 * kVocabularyBranching)
+    {
+        // too few keypoints for a meaningful vocabulary, return all images
+        for (size_t i = 0; i < nrImages; ++i)
+        {
+            for (size_t j = 0; j < nrImages && candidates[i].size() < nrCandidates; ++j)
+            {
+                if (i != j)
+                {
+                    candidates[i].push_back(j);
+                };
+            };
+        };
+        return candidates;
+    };
+    const int requestedWords = std::max(kVocabularyBranching, std::min<int>(kMaxVocabularySize, static_cast<int>(nrTrain / 10)));
+    std::vector<float> centerData(requestedWords * dims);
+    flann::Matrix<float> centers(centerData.data(), requestedWords, dims);
+    const int nrWords = flann::hierarchicalClustering<DescriptorL2<float> >(flann::Matrix<float>(trainData.data(), nrTrain, dims),
+        centers, flann::KMeansIndexParams(kVocabularyBranching, 10));
+    std::vector<float>().swap(trainData);
+    if (nrWords < 2)
+    {
+        return candidates;
+    };
+    flann::Index<DescriptorL2<float> > vocabulary(flann::Matrix<float>(centerData.data(), nrWords, dims), flann::KDTreeIndexParams(4));
+    vocabulary.buildIndex();
+
+    // assign the selected keypoints of each image to the words
+    std::vector<std::vector<std::pair<int, float> > > histograms(nrImages);
+#pragma omp parallel for schedule(dynamic)
+    for (int i = 0; i < static_cast<int>(nrImages); ++i)
+    {
+        const size_t n = selected[i].size();
+        if (n == 0)
+        {
+            continue;
+        };
+        std::vector<float> query(n * dims);
+        std::vector<double> buffer(dims);
+        for (size_t j = 0; j < n; ++j)
+        {
+            GetFloatDescriptor(*images[i].descriptors, selected[i][j], buffer, &query[j * dims]);
+        };
+        std::vector<int> wordIndex(n);
+        std::vector<float> wordDist(n);
+        flann::Matrix<int> indices(wordIndex.data(), n, 1);
+        flann::Matrix<float> dists(wordDist.data(), n, 1);
+        vocabulary.knnSearch(flann::Matrix<float>(query.data(), n, dims), indices, dists, 1, flann::SearchParams(32));
+        std::sort(wordIndex.begin(), wordIndex.end());
+        std::vector<std::pair<int, float> >& histogram = histograms[i];
+        for (size_t j = 0; j < n; ++j)
+        {
+            if (histogram.empty() || histogram.back().first != wordIndex[j])
+            {
+                histogram.push_back(std::make_pair(wordIndex[j], 0.0f));
+            };
+            histogram.back().second += 1.0f;
+        };
+    };
+
+    // weight the histograms with the inverse document frequency
+    std::vector<int> documentFrequency(nrWords, 0);
+    for (size_t i = 0; i < nrImages; ++i)
+    {
+        for (size_t j = 0; j < histograms[i].size(); ++j)
+        {
+            ++documentFrequency[histograms[i][j].first];
+        };
+    };
+    const int maxFrequency = std::max(2, static_cast<int>(kMaxWordFrequency * nrImages));
+    std::vector<std::vector<std::pair<unsigned int, float> > > invertedFile(nrWords);
+    for (size_t i = 0; i < nrImages; ++i)
+    {
+        std::vector<std::pair<int, float> >& histogram = histograms[i];
+        double norm = 0;
+        for (size_t j = 0; j < histogram.size(); ++j)
+        {
+            const int df = documentFrequency[histogram[j].first];
+            histogram[j].second *= (df > maxFrequency) ? 0.0f : static_cast<float>(log(static_cast<double>(nrImages + 1) / df));
+            norm += histogram[j].second * histogram[j].second;
+        };
+        if (norm <= 0)
+        {
+            continue;
+        };
+        const float scale = static_cast<float>(1.0 / sqrt(norm));
+        for (size_t j = 0; j < histogram.size(); ++j)
+        {
+            if (histogram[j].second > 0)
+            {
+                histogram[j].second *= scale;
+                invertedFile[histogram[j].first].push_back(std::make_pair(static_cast<unsigned int>(i), histogram[j].second));
+            };
+        };
+    };
+
+    // score all images, which share at least one word, and keep the best ones
+#pragma omp parallel for schedule(dynamic)
+    for (int i = 0; i < static_cast<int>(nrImages); ++i)
+    {
+        std::vector<float> scores(nrImages, 0.0f);
+        const std::vector<std::pair<int, float> >& histogram = histograms[i];
+        for (size_t j = 0; j < histogram.size(); ++j)
+        {
+            const std::vector<std::pair<unsigned int, float> >& postings = invertedFile[histogram[j].first];
+            for (size_t k = 0; k < postings.size(); ++k)
+            {
+                scores[postings[k].first] += histogram[j].second * postings[k].second;
+            };
+        };
+        scores[i] = 0;
+        HuginBase::UIntVector ranking;
+        for (size_t j = 0; j < nrImages; ++j)
+        {
+            if (scores[j] > 0)
+            {
+                ranking.push_back(j);
+            };
+        };
+        const size_t count = std::min(nrCandidates, ranking.size());
+        std::partial_sort(ranking.begin(), ranking.begin() + count, ranking.end(),
+            [&scores](unsigned int a, unsigned int b) { return scores[a] > scores[b]; });
+        ranking.resize(count);
+        candidates[i].swap(ranking);
+    };
+    return candidates;
+}
@@ -0,0 +1,53 @@
+// -*- c-basic-offset: 4 ; tab-width: 4 -*-
+/*
+* This file is part of Panomatic.
+*
+* Panomatic is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* Panomatic is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with Panomatic; if not, write to the Free Software
+* <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __detectpano_imageretrieval_h
+#define __detectpano_imageretrieval_h
+
+#include <vector>
+#include <localfeatures/KeyPoint.h>
+#include <localfeatures/DescriptorSet.h>
+#include <panodata/PanoramaData.h>
+
+/** keypoints and descriptors of one image for the image retrieval */
+struct RetrievalImage
+{
+    RetrievalImage() : keypoints(NULL), descriptors(NULL) {};
+    RetrievalImage(const lfeat::KeyPointVect_t* kp, const lfeat::DescriptorSet* desc) : keypoints(kp), descriptors(desc) {};
+
+    const lfeat::KeyPointVect_t* keypoints;
+    const lfeat::DescriptorSet* descriptors;
+};
+
+/** find for each image the images, which are most likely overlapping.
+ *
+ *  A vocabulary of visual words is trained by hierarchical k-means clustering
+ *  of a sample of the descriptors of all images. The strongest keypoints of each
+ *  image are assigned to their nearest word and each image is described by a
+ *  tf-idf weighted histogram of words (bag of words). The similarity of two
+ *  images is the scalar product of their normalized histograms, which is
+ *  evaluated with an inverted file, so the costs grow nearly linear with the
+ *  number of images instead of quadratic.
+ *  @param images keypoints and descriptors of all images
+ *  @param nrCandidates number of candidates returned for each image
+ *  @return for each image the indices of the candidate images, sorted by decreasing similarity
+ */
+std::vector<HuginBase::UIntVector> FindCandidateImages(const std::vector<RetrievalImage>& images, size_t nrCandidates);
+
+#endif // __detectpano_imageretrieval_h
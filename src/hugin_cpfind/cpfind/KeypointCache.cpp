@@ -0,0 +1,106 @@
+// -*- c-basic-offset: 4 ; tab-width: 4 -*-
+/*
+* This file is part of Panomatic.
+*
+* Panomatic is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* Panomatic is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with Panomatic; if not, write to the Free Software
+* <http://www.gnu.org/licenses/>.
+*/
+
+#include "KeypointCache.h"
+
+#include <sstream>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+/** returns a copy of the image without the photometric parameters, these parameters don't
+ *  influence the keypoint detection, so e.g. a photometric optimisation does not invalidate
+ *  the cached keypoints */
+static HuginBase::SrcPanoImage GetDetectionParameters(const HuginBase::SrcPanoImage& image)
+{
+    const HuginBase::SrcPanoImage defaults;
+    HuginBase::SrcPanoImage img(image);
+    img.setEMoRParams(defaults.getEMoRParams());
+    img.setExposureValue(defaults.getExposureValue());
+    img.setWhiteBalanceRed(defaults.getWhiteBalanceRed());
+    img.setWhiteBalanceBlue(defaults.getWhiteBalanceBlue());
+    img.setVigCorrMode(defaults.getVigCorrMode());
+    img.setFlatfieldFilename(defaults.getFlatfieldFilename());
+    img.setRadialVigCorrCoeff(defaults.getRadialVigCorrCoeff());
+    img.setRadialVigCorrCenterShift(defaults.getRadialVigCorrCenterShift());
+    img.setStack(defaults.getStack());
+    return img;
+}
+
+KeypointCache::EntryPtr KeypointCache::get(const std::string& key, const HuginBase::SrcPanoImage& image)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    CacheMap::iterator it = _items.find(key);
+    if (it == _items.end())
+    {
+        return EntryPtr();
+    };
+    if (!(GetDetectionParameters(it->second.entry->image) == GetDetectionParameters(image)))
+    {
+        // the image parameters were changed, the keypoints need to be detected again
+        _items.erase(it);
+        return EntryPtr();
+    };
+    it->second.lastUsed = ++_counter;
+    return it->second.entry;
+}
+
+void KeypointCache::insert(const std::string& key, const EntryPtr& entry)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    CacheItem& item = _items[key];
+    item.entry = entry;
+    item.lastUsed = ++_counter;
+    // remove the least recently used images
+    while (_maxImages > 0 && _items.size() > _maxImages)
+    {
+        CacheMap::iterator oldest = _items.begin();
+        for (CacheMap::iterator it = _items.begin(); it != _items.end(); ++it)
+        {
+            if (it->second.lastUsed < oldest->second.lastUsed)
+            {
+                oldest = it;
+            };
+        };
+        _items.erase(oldest);
+    };
+}
+
+void KeypointCache::clear()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _items.clear();
+}
+
+size_t KeypointCache::size() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _items.size();
+}
+
+std::string KeypointCache::GetFileStamp(const std::string& filename)
+{
+    struct stat fileInfo;
+    if (stat(filename.c_str(), &fileInfo) != 0)
+    {
+        return std::string();
+    };
+    std::ostringstream stamp;
+    stamp << static_cast<long long>(fileInfo.st_mtime) << ":" << static_cast<long long>(fileInfo.st_size);
+    return stamp.str();
+}
@@ -0,0 +1,91 @@
+// -*- c-basic-offset: 4 ; tab-width: 4 -*-
+/*
+* This file is part of Panomatic.
+*
+* Panomatic is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* Panomatic is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with Panomatic; if not, write to the Free Software
+* <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __detectpano_keypointcache_h
+#define __detectpano_keypointcache_h
+
+#include <hugin_shared.h>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include <localfeatures/KeyPoint.h>
+#include <localfeatures/DescriptorSet.h>
+#include <panodata/SrcPanoImage.h>
+
+/** keeps the keypoints and descriptors of analysed images in memory, so that
+ *  repeated detections in the same process (e.g. from the GUI) analyse only new
+ *  or changed images. The cache can be shared by several PanoDetector objects
+ *  and is thread safe. */
+class CPFINDIMPEX KeypointCache
+{
+public:
+    /** the result of the analysis of one image */
+    struct Entry
+    {
+        Entry() : detectWidth(0), detectHeight(0), descLength(0) {};
+        /** the image as it was analysed, used to check if the entry is still valid */
+        HuginBase::SrcPanoImage image;
+        lfeat::KeyPointVect_t keypoints;
+        lfeat::DescriptorSet descriptors;
+        int detectWidth;
+        int detectHeight;
+        int descLength;
+    };
+    typedef std::shared_ptr<const Entry> EntryPtr;
+
+    /** constructor
+     *  @param maxImages maximal number of cached images, when the limit is reached
+     *                   the least recently used image is removed, 0 means no limit */
+    explicit KeypointCache(size_t maxImages = 200) : _maxImages(maxImages), _counter(0) {};
+
+    /** returns the cached data for the given key, if the parameters of the image, which
+     *  influence the detection, are unchanged, otherwise an empty pointer is returned */
+    EntryPtr get(const std::string& key, const HuginBase::SrcPanoImage& image);
+    /** stores the data for the given key, an older entry is replaced */
+    void insert(const std::string& key, const EntryPtr& entry);
+    /** removes all cached data */
+    void clear();
+    /** returns the number of cached images */
+    size_t size() const;
+
+    /** returns a string describing the version of the file (modification time and size),
+     *  to detect changed image files */
+    static std::string GetFileStamp(const std::string& filename);
+
+private:
+    // prevent copying of class
+    KeypointCache(const KeypointCache&);
+    KeypointCache& operator=(const KeypointCache&);
+
+    struct CacheItem
+    {
+        EntryPtr entry;
+        unsigned long long lastUsed;
+    };
+    typedef std::map<std::string, CacheItem> CacheMap;
+
+    mutable std::mutex _mutex;
+    CacheMap _items;
+    size_t _maxImages;
+    unsigned long long _counter;
+};
+
+#endif // __detectpano_keypointcache_h
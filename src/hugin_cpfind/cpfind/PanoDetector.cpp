@@ -23,11 +23,16 @@
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <deque>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
 
 #include <time.h>
 
 #include "Utils.h"
 #include "Tracer.h"
+#include "ImageRetrieval.h"
 #include "hugin_base/hugin_utils/platform.h"
 
 #include <algorithms/nona/ComputeImageROI.h>
@@ -42,6 +47,7 @@
 #include <algorithms/optimizer/ImageGraph.h>
 #include <algorithms/optimizer/PTOptimizer.h>
 #include <algorithms/basic/CalculateOverlap.h>
+#include <panotools/PanoToolsInterface.h>
 
 #include "ImageImport.h"
 
@@ -101,13 +107,14 @@ std::string getKeyfilenameFor(std::string keyfilesPath, std::string filename)
 PanoDetector::PanoDetector() :
     _writeAllKeyPoints(false), _verbose(1),
     _sieve1Width(10), _sieve1Height(10), _sieve1Size(100),
-    _kdTreeSearchSteps(200), _kdTreeSecondDistance(0.25),
+    _kdTreeSearchSteps(200), _kdTreeSecondDistance(0.25), _descriptorType(lfeat::DescriptorSet::FLOAT),
     _minimumMatches(6), _ransacMode(HuginBase::RANSACOptimizer::AUTO), _ransacIters(1000), _ransacDistanceThres(50),
     _sieve2Width(5), _sieve2Height(5), _sieve2Size(1),
-    _matchingStrategy(ALLPAIRS), _linearMatchLen(1),
-    _test(false), _cores(0), _downscale(true), _cache(false), _cleanup(false),
-    _celeste(false), _celesteThreshold(0.5), _celesteRadius(20), 
-    _keypath(""), _outputFile("default.pto"), _outputGiven(false), svmModel(NULL)
+    _matchingStrategy(ALLPAIRS), _linearMatchLen(1), _globalMatchLen(10), _overlapSlack(0),
+    _test(false), _cores(0), _downscale(true), _cache(false), _keyfileFormat(KEYFILE_BINARY), _cleanup(false),
+    _celeste(false), _celesteThreshold(0.5), _celesteRadius(20), _tileSize(0), _incremental(false),
+    _keypath(""), _outputFile("default.pto"), _outputGiven(false),
+    _progress(NULL), _keypointCache(NULL), _cancelled(false), svmModel(NULL)
 {
     _panoramaInfo = new HuginBase::Panorama();
 }
@@ -139,6 +146,16 @@ bool PanoDetector::checkData()
     return true;
 }
 
+lfeat::DetectorSettings PanoDetector::getDetectorSettings() const
+{
+    lfeat::DetectorSettings settings;
+    settings.sieve1Width = _sieve1Width;
+    settings.sieve1Height = _sieve1Height;
+    settings.sieve1Size = _sieve1Size;
+    settings.downscale = _downscale ? 1 : 0;
+    return settings;
+}
+
 void PanoDetector::printDetails()
 {
     std::cout << "Input file           : " << _inputFile << std::endl;
@@ -173,11 +190,19 @@ void PanoDetector::printDetails()
     {
         std::cout << "Automatically cache keypoints files to disc." << std::endl;
     };
+    if(_cache || _writeAllKeyPoints || _keyPointsIdx.size() != 0)
+    {
+        std::cout << "Keyfile format       : " << (_keyfileFormat == KEYFILE_BINARY ? "binary" : "text") << std::endl;
+    };
 #ifdef HAVE_OPENMP
     std::cout << "Number of threads  : " << (_cores>0 ? _cores : omp_get_max_threads()) << std::endl << std::endl;
 #endif
     std::cout << "Input image options" << std::endl;
     std::cout << "  Downscale to half-size : " << (_downscale?"yes":"no") << std::endl;
+    if (_tileSize > 0)
+    {
+        std::cout << "  Detect keypoints in tiles of " << _tileSize << " pixels" << std::endl;
+    };
     if(_celeste)
     {
         std::cout << "Celeste options" << std::endl;
@@ -192,6 +217,7 @@ void PanoDetector::printDetails()
     std::cout << "KDTree Options" << std::endl;
     std::cout << "  Search steps : " << _kdTreeSearchSteps << std::endl;
     std::cout << "  Second match distance : " << _kdTreeSecondDistance << std::endl;
+    std::cout << "  Descriptor type : " << lfeat::DescriptorSet::GetTypeName(_descriptorType) << std::endl;
     std::cout << "Matching Options" << std::endl;
     switch(_matchingStrategy)
     {
@@ -205,9 +231,16 @@ void PanoDetector::printDetails()
             std::cout << "  Mode : Multi row" << std::endl;
             break;
         case PREALIGNED:
-            std::cout << "  Mode : Prealigned positions" << std::endl;
+            std::cout << "  Mode : Prealigned positions with overlap slack of " << _overlapSlack << " degree" << std::endl;
+            break;
+        case GLOBAL:
+            std::cout << "  Mode : Global matching with " << _globalMatchLen << " candidate images" << std::endl;
             break;
     };
+    if (_incremental)
+    {
+        std::cout << "  Incremental : match only image pairs with new images" << std::endl;
+    };
     std::cout << "  Distance threshold : " << _ransacDistanceThres << std::endl;
     std::cout << "RANSAC Options" << std::endl;
     std::cout << "  Mode : ";
@@ -250,6 +283,10 @@ void PanoDetector::printFilenames()
             name=name.substr(_prefix.length(),name.length()-_prefix.length());
         }
         std::cout << "Image " << i << std::endl << "  Imagefile: " << name << std::endl;
+        if(_filesData[i]._cacheEntry)
+        {
+            std::cout << "  Keypoints: cached in memory" << std::endl;
+        };
         bool writeKeyfileForImage=false;
         if(_keyPointsIdx.size()>0)
         {
@@ -258,7 +295,7 @@ void PanoDetector::printFilenames()
                 writeKeyfileForImage=_keyPointsIdx[j]==i;
             };
         };
-        if(_cache || _filesData[i]._hasakeyfile || writeKeyfileForImage)
+        if(!_filesData[i]._cacheEntry && (_cache || _filesData[i]._hasakeyfile || writeKeyfileForImage))
         {
             name=_filesData[i]._keyfilename;
             if(name.compare(0,_prefix.length(),_prefix)==0)
@@ -305,6 +342,7 @@ public:
         PanoDetector::FilterKeyPointsInImage(_imgData, _panoDetector);
         PanoDetector::MakeKeyPointDescriptorsInImage(_imgData, _panoDetector);
         PanoDetector::RemapBackKeypoints(_imgData, _panoDetector);
+        PanoDetector::StoreKeypointsInCache(_imgData, _panoDetector);
         PanoDetector::BuildKDTreesInImage(_imgData, _panoDetector);
         PanoDetector::FreeMemoryInImage(_imgData, _panoDetector);
     }
@@ -357,6 +395,40 @@ private:
     PanoDetector::ImgData&		_imgData;
 };
 
+// definition of a runnable class for keypoints from the in-memory cache
+class LoadCachedKeypointsRunnable : public Runnable
+{
+public:
+    LoadCachedKeypointsRunnable(PanoDetector::ImgData& iImageData, const PanoDetector& iPanoDetector) :
+        _panoDetector(iPanoDetector), _imgData(iImageData) {};
+
+    virtual void run()
+    {
+        TRACE_IMG("Using cached keypoints...");
+        PanoDetector::LoadCachedKeypoints(_imgData, _panoDetector);
+        PanoDetector::BuildKDTreesInImage(_imgData, _panoDetector);
+    }
+
+private:
+    const PanoDetector&			_panoDetector;
+    PanoDetector::ImgData&		_imgData;
+};
+
+/** returns the runnable, which provides the keypoints of the image for the matching:
+ *  from the in-memory cache, from a keyfile or by analysing the image */
+static Runnable* CreateImageRunnable(PanoDetector::ImgData& iImageData, const PanoDetector& iPanoDetector)
+{
+    if (iImageData._cacheEntry)
+    {
+        return new LoadCachedKeypointsRunnable(iImageData, iPanoDetector);
+    };
+    if (iImageData._hasakeyfile)
+    {
+        return new LoadKeypointsDataRunnable(iImageData, iPanoDetector);
+    };
+    return new ImgDataRunnable(iImageData, iPanoDetector);
+};
+
 // definition of a runnable class for MatchData
 class MatchDataRunnable : public Runnable
 {
@@ -380,6 +452,48 @@ private:
     PanoDetector::MatchData&	_matchData;
 };
 
+// definition of a runnable class, which writes the keyfile after the analysis of the image
+class CacheKeyfileRunnable : public Runnable
+{
+public:
+    CacheKeyfileRunnable(Runnable* iRunnable, PanoDetector::ImgData& iImageData, const PanoDetector& iPanoDetector) :
+        _runnable(iRunnable), _panoDetector(iPanoDetector), _imgData(iImageData) {};
+    virtual ~CacheKeyfileRunnable()
+    {
+        delete _runnable;
+    };
+
+    virtual void run()
+    {
+        _runnable->run();
+        if (!_imgData._loadFail)
+        {
+            TRACE_IMG("Caching keypoints...");
+            _panoDetector.writeKeyfile(_imgData);
+        };
+    }
+private:
+    Runnable*					_runnable;
+    const PanoDetector&			_panoDetector;
+    PanoDetector::ImgData&		_imgData;
+};
+
+// definition of a runnable class, which frees the matching data of an image
+class FreeMatchingDataRunnable : public Runnable
+{
+public:
+    FreeMatchingDataRunnable(PanoDetector::ImgData& iImageData, const PanoDetector& iPanoDetector) :
+        _panoDetector(iPanoDetector), _imgData(iImageData) {};
+
+    virtual void run()
+    {
+        PanoDetector::FreeMatchingDataInImage(_imgData, _panoDetector);
+    }
+private:
+    const PanoDetector&			_panoDetector;
+    PanoDetector::ImgData&		_imgData;
+};
+
 bool PanoDetector::LoadSVMModel()
 {
     std::string model_file = ("celeste.model");
@@ -407,12 +521,40 @@ bool PanoDetector::LoadSVMModel()
 
 typedef std::vector<Runnable*> RunnableVector;
 
-void RunQueue(std::vector<Runnable*>& queue)
+/** updates the progress display, the progress display is not thread safe, so only the
+ *  master thread (the thread which started the detection) accesses it.
+ *  Sets cancelled, if the user has cancelled the detection */
+static void UpdateProgress(AppBase::ProgressDisplay* progress, std::atomic<bool>& cancelled)
 {
+    if (progress == NULL)
+    {
+        return;
+    };
+#ifdef HAVE_OPENMP
+    if (omp_get_thread_num() != 0)
+    {
+        return;
+    };
+#endif
+    if (!progress->updateDisplayValue())
+    {
+        cancelled = true;
+    };
+};
+
+/** runs all runnables in parallel and deletes them afterwards
+ *  @return false, if the user has cancelled the processing, the remaining runnables are skipped */
+static bool RunQueue(RunnableVector& queue, AppBase::ProgressDisplay* progress)
+{
+    std::atomic<bool> cancelled(false);
 #pragma omp parallel for schedule(dynamic)
     for (int i = 0; i < queue.size(); ++i)
     {
-        queue[i]->run();
+        if (!cancelled)
+        {
+            queue[i]->run();
+            UpdateProgress(progress, cancelled);
+        };
     };
     // now clear queue
     while (!queue.empty())
@@ -420,13 +562,161 @@ void RunQueue(std::vector<Runnable*>& queue)
         delete queue.back();
         queue.pop_back();
     };
+    return !cancelled;
 };
 
-void PanoDetector::run()
+/** runs the analysis of the images and the matching of the image pairs without a barrier
+ *  between both steps. A pair is matched as soon as both of its images are analysed,
+ *  ready pairs are preferred over the analysis of the next image. When all pairs of an
+ *  image are matched, the release task of this image is run to free its memory.
+ *  The pairs of images, which could not be loaded or have no keypoints, are skipped.
+ *  All runnables are deleted at the end.
+ *  @param imageTasks analysis task for each image, the images are analysed in this order
+ *  @param releaseTasks task for each image, which frees the memory of the image
+ *  @param pairTasks matching task for each pair
+ *  @param pairs the indices of the two images (in imageTasks) of each pair
+ *  @param images the image data of each image task, used to check the result of the analysis
+ *  @param progress progress display, can be NULL
+ *  @return false, if the user has cancelled the processing
+ */
+static bool RunPipeline(RunnableVector& imageTasks, RunnableVector& releaseTasks, RunnableVector& pairTasks,
+    const std::vector<std::pair<size_t, size_t> >& pairs, const std::vector<PanoDetector::ImgData*>& images,
+    AppBase::ProgressDisplay* progress)
 {
-    // init the random time generator
-    srandom((unsigned int)time(NULL));
+    const size_t nrImages = imageTasks.size();
+    // for each image the pairs, which depends on this image
+    std::vector<std::vector<size_t> > imagePairs(nrImages);
+    for (size_t i = 0; i < pairs.size(); ++i)
+    {
+        imagePairs[pairs[i].first].push_back(i);
+        imagePairs[pairs[i].second].push_back(i);
+    };
+    // number of images each pair is still waiting for
+    std::vector<int> missingImages(pairs.size(), 2);
+    // pairs with at least one failed image, these are not matched
+    std::vector<bool> skippedPairs(pairs.size(), false);
+    // reference count: number of not yet matched pairs of each image
+    std::vector<size_t> openPairs(nrImages);
+    for (size_t i = 0; i < nrImages; ++i)
+    {
+        openPairs[i] = imagePairs[i].size();
+    };
+    std::deque<size_t> readyPairs;
+    size_t nextImage = 0;
+    size_t finishedTasks = 0;
+    const size_t nrTasks = nrImages + pairs.size();
+    std::mutex queueMutex;
+    std::condition_variable queueChanged;
+    std::atomic<bool> cancelled(false);
+#pragma omp parallel
+    {
+        std::unique_lock<std::mutex> lock(queueMutex);
+        std::vector<size_t> releaseImages;
+        while (finishedTasks < nrTasks && !cancelled)
+        {
+            Runnable* task;
+            size_t index;
+            bool isPair;
+            if (!readyPairs.empty())
+            {
+                index = readyPairs.front();
+                readyPairs.pop_front();
+                task = pairTasks[index];
+                isPair = true;
+            }
+            else
+            {
+                if (nextImage < nrImages)
+                {
+                    index = nextImage++;
+                    task = imageTasks[index];
+                    isPair = false;
+                }
+                else
+                {
+                    // all remaining tasks are running or waiting for running tasks
+                    queueChanged.wait(lock);
+                    continue;
+                };
+            };
+            lock.unlock();
+            task->run();
+            const bool imageFailed = !isPair && (images[index]->_loadFail || images[index]->_kp.empty());
+            UpdateProgress(progress, cancelled);
+            lock.lock();
+            ++finishedTasks;
+            // the matched pairs, and the skipped pairs which are complete now
+            std::vector<size_t> finishedPairs;
+            if (isPair)
+            {
+                finishedPairs.push_back(index);
+            }
+            else
+            {
+                for (size_t i = 0; i < imagePairs[index].size(); ++i)
+                {
+                    const size_t pair = imagePairs[index][i];
+                    if (imageFailed)
+                    {
+                        skippedPairs[pair] = true;
+                    };
+                    if (--missingImages[pair] == 0)
+                    {
+                        if (skippedPairs[pair])
+                        {
+                            finishedPairs.push_back(pair);
+                            ++finishedTasks;
+                        }
+                        else
+                        {
+                            readyPairs.push_back(pair);
+                        };
+                    };
+                };
+                if (imagePairs[index].empty())
+                {
+                    releaseImages.push_back(index);
+                };
+            };
+            for (size_t i = 0; i < finishedPairs.size(); ++i)
+            {
+                if (--openPairs[pairs[finishedPairs[i]].first] == 0)
+                {
+                    releaseImages.push_back(pairs[finishedPairs[i]].first);
+                };
+                if (--openPairs[pairs[finishedPairs[i]].second] == 0)
+                {
+                    releaseImages.push_back(pairs[finishedPairs[i]].second);
+                };
+            };
+            queueChanged.notify_all();
+            if (!releaseImages.empty())
+            {
+                lock.unlock();
+                for (size_t i = 0; i < releaseImages.size(); ++i)
+                {
+                    releaseTasks[releaseImages[i]]->run();
+                };
+                releaseImages.clear();
+                lock.lock();
+            };
+        };
+    }
+    // now clear all queues
+    RunnableVector* queues[3] = { &imageTasks, &releaseTasks, &pairTasks };
+    for (size_t i = 0; i < 3; ++i)
+    {
+        while (!queues[i]->empty())
+        {
+            delete queues[i]->back();
+            queues[i]->pop_back();
+        };
+    };
+    return !cancelled;
+};
 
+void PanoDetector::run()
+{
     // Load the input project file
     if(!loadProject())
     {
@@ -446,12 +736,111 @@ void PanoDetector::run()
         return;
     };
 
+    if (!detect())
+    {
+        return;
+    };
+
+    // 5. write output
+    if (_keyPointsIdx.size() != 0)
+    {
+        //Write all keyfiles
+        TRACE_INFO(std::endl<< "--- Write Keyfiles output ---" << std::endl << std::endl);
+        for (unsigned int i = 0; i < _keyPointsIdx.size(); ++i)
+        {
+            writeKeyfile(_filesData[_keyPointsIdx[i]]);
+        };
+        if(_outputGiven)
+        {
+            std::cout << std::endl << "Warning: You have given the --output switch." << std::endl
+                 << "This switch is not compatible with the --writekeyfile or --kall switch." << std::endl
+                 << "If you want to generate the keyfiles and" << std::endl
+                 << "do the matching in the same run use the --cache switch instead." << std::endl << std::endl;
+        };
+    }
+    else
+    {
+        /// Write output project
+        TRACE_INFO(std::endl<< "--- Write Project output ---" << std::endl);
+        writeOutput();
+        TRACE_INFO("Written output to " << _outputFile << std::endl << std::endl);
+    };
+}
+
+bool PanoDetector::findControlPoints(const HuginBase::Panorama& pano, const HuginBase::UIntSet& imgs, HuginBase::CPVector& cps)
+{
+    cps.clear();
+    if (imgs.size() < 2 || !_keyPointsIdx.empty() || _writeAllKeyPoints || _cleanup)
+    {
+        return false;
+    };
+    // reset the state of a previous run
+    _filesData.clear();
+    _image_layer.clear();
+    _image_stacks.clear();
+    _prefix.clear();
+    // work on a copy of the selected images, the existing control points are only
+    // considered in incremental mode
+    *_panoramaInfo = pano.getSubset(imgs);
+    if (!_incremental)
+    {
+        _panoramaInfo->setCtrlPoints(HuginBase::CPVector());
+    };
+    const size_t oldCPs = _panoramaInfo->getNrOfCtrlPoints();
+    // the detection can disable celeste and change the number of threads,
+    // restore the settings afterwards
+    const bool celeste = _celeste;
+#ifdef HAVE_OPENMP
+    const int oldThreads = omp_get_max_threads();
+#endif
+    const bool success = initImages() && checkData() && detect();
+    _celeste = celeste;
+#ifdef HAVE_OPENMP
+    omp_set_num_threads(oldThreads);
+#endif
+    if (!success)
+    {
+        return false;
+    };
+    if (!_incremental)
+    {
+        _panoramaInfo->removeDuplicateCtrlPoints();
+    };
+    // return only the new control points, the image numbers are mapped back
+    // to the numbers in the given panorama
+    const HuginBase::UIntVector imgMap(imgs.begin(), imgs.end());
+    const HuginBase::CPVector& allCPs = _panoramaInfo->getCtrlPoints();
+    cps.assign(allCPs.begin() + oldCPs, allCPs.end());
+    for (HuginBase::CPVector::iterator it = cps.begin(); it != cps.end(); ++it)
+    {
+        it->image1Nr = imgMap[it->image1Nr];
+        it->image2Nr = imgMap[it->image2Nr];
+    };
+    // the image data are not needed any more, the keypoints are kept in the cache
+    _filesData.clear();
+    return true;
+}
+
+void PanoDetector::setProgressMessage(const std::string& message)
+{
+    if (_progress != NULL)
+    {
+        _progress->setMessage(message);
+    };
+}
+
+bool PanoDetector::detect()
+{
+    // init the random time generator
+    srandom((unsigned int)time(NULL));
+    _cancelled = false;
+
     //checking, if memory allows running desired number of threads
     unsigned long maxImageSize=0;
     bool withRemap=false;
     for (ImgDataIt_t aB = _filesData.begin(); aB != _filesData.end(); ++aB)
     {
-        if(!aB->second._hasakeyfile)
+        if(!aB->second._hasakeyfile && !aB->second._cacheEntry)
         {
             maxImageSize=std::max<unsigned long>(aB->second._detectWidth*aB->second._detectHeight,maxImageSize);
             if(aB->second.NeedsRemapping())
@@ -461,39 +850,32 @@ void PanoDetector::run()
         };
     };
 #ifdef HAVE_OPENMP
-    if (_cores == 0)
-    {
-        setCores(omp_get_max_threads());
-    };
+    unsigned long long cores = (_cores > 0) ? _cores : omp_get_max_threads();
     if (maxImageSize != 0)
     {
         unsigned long long maxCores;
         //determinded factors by testing of some projects
         //the memory usage seems to be very high
         //if the memory usage could be decreased these numbers can be decreased
-        if(withRemap)
-        {
-            maxCores=utils::getTotalMemory()/(maxImageSize*75);
-        }
-        else
-        {
-            maxCores=utils::getTotalMemory()/(maxImageSize*50);
-        };
+        //in tile mode the integral image and the scale space are only needed for a tile
+        //and not for the whole image
+        const unsigned long long bytesPerPixel = (withRemap ? 75 : 50) - (_tileSize > 0 ? 25 : 0);
+        maxCores=utils::getTotalMemory()/(maxImageSize*bytesPerPixel);
         if(maxCores<1)
         {
             maxCores=1;
         }
-        if(maxCores<_cores)
+        if(maxCores<cores)
         {
             if(getVerbose()>0)
             {
-                std::cout << "\nThe available memory does not allow running " << _cores << " threads parallel.\n"
+                std::cout << "\nThe available memory does not allow running " << cores << " threads parallel.\n"
                             << "Running cpfind with " << maxCores << " threads.\n";
             };
-            setCores(maxCores);
+            cores = maxCores;
         };
     };
-    omp_set_num_threads(_cores);
+    omp_set_num_threads(cores);
 #endif
     RunnableVector queue;
     svmModel = NULL;
@@ -519,77 +901,90 @@ void PanoDetector::run()
     //running multi threading part
     std::string s=vigra::impexListExtensions();
 #endif
-    if (_keyPointsIdx.size() != 0)
-    {
-        if (_verbose > 0)
-        {
-            TRACE_INFO(std::endl << "--- Analyze Images ---" << std::endl);
-        }
-        for (unsigned int i = 0; i < _keyPointsIdx.size(); ++i)
-        {
-            queue.push_back(new WriteKeyPointsRunnable(_filesData[_keyPointsIdx[i]], *this));
-        };
+    // when the image pairs are known before the analysis, the matching of the pairs
+    // is started as soon as both images of a pair are analysed
+    const bool pipelined = _keyPointsIdx.empty() && (getMatchingStrategy() == ALLPAIRS || getMatchingStrategy() == LINEAR);
+    MatchData_t pipelinedMatches;
+    if (pipelined)
+    {
+        setProgressMessage("Analyzing images and matching image pairs");
+        analyzeAndMatchPairs(pipelinedMatches);
     }
     else
     {
-        TRACE_INFO(std::endl << "--- Analyze Images ---" << std::endl);
-        if (getMatchingStrategy() == MULTIROW)
+        setProgressMessage("Analyzing images");
+        if (_keyPointsIdx.size() != 0)
         {
-            // when using multirow, don't analyse stacks with linked positions
-            buildMultiRowImageSets();
-            HuginBase::UIntSet imagesToAnalyse;
-            imagesToAnalyse.insert(_image_layer.begin(), _image_layer.end());
-            for (size_t i = 0; i < _image_stacks.size(); i++)
+            if (_verbose > 0)
             {
-                imagesToAnalyse.insert(_image_stacks[i].begin(), _image_stacks[i].end());
+                TRACE_INFO(std::endl << "--- Analyze Images ---" << std::endl);
             }
-            for (HuginBase::UIntSet::const_iterator it = imagesToAnalyse.begin(); it != imagesToAnalyse.end(); ++it)
+            for (unsigned int i = 0; i < _keyPointsIdx.size(); ++i)
             {
-                if (_filesData[*it]._hasakeyfile)
-                {
-                    queue.push_back(new LoadKeypointsDataRunnable(_filesData[*it], *this));
-                }
-                else
-                {
-                    queue.push_back(new ImgDataRunnable(_filesData[*it], *this));
-                };
+                queue.push_back(new WriteKeyPointsRunnable(_filesData[_keyPointsIdx[i]], *this));
             };
         }
         else
         {
-            for (ImgDataIt_t aB = _filesData.begin(); aB != _filesData.end(); ++aB)
+            TRACE_INFO(std::endl << "--- Analyze Images ---" << std::endl);
+            if (getMatchingStrategy() == MULTIROW)
             {
-                if (aB->second._hasakeyfile)
+                // when using multirow, don't analyse stacks with linked positions
+                buildMultiRowImageSets();
+                HuginBase::UIntSet imagesToAnalyse;
+                imagesToAnalyse.insert(_image_layer.begin(), _image_layer.end());
+                for (size_t i = 0; i < _image_stacks.size(); i++)
                 {
-                    queue.push_back(new LoadKeypointsDataRunnable(aB->second, *this));
+                    imagesToAnalyse.insert(_image_stacks[i].begin(), _image_stacks[i].end());
                 }
-                else
+                for (HuginBase::UIntSet::const_iterator it = imagesToAnalyse.begin(); it != imagesToAnalyse.end(); ++it)
                 {
-                    queue.push_back(new ImgDataRunnable(aB->second, *this));
-                }
+                    queue.push_back(CreateImageRunnable(_filesData[*it], *this));
+                };
             }
+            else
+            {
+                for (ImgDataIt_t aB = _filesData.begin(); aB != _filesData.end(); ++aB)
+                {
+                    queue.push_back(CreateImageRunnable(aB->second, *this));
+                }
+            };
+        }
+        if (!RunQueue(queue, _progress))
+        {
+            _cancelled = true;
         };
+    };
+    // the keypoint detection is finished, free the scratch memory of the detector in all threads
+#pragma omp parallel
+    {
+        lfeat::KeyPointDetector::ReleaseScratchMemory();
     }
-    RunQueue(queue);
 
     if(svmModel!=NULL)
     {
         celeste::destroySVMmodel(svmModel);
     };
 
+    if (_cancelled)
+    {
+        TRACE_INFO("Detection cancelled." << std::endl);
+        return false;
+    };
+
     // check if the load of images succeed.
     if (!checkLoadSuccess())
     {
         TRACE_INFO("One or more images failed to load. Exiting.");
-        return;
+        return false;
     }
 
-    if(_cache)
+    if(_cache && !pipelined)
     {
         TRACE_INFO(std::endl << "--- Cache keyfiles to disc ---" << std::endl);
         for (ImgDataIt_t aB = _filesData.begin(); aB != _filesData.end(); ++aB)
         {
-            if (!aB->second._hasakeyfile)
+            if (!aB->second._hasakeyfile && !aB->second._cacheEntry)
             {
                 TRACE_INFO("i" << aB->second._number << " : Caching keypoints..." << std::endl);
                 writeKeyfile(aB->second);
@@ -600,22 +995,27 @@ void PanoDetector::run()
     // Detect matches if writeKeyPoints wasn't set
     if(_keyPointsIdx.size() == 0)
     {
+        if (!pipelined)
+        {
+            setProgressMessage("Matching image pairs");
+        };
         switch (getMatchingStrategy())
         {
             case ALLPAIRS:
             case LINEAR:
-                {
-                    std::vector<HuginBase::UIntSet> imgPairs(_panoramaInfo->getNrOfImages());
-                    if(!match(imgPairs))
-                    {
-                        return;
-                    };
-                };
+                // the pairs were already matched together with the analysis of the images
+                addControlPoints(pipelinedMatches);
                 break;
             case MULTIROW:
                 if(!matchMultiRow())
                 {
-                    return;
+                    return false;
+                };
+                break;
+            case GLOBAL:
+                if(!matchGlobal())
+                {
+                    return false;
                 };
                 break;
             case PREALIGNED:
@@ -640,44 +1040,19 @@ void PanoDetector::run()
                     //and the final matching step
                     if(!matchPrealigned(_panoramaInfo, connectedImages, imgMap))
                     {
-                        return;
+                        return false;
                     };
                 }
                 break;
         };
     }
-
-    // 5. write output
-    if (_keyPointsIdx.size() != 0)
-    {
-        //Write all keyfiles
-        TRACE_INFO(std::endl<< "--- Write Keyfiles output ---" << std::endl << std::endl);
-        for (unsigned int i = 0; i < _keyPointsIdx.size(); ++i)
-        {
-            writeKeyfile(_filesData[_keyPointsIdx[i]]);
-        };
-        if(_outputGiven)
-        {
-            std::cout << std::endl << "Warning: You have given the --output switch." << std::endl
-                 << "This switch is not compatible with the --writekeyfile or --kall switch." << std::endl
-                 << "If you want to generate the keyfiles and" << std::endl
-                 << "do the matching in the same run use the --cache switch instead." << std::endl << std::endl;
-        };
-    }
-    else
-    {
-        /// Write output project
-        TRACE_INFO(std::endl<< "--- Write Project output ---" << std::endl);
-        writeOutput();
-        TRACE_INFO("Written output to " << _outputFile << std::endl << std::endl);
-    };
+    setProgressMessage("");
+    return true;
 }
 
-bool PanoDetector::match(std::vector<HuginBase::UIntSet> &checkedPairs)
+void PanoDetector::buildLinearPairs(std::vector<HuginBase::UIntSet> &checkedPairs, MatchData_t& matchesData)
 {
     // 3. prepare matches
-    RunnableVector queue;
-    MatchData_t matchesData;
     unsigned int aLen = _filesData.size();
     if (getMatchingStrategy()==LINEAR)
     {
@@ -699,7 +1074,7 @@ bool PanoDetector::match(std::vector<HuginBase::UIntSet> &checkedPairs)
 
         for (unsigned int i2 = (i1+1); i2 < aEnd; ++i2)
         {
-            if(set_contains(checkedPairs[i1], i2))
+            if(!needsMatching(checkedPairs, i1, i2))
             {
                 continue;
             };
@@ -714,14 +1089,125 @@ bool PanoDetector::match(std::vector<HuginBase::UIntSet> &checkedPairs)
             checkedPairs[i2].insert(i1);
         }
     }
+};
+
+bool PanoDetector::match(std::vector<HuginBase::UIntSet> &checkedPairs)
+{
+    MatchData_t matchesData;
+    buildLinearPairs(checkedPairs, matchesData);
+    return matchPairs(matchesData);
+};
+
+void PanoDetector::analyzeAndMatchPairs(MatchData_t& matchesData)
+{
+    // the pairs are known before the analysis, so a pair can be matched as soon
+    // as both images are analysed and not only after all images are analysed
+    std::vector<HuginBase::UIntSet> checkedPairs(_filesData.size());
+    buildLinearPairs(checkedPairs, matchesData);
+    TRACE_INFO(std::endl << "--- Analyze Images and find pair-wise matches ---" << std::endl);
+    // in incremental mode only the images of the pairs are needed
+    std::vector<size_t> taskIndex(_filesData.size(), 0);
+    std::vector<bool> usedImages(_filesData.size(), !_incremental);
+    for (size_t i = 0; i < matchesData.size(); ++i)
+    {
+        usedImages[matchesData[i]._i1->_number] = true;
+        usedImages[matchesData[i]._i2->_number] = true;
+    };
+    RunnableVector imageTasks;
+    RunnableVector releaseTasks;
+    std::vector<ImgData*> images;
+    for (ImgDataIt_t aB = _filesData.begin(); aB != _filesData.end(); ++aB)
+    {
+        if (!usedImages[aB->first])
+        {
+            continue;
+        };
+        taskIndex[aB->first] = imageTasks.size();
+        images.push_back(&aB->second);
+        if (_cache && !aB->second._hasakeyfile && !aB->second._cacheEntry)
+        {
+            // the descriptors are freed after matching, so write the keyfile directly after the analysis
+            imageTasks.push_back(new CacheKeyfileRunnable(new ImgDataRunnable(aB->second, *this), aB->second, *this));
+        }
+        else
+        {
+            imageTasks.push_back(CreateImageRunnable(aB->second, *this));
+        };
+        releaseTasks.push_back(new FreeMatchingDataRunnable(aB->second, *this));
+    };
+    RunnableVector pairTasks;
+    std::vector<std::pair<size_t, size_t> > pairs;
+    for (size_t i = 0; i < matchesData.size(); ++i)
+    {
+        pairTasks.push_back(new MatchDataRunnable(matchesData[i], *this));
+        pairs.push_back(std::pair<size_t, size_t>(taskIndex[matchesData[i]._i1->_number], taskIndex[matchesData[i]._i2->_number]));
+    };
+    if (!RunPipeline(imageTasks, releaseTasks, pairTasks, pairs, images, _progress))
+    {
+        _cancelled = true;
+    };
+};
+
+bool PanoDetector::matchGlobal()
+{
+    // 3. find candidate pairs by comparing the descriptors of all images
+    TRACE_INFO(std::endl<< "--- Find candidate image pairs ---" << std::endl);
+    const unsigned int nImg = _filesData.size();
+    std::vector<RetrievalImage> images(nImg);
+    for (unsigned int i = 0; i < nImg; ++i)
+    {
+        images[i] = RetrievalImage(&_filesData[i]._kp, &_filesData[i]._descriptors);
+    };
+    const std::vector<HuginBase::UIntVector> candidates = FindCandidateImages(images, _globalMatchLen);
+
+    // the candidates are not symmetric, match each pair only once
+    MatchData_t matchesData;
+    std::vector<HuginBase::UIntSet> checkedPairs(nImg);
+    for (unsigned int i1 = 0; i1 < nImg; ++i1)
+    {
+        for (size_t j = 0; j < candidates[i1].size(); ++j)
+        {
+            const unsigned int i2 = candidates[i1][j];
+            if (!needsMatching(checkedPairs, i1, i2))
+            {
+                continue;
+            };
+            matchesData.push_back(MatchData());
+            MatchData& aM = matchesData.back();
+            aM._i1 = &(_filesData[std::min(i1, i2)]);
+            aM._i2 = &(_filesData[std::max(i1, i2)]);
+
+            checkedPairs[i1].insert(i2);
+            checkedPairs[i2].insert(i1);
+        };
+    };
+    if (_verbose > 0)
+    {
+        std::cout << "Selected " << matchesData.size() << " of " << nImg * (nImg - 1) / 2 << " image pairs for matching" << std::endl;
+    };
+    return matchPairs(matchesData);
+};
+
+bool PanoDetector::matchPairs(MatchData_t& matchesData)
+{
+    RunnableVector queue;
     // 4. find matches
     TRACE_INFO(std::endl<< "--- Find pair-wise matches ---" << std::endl);
     for (size_t i = 0; i < matchesData.size(); ++i)
     {
         queue.push_back(new MatchDataRunnable(matchesData[i], *this));
     };
-    RunQueue(queue);
+    if (!RunQueue(queue, _progress))
+    {
+        _cancelled = true;
+        return false;
+    };
+    addControlPoints(matchesData);
+    return true;
+};
 
+void PanoDetector::addControlPoints(const MatchData_t& matchesData)
+{
     // Add detected matches to _panoramaInfo
     for (size_t i = 0; i < matchesData.size(); ++i)
     {
@@ -733,7 +1219,6 @@ bool PanoDetector::match(std::vector<HuginBase::UIntSet> &checkedPairs)
                 aM._i2->_number, aPM->_img2_x, aPM->_img2_y));
         };
     };
-    return true;
 };
 
 bool PanoDetector::loadProject()
@@ -766,7 +1251,11 @@ bool PanoDetector::loadProject()
         std::cerr << "ERROR: couldn't parse panos tool script: '" << _inputFile << "'!" << std::endl;
         return false;
     }
+    return initImages();
+}
 
+bool PanoDetector::initImages()
+{
     // Create a copy of panoramaInfo that will be used to define
     // image options
     _panoramaInfoCopy=_panoramaInfo->duplicate();
@@ -864,10 +1353,50 @@ bool PanoDetector::loadProject()
             imgWithKeyfile++;
         };
     }
+    // images without control points are the new images for the incremental matching
+    _newImages.clear();
+    HuginBase::UIntSet imagesWithCPs;
+    const HuginBase::CPVector& cps = _panoramaInfo->getCtrlPoints();
+    for (HuginBase::CPVector::const_iterator it = cps.begin(); it != cps.end(); ++it)
+    {
+        imagesWithCPs.insert(it->image1Nr);
+        imagesWithCPs.insert(it->image2Nr);
+    };
+    for (unsigned int imgNr = 0; imgNr < nImg; ++imgNr)
+    {
+        if (!set_contains(imagesWithCPs, imgNr))
+        {
+            _newImages.insert(imgNr);
+        };
+    };
+    if (_incremental && _verbose > 0)
+    {
+        std::cout << "Project contains " << _newImages.size() << " new images without control points." << std::endl;
+    };
+
     //update masks, convert positive masks into negative masks
     //because positive masks works only if the images are on the final positions
     _panoramaInfoCopy.updateMasks(true);
 
+    // use the keypoints from the in-memory cache, if the image and the settings are unchanged
+    if (_keypointCache != NULL && _keyPointsIdx.empty() && !_writeAllKeyPoints)
+    {
+        for (ImgDataIt_t aB = _filesData.begin(); aB != _filesData.end(); ++aB)
+        {
+            ImgData& aImgData = aB->second;
+            aImgData._cacheKey = getCacheKey(aImgData._name);
+            if (aImgData._cacheKey.empty())
+            {
+                continue;
+            };
+            aImgData._cacheEntry = _keypointCache->get(aImgData._cacheKey, _panoramaInfoCopy.getSrcImage(aImgData._number));
+            if (aImgData._cacheEntry && !aImgData._hasakeyfile)
+            {
+                imgWithKeyfile++;
+            };
+        };
+    };
+
     //if all images has keyfile, we don't need to load celeste model file
     if(nImg==imgWithKeyfile)
     {
@@ -876,6 +1405,32 @@ bool PanoDetector::loadProject()
     return true;
 }
 
+std::string PanoDetector::getCacheKey(const std::string& filename) const
+{
+    const std::string fileStamp = KeypointCache::GetFileStamp(filename);
+    if (fileStamp.empty())
+    {
+        return std::string();
+    };
+    std::ostringstream key;
+    key << filename << "|" << fileStamp << "|" << _sieve1Width << "x" << _sieve1Height << "x" << _sieve1Size
+        << "|" << _downscale << "|" << _tileSize << "|" << _descriptorType;
+    if (_celeste)
+    {
+        key << "|" << _celesteThreshold << "|" << _celesteRadius;
+    };
+    return key.str();
+}
+
+bool PanoDetector::needsMatching(const std::vector<HuginBase::UIntSet>& checkedPairs, size_t img1, size_t img2) const
+{
+    if (set_contains(checkedPairs[img1], img2))
+    {
+        return false;
+    };
+    return !_incremental || set_contains(_newImages, img1) || set_contains(_newImages, img2);
+}
+
 bool PanoDetector::checkLoadSuccess()
 {
     if(!_keyPointsIdx.empty())
@@ -948,6 +1503,10 @@ bool PanoDetector::matchMultiRow()
         {
             const size_t img1 = _image_stacks[i][j];
             const size_t img2 = _image_stacks[i][j + 1];
+            if (!needsMatching(checkedImagePairs, img1, img2))
+            {
+                continue;
+            };
             matchesData.push_back(MatchData());
             MatchData& aM=matchesData.back();
             if (img1 < img2)
@@ -972,7 +1531,7 @@ bool PanoDetector::matchMultiRow()
             const size_t img1 = *it;
             HuginBase::UIntSet::const_iterator it2 = it;
             ++it2;
-            if (it2 != _image_layer.end())
+            if (it2 != _image_layer.end() && needsMatching(checkedImagePairs, img1, *it2))
             {
                 const size_t img2 = *it2;
                 matchesData.push_back(MatchData());
@@ -997,7 +1556,11 @@ bool PanoDetector::matchMultiRow()
     {
         queue.push_back(new MatchDataRunnable(matchesData[i], *this));
     };
-    RunQueue(queue);
+    if (!RunQueue(queue, _progress))
+    {
+        _cancelled = true;
+        return false;
+    };
 
     // Add detected matches to _panoramaInfo
     for (size_t i = 0; i < matchesData.size(); ++i)
@@ -1040,7 +1603,7 @@ bool PanoDetector::matchMultiRow()
                 size_t img1=ImagesGroups[i];
                 size_t img2=ImagesGroups[j];
                 //skip already checked image pairs
-                if(set_contains(checkedImagePairs[img1],img2))
+                if(!needsMatching(checkedImagePairs, img1, img2))
                 {
                     continue;
                 };
@@ -1065,7 +1628,11 @@ bool PanoDetector::matchMultiRow()
         {
             queue.push_back(new MatchDataRunnable(matchesData[i], *this));
         };
-        RunQueue(queue);
+        if (!RunQueue(queue, _progress))
+    {
+        _cancelled = true;
+        return false;
+    };
 
         for (size_t i = 0; i < matchesData.size(); ++i)
         {
@@ -1176,29 +1743,62 @@ bool PanoDetector::matchMultiRow()
     return true;
 };
 
+/** returns the indices of all keypoints of image 1, which are inside image 2 */
+static std::vector<unsigned int> GetKeypointsInOverlap(const lfeat::KeyPointVect_t& keypoints,
+    const HuginBase::SrcPanoImage& img1, const HuginBase::SrcPanoImage& img2)
+{
+    // transform via a full spherical panorama, so all directions are valid
+    HuginBase::PanoramaOptions opts;
+    opts.setProjection(HuginBase::PanoramaOptions::EQUIRECTANGULAR);
+    opts.setHFOV(360, false);
+    opts.setWidth(3600, false);
+    opts.setHeight(1800);
+    HuginBase::PTools::Transform imgToPano;
+    imgToPano.createInvTransform(img1, opts);
+    HuginBase::PTools::Transform panoToImg;
+    panoToImg.createTransform(img2, opts);
+    const double width = img2.getSize().width();
+    const double height = img2.getSize().height();
+    std::vector<unsigned int> indices;
+    for (size_t i = 0; i < keypoints.size(); ++i)
+    {
+        double panoX, panoY, x, y;
+        if (imgToPano.transformImgCoord(panoX, panoY, keypoints[i]->_x, keypoints[i]->_y) &&
+            panoToImg.transformImgCoord(x, y, panoX, panoY) &&
+            x >= 0 && y >= 0 && x < width && y < height)
+        {
+            indices.push_back(i);
+        };
+    };
+    return indices;
+}
+
 bool PanoDetector::matchPrealigned(HuginBase::Panorama* pano, std::vector<HuginBase::UIntSet> &connectedImages, std::vector<size_t> imgMap, bool exactOverlap)
 {
     RunnableVector queue;
     MatchData_t matchesData;
     HuginBase::Panorama tempPano = pano->duplicate();
-    if(!exactOverlap)
+    // increase hfov by the slack on each side and if requested additional by 25 %
+    // to handle narrow overlaps (or even no overlap) better
+    const double hfovFactor = exactOverlap ? 1.0 : 1.25;
+    if (!exactOverlap || _overlapSlack > 0)
     {
-        // increase hfov by 25 % to handle narrow overlaps (or even no overlap) better
         HuginBase::VariableMapVector varMapVec = tempPano.getVariables();
         for(size_t i=0; i<tempPano.getNrOfImages(); i++)
         {
             HuginBase::Variable& hfovVar = map_get(varMapVec[i], "v");
-            hfovVar.setValue(std::min(360.0, 1.25 * hfovVar.getValue()));
+            hfovVar.setValue(std::min(360.0, hfovFactor * hfovVar.getValue() + 2.0 * _overlapSlack));
         };
         tempPano.updateVariables(varMapVec);
     };
     HuginBase::CalculateImageOverlap overlap(&tempPano);
     overlap.calculate(10);
+    std::vector<std::pair<size_t, size_t> > pairs;
     for(size_t i=0; i<tempPano.getNrOfImages()-1; i++)
     {
         for(size_t j=i+1; j<tempPano.getNrOfImages(); j++)
         {
-            if(set_contains(connectedImages[imgMap[i]],imgMap[j]))
+            if(!needsMatching(connectedImages, imgMap[i], imgMap[j]))
             {
                 continue;
             };
@@ -1208,18 +1808,32 @@ bool PanoDetector::matchPrealigned(HuginBase::Panorama* pano, std::vector<HuginB
                 MatchData& aM = matchesData.back();
                 aM._i1 = &(_filesData[imgMap[i]]);
                 aM._i2 = &(_filesData[imgMap[j]]);
+                pairs.push_back(std::make_pair(i, j));
                 connectedImages[imgMap[i]].insert(imgMap[j]);
                 connectedImages[imgMap[j]].insert(imgMap[i]);
             };
         };
     };
 
+    // match only the keypoints of image 1, which are in the enlarged image 2
+#pragma omp parallel for schedule(dynamic)
+    for (int i = 0; i < static_cast<int>(matchesData.size()); ++i)
+    {
+        MatchData& aM = matchesData[i];
+        aM._restrictQuery = true;
+        aM._queryKeypoints = GetKeypointsInOverlap(aM._i1->_kp, pano->getImage(pairs[i].first), tempPano.getImage(pairs[i].second));
+    };
+
     TRACE_INFO(std::endl<< "--- Find matches for overlapping images ---" << std::endl);
     for (size_t i = 0; i < matchesData.size(); ++i)
     {
         queue.push_back(new MatchDataRunnable(matchesData[i], *this));
     };
-    RunQueue(queue);
+    if (!RunQueue(queue, _progress))
+    {
+        _cancelled = true;
+        return false;
+    };
 
     // Add detected matches to _panoramaInfo
     for (size_t i = 0; i < matchesData.size(); ++i)
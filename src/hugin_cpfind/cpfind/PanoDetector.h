@@ -23,6 +23,7 @@
 #define __detectpano_panodetector_h
 
 #include <hugin_config.h>
+#include <hugin_shared.h>
 
 #include "PanoDetectorDefs.h"
 #include <memory>
@@ -31,9 +32,12 @@
 #include <localfeatures/Image.h>
 #include <localfeatures/PointMatch.h>
 #include "TestCode.h"
+#include "KeypointCache.h"
 
 #include <localfeatures/KeyPoint.h>
 #include <localfeatures/KeyPointDetector.h>
+#include <localfeatures/DescriptorSet.h>
+#include <localfeatures/BinaryKeyfile.h>
 
 #include <flann/flann.hpp>
 
@@ -42,8 +46,12 @@
 #include <panodata/Panorama.h>
 #include <algorithms/optimizer/PTOptimizer.h>
 #include <celeste/Celeste.h>
+#include <appbase/ProgressDisplay.h>
 
-class PanoDetector
+// provides the gray scale image tile by tile, defined in PanoDetectorLogic.cpp
+class GrayTileSource;
+
+class CPFINDIMPEX PanoDetector
 {
 public:
     typedef std::vector<std::string>						FileNameList_t;
@@ -59,7 +67,15 @@ public:
         ALLPAIRS=0,
         LINEAR,
         MULTIROW,
-        PREALIGNED
+        PREALIGNED,
+        GLOBAL
+    };
+
+    /** format of the written keyfiles */
+    enum KeyfileFormat
+    {
+        KEYFILE_TEXT=0,
+        KEYFILE_BINARY
     };
 
     PanoDetector();
@@ -70,9 +86,25 @@ public:
     void printFilenames();
     void printHelp();
     void run();
+    /** runs the detection for the given images of a panorama in memory, no project file is read
+        or written. The existing control points of the panorama are ignored.
+        This function can be called several times with the same object.
+        @param pano panorama with the images
+        @param imgs images, which should be matched
+        @param cps found control points, the image numbers refer to pano
+        @return true, if the detection was successful, false on errors or if it was cancelled
+    */
+    bool findControlPoints(const HuginBase::Panorama& pano, const HuginBase::UIntSet& imgs, HuginBase::CPVector& cps);
     bool match(std::vector<HuginBase::UIntSet> &checkedPairs);
     bool matchMultiRow();
-    /** does only matches image pairs which overlaps and don't have control points
+    /** matches each image only with the most similar images, which are found by an
+        image retrieval step over the descriptors of all images
+        @return true, if detection was successful
+    */
+    bool matchGlobal();
+    /** does only matches image pairs which overlaps and don't have control points,
+        the field of view of the images is enlarged by the overlap slack on each side.
+        Only the keypoints inside the predicted overlap are matched.
         @param aExecutor executor for threading
         @param pano pano, which should be used for determing of overlap, can contain also less images than _panoramaInfo
         @param connectedImages contains a list of already connected or tested image pairs, which should be skipped
@@ -158,6 +190,14 @@ public:
     {
         return _kdTreeSecondDistance;
     }
+    inline void setDescriptorType(lfeat::DescriptorSet::Type iType)
+    {
+        _descriptorType = iType;
+    }
+    inline lfeat::DescriptorSet::Type getDescriptorType() const
+    {
+        return _descriptorType;
+    }
 
     inline void setMinimumMatches(int iMatches)
     {
@@ -225,6 +265,22 @@ public:
     {
         return _linearMatchLen;
     }
+    inline void setOverlapSlack(double iSlack)
+    {
+        _overlapSlack = iSlack;
+    }
+    inline double getOverlapSlack() const
+    {
+        return _overlapSlack;
+    }
+    inline void setGlobalMatchLen(int iLen)
+    {
+        _globalMatchLen = iLen;
+    }
+    inline int  getGlobalMatchLen() const
+    {
+        return _globalMatchLen;
+    }
     inline void setMatchingStrategy(MatchingStrategy iMatchStrategy)
     {
         _matchingStrategy = iMatchStrategy;
@@ -265,6 +321,16 @@ public:
     {
         _cache = iCached;
     }
+    inline KeyfileFormat getKeyfileFormat() const
+    {
+        return _keyfileFormat;
+    }
+    inline void setKeyfileFormat(KeyfileFormat iFormat)
+    {
+        _keyfileFormat = iFormat;
+    }
+    /** returns the detector settings, which are stored in binary keyfiles */
+    lfeat::DetectorSettings getDetectorSettings() const;
     inline bool getCleanup() const
     {
         return _cleanup;
@@ -297,6 +363,22 @@ public:
     {
         _celesteRadius = iCelesteRadius;
     };
+    inline int getTileSize() const
+    {
+        return _tileSize;
+    };
+    inline void setTileSize(int iTileSize)
+    {
+        _tileSize = iTileSize;
+    };
+    inline bool getIncremental() const
+    {
+        return _incremental;
+    };
+    inline void setIncremental(bool iIncremental)
+    {
+        _incremental = iIncremental;
+    };
     inline void setTest(bool iTest)
     {
         _test = iTest;
@@ -309,6 +391,31 @@ public:
     {
         _cores = iCores;
     }
+    /** set progress display, it is only accessed from the thread, which runs the detection.
+        If the user cancels the progress display, the detection is stopped */
+    inline void setProgressDisplay(AppBase::ProgressDisplay* iProgress)
+    {
+        _progress = iProgress;
+    }
+    inline AppBase::ProgressDisplay* getProgressDisplay() const
+    {
+        return _progress;
+    }
+    /** set the in-memory cache for the keypoints, the cache is not owned by the detector
+        and can be shared by several detectors. NULL disables the cache */
+    inline void setKeypointCache(KeypointCache* iCache)
+    {
+        _keypointCache = iCache;
+    }
+    inline KeypointCache* getKeypointCache() const
+    {
+        return _keypointCache;
+    }
+    /** returns true, if the last detection was cancelled by the user */
+    inline bool wasCancelled() const
+    {
+        return _cancelled;
+    }
 
     // predeclaration
     struct ImgData;
@@ -332,6 +439,7 @@ private:
 
     int						_kdTreeSearchSteps;
     double					_kdTreeSecondDistance;
+    lfeat::DescriptorSet::Type	_descriptorType;
 
     int						_minimumMatches;
     HuginBase::RANSACOptimizer::Mode	_ransacMode;
@@ -344,15 +452,20 @@ private:
 
     MatchingStrategy _matchingStrategy;
     int						_linearMatchLen;
+    int						_globalMatchLen;
+    double					_overlapSlack;
 
     bool						_test;
     int						_cores;
     bool                 _downscale;
     bool        _cache;
+    KeyfileFormat _keyfileFormat;
     bool        _cleanup;
     bool        _celeste;
     double      _celesteThreshold;
     int         _celesteRadius;
+    int         _tileSize;
+    bool        _incremental;
     std::string _keypath;
     std::string _prefix;
 
@@ -367,20 +480,39 @@ private:
     HuginBase::Panorama*			_panoramaInfo;
     HuginBase::Panorama				_panoramaInfoCopy;
 
+    AppBase::ProgressDisplay* _progress;
+    KeypointCache* _keypointCache;
+    bool _cancelled;
+
     /** search for image layer and image stacks for the multirow matching step */
     void buildMultiRowImageSets();
 
+    /** images without control points, in incremental mode only pairs with at least one of these images are matched */
+    HuginBase::UIntSet _newImages;
+    /** returns true, if the image pair should be matched: it was not already checked and in
+        incremental mode at least one of the images is new */
+    bool needsMatching(const std::vector<HuginBase::UIntSet>& checkedPairs, size_t img1, size_t img2) const;
+
     /** image set contains only the images with the median exposure of each stack */
     HuginBase::UIntSet _image_layer;
     /** vector with image numbers of all stacks, contains only the unlinked stacks */
     std::vector<HuginBase::UIntVector> _image_stacks;
 
     bool					loadProject();
+    /** initialise the image data for all images in _panoramaInfo */
+    bool initImages();
+    /** analyse the images and match them, the control points are added to _panoramaInfo
+        @return false on errors or if cancelled */
+    bool detect();
+    /** returns the key of the image in the keypoint cache, it depends on the file
+        and on all settings which influence the keypoints */
+    std::string getCacheKey(const std::string& filename) const;
+    /** set a new message in the progress display */
+    void setProgressMessage(const std::string& message);
     bool	      		checkLoadSuccess();
     void CleanupKeyfiles();
 
     void					writeOutput();
-    void					writeKeyfile(ImgData& imgInfo);
 
     // internals
 public:
@@ -396,19 +528,25 @@ public:
 
         lfeat::Image		_ii;
         vigra::BImage		_distancemap;
+        // gray scale image and mask, only used when the keypoints are detected in tiles
+        std::shared_ptr<GrayTileSource> _tileSource;
 
         HuginBase::PanoramaOptions 	_projOpts;
 
         bool 					_hasakeyfile;
         std::string _keyfilename;
+        // key and data of the image in the in-memory keypoint cache
+        std::string _cacheKey;
+        KeypointCache::EntryPtr _cacheEntry;
 
         lfeat::KeyPointVect_t	_kp;
         int					_descLength;
         bool          	   _loadFail;
 
-        // kdtree
-        flann::Matrix<double> _flann_descriptors;
-        flann::Index<flann::L2<double> > * _flann_index;
+        // descriptors and kdtree, depending on the descriptor type only one of the indices is used
+        lfeat::DescriptorSet _descriptors;
+        flann::Index<DescriptorL2<float> > * _flann_index_float;
+        flann::Index<DescriptorL2<unsigned char> > * _flann_index_uint8;
 
         ImgData()
         {
@@ -419,19 +557,14 @@ public:
             m_sizeMode = FULLSIZE;
             _hasakeyfile = false;
             _descLength = 0;
-            _flann_index = NULL;
+            _flann_index_float = NULL;
+            _flann_index_uint8 = NULL;
         }
 
         ~ImgData()
         {
-            if (_flann_index != NULL)
-            {
-                delete _flann_index;
-            };
-            if (_flann_descriptors.rows + _flann_descriptors.cols > 0)
-            {
-                delete[]_flann_descriptors.ptr();
-            };
+            delete _flann_index_float;
+            delete _flann_index_uint8;
         }
         void SetSizeMode(const SizeMode newSizeMode) { m_sizeMode = newSizeMode; };
         SizeMode GetSizeMode() const { return m_sizeMode; };
@@ -446,9 +579,14 @@ public:
 
     struct MatchData
     {
+        MatchData() : _i1(NULL), _i2(NULL), _restrictQuery(false) {};
         ImgData*				_i1;
         ImgData*				_i2;
         lfeat::PointMatchVector_t		_matches;
+        /** if _restrictQuery is true, only the keypoints of image 1 with the given indices
+            (e.g. inside the predicted overlap) are matched against image 2 */
+        bool _restrictQuery;
+        std::vector<unsigned int> _queryKeypoints;
     };
 
     typedef std::vector<MatchData>								MatchData_t;
@@ -456,6 +594,11 @@ public:
 
     // actions
     static bool				LoadKeypoints(ImgData& ioImgInfo, const PanoDetector& iPanoDetector);
+    /** use the keypoints and descriptors from the in-memory cache */
+    static bool				LoadCachedKeypoints(ImgData& ioImgInfo, const PanoDetector& iPanoDetector);
+    /** store the keypoints and descriptors in the in-memory cache, the image data uses the
+        descriptors of the cache afterwards */
+    static bool				StoreKeypointsInCache(ImgData& ioImgInfo, const PanoDetector& iPanoDetector);
 
     static bool				AnalyzeImage(ImgData& ioImgInfo, const PanoDetector& iPanoDetector);
     static bool				FindKeyPointsInImage(ImgData& ioImgInfo, const PanoDetector& iPanoDetector);
@@ -464,6 +607,8 @@ public:
     static bool             RemapBackKeypoints(ImgData& ioImgInfo, const PanoDetector& iPanoDetector);
     static bool				BuildKDTreesInImage(ImgData& ioImgInfo, const PanoDetector& iPanoDetector);
     static bool				FreeMemoryInImage(ImgData& ioImgInfo, const PanoDetector& iPanoDetector);
+    /** frees the keypoints, descriptors and kdtree of the image, when all pairs of the image are matched */
+    static bool				FreeMatchingDataInImage(ImgData& ioImgInfo, const PanoDetector& iPanoDetector);
 
     static bool				FindMatchesInPair(MatchData& ioMatchData, const PanoDetector& iPanoDetector);
     static bool				RansacMatchesInPair(MatchData& ioMatchData, const PanoDetector& iPanoDetector);
@@ -471,7 +616,20 @@ public:
     static bool				RansacMatchesInPairHomography(MatchData& ioMatchData, const PanoDetector& iPanoDetector);
     static bool				FilterMatchesInPair(MatchData& ioMatchData, const PanoDetector& iPanoDetector);
 
+    void					writeKeyfile(ImgData& imgInfo) const;
+
 private:
+    /** find the matches of the given image pairs and add them to the panorama */
+    bool matchPairs(MatchData_t& matchesData);
+    /** build the list of image pairs for the linear and the all pairs strategy,
+        pairs already in checkedPairs are skipped */
+    void buildLinearPairs(std::vector<HuginBase::UIntSet>& checkedPairs, MatchData_t& matchesData);
+    /** add the found matches of the pairs as control points to the panorama */
+    void addControlPoints(const MatchData_t& matchesData);
+    /** analyse the images and match the given pairs in one step, the pairs are matched
+        as soon as both images are analysed and the memory of the images is freed as soon
+        as all their pairs are matched */
+    void analyzeAndMatchPairs(MatchData_t& matchesData);
     bool LoadSVMModel();
     ImgData_t				_filesData;
     struct celeste::svm_model* svmModel;
@@ -25,6 +25,7 @@
 #include <iostream>
 
 #include <localfeatures/KeyPoint.h>
+#include <flann/flann.hpp>
 #include "KDTree.h"
 #include "Utils.h"
 
@@ -45,6 +46,43 @@ public:
 
 typedef std::vector<KDElemKeyPoint>	KDElemKeyPointVect_t;
 
+// squared euclidean distance for the compact descriptors, same as flann::L2
+// but written as simple loop so the compiler can vectorize it
+template <class T>
+struct DescriptorL2 : public flann::L2<T>
+{
+    typedef typename flann::L2<T>::ResultType ResultType;
+
+    template <typename Iterator1, typename Iterator2>
+    ResultType operator()(Iterator1 a, Iterator2 b, size_t size, ResultType worst_dist = -1) const
+    {
+        ResultType result = ResultType();
+#pragma omp simd reduction(+:result)
+        for (size_t i = 0; i < size; ++i)
+        {
+            const ResultType diff = static_cast<ResultType>(a[i] - b[i]);
+            result += diff * diff;
+        }
+        return result;
+    }
+};
+
+// for 8 bit descriptors the sum is calculated with integers, this is exact
+// and allows wider vectors
+template <>
+template <typename Iterator1, typename Iterator2>
+inline DescriptorL2<unsigned char>::ResultType DescriptorL2<unsigned char>::operator()(Iterator1 a, Iterator2 b, size_t size, ResultType worst_dist) const
+{
+    int result = 0;
+#pragma omp simd reduction(+:result)
+    for (size_t i = 0; i < size; ++i)
+    {
+        const int diff = static_cast<int>(a[i]) - static_cast<int>(b[i]);
+        result += diff * diff;
+    }
+    return static_cast<ResultType>(result);
+}
+
 
 
 
@@ -24,9 +24,12 @@
 #include "PanoDetector.h"
 #include <iostream>
 #include <fstream>
+#include <algorithm>
+#include <cmath>
 #include <vigra/distancetransform.hxx>
 #include "vigra_ext/impexalpha.hxx"
 #include "vigra_ext/cms.h"
+#include "vigra_ext/tiffUtils.h"
 
 #include <localfeatures/Sieve.h>
 #include <localfeatures/PointMatch.h>
@@ -47,6 +50,8 @@
 #include <nona/ImageRemapper.h>
 
 #include <time.h>
+#include <mutex>
+#include <random>
 
 #define TRACE_IMG(X) {if (iPanoDetector.getVerbose() > 1) { TRACE_INFO("i" << ioImgInfo._number << " : " << X << std::endl);} }
 #define TRACE_PAIR(X) {if (iPanoDetector.getVerbose() > 1){ TRACE_INFO("i" << ioMatchData._i1->_number << " <> " \
@@ -93,12 +98,273 @@ private:
     lfeat::PointMatchVector_t& _m;
 };
 
+/** split an image of the given size into tiles, the tile borders are multiples of iAlignment */
+static std::vector<vigra::Rect2D> GetImageTiles(const vigra::Size2D& iSize, int iTileSize, int iAlignment)
+{
+    const int aTileSize = std::max(1, (iTileSize + iAlignment - 1) / iAlignment) * iAlignment;
+    std::vector<vigra::Rect2D> aTiles;
+    for (int y = 0; y < iSize.y; y += aTileSize)
+    {
+        for (int x = 0; x < iSize.x; x += aTileSize)
+        {
+            aTiles.push_back(vigra::Rect2D(x, y, std::min(x + aTileSize, iSize.x), std::min(y + aTileSize, iSize.y)));
+        };
+    };
+    return aTiles;
+}
+
+/** enlarge the tile by iBorder pixels on each side, the result is clipped to the image */
+static vigra::Rect2D GetPaddedTile(const vigra::Rect2D& iTile, const vigra::Size2D& iSize, int iBorder)
+{
+    vigra::Rect2D aRect(iTile);
+    aRect.addBorder(iBorder);
+    aRect &= vigra::Rect2D(iSize);
+    return aRect;
+}
+
+/** returns true, if the position belongs to the given tile, positions outside of the image
+ *  belong to the tiles at the image border */
+static bool IsInTile(const vigra::Rect2D& iTile, const vigra::Size2D& iSize, double iX, double iY)
+{
+    return (iX >= iTile.left() || iTile.left() == 0) && (iX < iTile.right() || iTile.right() == iSize.x) &&
+        (iY >= iTile.top() || iTile.top() == 0) && (iY < iTile.bottom() || iTile.bottom() == iSize.y);
+}
+
+/** move the keypoints by the given offset */
+static void ShiftKeyPoints(lfeat::KeyPointVect_t& ioKeypoints, double iDx, double iDy)
+{
+    for (size_t i = 0; i < ioKeypoints.size(); ++i)
+    {
+        ioKeypoints[i]->_x += iDx;
+        ioKeypoints[i]->_y += iDy;
+    };
+}
+
+/** sort the keypoints into the tiles of GetImageTiles(iSize, iTileSize, 1), returns the indices
+ *  of the keypoints for each tile, the keypoints are assigned with the same rule as in IsInTile */
+static std::vector<std::vector<size_t> > BucketKeyPoints(const lfeat::KeyPointVect_t& iKeypoints, const vigra::Size2D& iSize, int iTileSize)
+{
+    const int aTileSize = std::max(1, iTileSize);
+    const int aTilesX = (iSize.x + aTileSize - 1) / aTileSize;
+    const int aTilesY = (iSize.y + aTileSize - 1) / aTileSize;
+    std::vector<std::vector<size_t> > aBuckets(aTilesX * aTilesY);
+    for (size_t i = 0; i < iKeypoints.size(); ++i)
+    {
+        const int aX = std::min(std::max(static_cast<int>(std::floor(iKeypoints[i]->_x / aTileSize)), 0), aTilesX - 1);
+        const int aY = std::min(std::max(static_cast<int>(std::floor(iKeypoints[i]->_y / aTileSize)), 0), aTilesY - 1);
+        aBuckets[aY * aTilesX + aX].push_back(i);
+    };
+    return aBuckets;
+}
+
+/** border around a tile for the distance transform of the mask, the distance map is stored
+ *  as BImage and saturates at 255, so with this border the result inside the tile is the same
+ *  as with the distance transform of the whole mask */
+static const int MaskDistanceBorder = 256;
+/** maximal border around a tile for the keypoint descriptors, keypoints with a bigger support
+ *  are described with their own image section */
+static const int MaxDescriptorBorder = 256;
+
+/** provides the gray scale image (range 0..255) and the mask of an image for the detection
+ *  in tiles, only the requested part of the image is converted */
+class GrayTileSource
+{
+public:
+    virtual ~GrayTileSource() {};
+    /** size of the image */
+    virtual vigra::Size2D size() const = 0;
+    /** returns true, if the image has a mask */
+    virtual bool hasMask() const = 0;
+    /** copy the gray values of the given rectangle into oImage, returns false on read errors */
+    virtual bool readGray(const vigra::Rect2D& iRect, vigra::DImage& oImage) = 0;
+    /** copy the mask of the given rectangle into oMask, valid pixels are 255, masked pixels 0 */
+    virtual bool readMask(const vigra::Rect2D& iRect, vigra::BImage& oMask) = 0;
+};
+
+/** tile source for images which needed a full conversion (remapping, downscaling,
+ *  icc profiles, celeste...), keeps the converted gray scale image and the mask in memory */
+class MemoryGrayTileSource : public GrayTileSource
+{
+public:
+    /** takes over the data of ioImage and ioMask (can be NULL) */
+    MemoryGrayTileSource(vigra::DImage& ioImage, vigra::BImage* ioMask)
+    {
+        m_image.swap(ioImage);
+        if (ioMask)
+        {
+            m_mask.swap(*ioMask);
+        };
+    };
+    virtual vigra::Size2D size() const { return m_image.size(); };
+    virtual bool hasMask() const { return m_mask.width() > 0; };
+    virtual bool readGray(const vigra::Rect2D& iRect, vigra::DImage& oImage)
+    {
+        oImage.resize(iRect.size());
+        vigra::copyImage(vigra::srcIterRange(m_image.upperLeft() + iRect.upperLeft(), m_image.upperLeft() + iRect.lowerRight()),
+            vigra::destImage(oImage));
+        return true;
+    };
+    virtual bool readMask(const vigra::Rect2D& iRect, vigra::BImage& oMask)
+    {
+        oMask.resize(iRect.size());
+        vigra::copyImage(vigra::srcIterRange(m_mask.upperLeft() + iRect.upperLeft(), m_mask.upperLeft() + iRect.lowerRight()),
+            vigra::destImage(oMask));
+        return true;
+    };
+private:
+    vigra::DImage m_image;
+    vigra::BImage m_mask;
+};
+
+/** tile source which reads the needed rows of a tiff file on demand, the pixel values are
+ *  converted with the GrayFunctor, the same conversion as in AnalyzeImage must be used */
+template <class PixelType, class GrayFunctor>
+class TiffGrayTileSource : public GrayTileSource
+{
+public:
+    TiffGrayTileSource(const HuginBase::SrcPanoImage& iSrcImage, const GrayFunctor& iFunctor) :
+        m_srcImage(iSrcImage), m_functor(iFunctor), m_maskAndCrop(false)
+    {
+        m_maskAndCrop = iSrcImage.hasActiveMasks() ||
+            (iSrcImage.getCropMode() != HuginBase::SrcPanoImage::NO_CROP && !iSrcImage.getCropRect().isEmpty());
+    };
+    /** open the file, iCacheSize is the maximal size of the strip cache in bytes */
+    bool open(const std::string& iFilename, double iCacheSize)
+    {
+        return m_reader.open(iFilename, 1.0, iCacheSize);
+    };
+    virtual vigra::Size2D size() const { return vigra::Size2D(m_reader.width(), m_reader.height()); };
+    virtual bool hasMask() const { return m_reader.hasAlpha() || m_maskAndCrop; };
+    virtual bool readGray(const vigra::Rect2D& iRect, vigra::DImage& oImage)
+    {
+        if (!m_reader.setRows(iRect.top(), iRect.bottom()))
+        {
+            return false;
+        };
+        PixelType** aLines = m_reader.lines();
+        oImage.resize(iRect.size());
+        for (int y = 0; y < iRect.height(); ++y)
+        {
+            const PixelType* aLine = aLines[iRect.top() + y] + iRect.left();
+            for (int x = 0; x < iRect.width(); ++x)
+            {
+                oImage(x, y) = m_functor(aLine[x]);
+            };
+        };
+        return true;
+    };
+    virtual bool readMask(const vigra::Rect2D& iRect, vigra::BImage& oMask)
+    {
+        if (!m_reader.setRows(iRect.top(), iRect.bottom()))
+        {
+            return false;
+        };
+        vigra::UInt8** aAlphaLines = m_reader.alphaLines();
+        oMask.resize(iRect.size());
+        for (int y = 0; y < iRect.height(); ++y)
+        {
+            const vigra::UInt8* aLine = aAlphaLines[iRect.top() + y] + iRect.left();
+            for (int x = 0; x < iRect.width(); ++x)
+            {
+                bool aValid = !m_reader.hasAlpha() || aLine[x] > 0;
+                if (aValid && m_maskAndCrop)
+                {
+                    aValid = m_srcImage.isInside(vigra::Point2D(iRect.left() + x, iRect.top() + y));
+                };
+                oMask(x, y) = aValid ? 255 : 0;
+            };
+        };
+        return true;
+    };
+private:
+    vigra_ext::TiffRowReader<PixelType, vigra::UInt8> m_reader;
+    HuginBase::SrcPanoImage m_srcImage;
+    GrayFunctor m_functor;
+    bool m_maskAndCrop;
+};
+
+/** creates a TiffGrayTileSource for the image, returns false if the file is not supported by the reader */
+template <class PixelType, class GrayFunctor>
+static bool OpenTiffTileSource(PanoDetector::ImgData& ioImgInfo, const HuginBase::SrcPanoImage& iSrcImage,
+    double iCacheSize, const GrayFunctor& iFunctor)
+{
+    std::shared_ptr<TiffGrayTileSource<PixelType, GrayFunctor> > aSource(new TiffGrayTileSource<PixelType, GrayFunctor>(iSrcImage, iFunctor));
+    if (!aSource->open(ioImgInfo._name, iCacheSize))
+    {
+        return false;
+    };
+    ioImgInfo._tileSource = aSource;
+    return true;
+}
+
+/** read 8 and 16 bit tiff files without icc profile tile by tile, when no remapping,
+ *  downscaling or celeste is needed, the gray values are the same as in AnalyzeImage,
+ *  returns false if the image needs to be loaded completely */
+static bool CreateTiffTileSource(PanoDetector::ImgData& ioImgInfo, const PanoDetector& iPanoDetector,
+    const HuginBase::SrcPanoImage& iSrcImage, const vigra::ImageImportInfo& iImageInfo)
+{
+    if (ioImgInfo.NeedsRemapping() || ioImgInfo.IsDownscale() || !iImageInfo.getICCProfile().empty() ||
+        std::string(iImageInfo.getFileType()) != "TIFF")
+    {
+        return false;
+    };
+    // the strip cache holds the rows of one row of padded tiles
+    KeyPointDetector aKP;
+    const int aCacheRows = iPanoDetector.getTileSize() + 2 * std::max<int>(aKP.getMaxSupport() + aKP.getTileAlignment(), MaskDistanceBorder);
+    if (iImageInfo.isGrayscale())
+    {
+        switch (iImageInfo.pixelType())
+        {
+            case vigra::ImageImportInfo::UINT8:
+                return OpenTiffTileSource<vigra::UInt8>(ioImgInfo, iSrcImage, aCacheRows * iImageInfo.width() * 2.0,
+                    [](vigra::UInt8 v) { return static_cast<double>(v); });
+            case vigra::ImageImportInfo::UINT16:
+                {
+                    const auto aMapping = vigra::linearRangeMapping(0.0, 65535.0, 0.0, 255.0);
+                    return OpenTiffTileSource<vigra::UInt16>(ioImgInfo, iSrcImage, aCacheRows * iImageInfo.width() * 3.0,
+                        [aMapping](vigra::UInt16 v) { return aMapping(static_cast<double>(v)); });
+                };
+            default:
+                return false;
+        };
+    };
+    if (iImageInfo.isColor() && !iPanoDetector.getCeleste())
+    {
+        switch (iImageInfo.pixelType())
+        {
+            case vigra::ImageImportInfo::UINT8:
+                return OpenTiffTileSource<vigra::RGBValue<vigra::UInt8> >(ioImgInfo, iSrcImage, aCacheRows * iImageInfo.width() * 4.0,
+                    [](const vigra::RGBValue<vigra::UInt8>& v) { return static_cast<double>(v.luminance()); });
+            case vigra::ImageImportInfo::UINT16:
+                return OpenTiffTileSource<vigra::RGBValue<vigra::UInt16> >(ioImgInfo, iSrcImage, aCacheRows * iImageInfo.width() * 7.0,
+                    [](const vigra::RGBValue<vigra::UInt16>& v) { return v.luminance() / 255.0; });
+            default:
+                return false;
+        };
+    };
+    return false;
+}
+
 bool PanoDetector::LoadKeypoints(ImgData& ioImgInfo, const PanoDetector& iPanoDetector)
 {
     TRACE_IMG("Loading keypoints...");
 
-    lfeat::ImageInfo info = lfeat::loadKeypoints(ioImgInfo._keyfilename, ioImgInfo._kp);
-    ioImgInfo._loadFail = (info.filename.size() == 0);
+    lfeat::ImageInfo info;
+    if (lfeat::IsBinaryKeyfile(ioImgInfo._keyfilename))
+    {
+        // binary keyfiles are memory mapped, the descriptors are used directly for the kdtree
+        lfeat::DetectorSettings settings;
+        ioImgInfo._loadFail = !lfeat::LoadBinaryKeyfile(ioImgInfo._keyfilename, info, settings, ioImgInfo._kp, ioImgInfo._descriptors);
+        if (!ioImgInfo._loadFail && settings != iPanoDetector.getDetectorSettings())
+        {
+            TRACE_IMG("Keyfile was generated with different detector settings.");
+        };
+    }
+    else
+    {
+        info = lfeat::loadKeypoints(ioImgInfo._keyfilename, ioImgInfo._kp);
+        ioImgInfo._loadFail = (info.filename.size() == 0);
+    };
 
     // update ImgData
     if(ioImgInfo.NeedsRemapping())
@@ -118,6 +384,65 @@ bool PanoDetector::LoadKeypoints(ImgData& ioImgInfo, const PanoDetector& iPanoDe
     return true;
 }
 
+/** use the descriptors of a cache entry without copying them, the entry is kept alive as long
+ *  as the descriptors are used */
+static void UseCachedDescriptors(lfeat::DescriptorSet& oDescriptors, const KeypointCache::EntryPtr& iEntry)
+{
+    const lfeat::DescriptorSet& cached = iEntry->descriptors;
+    if (cached.empty())
+    {
+        oDescriptors.clear();
+        return;
+    };
+    void* data;
+    if (cached.getType() == lfeat::DescriptorSet::UINT8)
+    {
+        data = const_cast<unsigned char*>(cached.getUInt8Data());
+    }
+    else
+    {
+        data = const_cast<float*>(cached.getFloatData());
+    };
+    oDescriptors.assignExternal(cached.getType(), cached.size(), cached.getLength(), data,
+        std::const_pointer_cast<KeypointCache::Entry>(iEntry));
+}
+
+bool PanoDetector::LoadCachedKeypoints(ImgData& ioImgInfo, const PanoDetector& iPanoDetector)
+{
+    TRACE_IMG("Using cached keypoints...");
+    const KeypointCache::EntryPtr& entry = ioImgInfo._cacheEntry;
+    // the keypoints are not modified during matching, so they can be shared with the cache
+    ioImgInfo._kp = entry->keypoints;
+    ioImgInfo._detectWidth = entry->detectWidth;
+    ioImgInfo._detectHeight = entry->detectHeight;
+    ioImgInfo._descLength = entry->descLength;
+    UseCachedDescriptors(ioImgInfo._descriptors, entry);
+    return true;
+}
+
+bool PanoDetector::StoreKeypointsInCache(ImgData& ioImgInfo, const PanoDetector& iPanoDetector)
+{
+    if (iPanoDetector._keypointCache == NULL || ioImgInfo._cacheKey.empty())
+    {
+        return false;
+    };
+    TRACE_IMG("Storing keypoints in cache...");
+    std::shared_ptr<KeypointCache::Entry> entry = std::make_shared<KeypointCache::Entry>();
+    entry->image = iPanoDetector._panoramaInfoCopy.getSrcImage(ioImgInfo._number);
+    entry->keypoints = ioImgInfo._kp;
+    entry->detectWidth = ioImgInfo._detectWidth;
+    entry->detectHeight = ioImgInfo._detectHeight;
+    entry->descLength = ioImgInfo._descLength;
+    if (!ioImgInfo._kp.empty())
+    {
+        // copy the descriptors into one compact block, which is shared by the cache and the image data
+        entry->descriptors.assign(ioImgInfo._kp, ioImgInfo._descLength, iPanoDetector.getDescriptorType(), true);
+    };
+    iPanoDetector._keypointCache->insert(ioImgInfo._cacheKey, entry);
+    UseCachedDescriptors(ioImgInfo._descriptors, entry);
+    return true;
+}
+
 /** apply the mask and the crop of the given SrcImg to given mask image */ 
 template <class SrcImageIterator, class SrcAccessor>
 void applyMaskAndCrop(vigra::triple<SrcImageIterator, SrcImageIterator, SrcAccessor> img, const HuginBase::SrcPanoImage& SrcImg)
@@ -273,6 +598,13 @@ bool PanoDetector::AnalyzeImage(ImgData& ioImgInfo, const PanoDetector& iPanoDet
             ioImgInfo._loadFail = true;
             return false;
         };
+        if (iPanoDetector.getTileSize() > 0 &&
+            CreateTiffTileSource(ioImgInfo, iPanoDetector, iPanoDetector._panoramaInfoCopy.getImage(ioImgInfo._number), aImageInfo))
+        {
+            // the tiles are read from the file when they are needed
+            TRACE_IMG("Reading image tile by tile...");
+            return true;
+        };
         // remark: it would be possible to handle all cases with the same code
         // but this would mean that in some cases there are unnecessary
         // range conversions and image data copying actions needed
@@ -673,6 +1005,22 @@ bool PanoDetector::AnalyzeImage(ImgData& ioImgInfo, const PanoDetector& iPanoDet
         vigra::exportImage(vigra::srcImageRange(*final_img), exinfo);
 #endif
 
+        if(final_mask)
+        {
+            //apply threshold, in case loaded mask contains other values than 0 and 255
+            vigra::transformImage(vigra::srcImageRange(*final_mask), vigra::destImage(*final_mask),
+                                  vigra::Threshold<vigra::BImage::PixelType, vigra::BImage::PixelType>(1, 255, 0, 255));
+        };
+        if (iPanoDetector.getTileSize() > 0)
+        {
+            // keep the gray scale image and the mask, the integral images and the
+            // distance maps are built for each tile
+            ioImgInfo._tileSource.reset(new MemoryGrayTileSource(*final_img, final_mask));
+            delete final_img;
+            delete final_mask;
+            return true;
+        };
+
         // Build integral image
         TRACE_IMG("Build integral image...");
         ioImgInfo._ii.init(*final_img);
@@ -682,9 +1030,6 @@ bool PanoDetector::AnalyzeImage(ImgData& ioImgInfo, const PanoDetector& iPanoDet
         if(final_mask)
         {
             TRACE_IMG("Build distance map...");
-            //apply threshold, in case loaded mask contains other values than 0 and 255
-            vigra::transformImage(vigra::srcImageRange(*final_mask), vigra::destImage(*final_mask),
-                                  vigra::Threshold<vigra::BImage::PixelType, vigra::BImage::PixelType>(1, 255, 0, 255));
             ioImgInfo._distancemap.resize(final_mask->width(), final_mask->height(), 0);
             vigra::distanceTransform(vigra::srcImageRange(*final_mask), vigra::destImage(ioImgInfo._distancemap), 255, 2);
 #ifdef DEBUG_LOADING_REMAPPING
@@ -718,9 +1063,47 @@ bool PanoDetector::FindKeyPointsInImage(ImgData& ioImgInfo, const PanoDetector&
     // setup the detector
     KeyPointDetector aKP;
 
-    // detect the keypoints
-    KeyPointVectInsertor aInsertor(ioImgInfo._kp);
-    aKP.detectKeypoints(ioImgInfo._ii, aInsertor);
+    if (iPanoDetector.getTileSize() > 0)
+    {
+        // detect the keypoints in overlapping tiles, the overlap is big enough that all
+        // keypoints inside a tile are found as in the whole image
+        const vigra::Size2D aSize(ioImgInfo._tileSource->size());
+        const int aAlignment = aKP.getTileAlignment();
+        const int aPadding = (aKP.getMaxSupport() + aAlignment - 1) / aAlignment * aAlignment;
+        const std::vector<vigra::Rect2D> aTiles = GetImageTiles(aSize, iPanoDetector.getTileSize(), aAlignment);
+        lfeat::Image aTileImage;
+        vigra::DImage aTileGray;
+        for (size_t i = 0; i < aTiles.size(); ++i)
+        {
+            const vigra::Rect2D aRect = GetPaddedTile(aTiles[i], aSize, aPadding);
+            if (!ioImgInfo._tileSource->readGray(aRect, aTileGray))
+            {
+                TRACE_INFO("i" << ioImgInfo._number << " : Could not read image data" << std::endl);
+                ioImgInfo._kp.clear();
+                ioImgInfo._loadFail = true;
+                return false;
+            };
+            aTileImage.init(aTileGray);
+            lfeat::KeyPointVect_t aTileKp;
+            KeyPointVectInsertor aInsertor(aTileKp);
+            aKP.detectKeypoints(aTileImage, aInsertor);
+            ShiftKeyPoints(aTileKp, aRect.left(), aRect.top());
+            // keep only the keypoints inside the tile, the others belong to the neighbouring tiles
+            for (size_t j = 0; j < aTileKp.size(); ++j)
+            {
+                if (IsInTile(aTiles[i], aSize, aTileKp[j]->_x, aTileKp[j]->_y))
+                {
+                    ioImgInfo._kp.push_back(aTileKp[j]);
+                };
+            };
+        };
+    }
+    else
+    {
+        // detect the keypoints
+        KeyPointVectInsertor aInsertor(ioImgInfo._kp);
+        aKP.detectKeypoints(ioImgInfo._ii, aInsertor);
+    };
 
     TRACE_IMG("Found "<< ioImgInfo._kp.size() << " interest points.");
 
@@ -739,11 +1122,54 @@ bool PanoDetector::FilterKeyPointsInImage(ImgData& ioImgInfo, const PanoDetector
     double aXF = (double)iPanoDetector.getSieve1Width() / (double)ioImgInfo._detectWidth;
     double aYF = (double)iPanoDetector.getSieve1Height() / (double)ioImgInfo._detectHeight;
 
+    // in tile mode the distance map is computed for each tile with a border, which contains
+    // all masked pixels in range of the saturated distance map
+    std::vector<bool> aTileKeep;
+    if (ioImgInfo._tileSource && ioImgInfo._tileSource->hasMask())
+    {
+        const vigra::Size2D aSize(ioImgInfo._tileSource->size());
+        const std::vector<vigra::Rect2D> aTiles = GetImageTiles(aSize, iPanoDetector.getTileSize(), 1);
+        const std::vector<std::vector<size_t> > aBuckets = BucketKeyPoints(ioImgInfo._kp, aSize, iPanoDetector.getTileSize());
+        aTileKeep.resize(ioImgInfo._kp.size(), false);
+        vigra::BImage aTileMask;
+        vigra::BImage aTileDistance;
+        for (size_t i = 0; i < aTiles.size(); ++i)
+        {
+            if (aBuckets[i].empty())
+            {
+                continue;
+            };
+            const vigra::Rect2D aRect = GetPaddedTile(aTiles[i], aSize, MaskDistanceBorder);
+            if (!ioImgInfo._tileSource->readMask(aRect, aTileMask))
+            {
+                TRACE_INFO("i" << ioImgInfo._number << " : Could not read image data" << std::endl);
+                ioImgInfo._kp.clear();
+                ioImgInfo._loadFail = true;
+                return false;
+            };
+            aTileDistance.resize(aTileMask.width(), aTileMask.height(), 0);
+            vigra::distanceTransform(vigra::srcImageRange(aTileMask), vigra::destImage(aTileDistance), 255, 2);
+            for (size_t j = 0; j < aBuckets[i].size(); ++j)
+            {
+                const lfeat::KeyPointPtr& aK = ioImgInfo._kp[aBuckets[i][j]];
+                aTileKeep[aBuckets[i][j]] = aK->_x > 0 && aK->_x < aSize.x && aK->_y > 0 && aK->_y < aSize.y
+                    && aTileDistance((int)(aK->_x) - aRect.left(), (int)(aK->_y) - aRect.top()) > aK->_scale * 8;
+            };
+        };
+    };
+
     const bool distmap_valid=(ioImgInfo._distancemap.width()>0 && ioImgInfo._distancemap.height()>0);
     for (size_t i = 0; i < ioImgInfo._kp.size(); ++i)
     {
         lfeat::KeyPointPtr& aK = ioImgInfo._kp[i];
-        if(distmap_valid)
+        if (!aTileKeep.empty())
+        {
+            if (aTileKeep[i])
+            {
+                aSieve.insert(aK, (int)(aK->_x * aXF), (int)(aK->_y * aYF));
+            };
+        }
+        else if(distmap_valid)
         {
             if(aK->_x > 0 && aK->_x < ioImgInfo._distancemap.width() && aK->_y > 0 && aK->_y < ioImgInfo._distancemap.height()
                     && ioImgInfo._distancemap((int)(aK->_x),(int)(aK->_y)) >aK->_scale*8)
@@ -771,20 +1197,17 @@ bool PanoDetector::FilterKeyPointsInImage(ImgData& ioImgInfo, const PanoDetector
 
 }
 
-bool PanoDetector::MakeKeyPointDescriptorsInImage(ImgData& ioImgInfo, const PanoDetector& iPanoDetector)
+/** assign the orientations and create the descriptors of the keypoints,
+ *  keypoints with more than one orientation are duplicated and appended */
+static void DescribeKeyPoints(const lfeat::CircularKeyPointDescriptor& iKPD, lfeat::KeyPointVect_t& ioKeypoints)
 {
-    TRACE_IMG("Make keypoint descriptors...");
-
-    // build a keypoint descriptor
-    lfeat::CircularKeyPointDescriptor aKPD(ioImgInfo._ii);
-
     // vector for keypoints with more than one orientation
     lfeat::KeyPointVect_t kp_new_ori;
-    for (size_t j = 0; j < ioImgInfo._kp.size(); ++j)
+    for (size_t j = 0; j < ioKeypoints.size(); ++j)
     {
-        lfeat::KeyPointPtr& aK = ioImgInfo._kp[j];
+        lfeat::KeyPointPtr& aK = ioKeypoints[j];
         double angles[4];
-        int nAngles = aKPD.assignOrientation(*aK, angles);
+        int nAngles = iKPD.assignOrientation(*aK, angles);
         for (int i=0; i < nAngles; i++)
         {
             // duplicate Keypoint with additional angles
@@ -793,12 +1216,88 @@ bool PanoDetector::MakeKeyPointDescriptorsInImage(ImgData& ioImgInfo, const Pano
             kp_new_ori.push_back(aKn);
         }
     }
-    ioImgInfo._kp.insert(ioImgInfo._kp.end(), kp_new_ori.begin(), kp_new_ori.end());
+    ioKeypoints.insert(ioKeypoints.end(), kp_new_ori.begin(), kp_new_ori.end());
 
-    for (size_t i = 0; i < ioImgInfo._kp.size(); ++i)
+    for (size_t i = 0; i < ioKeypoints.size(); ++i)
     {
-        aKPD.makeDescriptor(*(ioImgInfo._kp[i]));
+        iKPD.makeDescriptor(*(ioKeypoints[i]));
     }
+}
+
+bool PanoDetector::MakeKeyPointDescriptorsInImage(ImgData& ioImgInfo, const PanoDetector& iPanoDetector)
+{
+    TRACE_IMG("Make keypoint descriptors...");
+
+    if (iPanoDetector.getTileSize() > 0)
+    {
+        // build the integral image for each tile, the tile is enlarged by the support of the
+        // biggest keypoint inside the tile, but at most by MaxDescriptorBorder, keypoints
+        // with a bigger support get their own image section
+        lfeat::Image aTileImage;
+        lfeat::CircularKeyPointDescriptor aKPD(aTileImage);
+        const vigra::Size2D aSize(ioImgInfo._tileSource->size());
+        const std::vector<vigra::Rect2D> aTiles = GetImageTiles(aSize, iPanoDetector.getTileSize(), 1);
+        const std::vector<std::vector<size_t> > aBuckets = BucketKeyPoints(ioImgInfo._kp, aSize, iPanoDetector.getTileSize());
+        vigra::DImage aTileGray;
+        lfeat::KeyPointVect_t aAllKp;
+        for (size_t i = 0; i < aTiles.size(); ++i)
+        {
+            lfeat::KeyPointVect_t aTileKp;
+            lfeat::KeyPointVect_t aBigKp;
+            int aPadding = 0;
+            for (size_t j = 0; j < aBuckets[i].size(); ++j)
+            {
+                const lfeat::KeyPointPtr& aK = ioImgInfo._kp[aBuckets[i][j]];
+                const int aSupport = aKPD.getSupportSize(*aK);
+                if (aSupport > MaxDescriptorBorder)
+                {
+                    aBigKp.push_back(aK);
+                }
+                else
+                {
+                    aTileKp.push_back(aK);
+                    aPadding = std::max(aPadding, aSupport);
+                };
+            };
+            // the tile itself and a section around each keypoint with a big support
+            std::vector<vigra::Rect2D> aRects;
+            std::vector<lfeat::KeyPointVect_t> aRectKp;
+            if (!aTileKp.empty())
+            {
+                aRects.push_back(GetPaddedTile(aTiles[i], aSize, aPadding));
+                aRectKp.push_back(aTileKp);
+            };
+            for (size_t j = 0; j < aBigKp.size(); ++j)
+            {
+                const vigra::Point2D aPos(hugin_utils::roundi(aBigKp[j]->_x), hugin_utils::roundi(aBigKp[j]->_y));
+                aRects.push_back(GetPaddedTile(vigra::Rect2D(aPos, vigra::Size2D(1, 1)), aSize, aKPD.getSupportSize(*aBigKp[j])));
+                aRectKp.push_back(lfeat::KeyPointVect_t(1, aBigKp[j]));
+            };
+            for (size_t j = 0; j < aRects.size(); ++j)
+            {
+                if (!ioImgInfo._tileSource->readGray(aRects[j], aTileGray))
+                {
+                    TRACE_INFO("i" << ioImgInfo._number << " : Could not read image data" << std::endl);
+                    ioImgInfo._kp.clear();
+                    ioImgInfo._loadFail = true;
+                    return false;
+                };
+                aTileImage.init(aTileGray);
+                ShiftKeyPoints(aRectKp[j], -aRects[j].left(), -aRects[j].top());
+                DescribeKeyPoints(aKPD, aRectKp[j]);
+                ShiftKeyPoints(aRectKp[j], aRects[j].left(), aRects[j].top());
+                aAllKp.insert(aAllKp.end(), aRectKp[j].begin(), aRectKp[j].end());
+            };
+        };
+        aTileImage.clean();
+        ioImgInfo._kp.swap(aAllKp);
+        ioImgInfo._descLength = aKPD.getDescriptorLength();
+        return true;
+    };
+
+    // build a keypoint descriptor
+    lfeat::CircularKeyPointDescriptor aKPD(ioImgInfo._ii);
+    DescribeKeyPoints(aKPD, ioImgInfo._kp);
     // store the descriptor length
     ioImgInfo._descLength = aKPD.getDescriptorLength();
     return true;
@@ -853,19 +1352,40 @@ bool PanoDetector::BuildKDTreesInImage(ImgData& ioImgInfo, const PanoDetector& i
     {
         return false;
     };
-    // build a vector of KDElemKeyPointPtr
-
-    // create feature vector matrix for flann
-    ioImgInfo._flann_descriptors = flann::Matrix<double>(new double[ioImgInfo._kp.size()*ioImgInfo._descLength],
-                                   ioImgInfo._kp.size(), ioImgInfo._descLength);
-    for (size_t i = 0; i < ioImgInfo._kp.size(); ++i)
+    if (ioImgInfo._descriptors.empty())
     {
-        memcpy(ioImgInfo._flann_descriptors[i], ioImgInfo._kp[i]->_vec, sizeof(double)*ioImgInfo._descLength);
+        // copy the descriptors into one compact block, the descriptors of the keypoints
+        // are not needed any more
+        ioImgInfo._descriptors.assign(ioImgInfo._kp, ioImgInfo._descLength, iPanoDetector.getDescriptorType(), true);
     }
+    else
+    {
+        // descriptors from a binary keyfile
+        ioImgInfo._descriptors.convertTo(iPanoDetector.getDescriptorType());
+    };
 
+    // flann uses the global random generator for building the trees, in incremental mode
+    // the trees are built with a fixed seed to get reproducible results
+    static std::mutex flannRandomMutex;
+    std::unique_lock<std::mutex> randomLock(flannRandomMutex, std::defer_lock);
+    if (iPanoDetector.getIncremental())
+    {
+        randomLock.lock();
+        flann::seed_random(std::mt19937::default_seed);
+    };
     // build query structure
-    ioImgInfo._flann_index = new flann::Index<flann::L2<double> > (ioImgInfo._flann_descriptors, flann::KDTreeIndexParams(4));
-    ioImgInfo._flann_index->buildIndex();
+    if (ioImgInfo._descriptors.getType() == lfeat::DescriptorSet::UINT8)
+    {
+        flann::Matrix<unsigned char> descriptors(ioImgInfo._descriptors.getUInt8Data(), ioImgInfo._descriptors.size(), ioImgInfo._descLength);
+        ioImgInfo._flann_index_uint8 = new flann::Index<DescriptorL2<unsigned char> >(descriptors, flann::KDTreeIndexParams(4));
+        ioImgInfo._flann_index_uint8->buildIndex();
+    }
+    else
+    {
+        flann::Matrix<float> descriptors(ioImgInfo._descriptors.getFloatData(), ioImgInfo._descriptors.size(), ioImgInfo._descLength);
+        ioImgInfo._flann_index_float = new flann::Index<DescriptorL2<float> >(descriptors, flann::KDTreeIndexParams(4));
+        ioImgInfo._flann_index_float->buildIndex();
+    };
 
     return true;
 }
@@ -875,29 +1395,85 @@ bool PanoDetector::FreeMemoryInImage(ImgData& ioImgInfo, const PanoDetector& iPa
     TRACE_IMG("Freeing memory...");
 
     ioImgInfo._ii.clean();
+    ioImgInfo._tileSource.reset();
     ioImgInfo._distancemap.resize(0,0);
 
     return true;
 }
 
+bool PanoDetector::FreeMatchingDataInImage(ImgData& ioImgInfo, const PanoDetector& iPanoDetector)
+{
+    TRACE_IMG("Freeing keypoints and kdtree...");
+
+    delete ioImgInfo._flann_index_float;
+    ioImgInfo._flann_index_float = NULL;
+    delete ioImgInfo._flann_index_uint8;
+    ioImgInfo._flann_index_uint8 = NULL;
+    ioImgInfo._descriptors.clear();
+    // the matches keep a reference to their keypoints, so the keypoints can be released here
+    lfeat::KeyPointVect_t().swap(ioImgInfo._kp);
+
+    return true;
+}
+
+
+/** search the nn nearest neighbours of the query descriptors in the given index,
+ *  if rows is not NULL only the descriptors with the given indices are searched */
+template <class ElementType>
+static void SearchDescriptors(flann::Index<DescriptorL2<ElementType> >* index, ElementType* queryData,
+    const std::vector<unsigned int>* rows, size_t nrQuery, int descLength, flann::Matrix<int>& indices,
+    flann::Matrix<float>& dists, int nn, const flann::SearchParams& searchParams)
+{
+    if (rows != NULL)
+    {
+        // copy the selected descriptors into a continuous block
+        std::vector<ElementType> selected(rows->size() * descLength);
+        for (size_t i = 0; i < rows->size(); ++i)
+        {
+            memcpy(&selected[i * descLength], queryData + static_cast<size_t>((*rows)[i]) * descLength, sizeof(ElementType) * descLength);
+        };
+        flann::Matrix<ElementType> query(selected.data(), rows->size(), descLength);
+        index->knnSearch(query, indices, dists, nn, searchParams);
+    }
+    else
+    {
+        flann::Matrix<ElementType> query(queryData, nrQuery, descLength);
+        index->knnSearch(query, indices, dists, nn, searchParams);
+    };
+}
 
 bool PanoDetector::FindMatchesInPair(MatchData& ioMatchData, const PanoDetector& iPanoDetector)
 {
     TRACE_PAIR("Find Matches...");
 
-    // retrieve the KDTree of image 2
-    flann::Index<flann::L2<double> > * index2 = ioMatchData._i2->_flann_index;
-
-    // retrieve query points from image 1
-    flann::Matrix<double> & query = ioMatchData._i1->_flann_descriptors;
+    const lfeat::DescriptorSet& query = ioMatchData._i1->_descriptors;
+    // restrict the query to the keypoints in the predicted overlap, if given
+    const std::vector<unsigned int>* queryRows = ioMatchData._restrictQuery ? &ioMatchData._queryKeypoints : NULL;
+    const size_t nrQuery = ioMatchData._restrictQuery ? ioMatchData._queryKeypoints.size() : query.size();
+    if (nrQuery == 0 || ioMatchData._i2->_descriptors.empty())
+    {
+        return true;
+    };
 
     // storage for sorted 2 best matches
     int nn = 2;
-    flann::Matrix<int> indices(new int[query.rows*nn], query.rows, nn);
-    flann::Matrix<double> dists(new double[query.rows*nn], query.rows, nn);
-
-    // perform matching using flann
-    index2->knnSearch(query, indices, dists, nn, flann::SearchParams(iPanoDetector.getKDTreeSearchSteps()));
+    std::vector<int> indicesData(nrQuery*nn);
+    std::vector<float> distsData(nrQuery*nn);
+    flann::Matrix<int> indices(indicesData.data(), nrQuery, nn);
+    flann::Matrix<float> dists(distsData.data(), nrQuery, nn);
+
+    // perform matching using flann, query image 1 against the KDTree of image 2
+    const flann::SearchParams searchParams(iPanoDetector.getKDTreeSearchSteps());
+    if (query.getType() == lfeat::DescriptorSet::UINT8)
+    {
+        SearchDescriptors(ioMatchData._i2->_flann_index_uint8, ioMatchData._i1->_descriptors.getUInt8Data(),
+            queryRows, nrQuery, ioMatchData._i1->_descLength, indices, dists, nn, searchParams);
+    }
+    else
+    {
+        SearchDescriptors(ioMatchData._i2->_flann_index_float, ioMatchData._i1->_descriptors.getFloatData(),
+            queryRows, nrQuery, ioMatchData._i1->_descLength, indices, dists, nn, searchParams);
+    };
 
     //typedef KDTreeSpace::BestMatch<KDElemKeyPoint>		BM_t;
     //std::set<BM_t, std::greater<BM_t> >	aBestMatches;
@@ -911,11 +1487,13 @@ bool PanoDetector::FindMatchesInPair(MatchData& ioMatchData, const PanoDetector&
     // unfiltered vector of matches
     typedef std::pair<lfeat::KeyPointPtr, int> TmpPair_t;
     std::vector<TmpPair_t>	aUnfilteredMatches;
+    // distance ratio of best and second best match, used for ordering the matches
+    std::vector<std::pair<float, size_t> > aMatchQuality;
 
     //PointMatchVector_t aMatches;
 
     // go through all the keypoints of image 1
-    for (unsigned aKIt = 0; aKIt < query.rows; ++aKIt)
+    for (unsigned aKIt = 0; aKIt < nrQuery; ++aKIt)
     {
         // accept the match if the second match is far enough
         // put a lower value for stronger matching default 0.15
@@ -938,13 +1516,17 @@ bool PanoDetector::FindMatchesInPair(MatchData& ioMatchData, const PanoDetector&
         aAlreadyMatched.insert(indices[aKIt][0]);
 
         // add the match to the unfiltered list
-        aUnfilteredMatches.push_back(TmpPair_t(ioMatchData._i1->_kp[aKIt], indices[aKIt][0]));
+        const unsigned int kpIndex = queryRows != NULL ? (*queryRows)[aKIt] : aKIt;
+        aMatchQuality.push_back(std::make_pair(dists[aKIt][1] > 0 ? dists[aKIt][0] / dists[aKIt][1] : 0.0f, aUnfilteredMatches.size()));
+        aUnfilteredMatches.push_back(TmpPair_t(ioMatchData._i1->_kp[kpIndex], indices[aKIt][0]));
     }
 
-    // now filter and fill the vector of matches
-    for (size_t i = 0; i < aUnfilteredMatches.size(); ++i)
+    // now filter and fill the vector of matches, the most distinctive matches first,
+    // the RANSAC step draws its first samples from the beginning of the vector
+    std::sort(aMatchQuality.begin(), aMatchQuality.end());
+    for (size_t i = 0; i < aMatchQuality.size(); ++i)
     {
-        TmpPair_t& aP = aUnfilteredMatches[i];
+        TmpPair_t& aP = aUnfilteredMatches[aMatchQuality[i].second];
         // if the image2 match number is in the badmatch set, skip it.
         if (aBadMatch.find(aP.second) != aBadMatch.end())
         {
@@ -955,8 +1537,6 @@ bool PanoDetector::FindMatchesInPair(MatchData& ioMatchData, const PanoDetector&
         ioMatchData._matches.push_back(lfeat::PointMatchPtr( new lfeat::PointMatch(aP.first, ioMatchData._i2->_kp[aP.second])));
     }
 
-    delete[] indices.ptr();
-    delete[] dists.ptr();
     TRACE_PAIR("Found " << ioMatchData._matches.size() << " matches.");
     return true;
 }
@@ -1011,9 +1591,8 @@ bool PanoDetector::RansacMatchesInPairCam(MatchData& ioMatchData, const PanoDete
     }
 
     // perform ransac matching.
-    // ARGH the panotools optimizer uses global variables is not reentrant
     std::vector<int> inliers;
-#pragma omp critical
+    auto findInliers = [&]()
     {
         HuginBase::PanoramaData* panoSubset = iPanoDetector._panoramaInfo->getNewSubset(imgs);
 
@@ -1027,10 +1606,6 @@ bool PanoDetector::RansacMatchesInPairCam(MatchData& ioMatchData, const PanoDete
         }
         panoSubset->setCtrlPoints(controlPoints);
 
-
-        PT_setProgressFcn(ptProgress);
-        PT_setInfoDlgFcn(ptinfoDlg);
-
         HuginBase::RANSACOptimizer::Mode rmode = iPanoDetector._ransacMode;
         if (rmode == HuginBase::RANSACOptimizer::AUTO)
         {
@@ -1039,12 +1614,36 @@ bool PanoDetector::RansacMatchesInPairCam(MatchData& ioMatchData, const PanoDete
         // the RANSAC uses the distance in the image for determination of valid parameter
         // so make the threshold depending on the image size, use the given pixel distance relative to a 12 MPix image with 4000x3000 pixel
         const double threshold = iPanoDetector.getRansacDistanceThreshold() / 5000.0 * hypot(panoSubset->getImage(pano_local_i2).getWidth(), panoSubset->getImage(pano_local_i2).getHeight());
-        inliers = HuginBase::RANSACOptimizer::findInliers(*panoSubset, pano_local_i1, pano_local_i2,
-                  threshold, rmode);
-        PT_setProgressFcn(NULL);
-        PT_setInfoDlgFcn(NULL);
+        if (iPanoDetector.getIncremental())
+        {
+            // use a fixed seed for reproducible results
+            inliers = HuginBase::RANSACOptimizer::findInliers(*panoSubset, pano_local_i1, pano_local_i2,
+                      threshold, rmode, std::mt19937::default_seed);
+        }
+        else
+        {
+            inliers = HuginBase::RANSACOptimizer::findInliers(*panoSubset, pano_local_i1, pano_local_i2,
+                      threshold, rmode);
+        };
         delete panoSubset;
+    };
+    // the native optimizer is reentrant, it is used for all supported image pairs
+    // ARGH the panotools optimizer uses global variables is not reentrant
+    if (HuginBase::RANSACOptimizer::usesNativeOptimizer(*iPanoDetector._panoramaInfo, pano_i1, pano_i2))
+    {
+        findInliers();
     }
+    else
+    {
+#pragma omp critical
+        {
+            PT_setProgressFcn(ptProgress);
+            PT_setInfoDlgFcn(ptinfoDlg);
+            findInliers();
+            PT_setProgressFcn(NULL);
+            PT_setInfoDlgFcn(NULL);
+        }
+    };
 
     TRACE_PAIR("Removed " << ioMatchData._matches.size() - inliers.size() << " matches. " << inliers.size() << " remaining.");
     if (inliers.size() < 0.5 * ioMatchData._matches.size())
@@ -1224,26 +1823,56 @@ void PanoDetector::writeOutput()
     }
 }
 
-void PanoDetector::writeKeyfile(ImgData& imgInfo)
+void PanoDetector::writeKeyfile(ImgData& imgInfo) const
 {
     // Write output keyfile
-
-    std::ofstream aOut(imgInfo._keyfilename.c_str(), std::ios_base::trunc);
-
-    lfeat::SIFTFormatWriter writer(aOut);
-
     int origImgWidth =  _panoramaInfo->getImage(imgInfo._number).getSize().width();
     int origImgHeight =  _panoramaInfo->getImage(imgInfo._number).getSize().height();
 
     lfeat::ImageInfo img_info(imgInfo._name, origImgWidth, origImgHeight);
+    img_info.dimensions = imgInfo._descLength;
+
+    if (_keyfileFormat == KEYFILE_BINARY)
+    {
+        bool success;
+        if (imgInfo._descriptors.empty())
+        {
+            // keypoints still have their own descriptors (e.g. only keyfiles are written)
+            lfeat::DescriptorSet descriptors;
+            descriptors.assign(imgInfo._kp, imgInfo._descLength, _descriptorType, false);
+            success = lfeat::WriteBinaryKeyfile(imgInfo._keyfilename, img_info, getDetectorSettings(), imgInfo._kp, descriptors);
+        }
+        else
+        {
+            success = lfeat::WriteBinaryKeyfile(imgInfo._keyfilename, img_info, getDetectorSettings(), imgInfo._kp, imgInfo._descriptors);
+        };
+        if (!success)
+        {
+            std::cerr << "ERROR couldn't write keyfile '" << imgInfo._keyfilename << "'!" << std::endl;
+        };
+        return;
+    };
+
+    std::ofstream aOut(imgInfo._keyfilename.c_str(), std::ios_base::trunc);
+
+    lfeat::SIFTFormatWriter writer(aOut);
 
     writer.writeHeader ( img_info, imgInfo._kp.size(), imgInfo._descLength );
 
+    // the descriptors of the keypoints are freed after building the kdtree,
+    // in this case take them from the compact descriptor storage
+    std::vector<double> descriptor(imgInfo._descLength);
     for(size_t i=0; i<imgInfo._kp.size(); ++i)
     {
         lfeat::KeyPointPtr& aK=imgInfo._kp[i];
+        double* vec = aK->_vec;
+        if (vec == NULL && i < imgInfo._descriptors.size())
+        {
+            imgInfo._descriptors.getDescriptor(i, descriptor.data());
+            vec = descriptor.data();
+        };
         writer.writeKeypoint ( aK->_x, aK->_y, aK->_scale, aK->_ori, aK->_score,
-                               imgInfo._descLength, aK->_vec );
+                               imgInfo._descLength, vec );
     }
     writer.writeFooter();
 }
@@ -0,0 +1,184 @@
+// -*- c-basic-offset: 4 -*-
+
+/** @file cpfind_keyconvert.cpp
+ *
+ *  @brief converts cpfind keyfiles between the text and the binary format
+ *
+ */
+
+/*  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This software is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public
+ *  License along with this software. If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <iostream>
+#include <fstream>
+#include <getopt.h>
+#include <localfeatures/KeyPoint.h>
+#include <localfeatures/KeyPointIO.h>
+#include <localfeatures/BinaryKeyfile.h>
+#include <localfeatures/DescriptorSet.h>
+#include "hugin_utils/utils.h"
+
+static void usage(const char* name)
+{
+    std::cout << name << ": convert cpfind keyfiles between text and binary format" << std::endl
+         << name << " version " << hugin_utils::GetHuginVersion() << std::endl
+         << std::endl
+         << "Usage:  " << name << " [options] input.key output.key" << std::endl
+         << std::endl
+         << "     --format=<string>           Format of output file: binary or text" << std::endl
+         << "                                   (default: the other format than the input)" << std::endl
+         << "     --descriptortype=<string>   Descriptor storage for binary output:" << std::endl
+         << "                                   float or uint8 (default: float)" << std::endl
+         << "     -h, --help                  Shows this help" << std::endl
+         << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+    // parse arguments
+    const char* optstring = "h";
+
+    enum
+    {
+        SWITCH_FORMAT=1000,
+        SWITCH_DESCRIPTORTYPE
+    };
+    static struct option longOptions[] =
+    {
+        {"format", required_argument, NULL, SWITCH_FORMAT },
+        {"descriptortype", required_argument, NULL, SWITCH_DESCRIPTORTYPE },
+        {"help", no_argument, NULL, 'h' },
+        0
+    };
+
+    std::string format;
+    lfeat::DescriptorSet::Type descriptorType = lfeat::DescriptorSet::FLOAT;
+    std::string param;
+    int c;
+    while ((c = getopt_long (argc, argv, optstring, longOptions,nullptr)) != -1)
+    {
+        switch (c)
+        {
+            case 'h':
+                usage(hugin_utils::stripPath(argv[0]).c_str());
+                return 0;
+            case SWITCH_FORMAT:
+                format = hugin_utils::tolower(std::string(optarg));
+                if (format != "binary" && format != "text")
+                {
+                    std::cerr << hugin_utils::stripPath(argv[0]) << ": Invalid parameter in --format." << std::endl;
+                    return 1;
+                };
+                break;
+            case SWITCH_DESCRIPTORTYPE:
+                param = hugin_utils::tolower(std::string(optarg));
+                if (param == "float")
+                {
+                    descriptorType = lfeat::DescriptorSet::FLOAT;
+                }
+                else
+                {
+                    if (param == "uint8")
+                    {
+                        descriptorType = lfeat::DescriptorSet::UINT8;
+                    }
+                    else
+                    {
+                        std::cerr << hugin_utils::stripPath(argv[0]) << ": Invalid parameter in --descriptortype." << std::endl;
+                        return 1;
+                    };
+                };
+                break;
+            case ':':
+            case '?':
+                // missing argument or invalid switch
+                return 1;
+                break;
+            default:
+                // this should not happen
+                abort();
+        }
+    }
+
+    if (argc - optind != 2)
+    {
+        std::cerr << hugin_utils::stripPath(argv[0]) << ": Input and output keyfile expected." << std::endl
+             << "run \"" << hugin_utils::stripPath(argv[0]) << " --help\" for more information." << std::endl;
+        return 1;
+    };
+
+    const std::string input(argv[optind]);
+    const std::string output(argv[optind + 1]);
+    if (!hugin_utils::FileExists(input))
+    {
+        std::cerr << "ERROR: File \"" << input << "\" not found." << std::endl;
+        return 1;
+    };
+    const bool inputIsBinary = lfeat::IsBinaryKeyfile(input);
+    if (format.empty())
+    {
+        format = inputIsBinary ? "text" : "binary";
+    };
+
+    // load keypoints, the descriptors are copied into the keypoints
+    lfeat::KeyPointVect_t keypoints;
+    lfeat::ImageInfo info = lfeat::loadKeypoints(input, keypoints);
+    if (info.filename.empty())
+    {
+        std::cerr << "ERROR: Could not read keyfile \"" << input << "\"." << std::endl;
+        return 1;
+    };
+
+    if (format == "binary")
+    {
+        // keep the detector settings when converting a binary keyfile
+        lfeat::DetectorSettings settings;
+        if (inputIsBinary)
+        {
+            lfeat::ImageInfo dummyInfo;
+            lfeat::KeyPointVect_t dummyKeypoints;
+            lfeat::DescriptorSet dummyDescriptors;
+            lfeat::LoadBinaryKeyfile(input, dummyInfo, settings, dummyKeypoints, dummyDescriptors, false);
+        };
+        lfeat::DescriptorSet descriptors;
+        descriptors.assign(keypoints, info.dimensions, descriptorType, true);
+        if (!lfeat::WriteBinaryKeyfile(output, info, settings, keypoints, descriptors))
+        {
+            std::cerr << "ERROR: Could not write keyfile \"" << output << "\"." << std::endl;
+            return 1;
+        };
+    }
+    else
+    {
+        std::ofstream out(output.c_str(), std::ios_base::trunc);
+        if (!out.good())
+        {
+            std::cerr << "ERROR: Could not write keyfile \"" << output << "\"." << std::endl;
+            return 1;
+        };
+        lfeat::SIFTFormatWriter writer(out);
+        writer.writeHeader(info, keypoints.size(), info.dimensions);
+        for (size_t i = 0; i < keypoints.size(); ++i)
+        {
+            const lfeat::KeyPointPtr& k = keypoints[i];
+            writer.writeKeypoint(k->_x, k->_y, k->_scale, k->_ori, k->_score, info.dimensions, k->_vec);
+        };
+        writer.writeFooter();
+    };
+    std::cout << "Converted " << keypoints.size() << " keypoints from \"" << input << "\" to " << format
+        << " keyfile \"" << output << "\"." << std::endl;
+    return 0;
+}
@@ -0,0 +1,345 @@
+/*
+* This file is part of Panomatic.
+*
+* Panomatic is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* Panomatic is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with Panomatic; if not, write to the Free Software
+* <http://www.gnu.org/licenses/>.
+*/
+
+#include "BinaryKeyfile.h"
+
+#include <fstream>
+#include <vector>
+#include <cstring>
+#include <cstdint>
+#include <limits>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace lfeat
+{
+
+// layout of the binary keyfile, all values are stored in the native byte order
+static const char kMagic[8] = { 'H', 'K', 'E', 'Y', 'B', 'I', 'N', '\0' };
+static const uint32_t kVersion = 1;
+static const uint32_t kByteOrderMark = 0x01020304;
+static const uint64_t kAlignment = 64;
+
+struct BinaryKeyfileHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder;
+    uint32_t headerSize;
+    uint32_t descriptorType;
+    uint32_t dimensions;
+    int32_t width;
+    int32_t height;
+    int32_t sieve1Width;
+    int32_t sieve1Height;
+    int32_t sieve1Size;
+    int32_t downscale;
+    uint32_t filenameLength;
+    uint64_t keypointCount;
+    uint64_t filenameOffset;
+    uint64_t keypointOffset;
+    uint64_t descriptorOffset;
+    uint64_t fileSize;
+    uint64_t checksum;
+};
+
+struct BinaryKeypointRecord
+{
+    double x;
+    double y;
+    double scale;
+    double orientation;
+    double score;
+    int32_t trace;
+    int32_t reserved;
+};
+
+static_assert(sizeof(BinaryKeyfileHeader) == 104, "unexpected padding in keyfile header");
+static_assert(sizeof(BinaryKeypointRecord) == 48, "unexpected padding in keypoint record");
+
+static inline uint64_t AlignOffset(uint64_t offset)
+{
+    return (offset + kAlignment - 1) / kAlignment * kAlignment;
+}
+
+/** FNV-1a like hash over 64 bit words, the size of the data must be a multiple of 8 */
+static uint64_t CalcChecksum(const char* data, size_t size)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i + 8 <= size; i += 8)
+    {
+        uint64_t word;
+        memcpy(&word, data + i, 8);
+        hash ^= word;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+/** checksum of the whole file, the checksum field in the header is treated as zero */
+static uint64_t CalcFileChecksum(const char* data, size_t size)
+{
+    BinaryKeyfileHeader header;
+    memcpy(&header, data, sizeof(header));
+    header.checksum = 0;
+    uint64_t hash = CalcChecksum(reinterpret_cast<const char*>(&header), sizeof(header));
+    hash ^= CalcChecksum(data + sizeof(header), size - sizeof(header));
+    return hash * 1099511628211ULL;
+}
+
+MappedFile::MappedFile() : _data(NULL), _size(0)
+#ifdef _WIN32
+    , _file(INVALID_HANDLE_VALUE), _mapping(NULL)
+#endif
+{
+}
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+bool MappedFile::open(const std::string& filename)
+{
+    close();
+#ifdef _WIN32
+    _file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (_file == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(_file, &fileSize) || fileSize.QuadPart == 0)
+    {
+        close();
+        return false;
+    }
+    _mapping = CreateFileMappingA(_file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+    if (_mapping == NULL)
+    {
+        close();
+        return false;
+    }
+    _data = static_cast<char*>(MapViewOfFile(_mapping, FILE_MAP_COPY, 0, 0, 0));
+    if (_data == NULL)
+    {
+        close();
+        return false;
+    }
+    _size = static_cast<size_t>(fileSize.QuadPart);
+#else
+    const int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) != 0 || fileStat.st_size == 0)
+    {
+        ::close(fd);
+        return false;
+    }
+    // map private, so the index can't modify the file
+    void* data = mmap(NULL, fileStat.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED)
+    {
+        return false;
+    }
+    _data = static_cast<char*>(data);
+    _size = static_cast<size_t>(fileStat.st_size);
+#endif
+    return true;
+}
+
+void MappedFile::close()
+{
+#ifdef _WIN32
+    if (_data != NULL)
+    {
+        UnmapViewOfFile(_data);
+    }
+    if (_mapping != NULL)
+    {
+        CloseHandle(_mapping);
+        _mapping = NULL;
+    }
+    if (_file != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(_file);
+        _file = INVALID_HANDLE_VALUE;
+    }
+#else
+    if (_data != NULL)
+    {
+        munmap(_data, _size);
+    }
+#endif
+    _data = NULL;
+    _size = 0;
+}
+
+bool IsBinaryKeyfile(const std::string& filename)
+{
+    std::ifstream in(filename.c_str(), std::ios_base::binary);
+    char magic[sizeof(kMagic)];
+    if (!in.read(magic, sizeof(magic)))
+    {
+        return false;
+    }
+    return memcmp(magic, kMagic, sizeof(kMagic)) == 0;
+}
+
+bool WriteBinaryKeyfile(const std::string& filename, const ImageInfo& info, const DetectorSettings& settings,
+    const KeyPointVect_t& keypoints, const DescriptorSet& descriptors)
+{
+    if (descriptors.size() != keypoints.size())
+    {
+        return false;
+    }
+    const size_t elementSize = descriptors.getType() == DescriptorSet::UINT8 ? sizeof(unsigned char) : sizeof(float);
+    const uint64_t dims = descriptors.empty() ? info.dimensions : descriptors.getLength();
+
+    BinaryKeyfileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kVersion;
+    header.byteOrder = kByteOrderMark;
+    header.headerSize = sizeof(header);
+    header.descriptorType = descriptors.getType();
+    header.dimensions = static_cast<uint32_t>(dims);
+    header.width = info.width;
+    header.height = info.height;
+    header.sieve1Width = settings.sieve1Width;
+    header.sieve1Height = settings.sieve1Height;
+    header.sieve1Size = settings.sieve1Size;
+    header.downscale = settings.downscale;
+    header.filenameLength = static_cast<uint32_t>(info.filename.size());
+    header.keypointCount = keypoints.size();
+    header.filenameOffset = sizeof(header);
+    header.keypointOffset = AlignOffset(header.filenameOffset + header.filenameLength);
+    header.descriptorOffset = AlignOffset(header.keypointOffset + keypoints.size() * sizeof(BinaryKeypointRecord));
+    header.fileSize = AlignOffset(header.descriptorOffset + keypoints.size() * dims * elementSize);
+
+    // assemble the whole file in memory, so the checksum can be calculated
+    std::vector<char> buffer(header.fileSize, 0);
+    memcpy(&buffer[header.filenameOffset], info.filename.data(), info.filename.size());
+    for (size_t i = 0; i < keypoints.size(); ++i)
+    {
+        BinaryKeypointRecord record;
+        record.x = keypoints[i]->_x;
+        record.y = keypoints[i]->_y;
+        record.scale = keypoints[i]->_scale;
+        record.orientation = keypoints[i]->_ori;
+        record.score = keypoints[i]->_score;
+        record.trace = keypoints[i]->_trace;
+        record.reserved = 0;
+        memcpy(&buffer[header.keypointOffset + i * sizeof(record)], &record, sizeof(record));
+    }
+    if (!descriptors.empty())
+    {
+        const void* data = descriptors.getType() == DescriptorSet::UINT8 ?
+            static_cast<const void*>(descriptors.getUInt8Data()) : static_cast<const void*>(descriptors.getFloatData());
+        memcpy(&buffer[header.descriptorOffset], data, keypoints.size() * dims * elementSize);
+    }
+    memcpy(&buffer[0], &header, sizeof(header));
+    header.checksum = CalcFileChecksum(&buffer[0], buffer.size());
+    memcpy(&buffer[0], &header, sizeof(header));
+
+    std::ofstream out(filename.c_str(), std::ios_base::binary | std::ios_base::trunc);
+    if (!out.write(&buffer[0], buffer.size()))
+    {
+        return false;
+    }
+    out.close();
+    return !out.fail();
+}
+
+bool LoadBinaryKeyfile(const std::string& filename, ImageInfo& info, DetectorSettings& settings,
+    KeyPointVect_t& keypoints, DescriptorSet& descriptors, bool verifyChecksum)
+{
+    std::shared_ptr<MappedFile> file(new MappedFile());
+    if (!file->open(filename) || file->size() < sizeof(BinaryKeyfileHeader))
+    {
+        return false;
+    }
+    BinaryKeyfileHeader header;
+    memcpy(&header, file->data(), sizeof(header));
+    if (memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 || header.version != kVersion ||
+        header.byteOrder != kByteOrderMark || header.headerSize != sizeof(header) ||
+        header.fileSize != file->size() || header.fileSize % 8 != 0 ||
+        header.descriptorType > DescriptorSet::UINT8)
+    {
+        return false;
+    }
+    // check that all arrays are inside the file, the sizes are compared with
+    // divisions, so that corrupt values can not overflow the products
+    const uint64_t elementSize = header.descriptorType == DescriptorSet::UINT8 ? sizeof(unsigned char) : sizeof(float);
+    if (header.filenameOffset < header.headerSize || header.filenameOffset > header.fileSize ||
+        header.filenameLength > header.fileSize - header.filenameOffset ||
+        header.keypointOffset < header.headerSize || header.keypointOffset > header.fileSize ||
+        header.keypointCount > (header.fileSize - header.keypointOffset) / sizeof(BinaryKeypointRecord) ||
+        header.descriptorOffset < header.headerSize || header.descriptorOffset > header.fileSize ||
+        header.descriptorOffset % kAlignment != 0)
+    {
+        return false;
+    }
+    const uint64_t descriptorSpace = header.fileSize - header.descriptorOffset;
+    if (header.dimensions > static_cast<uint32_t>(std::numeric_limits<int>::max()) ||
+        (header.dimensions > 0 && header.keypointCount > descriptorSpace / elementSize / header.dimensions))
+    {
+        return false;
+    }
+    if (verifyChecksum && CalcFileChecksum(file->data(), file->size()) != header.checksum)
+    {
+        return false;
+    }
+
+    info.filename.assign(file->data() + header.filenameOffset, header.filenameLength);
+    info.width = header.width;
+    info.height = header.height;
+    info.dimensions = header.dimensions;
+    settings.sieve1Width = header.sieve1Width;
+    settings.sieve1Height = header.sieve1Height;
+    settings.sieve1Size = header.sieve1Size;
+    settings.downscale = header.downscale;
+
+    keypoints.reserve(keypoints.size() + header.keypointCount);
+    const char* records = file->data() + header.keypointOffset;
+    for (uint64_t i = 0; i < header.keypointCount; ++i)
+    {
+        BinaryKeypointRecord record;
+        memcpy(&record, records + i * sizeof(record), sizeof(record));
+        KeyPointPtr k(new KeyPoint(record.x, record.y, record.scale, record.score, record.trace));
+        k->_ori = record.orientation;
+        keypoints.push_back(k);
+    }
+    descriptors.assignExternal(static_cast<DescriptorSet::Type>(header.descriptorType), header.keypointCount,
+        header.dimensions, file->data() + header.descriptorOffset, file);
+    return true;
+}
+
+}
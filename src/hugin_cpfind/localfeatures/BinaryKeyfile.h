@@ -0,0 +1,123 @@
+/*
+* This file is part of Panomatic.
+*
+* Panomatic is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* Panomatic is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with Panomatic; if not, write to the Free Software
+* <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __lfeat_binarykeyfile_h
+#define __lfeat_binarykeyfile_h
+
+#include <hugin_shared.h>
+#include <string>
+#include <memory>
+#include "KeyPoint.h"
+#include "KeyPointIO.h"
+#include "DescriptorSet.h"
+
+namespace lfeat
+{
+
+/** parameters of the keypoint detection, which are stored in the binary keyfile,
+ *  so that a keyfile generated with different settings can be recognized */
+struct LFIMPEX DetectorSettings
+{
+    DetectorSettings() : sieve1Width(0), sieve1Height(0), sieve1Size(0), downscale(0) {};
+
+    bool operator==(const DetectorSettings& other) const
+    {
+        return sieve1Width == other.sieve1Width && sieve1Height == other.sieve1Height &&
+            sieve1Size == other.sieve1Size && downscale == other.downscale;
+    };
+    bool operator!=(const DetectorSettings& other) const
+    {
+        return !(*this == other);
+    };
+
+    int sieve1Width;
+    int sieve1Height;
+    int sieve1Size;
+    int downscale;
+};
+
+/** read only memory mapping of a whole file, pages are mapped copy-on-write */
+class LFIMPEX MappedFile
+{
+public:
+    MappedFile();
+    ~MappedFile();
+
+    /** map the given file, returns false if the file could not be opened or mapped */
+    bool open(const std::string& filename);
+    /** unmap the file */
+    void close();
+
+    inline char* data() const
+    {
+        return _data;
+    }
+    inline size_t size() const
+    {
+        return _size;
+    }
+
+private:
+    char* _data;
+    size_t _size;
+#ifdef _WIN32
+    void* _file;
+    void* _mapping;
+#endif
+
+    MappedFile(const MappedFile&);
+    MappedFile& operator=(const MappedFile&);
+};
+
+/** returns true, if the given file is a binary keyfile */
+LFIMPEX bool IsBinaryKeyfile(const std::string& filename);
+
+/** write a binary keyfile.
+ *
+ *  The file starts with a fixed size header (magic, version, byte order, image size,
+ *  detector settings, offsets and a checksum of the whole file). It is followed by the
+ *  image filename, an array with one record per keypoint and the descriptors of all
+ *  keypoints in a single row-major block as float or uint8. The arrays are aligned
+ *  to 64 bytes, so the file can be memory mapped and the descriptors can be used directly.
+ *  @param filename name of the keyfile
+ *  @param info image filename, size and descriptor dimensions
+ *  @param settings detector settings
+ *  @param keypoints the keypoints
+ *  @param descriptors the descriptors of the keypoints, in the same order
+ *  @return true on success
+ */
+LFIMPEX bool WriteBinaryKeyfile(const std::string& filename, const ImageInfo& info, const DetectorSettings& settings,
+    const KeyPointVect_t& keypoints, const DescriptorSet& descriptors);
+
+/** load a binary keyfile, the file is memory mapped and the descriptors are used
+ *  directly from the mapping without copying.
+ *  @param filename name of the keyfile
+ *  @param info returns the image filename, size and descriptor dimensions
+ *  @param settings returns the detector settings stored in the file
+ *  @param keypoints the keypoints are appended, the keypoints have no descriptor vectors
+ *  @param descriptors descriptors of all keypoints
+ *  @param verifyChecksum if true, the checksum of the file is verified
+ *  @return true on success, false if the file could not be read, is corrupt or has a
+ *          different version or byte order
+ */
+LFIMPEX bool LoadBinaryKeyfile(const std::string& filename, ImageInfo& info, DetectorSettings& settings,
+    KeyPointVect_t& keypoints, DescriptorSet& descriptors, bool verifyChecksum = true);
+
+}
+
+#endif //__lfeat_binarykeyfile_h
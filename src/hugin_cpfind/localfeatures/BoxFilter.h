@@ -39,6 +39,9 @@ public:
     double getDyyWithX(unsigned int x) const;
     double getDxyWithX(unsigned int x) const;
     double getDetWithX(unsigned int x) const;
+    // calculate the determinant of the hessian for a whole line at y = the value set with setY,
+    // at the positions iStartX + i * iStep for i = 0 ... iCount - 1
+    void getDetLine(unsigned int iStartX, unsigned int iStep, int iCount, float* oDet) const;
 
     bool checkBounds(int x, int y) const;
 
@@ -129,6 +132,76 @@ inline double BoxFilter::getDxyWithX(unsigned int x) const
 
 #undef CALC_INTEGRAL_SURFACE
 
+// same as CALC_INTEGRAL_SURFACE, but with the pointers to the top and bottom lines already calculated
+#define CALC_LINE_SURFACE(TOP, BOTTOM, STARTX, ENDX) \
+    (BOTTOM[ENDX+1] + TOP[STARTX] - BOTTOM[STARTX] - TOP[ENDX+1])
+
+inline void BoxFilter::getDetLine(unsigned int iStartX, unsigned int iStep, int iCount, float* oDet) const
+{
+    // the lines of the integral image needed for Lxx, Lyy and Lxy
+    const double* aXXTop = _ii[_y_minus_lxx_y_bottom];
+    const double* aXXBottom = _ii[_y_plus_lxx_y_bottom + 1];
+    const double* aYYOuterTop = _ii[_y_minus_lxx_x_right];
+    const double* aYYOuterBottom = _ii[_y_plus_lxx_x_right + 1];
+    const double* aYYInnerTop = _ii[_y_minus_lxx_x_mid];
+    const double* aYYInnerBottom = _ii[_y_plus_lxx_x_mid + 1];
+    const double* aXYTop = _ii[_y_minus_lxy_d2];
+    const double* aXYMidTop = _ii[_y];
+    const double* aXYMidBottom = _ii[_y + 1];
+    const double* aXYBottom = _ii[_y_plus_lxy_d2 + 1];
+    const int aR = _lxx_x_right;
+    const int aM = _lxx_x_mid;
+    const int aB = _lxx_y_bottom;
+    const int aD = _lxy_d2;
+    const double aCorrect = _sqCorrectFactor;
+    if (iStep == 1)
+    {
+        // contiguous positions, shift the line pointers to the start position so that the
+        // loop can be vectorized, all positions are inside the image, so the indices can't become negative
+        aXXTop += iStartX;
+        aXXBottom += iStartX;
+        aYYOuterTop += iStartX;
+        aYYOuterBottom += iStartX;
+        aYYInnerTop += iStartX;
+        aYYInnerBottom += iStartX;
+        aXYTop += iStartX;
+        aXYMidTop += iStartX;
+        aXYMidBottom += iStartX;
+        aXYBottom += iStartX;
+#pragma omp simd
+        for (int x = 0; x < iCount; ++x)
+        {
+            const double aDxx = CALC_LINE_SURFACE(aXXTop, aXXBottom, x - aR, x + aR)
+                                - 3.0 * CALC_LINE_SURFACE(aXXTop, aXXBottom, x - aM, x + aM);
+            const double aDyy = CALC_LINE_SURFACE(aYYOuterTop, aYYOuterBottom, x - aB, x + aB)
+                                - 3.0 * CALC_LINE_SURFACE(aYYInnerTop, aYYInnerBottom, x - aB, x + aB);
+            const double aDxy = (CALC_LINE_SURFACE(aXYMidTop, aXYBottom, x, x + aD)
+                                 + CALC_LINE_SURFACE(aXYTop, aXYMidBottom, x - aD, x)
+                                 - CALC_LINE_SURFACE(aXYTop, aXYMidBottom, x, x + aD)
+                                 - CALC_LINE_SURFACE(aXYMidTop, aXYBottom, x - aD, x)) * 0.9 * 2 / 3.0;
+            oDet[x] = static_cast<float>(((aDxx * aDyy) - (aDxy * aDxy)) * aCorrect);
+        }
+        return;
+    }
+    // positions with a step (higher octaves) don't profit from vectorization,
+    // the gathered loads are slower than the scalar code
+    for (int i = 0; i < iCount; ++i)
+    {
+        const int x = iStartX + i * iStep;
+        const double aDxx = CALC_LINE_SURFACE(aXXTop, aXXBottom, x - aR, x + aR)
+                            - 3.0 * CALC_LINE_SURFACE(aXXTop, aXXBottom, x - aM, x + aM);
+        const double aDyy = CALC_LINE_SURFACE(aYYOuterTop, aYYOuterBottom, x - aB, x + aB)
+                            - 3.0 * CALC_LINE_SURFACE(aYYInnerTop, aYYInnerBottom, x - aB, x + aB);
+        const double aDxy = (CALC_LINE_SURFACE(aXYMidTop, aXYBottom, x, x + aD)
+                             + CALC_LINE_SURFACE(aXYTop, aXYMidBottom, x - aD, x)
+                             - CALC_LINE_SURFACE(aXYTop, aXYMidBottom, x, x + aD)
+                             - CALC_LINE_SURFACE(aXYMidTop, aXYBottom, x - aD, x)) * 0.9 * 2 / 3.0;
+        oDet[i] = static_cast<float>(((aDxx * aDyy) - (aDxy * aDxy)) * aCorrect);
+    }
+}
+
+#undef CALC_LINE_SURFACE
+
 inline double BoxFilter::getDetWithX(unsigned int x) const
 {
     double aDxy = getDxyWithX(x) * 0.9 * 2 / 3.0;
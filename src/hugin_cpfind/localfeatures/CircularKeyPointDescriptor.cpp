@@ -26,6 +26,7 @@
 #endif
 #include <math.h>
 #include <vector>
+#include <algorithm>
 #include <map>
 #include <fstream>
 #include <cassert>
@@ -155,6 +156,23 @@ void CircularKeyPointDescriptor::makeDescriptor(lfeat::KeyPoint& ioKeyPoint) con
     Math::Normalize(ioKeyPoint._vec, getDescriptorLength());
 }
 
+int CircularKeyPointDescriptor::getSupportSize(const lfeat::KeyPoint& iKeyPoint) const
+{
+    // orientation: grid of wave filters around the keypoint
+    const int aStep = (int)(iKeyPoint._scale + 0.8);
+    const int aOriWave = (int)(_ori_sample_scale * iKeyPoint._scale + 1.5);
+    int aSupport = _ori_gridsize * aStep + aOriWave;
+    // descriptor: wave filters at the rotated sample positions
+    const int aS = std::max(1, (int)iKeyPoint._scale);
+    for (int i = 0; i < _subRegions; i++)
+    {
+        const double aRadius = sqrt(_samples[i].x * _samples[i].x + _samples[i].y * _samples[i].y) * aS;
+        aSupport = std::max(aSupport, (int)ceil(aRadius) + hugin_utils::roundi(_samples[i].size * aS) + 1);
+    }
+    // keypoint position is rounded, and the filters access one pixel more
+    return aSupport + 3;
+}
+
 int CircularKeyPointDescriptor::assignOrientation(lfeat::KeyPoint& ioKeyPoint, double angles[4]) const
 {
     double* hist = _ori_hist + 1;
@@ -49,6 +49,10 @@ public:
         return _descrLen;
     };
     int assignOrientation(KeyPoint& ioKeyPoint, double angles[4]) const;
+    // returns the number of pixels around the keypoint, which are used for the orientation
+    // and the descriptor, the image must contain this region to get the same result as with
+    // the whole image
+    int getSupportSize(const KeyPoint& iKeyPoint) const;
 
 protected:
     void createDescriptor(KeyPoint& ioKeyPoint) const;
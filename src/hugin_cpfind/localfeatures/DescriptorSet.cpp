@@ -0,0 +1,174 @@
+/*
+* This file is part of Panomatic.
+*
+* Panomatic is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* Panomatic is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with Panomatic; if not, write to the Free Software
+* <http://www.gnu.org/licenses/>.
+*/
+
+#include "DescriptorSet.h"
+#include <math.h>
+
+namespace lfeat
+{
+
+// scale for the 8 bit storage, unit vectors are mapped from [-0.5, 0.5] to [0, 255]
+static const double kUInt8Scale = 255.0;
+static const double kUInt8Offset = 127.5;
+
+void DescriptorSet::assign(KeyPointVect_t& iKeyPoints, int iLength, Type iType, bool iFreeKeyPointVectors)
+{
+    clear();
+    _type = iType;
+    _length = iLength;
+    _count = iKeyPoints.size();
+    if (_type == FLOAT)
+    {
+        _float.resize(_count * _length);
+        float* out = getFloatData();
+        for (size_t i = 0; i < _count; ++i)
+        {
+            const double* vec = iKeyPoints[i]->_vec;
+            for (int j = 0; j < _length; ++j)
+            {
+                *out++ = static_cast<float>(vec[j]);
+            }
+        }
+    }
+    else
+    {
+        _uint8.resize(_count * _length);
+        unsigned char* out = getUInt8Data();
+        for (size_t i = 0; i < _count; ++i)
+        {
+            const double* vec = iKeyPoints[i]->_vec;
+            for (int j = 0; j < _length; ++j)
+            {
+                *out++ = Quantize(vec[j]);
+            }
+        }
+    }
+    if (iFreeKeyPointVectors)
+    {
+        for (size_t i = 0; i < _count; ++i)
+        {
+            iKeyPoints[i]->freeVector();
+        }
+    }
+}
+
+void DescriptorSet::clear()
+{
+    // swap with empty vectors to really release the memory
+    std::vector<float>().swap(_float);
+    std::vector<unsigned char>().swap(_uint8);
+    _count = 0;
+    _length = 0;
+    _external = NULL;
+    _owner.reset();
+}
+
+void DescriptorSet::assignExternal(Type iType, size_t iCount, int iLength, void* iData, const std::shared_ptr<void>& iOwner)
+{
+    clear();
+    _type = iType;
+    _count = iCount;
+    _length = iLength;
+    _external = iData;
+    _owner = iOwner;
+}
+
+void DescriptorSet::convertTo(Type iType)
+{
+    if (iType == _type)
+    {
+        return;
+    }
+    const size_t n = _count * _length;
+    if (iType == FLOAT)
+    {
+        const unsigned char* in = getUInt8Data();
+        std::vector<float> converted(n);
+        for (size_t i = 0; i < n; ++i)
+        {
+            converted[i] = static_cast<float>(Dequantize(in[i]));
+        }
+        _float.swap(converted);
+        std::vector<unsigned char>().swap(_uint8);
+    }
+    else
+    {
+        const float* in = getFloatData();
+        std::vector<unsigned char> converted(n);
+        for (size_t i = 0; i < n; ++i)
+        {
+            converted[i] = Quantize(in[i]);
+        }
+        _uint8.swap(converted);
+        std::vector<float>().swap(_float);
+    }
+    _type = iType;
+    _external = NULL;
+    _owner.reset();
+}
+
+void DescriptorSet::getDescriptor(size_t i, double* oVec) const
+{
+    if (_type == FLOAT)
+    {
+        const float* vec = getFloatData() + i * _length;
+        for (int j = 0; j < _length; ++j)
+        {
+            oVec[j] = vec[j];
+        }
+    }
+    else
+    {
+        const unsigned char* vec = getUInt8Data() + i * _length;
+        for (int j = 0; j < _length; ++j)
+        {
+            oVec[j] = Dequantize(vec[j]);
+        }
+    }
+}
+
+size_t DescriptorSet::getMemoryUsage() const
+{
+    return _float.capacity() * sizeof(float) + _uint8.capacity();
+}
+
+unsigned char DescriptorSet::Quantize(double iValue)
+{
+    const double v = floor(iValue * kUInt8Scale + kUInt8Offset + 0.5);
+    if (v <= 0)
+    {
+        return 0;
+    }
+    if (v >= 255)
+    {
+        return 255;
+    }
+    return static_cast<unsigned char>(v);
+}
+
+double DescriptorSet::Dequantize(unsigned char iValue)
+{
+    return (iValue - kUInt8Offset) / kUInt8Scale;
+}
+
+std::string DescriptorSet::GetTypeName(Type iType)
+{
+    return iType == UINT8 ? "uint8" : "float";
+}
+
+}
@@ -0,0 +1,141 @@
+/*
+* This file is part of Panomatic.
+*
+* Panomatic is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* Panomatic is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with Panomatic; if not, write to the Free Software
+* <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __lfeat_descriptorset_h
+#define __lfeat_descriptorset_h
+
+#include <hugin_shared.h>
+#include <vector>
+#include <string>
+#include <memory>
+#include "KeyPoint.h"
+
+namespace lfeat
+{
+
+/** descriptors of all keypoints of an image in a single contiguous block,
+ *  stored as float or as 8 bit values instead of one double array per keypoint.
+ *
+ *  The descriptors are normalized to unit length, so for the 8 bit storage each
+ *  component is mapped linear from [-0.5, 0.5] to [0, 255], larger values are
+ *  clipped. This scales all squared distances by the same factor, so the ratio
+ *  of the distances of the best and second best match is preserved.
+ */
+class LFIMPEX DescriptorSet
+{
+public:
+    /** storage type of the descriptor components */
+    enum Type
+    {
+        FLOAT = 0,
+        UINT8
+    };
+
+    DescriptorSet() : _type(FLOAT), _count(0), _length(0), _external(NULL) {};
+
+    /** copy the descriptors of all keypoints into the set
+     *  @param iKeyPoints keypoints with descriptors
+     *  @param iLength length of the descriptors
+     *  @param iType storage type
+     *  @param iFreeKeyPointVectors if true, the descriptors in the keypoints are freed
+     */
+    void assign(KeyPointVect_t& iKeyPoints, int iLength, Type iType, bool iFreeKeyPointVectors);
+    /** use descriptors stored in external memory (e.g. a memory mapped keyfile) without copying
+     *  @param iType storage type of the data
+     *  @param iCount number of descriptors
+     *  @param iLength length of each descriptor
+     *  @param iData pointer to the first descriptor, must stay valid as long as iOwner exists
+     *  @param iOwner owner of the memory, is kept alive as long as the set uses the data
+     */
+    void assignExternal(Type iType, size_t iCount, int iLength, void* iData, const std::shared_ptr<void>& iOwner);
+    /** change the storage type, the descriptors are converted into internal memory if needed */
+    void convertTo(Type iType);
+    /** free the memory */
+    void clear();
+
+    inline Type getType() const
+    {
+        return _type;
+    }
+    /** number of descriptors */
+    inline size_t size() const
+    {
+        return _count;
+    }
+    inline bool empty() const
+    {
+        return _count == 0;
+    }
+    /** length of each descriptor */
+    inline int getLength() const
+    {
+        return _length;
+    }
+    /** pointer to the descriptors, only valid for type FLOAT */
+    inline float* getFloatData()
+    {
+        if (_external != NULL)
+        {
+            return _type == FLOAT ? static_cast<float*>(_external) : NULL;
+        }
+        return _float.empty() ? NULL : &_float[0];
+    }
+    inline const float* getFloatData() const
+    {
+        return const_cast<DescriptorSet*>(this)->getFloatData();
+    }
+    /** pointer to the descriptors, only valid for type UINT8 */
+    inline unsigned char* getUInt8Data()
+    {
+        if (_external != NULL)
+        {
+            return _type == UINT8 ? static_cast<unsigned char*>(_external) : NULL;
+        }
+        return _uint8.empty() ? NULL : &_uint8[0];
+    }
+    inline const unsigned char* getUInt8Data() const
+    {
+        return const_cast<DescriptorSet*>(this)->getUInt8Data();
+    }
+    /** copy descriptor i into oVec, 8 bit values are converted back */
+    void getDescriptor(size_t i, double* oVec) const;
+    /** returns the memory allocated for the descriptors in bytes, external memory is not counted */
+    size_t getMemoryUsage() const;
+
+    /** convert a single descriptor component to 8 bit */
+    static unsigned char Quantize(double iValue);
+    /** convert 8 bit value back to descriptor component */
+    static double Dequantize(unsigned char iValue);
+
+    /** returns the name of the given type */
+    static std::string GetTypeName(Type iType);
+
+private:
+    Type _type;
+    size_t _count;
+    int _length;
+    std::vector<float> _float;
+    std::vector<unsigned char> _uint8;
+    // descriptors in external memory
+    void* _external;
+    std::shared_ptr<void> _owner;
+};
+
+}
+
+#endif //__lfeat_descriptorset_h
@@ -136,13 +136,13 @@ std::ostream& operator<< (std::ostream& o, const Homography& H)
     return o;
 }
 
-void Homography::addMatch(size_t iIndex, PointMatch& iMatch)
+void Homography::addMatch(size_t iIndex, double iX1, double iY1, double iX2, double iY2)
 {
     size_t aRow = iIndex * 2;
-    double aI1x = iMatch._img1_x - _v1x;
-    double aI1y = iMatch._img1_y - _v1y;
-    double aI2x = iMatch._img2_x - _v2x;
-    double aI2y = iMatch._img2_y - _v2y;
+    double aI1x = iX1 - _v1x;
+    double aI1y = iY1 - _v1y;
+    double aI2x = iX2 - _v2x;
+    double aI2y = iY2 - _v2y;
 
     _Amat[aRow][0] = 0;
     _Amat[aRow][1] = 0;
@@ -205,11 +205,44 @@ bool Homography::estimate(PointMatchVector_t& iMatches)
     // fill the matrices and vectors with points
     for (size_t aFillRow = 0; aFillRow < iMatches.size(); ++aFillRow)
     {
-        addMatch(aFillRow, *(iMatches[aFillRow]));
+        const PointMatch& aM = *(iMatches[aFillRow]);
+        addMatch(aFillRow, aM._img1_x, aM._img1_y, aM._img2_x, aM._img2_y);
     }
 
+    return solve(iMatches.size());
+}
+
+bool Homography::estimate(const double* iX1, const double* iY1, const double* iX2, const double* iY2,
+                          const size_t* iIndices, size_t iCount)
+{
+    if (iCount < 4)
+    {
+        return false;
+    }
+
+    if (_nMatches != (int)iCount && _nMatches != 0)
+    {
+        freeMemory();
+    }
+
+    if (_nMatches == 0)
+    {
+        allocMemory((int)iCount);
+    }
+
+    for (size_t aFillRow = 0; aFillRow < iCount; ++aFillRow)
+    {
+        const size_t aIndex = iIndices[aFillRow];
+        addMatch(aFillRow, iX1[aIndex], iY1[aIndex], iX2[aIndex], iY2[aIndex]);
+    }
+
+    return solve(iCount);
+}
+
+bool Homography::solve(size_t iNMatches)
+{
     // solve the system
-    if (!Givens(_Amat, _Bvec, _Xvec, _Rvec, _nMatches*2, kNCols, 0))
+    if (!Givens(_Amat, _Bvec, _Xvec, _Rvec, (int)iNMatches*2, kNCols, 0))
     {
         //TRACE_ERROR("Failed to solve the linear system");
         return false;
@@ -38,6 +38,10 @@ public:
     void initMatchesNormalization(PointMatchVector_t& iMatches);
 
     bool estimate(PointMatchVector_t& iMatches);
+    /** estimate the homography from the matches with the given indices, the coordinates
+        of the matches are given as separate arrays for each coordinate */
+    bool estimate(const double* iX1, const double* iY1, const double* iX2, const double* iY2,
+                  const size_t* iIndices, size_t iCount);
 
     friend std::ostream& operator<< (std::ostream& o, const Homography& H);
 
@@ -47,7 +51,8 @@ public:
 private:
     void initialize(void);
 
-    void addMatch(size_t iIndex, PointMatch& iMatch);
+    void addMatch(size_t iIndex, double iX1, double iY1, double iX2, double iY2);
+    bool solve(size_t iNMatches);
 
     static const int kNCols;
 
@@ -33,24 +33,38 @@ Image::Image(vigra::DImage &img)
 
 void Image::init(vigra::DImage &img)
 {
-    // store values
-    _width = img.width();
-    _height = img.height();
+    init(img, 0, 0, img.width(), img.height());
+}
 
-    // allocate the integral image data
-    _ii = AllocateImage(_width + 1, _height + 1);
+void Image::init(vigra::DImage &img, int iLeft, int iTop, unsigned int iWidth, unsigned int iHeight)
+{
+    // store values
+    _width = iWidth;
+    _height = iHeight;
+
+    // allocate the integral image data as one block, each line is padded to a multiple of 64 bytes
+    // so that the lines start at aligned addresses
+    const size_t kAlignDoubles = 64 / sizeof(double);
+    _stride = (_width + 1 + kAlignDoubles - 1) / kAlignDoubles * kAlignDoubles;
+    _buffer.assign(_stride * (_height + 1) + kAlignDoubles, 0.0);
+    const size_t aMisalign = (reinterpret_cast<size_t>(&_buffer[0]) / sizeof(double)) % kAlignDoubles;
+    _data = &_buffer[0] + (aMisalign == 0 ? 0 : kAlignDoubles - aMisalign);
+    _ii.resize(_height + 1);
+    for (unsigned int i = 0; i <= _height; ++i)
+    {
+        _ii[i] = _data + i * _stride;
+    }
 
     // create the integral image
-    buildIntegralImage(img);
+    buildIntegralImage(img, iLeft, iTop);
 }
 
 void Image::clean()
 {
-    if (_ii)
-    {
-        DeallocateImage(_ii, _height + 1);
-    }
-    _ii = 0;
+    std::vector<double>().swap(_buffer);
+    std::vector<double*>().swap(_ii);
+    _data = 0;
+    _stride = 0;
 }
 
 Image::~Image()
@@ -58,57 +72,26 @@ Image::~Image()
     clean();
 }
 
-void Image::buildIntegralImage(vigra::DImage &img)
+void Image::buildIntegralImage(vigra::DImage &img, int iLeft, int iTop)
 {
     // to make easier the later computation, shift the image by 1 pix (x and y)
     // so the image has a size of +1 for width and height compared to orig image.
+    // the first line and the first row are already zero from the allocation
 
-    // fill first line with zero
-    for (unsigned int i = 0; i <= _width; ++i)
-    {
-        _ii[0][i] = 0;
-    }
-
-    // fill first row with zero
-    for (unsigned int i = 0; i <= _height; ++i)
-    {
-        _ii[i][0] = 0;
-    }
-
-    // compute all the others pixels
+    // compute all the others pixels, keep a running sum of the current line,
+    // so each pixel depends only on the line above
     for (unsigned int i = 1; i <= _height; ++i)
+    {
+        const double* aSrc = &img(iLeft, iTop + i - 1);
+        const double* aAbove = _ii[i - 1];
+        double* aLine = _ii[i];
+        double aLineSum = 0;
         for (unsigned int j = 1; j <= _width; ++j)
         {
-            _ii[i][j] = img[i - 1][j - 1] + _ii[i - 1][j] + _ii[i][j - 1] - _ii[i - 1][j - 1];
+            aLineSum += aSrc[j - 1];
+            aLine[j] = aAbove[j] + aLineSum;
         }
-
-}
-
-// allocate and deallocate pixels
-double** Image::AllocateImage(unsigned int iWidth, unsigned int iHeight)
-{
-    // create the lines holder
-    double** aImagePtr = new double*[iHeight];
-
-    // create the lines
-    for (unsigned int i = 0; i < iHeight; ++i)
-    {
-        aImagePtr[i] = new double[iWidth] {};
     }
-
-    return aImagePtr;
-}
-
-void Image::DeallocateImage(double** iImagePtr, unsigned int iHeight)
-{
-    // delete the lines
-    for (unsigned int i = 0; i < iHeight; ++i)
-    {
-        delete[] iImagePtr[i];
-    }
-
-    // delete the lines holder
-    delete[] iImagePtr;
 }
 
-} // namespace lfeat
\ No newline at end of file
+} // namespace lfeat
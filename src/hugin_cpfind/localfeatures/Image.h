@@ -21,6 +21,7 @@
 #ifndef __lfeat_image_h
 #define __lfeat_image_h
 
+#include <vector>
 #include "KeyPoint.h"
 #include "vigra/stdimage.hxx"
 
@@ -33,12 +34,15 @@ class IntegralImage;
 class LFIMPEX Image
 {
 public:
-    Image() : _width(0), _height(0), _ii(0) {};
+    Image() : _width(0), _height(0), _stride(0), _data(0) {};
 
     // Constructor from a pixel array (C style)
     explicit Image(vigra::DImage &img);
     // setup the integral image
     void init(vigra::DImage &img);
+    // setup the integral image of the given rectangle of img, the coordinates
+    // used with this image are relative to the upper left corner of the rectangle
+    void init(vigra::DImage &img, int iLeft, int iTop, unsigned int iWidth, unsigned int iHeight);
 
     // cleanup
     void clean();
@@ -49,7 +53,12 @@ public:
     // Accessors
     inline double** getIntegralImage()
     {
-        return _ii;
+        return _ii.empty() ? 0 : &_ii[0];
+    }
+    // number of elements between two lines of the integral image, the lines are aligned to 64 bytes
+    inline size_t getStride() const
+    {
+        return _stride;
     }
     inline unsigned int getWidth()
     {
@@ -60,21 +69,20 @@ public:
         return _height;
     }
 
-    // allocate and deallocate integral image pixels
-    static double** AllocateImage(unsigned int iWidth, unsigned int iHeight);
-    static void DeallocateImage(double** iImagePtr, unsigned int iHeight);
-
 private:
 
     // prepare the integral image
-    void buildIntegralImage(vigra::DImage &img);
+    void buildIntegralImage(vigra::DImage &img, int iLeft, int iTop);
 
     // image size
     unsigned int _width;
     unsigned int _height;
 
-    // integral image
-    double**_ii; // Data of the integral image Like data[lines][rows]
+    // integral image, all lines are stored in a single contiguous block
+    size_t _stride;
+    std::vector<double> _buffer;
+    double* _data; // aligned start of the data in _buffer
+    std::vector<double*> _ii; // pointers to the lines of the integral image, like data[lines][rows]
 };
 
 }
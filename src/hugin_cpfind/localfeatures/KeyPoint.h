@@ -40,6 +40,7 @@ public:
     ~KeyPoint();
 
     void allocVector(int iSize);
+    void freeVector();
 
     double		_x, _y;
     double		_scale;
@@ -98,6 +99,12 @@ inline void KeyPoint::allocVector(int iSize)
     _vec = new double[iSize];
 }
 
+inline void KeyPoint::freeVector()
+{
+    delete[] _vec;
+    _vec = 0;
+}
+
 
 inline bool operator < (const KeyPoint& iA, const KeyPoint& iB)
 {
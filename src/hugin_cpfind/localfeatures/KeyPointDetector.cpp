@@ -19,6 +19,8 @@
 */
 
 #include <iostream>
+#include <vector>
+#include <algorithm>
 
 #include "KeyPoint.h"
 #include "KeyPointDetector.h"
@@ -42,17 +44,66 @@ KeyPointDetector::KeyPointDetector()
 
 }
 
-void KeyPointDetector::detectKeypoints(Image& iImage, KeyPointInsertor& iInsertor)
+// scratch memory for the hessian responses of all scales of one octave.
+// each thread keeps its own instance, so the memory is reused for all images
+// processed by this thread instead of allocating it again for each image
+class ScaleSpaceArena
 {
-    // allocate lots of memory for the scales
-    double** * aSH = new double**[_maxScales];
-    for (unsigned int s = 0; s < _maxScales; ++s)
+public:
+    // prepare iNrScales layers of the given size and return the line pointers of the layers,
+    // the memory is only enlarged when needed
+    float*** prepare(unsigned int iNrScales, unsigned int iWidth, unsigned int iHeight)
     {
-        aSH[s] = Image::AllocateImage(iImage.getWidth(), iImage.getHeight());
+        // pad the lines to a multiple of 64 bytes
+        const size_t kAlignFloats = 64 / sizeof(float);
+        const size_t aStride = (iWidth + kAlignFloats - 1) / kAlignFloats * kAlignFloats;
+        const size_t aLayerSize = aStride * iHeight;
+        const size_t aNeeded = aLayerSize * iNrScales + kAlignFloats;
+        if (_data.size() < aNeeded)
+        {
+            std::vector<float>().swap(_data);
+            _data.resize(aNeeded);
+        }
+        const size_t aMisalign = (reinterpret_cast<size_t>(&_data[0]) / sizeof(float)) % kAlignFloats;
+        float* aStart = &_data[0] + (aMisalign == 0 ? 0 : kAlignFloats - aMisalign);
+        _lines.resize(static_cast<size_t>(iNrScales) * iHeight);
+        _layers.resize(iNrScales);
+        for (unsigned int s = 0; s < iNrScales; ++s)
+        {
+            _layers[s] = &_lines[0] + s * iHeight;
+            for (unsigned int y = 0; y < iHeight; ++y)
+            {
+                _layers[s][y] = aStart + s * aLayerSize + y * aStride;
+            }
+        }
+        return &_layers[0];
     }
 
+    // free the memory
+    void release()
+    {
+        std::vector<float>().swap(_data);
+        std::vector<float*>().swap(_lines);
+        std::vector<float**>().swap(_layers);
+    }
+
+private:
+    std::vector<float> _data;
+    std::vector<float*> _lines;
+    std::vector<float**> _layers;
+};
+
+static thread_local ScaleSpaceArena gScaleSpaceArena;
+
+void KeyPointDetector::ReleaseScratchMemory()
+{
+    gScaleSpaceArena.release();
+}
+
+void KeyPointDetector::detectKeypoints(Image& iImage, KeyPointInsertor& iInsertor)
+{
     // init the border size
-    unsigned int* aBorderSize = new unsigned int[_maxScales];
+    std::vector<unsigned int> aBorderSize(_maxScales);
 
     unsigned int aMaxima = 0;
 
@@ -67,6 +118,13 @@ void KeyPointDetector::detectKeypoints(Image& iImage, KeyPointInsertor& iInserto
         unsigned int aPixelStep = 1 << o;	// 2^aOctaveIt
         int aOctaveWidth = iImage.getWidth() / aPixelStep;	// integer division
         int aOctaveHeight = iImage.getHeight() / aPixelStep;	// integer division
+        if (aOctaveWidth <= 0 || aOctaveHeight <= 0)
+        {
+            break;
+        }
+
+        // get the memory for the scales of this octave from the scratch arena of this thread
+        float*** aSH = gScaleSpaceArena.prepare(_maxScales, aOctaveWidth, aOctaveHeight);
 
         // fill each scale matrices
         for (unsigned int s = 0; s < _maxScales; ++s)
@@ -77,20 +135,24 @@ void KeyPointDetector::detectKeypoints(Image& iImage, KeyPointInsertor& iInserto
             // calculate the border for this scale
             aBorderSize[s] = getBorderSize(o, s);
 
-            // fill the hessians
-            int aEy = aOctaveHeight - aBorderSize[s];
-            int aEx = aOctaveWidth - aBorderSize[s];
+            // fill the hessians line by line, the border is set to zero
+            const int aBS = aBorderSize[s];
+            int aEy = aOctaveHeight - aBS;
+            int aEx = aOctaveWidth - aBS;
 
-            int aYPS = aBorderSize[s] * aPixelStep;
-            for (int y = aBorderSize[s]; y < aEy; ++y)
+            int aYPS = aBS * aPixelStep;
+            for (int y = 0; y < aOctaveHeight; ++y)
             {
-                aBoxFilter.setY(aYPS);
-                int aXPS = aBorderSize[s] * aPixelStep;
-                for (int x = aBorderSize[s]; x < aEx; ++x)
+                float* aLine = aSH[s][y];
+                if (y < aBS || y >= aEy || aEx <= aBS)
                 {
-                    aSH[s][y][x] = aBoxFilter.getDetWithX(aXPS);
-                    aXPS += aPixelStep;
+                    std::fill(aLine, aLine + aOctaveWidth, 0.0f);
+                    continue;
                 }
+                std::fill(aLine, aLine + aBS, 0.0f);
+                aBoxFilter.setY(aYPS);
+                aBoxFilter.getDetLine(aBS * aPixelStep, aPixelStep, aEx - aBS, aLine + aBS);
+                std::fill(aLine + aEx, aLine + aOctaveWidth, 0.0f);
                 aYPS += aPixelStep;
             }
         }
@@ -236,17 +298,9 @@ void KeyPointDetector::detectKeypoints(Image& iImage, KeyPointInsertor& iInserto
             }
         }
     }
-
-    // deallocate memory of the scale images
-    for (unsigned int s = 0; s < _maxScales; ++s)
-    {
-        Image::DeallocateImage(aSH[s], iImage.getHeight());
-    }
-    delete[]aSH;
-    delete[]aBorderSize;
 }
 
-bool KeyPointDetector::fineTuneExtrema(double** * iSH, unsigned int iX, unsigned int iY, unsigned int iS,
+bool KeyPointDetector::fineTuneExtrema(float** * iSH, unsigned int iX, unsigned int iY, unsigned int iS,
     double& oX, double& oY, double& oS, double& oScore,
     unsigned int iOctaveWidth, unsigned int iOctaveHeight, unsigned int iBorder)
 {
@@ -367,6 +421,25 @@ unsigned int		KeyPointDetector::getBorderSize(unsigned int iOctave, unsigned int
     return getFilterSize(iOctave, iScale) * 3 / aScaleShift + 1;
 }
 
+unsigned int KeyPointDetector::getMaxSupport()
+{
+    unsigned int aSupport = 0;
+    for (unsigned int o = 0; o < _maxOctaves; ++o)
+    {
+        const unsigned int aPixelStep = 1 << o;
+        // the border of the hessian responses, plus some octave pixels for the
+        // non maxima suppression and the shifts during fine tuning of the position
+        for (unsigned int s = 0; s < _maxScales; ++s)
+        {
+            aSupport = std::max(aSupport, (getBorderSize(o, s) + 12) * aPixelStep);
+        }
+        // box filter of the trace at the largest scale of this octave
+        const double aS = ((2 * (_maxScales - 0.5) * aPixelStep) + _initialBoxFilterSize + (aPixelStep - 1) * _maxScales) / 3.0;
+        aSupport = std::max<unsigned int>(aSupport, 3 * hugin_utils::roundi(3 * aS) / 2 + 2);
+    }
+    return aSupport;
+}
+
 bool KeyPointDetector::calcTrace(Image& iImage,
     double iX,
     double iY,
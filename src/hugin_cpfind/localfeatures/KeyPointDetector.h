@@ -56,6 +56,20 @@ public:
     // detect keypoints and put them in the insertor
     void detectKeypoints(Image& iImage, KeyPointInsertor& iInsertor);
 
+    // number of pixels around a keypoint, which are needed to detect it, when the image is processed
+    // in tiles the tiles need to overlap by this size to find the same keypoints as in the whole image
+    unsigned int getMaxSupport();
+    // the tiles have to start at multiples of this value, so that the sampling grid
+    // of all octaves is the same as for the whole image
+    inline unsigned int getTileAlignment() const
+    {
+        return 1 << _maxOctaves;
+    }
+
+    // the hessian responses are stored in a scratch memory, which is kept by each thread
+    // and reused for the next image, this frees the scratch memory of the calling thread
+    static void ReleaseScratchMemory();
+
 private:
 
     // internal values of the keypoint detector
@@ -79,7 +93,7 @@ private:
     // some default values.
     const static double kBaseSigma;
 
-    bool fineTuneExtrema(double** * iSH, unsigned int iX, unsigned int iY, unsigned int iS,
+    bool fineTuneExtrema(float** * iSH, unsigned int iX, unsigned int iY, unsigned int iS,
                          double& oX, double& oY, double& oS, double& oScore,
                          unsigned int iOctaveWidth, unsigned int iOctaveHeight, unsigned int iBorder);
 
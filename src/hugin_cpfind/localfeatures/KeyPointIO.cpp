@@ -24,6 +24,7 @@
 #include <string>
 
 #include "KeyPointIO.h"
+#include "BinaryKeyfile.h"
 
 namespace lfeat
 {
@@ -82,8 +83,35 @@ static ImageInfo loadSIFTKeypoints(const std::string& filename, KeyPointVect_t&
     return info;
 }
 
+// loads a binary keyfile, the descriptors are copied into the keypoints
+static ImageInfo loadBinaryKeypoints(const std::string& filename, KeyPointVect_t& vec)
+{
+    ImageInfo info;
+    DetectorSettings settings;
+    DescriptorSet descriptors;
+    KeyPointVect_t keypoints;
+    if (!LoadBinaryKeyfile(filename, info, settings, keypoints, descriptors))
+    {
+        return ImageInfo();
+    }
+    for (size_t i = 0; i < keypoints.size(); ++i)
+    {
+        if (info.dimensions > 0)
+        {
+            keypoints[i]->allocVector(info.dimensions);
+            descriptors.getDescriptor(i, keypoints[i]->_vec);
+        }
+        vec.push_back(keypoints[i]);
+    }
+    return info;
+}
+
 ImageInfo loadKeypoints(const std::string& filename, KeyPointVect_t& vec)
 {
+    if (IsBinaryKeyfile(filename))
+    {
+        return loadBinaryKeypoints(filename, vec);
+    }
     if (identifySIFTKeypoints(filename))
     {
         return loadSIFTKeypoints(filename, vec);
@@ -21,89 +21,144 @@
 #include "RansacFiltering.h"
 #include "Homography.h"
 
-static int genint(int x)
-{
-    return (int)((double)rand()*x/(double)RAND_MAX);
-}
+#include <algorithm>
+#include <cmath>
 
 namespace lfeat
 {
 
-// distance between estimate and real point in pixels.
+// number of matches used to estimate a homography
+static const size_t kSampleSize = 5;
 
-double Ransac::calcError(Homography* aH, PointMatch& aM)
+/** returns the number of iterations needed to draw with the given confidence at least
+    one sample without outliers, when iInlierRatio of the matches are inliers */
+static int RequiredIterations(double iInlierRatio, double iConfidence, int iMaxIterations)
 {
-    double x1p, y1p;
-    aH->transformPoint(aM._img1_x, aM._img1_y, x1p, y1p);
+    const double aGoodSample = std::pow(iInlierRatio, static_cast<double>(kSampleSize));
+    if (aGoodSample >= 1.0)
+    {
+        return 0;
+    }
+    if (aGoodSample <= 0.0)
+    {
+        return iMaxIterations;
+    }
+    const double aIterations = std::log(1.0 - iConfidence) / std::log(1.0 - aGoodSample);
+    if (aIterations >= iMaxIterations)
+    {
+        return iMaxIterations;
+    }
+    return static_cast<int>(std::ceil(aIterations));
+}
 
-    double d1 = aM._img2_x - x1p;
-    double d2 = aM._img2_y - y1p;
+void Ransac::drawSample(size_t iSubsetSize, bool iIncludeLast, size_t* oSample)
+{
+    size_t aCount = 0;
+    if (iIncludeLast)
+    {
+        oSample[aCount++] = iSubsetSize - 1;
+        --iSubsetSize;
+    }
+    std::uniform_int_distribution<size_t> aDistrib(0, iSubsetSize - 1);
+    while (aCount < kSampleSize)
+    {
+        const size_t aIndex = aDistrib(_rng);
+        if (std::find(oSample, oSample + aCount, aIndex) == oSample + aCount)
+        {
+            oSample[aCount++] = aIndex;
+        }
+    }
+}
 
-    return d1*d1+d2*d2;
+// distance between estimate and real point in pixels.
+size_t Ransac::countInliers(const Homography& iModel, double iErrorDistSq, unsigned char* oInliers) const
+{
+    const double h00 = iModel._H[0][0], h01 = iModel._H[0][1], h02 = iModel._H[0][2];
+    const double h10 = iModel._H[1][0], h11 = iModel._H[1][1], h12 = iModel._H[1][2];
+    const double h20 = iModel._H[2][0], h21 = iModel._H[2][1], h22 = iModel._H[2][2];
+    const double v1x = iModel._v1x, v1y = iModel._v1y, v2x = iModel._v2x, v2y = iModel._v2y;
+    const double* x1 = _x1.data();
+    const double* y1 = _y1.data();
+    const double* x2 = _x2.data();
+    const double* y2 = _y2.data();
+    const size_t aSize = _x1.size();
+    size_t aCount = 0;
+#pragma omp simd reduction(+:aCount)
+    for (size_t i = 0; i < aSize; ++i)
+    {
+        const double aX = x1[i] - v1x;
+        const double aY = y1[i] - v1y;
+        const double aK = 1.0 / (h20 * aX + h21 * aY + h22);
+        const double d1 = x2[i] - (aK * (h00 * aX + h01 * aY + h02) + v2x);
+        const double d2 = y2[i] - (aK * (h10 * aX + h11 * aY + h12) + v2y);
+        const unsigned char aInlier = (d1 * d1 + d2 * d2 < iErrorDistSq) ? 1 : 0;
+        oInliers[i] = aInlier;
+        aCount += aInlier;
+    }
+    return aCount;
 }
 
 
 void Ransac::filter(PointMatchVector_t& ioMatches, PointMatchVector_t& ioRemovedMatches)
 {
-    int aRemainingIterations = _nIter;
+    const size_t aNrMatches = ioMatches.size();
+    if (aNrMatches < kSampleSize)
+    {
+        return;
+    }
     const double aErrorDistSq = _distanceThres * _distanceThres;
 
+    // copy the coordinates into separate arrays and normalize them
+    _x1.resize(aNrMatches);
+    _y1.resize(aNrMatches);
+    _x2.resize(aNrMatches);
+    _y2.resize(aNrMatches);
+    for (size_t i = 0; i < aNrMatches; ++i)
+    {
+        const PointMatch& aM = *ioMatches[i];
+        _x1[i] = aM._img1_x;
+        _y1[i] = aM._img1_y;
+        _x2[i] = aM._img2_x;
+        _y2[i] = aM._img2_y;
+    }
     Homography aCurrentModel;
-
-    unsigned int aMaxInliers = 0;
-    PointMatchVector_t aBestInliers;
-    PointMatchVector_t aBestOutliers;
-
-    // normalization  !!!!!!
     aCurrentModel.initMatchesNormalization(ioMatches);
 
+    std::vector<unsigned char> aCurrentInliers(aNrMatches);
+    std::vector<unsigned char> aBestInliers(aNrMatches, 0);
+    size_t aMaxInliers = 0;
+    size_t aSample[kSampleSize];
 
-    //std::cout << "gravity " << _v1x << " " << _v1y << " " << _v2x << " " << _v2y << endl;
-
-    for(; aRemainingIterations > 0; aRemainingIterations--)
+    // PROSAC: start with the best matches and enlarge the subset from which the samples
+    // are drawn, so that after _nIter iterations the samples are drawn from all matches
+    size_t aSubsetSize = kSampleSize;
+    double aTn = _nIter;
+    for (size_t i = 0; i < kSampleSize; ++i)
     {
-        //cout << "RANSAC -- iter " << aRemainingIterations << endl;
-
-        // random select 4 matches to fit the model
-        // from the input set as maybe_inliers
-        PointMatchVector_t aMatches(ioMatches);
-        PointMatchVector_t aInliers, aOutliers;
-
-        //std::cout << aMatches.size() << " matches size" << endl;
+        aTn *= static_cast<double>(aSubsetSize - i) / (aNrMatches - i);
+    }
+    double aTnPrime = 1;
 
-        for(int i=0; i<5; i++)
+    int aMaxIterations = _nIter;
+    for (int aIter = 1; aIter <= aMaxIterations; ++aIter)
+    {
+        while (aIter > aTnPrime && aSubsetSize < aNrMatches)
         {
-            int n = genint((int)aMatches.size()-1);
-            aInliers.push_back(aMatches.at(n));
-            aMatches.erase(aMatches.begin()+n);
+            const double aTnNext = aTn * (aSubsetSize + 1) / (aSubsetSize + 1 - kSampleSize);
+            aTnPrime += std::ceil(aTnNext - aTn);
+            aTn = aTnNext;
+            ++aSubsetSize;
         }
+        drawSample(aSubsetSize, aIter <= aTnPrime, aSample);
 
-        //std::cout << aMatches.size() << " estimate" << endl;
-
-        if (!aCurrentModel.estimate(aInliers))
+        if (!aCurrentModel.estimate(&_x1[0], &_y1[0], &_x2[0], &_y2[0], aSample, kSampleSize))
         {
-            aMatches.clear();
             continue;
         }
 
-        // for every point remaining in aMatches, add them to aInliers if they fit the model well.
-        for (size_t i = 0; i < aMatches.size(); ++i)
+        const size_t aNrInliers = countInliers(aCurrentModel, aErrorDistSq, &aCurrentInliers[0]);
+        if (aNrInliers > aMaxInliers)
         {
-            PointMatchPtr aMatchesIter2 = aMatches[i];
-            if (calcError(&aCurrentModel, *aMatchesIter2) < aErrorDistSq)
-            {
-                aInliers.push_back(aMatchesIter2);
-            }
-            else
-            {
-                aOutliers.push_back(aMatchesIter2);
-            }
-        }
-
-        if (aInliers.size() > aMaxInliers)
-        {
-            //cout << "good found -----------------" << aRemainingIterations << endl;
-            //cout << aCurrentModel << endl;
             for (int i=0; i<3; ++i)
                 for(int j=0; j<3; ++j)
                 {
@@ -115,29 +170,30 @@ void Ransac::filter(PointMatchVector_t& ioMatches, PointMatchVector_t& ioRemoved
             _bestModel._v1y = aCurrentModel._v1y;
             _bestModel._v2y = aCurrentModel._v2y;
 
-
-            //*ioBestModel = *aCurrentModel;
-            aMaxInliers = (unsigned int)aInliers.size();
-            aBestInliers = aInliers;
-            aBestOutliers = aOutliers;
-            //cout << "Inliers : " << aInliers.size() << " Outliers : " << aOutliers.size() << endl;
-
+            aMaxInliers = aNrInliers;
+            aBestInliers.swap(aCurrentInliers);
+            // update the number of needed iterations with the new inlier ratio
+            aMaxIterations = RequiredIterations(static_cast<double>(aNrInliers) / aNrMatches, _confidence, _nIter);
         }
+    }
 
-        // if there are 0 outliers then we are done.
-        if (aOutliers.empty())
+    PointMatchVector_t aInliers, aOutliers;
+    aInliers.reserve(aMaxInliers);
+    aOutliers.reserve(aNrMatches - aMaxInliers);
+    for (size_t i = 0; i < aNrMatches; ++i)
+    {
+        if (aBestInliers[i])
         {
-            break;
+            aInliers.push_back(ioMatches[i]);
+        }
+        else
+        {
+            aOutliers.push_back(ioMatches[i]);
         }
-
-        //cout << "Inliers : " << aInliers.size() << " Outliers : " << aOutliers.size() << endl;
-        //cout << "end iter" << endl;
     }
 
-    ioMatches = aBestInliers;
-    ioRemovedMatches = aBestOutliers;
-
-
+    ioMatches.swap(aInliers);
+    ioRemovedMatches.swap(aOutliers);
 }
 
 void Ransac::transform(double iX, double iY, double& oX, double& oY)
@@ -22,15 +22,21 @@
 #define __lfeat_ransacfiltering_h
 
 #include <vector>
+#include <random>
 #include "Homography.h"
 
 namespace lfeat
 {
 
+/** RANSAC filtering of matches with a homography model.
+ *  The number of iterations is adapted to the inlier ratio of the best model found so far,
+ *  the given number of iterations is only the upper limit. The samples are drawn
+ *  progressively from the best matches first (PROSAC), so the matches should be sorted
+ *  by decreasing quality (e.g. by the distance ratio of the descriptors). */
 class LFIMPEX Ransac
 {
 public:
-    Ransac() : _nIter(1000), _distanceThres(25) {};
+    Ransac() : _nIter(1000), _distanceThres(25), _confidence(0.995), _rng(5489u) {};
 
     void filter(std::vector<PointMatchPtr>& ioMatches, std::vector<PointMatchPtr>& ioRemovedMatches);
     inline void setIterations(int iIters)
@@ -41,6 +47,12 @@ public:
     {
         _distanceThres = iDT;
     }
+    /** set the probability that at least one sample without outliers was drawn,
+        when this probability is reached the iteration stops */
+    inline void setConfidence(double iConfidence)
+    {
+        _confidence = iConfidence;
+    }
 
     Homography	_bestModel;
 
@@ -48,12 +60,20 @@ public:
     void transform(double iX, double iY, double& oX, double& oY);
 
 private:
+    /** draw the indices of the next sample, the sample is taken from the first iSubsetSize
+        matches, if iIncludeLast is true the sample contains always the last match of the subset */
+    void drawSample(size_t iSubsetSize, bool iIncludeLast, size_t* oSample);
+    /** mark all matches, which fits the given model, returns the number of inliers */
+    size_t countInliers(const Homography& iModel, double iErrorDistSq, unsigned char* oInliers) const;
 
-    double calcError(Homography* aH, PointMatch& aM);
-
-    int		_nIter;				// number of iterations
+    int		_nIter;				// maximal number of iterations
     int		_distanceThres;	// error distance threshold in pixels
+    double	_confidence;	// desired probability for an outlier free sample
 
+    // each filter has its own random generator, so several pairs can be filtered in parallel
+    std::mt19937 _rng;
+    // coordinates of the matches, stored as separate arrays for a vectorised error calculation
+    std::vector<double> _x1, _y1, _x2, _y2;
 
 };
 
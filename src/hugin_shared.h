@@ -37,6 +37,12 @@
 #define LFIMPEX __declspec(dllimport)
 #endif
 
+#if defined cpfindlib_EXPORTS
+#define CPFINDIMPEX __declspec(dllexport)
+#else
+#define CPFINDIMPEX __declspec(dllimport)
+#endif
+
 #ifdef _MSC_VER
 #pragma warning( disable: 4251 )
 #endif
@@ -46,6 +52,7 @@
 #define WXIMPEX
 #define MAKEIMPEX
 #define LFIMPEX
+#define CPFINDIMPEX
 #define ICPIMPEX
 #define CELESTEIMPEX
 #define LINESIMPEX
@@ -35,6 +35,8 @@
 #include <hugin_utils/stl_utils.h>
 #include <appbase/ProgressDisplay.h>
 #include <algorithms/optimizer/PTOptimizer.h>
+#include <algorithms/optimizer/BundleAdjuster.h>
+#include <algorithms/optimizer/HierarchicalOptimizer.h>
 #include <algorithms/nona/CenterHorizontally.h>
 #include <algorithms/basic/StraightenPanorama.h>
 #include <algorithms/basic/CalculateMeanExposure.h>
@@ -63,6 +65,10 @@ static void usage(const char* name)
          << "              first image" << std::endl
          << "     -m       Optimise photometric parameters" << std::endl
          << "     -n       Optimize parameters specified in script file (like PTOptimizer)" << std::endl
+         << "     --hierarchical  Optimise big projects in clusters of images, used" << std::endl
+         << "              with -p and -n" << std::endl
+         << "     --native-optimizer  Use the native optimizer instead of libpano13" << std::endl
+         << "              for supported projects (EXPERIMENTAL)" << std::endl
          << std::endl
          << "    Postprocessing options:" << std::endl
          << "     -l       level horizon (works best for horizontal panos)" << std::endl
@@ -83,9 +89,16 @@ int main(int argc, char* argv[])
     // parse arguments
     const char* optstring = "alho:npqsv:m";
     int c;
+    enum
+    {
+        HIERARCHICAL = 1000,
+        NATIVE_OPTIMIZER,
+    };
     static struct option longOptions[] =
     {
         { "output", required_argument, NULL, 'o'},
+        { "hierarchical", no_argument, NULL, HIERARCHICAL },
+        { "native-optimizer", no_argument, NULL, NATIVE_OPTIMIZER },
         { "help", no_argument, NULL, 'h' },
         0
     };
@@ -97,6 +110,8 @@ int main(int argc, char* argv[])
     bool chooseProj = false;
     bool quiet = false;
     bool doPhotometric = false;
+    bool doHierarchical = false;
+    bool useNative = false;
     double hfov = 0.0;
     while ((c = getopt_long(argc, argv, optstring, longOptions, nullptr)) != -1)
     {
@@ -132,6 +147,12 @@ int main(int argc, char* argv[])
             case 'm':
                 doPhotometric = true;
                 break;
+            case HIERARCHICAL:
+                doHierarchical = true;
+                break;
+            case NATIVE_OPTIMIZER:
+                useNative = true;
+                break;
             case ':':
             case '?':
                 // missing argument or invalid switch
@@ -228,14 +249,21 @@ int main(int argc, char* argv[])
     if (doPairwise && ! doAutoOpt)
     {
         // do pairwise optimisation
-        HuginBase::AutoOptimise::autoOptimise(pano);
+        HuginBase::AutoOptimise::autoOptimise(pano, true, useNative);
 
         // do global optimisation
         if (!quiet)
         {
             std::cerr << "*** Pairwise position optimisation" << std::endl;
         }
-        HuginBase::PTools::optimize(pano);
+        if (doHierarchical)
+        {
+            HuginBase::HierarchicalOptimizer::optimizeHierarchical(pano);
+        }
+        else
+        {
+            HuginBase::BundleAdjuster::optimizePanorama(pano, useNative);
+        };
     }
     else if (doAutoOpt)
     {
@@ -243,7 +271,7 @@ int main(int argc, char* argv[])
         {
             std::cerr << "*** Adaptive geometric optimisation" << std::endl;
         }
-        HuginBase::SmartOptimise::smartOptimize(pano);
+        HuginBase::SmartOptimise::smartOptimize(pano, useNative);
     }
     else if (doNormalOpt)
     {
@@ -251,7 +279,14 @@ int main(int argc, char* argv[])
         {
             std::cerr << "*** Optimising parameters specified in PTO file" << std::endl;
         }
-        HuginBase::PTools::optimize(pano);
+        if (doHierarchical)
+        {
+            HuginBase::HierarchicalOptimizer::optimizeHierarchical(pano);
+        }
+        else
+        {
+            HuginBase::BundleAdjuster::optimizePanorama(pano, useNative);
+        };
     }
     else
     {
@@ -574,6 +574,17 @@ public:
         y_dest = y_src;
         return true;
     };
+
+    void transformImgCoords(const double* x, const double* y, double* x_dest, double* y_dest,
+                            unsigned char* valid, size_t n) const
+    {
+        for (size_t i = 0; i < n; ++i)
+        {
+            x_dest[i] = x[i];
+            y_dest[i] = y[i];
+            valid[i] = 1;
+        };
+    };
 };
 
 
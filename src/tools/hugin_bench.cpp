@@ -0,0 +1,1278 @@
+// -*- c-basic-offset: 4 -*-
+
+/** @file hugin_bench.cpp
+ *
+ *  @brief benchmark for the time critical parts of hugin
+ *
+ *  Creates a synthetic panorama in memory (no image files are read or
+ *  written) and measures the run time of remapping, blending, sampling,
+ *  optimisation and feature detection. The results are written as JSON,
+ *  so that different builds or machines can be compared with scripts.
+ *
+ */
+
+/*  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This software is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public
+ *  License along with this software. If not, see
+ *  <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <hugin_config.h>
+
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <chrono>
+#include <random>
+#include <memory>
+#include <functional>
+#include <getopt.h>
+#ifdef HAVE_OPENMP
+#include <omp.h>
+#endif
+
+#include <vigra/stdimage.hxx>
+#include <panodata/Panorama.h>
+#include <panotools/PanoToolsInterface.h>
+#include <panotools/PanoToolsOptimizerWrapper.h>
+#include <nona/SpaceTransform.h>
+#include <nona/RemappedPanoImage.h>
+#include <photometric/ResponseTransform.h>
+#include <algorithms/nona/FitPanorama.h>
+#include <algorithms/nona/ComputeImageROI.h>
+#include <algorithms/basic/CalculateOptimalScale.h>
+#include <algorithms/basic/CalculateOverlap.h>
+#include <algorithms/point_sampler/PointSampler.h>
+#include <vigra_ext/StitchWatershed.h>
+#include <vigra_ext/ImageTransforms.h>
+#include <vigra_ext/Pyramid.h>
+#include <hugin_utils/utils.h>
+#include <hugin_utils/stl_utils.h>
+#include <localfeatures/Image.h>
+#include <localfeatures/KeyPointDetector.h>
+#include <localfeatures/CircularKeyPointDescriptor.h>
+#include <localfeatures/Sieve.h>
+#include <localfeatures/DescriptorSet.h>
+#include <cpfind/PanoDetectorDefs.h>
+
+static void usage(const char* name)
+{
+    std::cout << name << ": benchmark of hugin's time critical algorithms" << std::endl
+         << "hugin_bench version " << hugin_utils::GetHuginVersion() << std::endl
+         << std::endl
+         << "Usage:  " << name << " [options]" << std::endl
+         << std::endl
+         << "hugin_bench creates a synthetic panorama in memory and measures" << std::endl
+         << "the run time of the main processing steps. The results are" << std::endl
+         << "written in JSON format." << std::endl
+         << std::endl
+         << "  Options:" << std::endl
+         << "     -o, --output=file.json     Write results to given file" << std::endl
+         << "                                (default: standard output)" << std::endl
+         << "     -n, --images=NUM           Number of images (default: 8)" << std::endl
+         << "     --size=WIDTHxHEIGHT        Size of the source images (default: 1200x800)" << std::endl
+         << "     --hfov=NUM                 Horizontal field of view of the source images" << std::endl
+         << "                                (default: 50)" << std::endl
+         << "     --src-projection=NUM       Projection of the source images, same numbers" << std::endl
+         << "                                as the f parameter of the i line (default: 0)" << std::endl
+         << "     --projection=NUM           Projection of the panorama, same numbers as" << std::endl
+         << "                                the f parameter of the p line (default: 2)" << std::endl
+         << "     --distortion=a,b,c         Radial distortion of the source images" << std::endl
+         << "                                (default: 0,-0.01,0)" << std::endl
+         << "     --masks                    Add an exclude mask to each image" << std::endl
+         << "     --repeat=NUM               Number of runs of each benchmark (default: 3)" << std::endl
+         << "     --seed=NUM                 Seed for the random generator (default: 1)" << std::endl
+         << "     --benchmarks=LIST          Comma separated list of benchmarks to run" << std::endl
+         << "                                transform, remap, merge, reduce, sampler," << std::endl
+         << "                                overlap, optimize, cpfind" << std::endl
+         << "                                (default: all)" << std::endl
+         << "     -h, --help                 Shows this help" << std::endl
+         << std::endl
+         << "The number of threads can be set with the environment variable" << std::endl
+         << "OMP_NUM_THREADS." << std::endl
+         << std::endl;
+}
+
+/** all known benchmark groups */
+static const char* BenchmarkGroups[] = { "transform", "remap", "merge", "reduce", "sampler", "overlap", "optimize", "cpfind" };
+
+/** parameters of the synthetic panorama and of the benchmark run */
+struct BenchSettings
+{
+    BenchSettings() : nrImages(8), size(1200, 800), hfov(50), srcProjection(0), panoProjection(2),
+        masks(false), repeat(3), seed(1)
+    {
+        distortion.push_back(0);
+        distortion.push_back(-0.01);
+        distortion.push_back(0);
+    };
+    int nrImages;
+    vigra::Size2D size;
+    double hfov;
+    int srcProjection;
+    int panoProjection;
+    std::vector<double> distortion;
+    bool masks;
+    int repeat;
+    unsigned int seed;
+    std::set<std::string> groups;
+};
+
+/** timings of a single benchmark */
+struct BenchResult
+{
+    std::string name;
+    /** processed items (pixels, points, ...) per run */
+    double items;
+    std::string unit;
+    /** run times in ms */
+    std::vector<double> times;
+};
+
+/** escape a string for the JSON output */
+static std::string JSONString(const std::string& s)
+{
+    std::ostringstream result;
+    result << '"';
+    for (size_t i = 0; i < s.size(); ++i)
+    {
+        const unsigned char c = static_cast<unsigned char>(s[i]);
+        switch (c)
+        {
+            case '"':
+                result << "\\\"";
+                break;
+            case '\\':
+                result << "\\\\";
+                break;
+            case '\n':
+                result << "\\n";
+                break;
+            case '\r':
+                result << "\\r";
+                break;
+            case '\t':
+                result << "\\t";
+                break;
+            default:
+                if (c < 0x20)
+                {
+                    // other control characters need to be written as unicode escape
+                    result << "\\u" << std::hex << std::setw(4) << std::setfill('0') << static_cast<int>(c) << std::dec;
+                }
+                else
+                {
+                    result << s[i];
+                };
+        };
+    };
+    result << '"';
+    return result.str();
+}
+
+/** runs the benchmarks and collects the timings */
+class BenchRunner
+{
+public:
+    explicit BenchRunner(int repeat) : m_repeat(std::max(1, repeat)) {};
+
+    /** run func repeat times and store the timings
+     *  @param name name of the benchmark
+     *  @param items number of processed items per run, used for the throughput
+     *  @param unit name of the items
+     *  @param func function to time
+     *  @param setup function called before each run, not included in the timing
+     */
+    void run(const std::string& name, double items, const std::string& unit,
+             const std::function<void()>& func, const std::function<void()>& setup = std::function<void()>())
+    {
+        BenchResult result;
+        result.name = name;
+        result.items = items;
+        result.unit = unit;
+        for (int i = 0; i < m_repeat; ++i)
+        {
+            if (setup)
+            {
+                setup();
+            };
+            const auto start = std::chrono::steady_clock::now();
+            func();
+            const auto end = std::chrono::steady_clock::now();
+            result.times.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+        };
+        std::cerr << std::setw(30) << std::left << name << " " << std::setw(10) << std::right << std::fixed << std::setprecision(2)
+            << *std::min_element(result.times.begin(), result.times.end()) << " ms" << std::endl;
+        m_results.push_back(result);
+    };
+
+    /** write the results and the settings as JSON to the stream */
+    void writeJSON(std::ostream& out, const BenchSettings& settings, const HuginBase::PanoramaOptions& opts) const
+    {
+        out << std::setprecision(6) << std::defaultfloat;
+        out << "{" << std::endl
+            << "  \"version\": " << JSONString(hugin_utils::GetHuginVersion()) << "," << std::endl
+#ifdef HAVE_OPENMP
+            << "  \"threads\": " << omp_get_max_threads() << "," << std::endl
+#else
+            << "  \"threads\": 1," << std::endl
+#endif
+            << "  \"settings\": {" << std::endl
+            << "    \"images\": " << settings.nrImages << "," << std::endl
+            << "    \"width\": " << settings.size.width() << "," << std::endl
+            << "    \"height\": " << settings.size.height() << "," << std::endl
+            << "    \"hfov\": " << settings.hfov << "," << std::endl
+            << "    \"src_projection\": " << settings.srcProjection << "," << std::endl
+            << "    \"projection\": " << settings.panoProjection << "," << std::endl
+            << "    \"distortion\": [" << settings.distortion[0] << ", " << settings.distortion[1] << ", " << settings.distortion[2] << "]," << std::endl
+            << "    \"masks\": " << (settings.masks ? "true" : "false") << "," << std::endl
+            << "    \"repeat\": " << m_repeat << "," << std::endl
+            << "    \"seed\": " << settings.seed << "," << std::endl
+            << "    \"panorama_width\": " << opts.getWidth() << "," << std::endl
+            << "    \"panorama_height\": " << opts.getHeight() << std::endl
+            << "  }," << std::endl
+            << "  \"results\": [";
+        for (size_t i = 0; i < m_results.size(); ++i)
+        {
+            const BenchResult& result = m_results[i];
+            std::vector<double> times(result.times);
+            std::sort(times.begin(), times.end());
+            double sum = 0;
+            for (size_t j = 0; j < times.size(); ++j)
+            {
+                sum += times[j];
+            };
+            const double median = (times.size() % 2 == 1) ? times[times.size() / 2] : 0.5 * (times[times.size() / 2 - 1] + times[times.size() / 2]);
+            out << (i > 0 ? "," : "") << std::endl
+                << "    {" << std::endl
+                << "      \"name\": " << JSONString(result.name) << "," << std::endl
+                << "      \"items\": " << result.items << "," << std::endl
+                << "      \"unit\": " << JSONString(result.unit) << "," << std::endl
+                << "      \"runs\": " << times.size() << "," << std::endl
+                << "      \"min_ms\": " << times.front() << "," << std::endl
+                << "      \"median_ms\": " << median << "," << std::endl
+                << "      \"mean_ms\": " << sum / times.size() << "," << std::endl
+                << "      \"max_ms\": " << times.back() << "," << std::endl
+                << "      \"items_per_second\": " << (times.front() > 0 ? result.items * 1000.0 / times.front() : 0) << std::endl
+                << "    }";
+        };
+        out << std::endl << "  ]" << std::endl << "}" << std::endl;
+    };
+
+private:
+    int m_repeat;
+    std::vector<BenchResult> m_results;
+};
+
+/** create a random texture for the whole sphere in equirectangular projection,
+ *  it contains discs and rectangles of different sizes, so the feature detector
+ *  finds structures at all scales */
+static void CreateWorldImage(vigra::FRGBImage& world, std::mt19937& rng)
+{
+    world.resize(4096, 2048);
+    for (int y = 0; y < world.height(); ++y)
+    {
+        for (int x = 0; x < world.width(); ++x)
+        {
+            world(x, y) = vigra::RGBValue<float>(96 + 48 * sin(6 * M_PI * x / world.width()),
+                96 + 48 * cos(4 * M_PI * y / world.height()), 128);
+        };
+    };
+    std::uniform_int_distribution<int> posX(0, world.width() - 1);
+    std::uniform_int_distribution<int> posY(0, world.height() - 1);
+    std::uniform_real_distribution<double> uniform(0, 1);
+    std::uniform_int_distribution<int> color(0, 255);
+    for (int i = 0; i < 8000; ++i)
+    {
+        const int cx = posX(rng);
+        const int cy = posY(rng);
+        // many small and some large objects
+        const int r = 2 + static_cast<int>(40 * pow(uniform(rng), 3));
+        const vigra::RGBValue<float> c(color(rng), color(rng), color(rng));
+        const bool disc = (i % 2 == 0);
+        for (int dy = -r; dy <= r; ++dy)
+        {
+            const int y = cy + dy;
+            if (y < 0 || y >= world.height())
+            {
+                continue;
+            };
+            for (int dx = -r; dx <= r; ++dx)
+            {
+                if (disc && dx * dx + dy * dy > r * r)
+                {
+                    continue;
+                };
+                world((cx + dx + world.width()) % world.width(), y) = c;
+            };
+        };
+    };
+}
+
+/** render the source image from the world texture with bilinear interpolation */
+static void RenderSourceImage(const vigra::FRGBImage& world, const HuginBase::SrcPanoImage& srcImg, vigra::BRGBImage& image)
+{
+    HuginBase::PanoramaOptions worldOpts;
+    worldOpts.setProjection(HuginBase::PanoramaOptions::EQUIRECTANGULAR);
+    worldOpts.setHFOV(360, false);
+    worldOpts.setWidth(world.width(), false);
+    worldOpts.setHeight(world.height());
+    HuginBase::PTools::Transform transf;
+    transf.createInvTransform(srcImg, worldOpts);
+    image.resize(srcImg.getSize());
+#pragma omp parallel for schedule(dynamic)
+    for (int y = 0; y < image.height(); ++y)
+    {
+        for (int x = 0; x < image.width(); ++x)
+        {
+            double wx;
+            double wy;
+            if (!transf.transformImgCoord(wx, wy, x, y))
+            {
+                continue;
+            };
+            const int x0 = static_cast<int>(floor(wx));
+            const int y0 = std::max(0, std::min(static_cast<int>(floor(wy)), world.height() - 2));
+            const float fx = static_cast<float>(wx - x0);
+            const float fy = std::max(0.0f, std::min(static_cast<float>(wy - y0), 1.0f));
+            const int xa = ((x0 % world.width()) + world.width()) % world.width();
+            const int xb = (xa + 1) % world.width();
+            const vigra::RGBValue<float> value = (world(xa, y0) * (1 - fx) + world(xb, y0) * fx) * (1 - fy) +
+                (world(xa, y0 + 1) * (1 - fx) + world(xb, y0 + 1) * fx) * fy;
+            image(x, y) = vigra::RGBValue<vigra::UInt8>(hugin_utils::roundi(value.red()),
+                hugin_utils::roundi(value.green()), hugin_utils::roundi(value.blue()));
+        };
+    };
+}
+
+/** build the panorama project: a single row of images around the horizon */
+static void CreatePanorama(const BenchSettings& settings, HuginBase::Panorama& pano)
+{
+    const double yawStep = std::min(0.7 * settings.hfov, 360.0 / settings.nrImages);
+    std::vector<double> radialDistortion(settings.distortion);
+    radialDistortion.push_back(1.0 - settings.distortion[0] - settings.distortion[1] - settings.distortion[2]);
+    for (int i = 0; i < settings.nrImages; ++i)
+    {
+        HuginBase::SrcPanoImage srcImg;
+        std::ostringstream filename;
+        filename << "synthetic" << i << ".tif";
+        srcImg.setFilename(filename.str());
+        srcImg.setSize(settings.size);
+        srcImg.setProjection(static_cast<HuginBase::SrcPanoImage::Projection>(settings.srcProjection));
+        srcImg.setHFOV(settings.hfov);
+        double yaw = i * yawStep;
+        if (yaw > 180)
+        {
+            yaw -= 360;
+        };
+        srcImg.setYaw(yaw);
+        srcImg.setRadialDistortion(radialDistortion);
+        if (settings.masks)
+        {
+            // exclude the lower right corner
+            HuginBase::MaskPolygon mask;
+            mask.setMaskType(HuginBase::MaskPolygon::Mask_negative);
+            mask.addPoint(hugin_utils::FDiff2D(0.7 * settings.size.width(), settings.size.height()));
+            mask.addPoint(hugin_utils::FDiff2D(settings.size.width(), 0.6 * settings.size.height()));
+            mask.addPoint(hugin_utils::FDiff2D(settings.size.width(), settings.size.height()));
+            srcImg.addMask(mask);
+        };
+        pano.addImage(srcImg);
+    };
+    // activate the masks
+    pano.updateMasks();
+
+    HuginBase::PanoramaOptions opts = pano.getOptions();
+    opts.setProjection(static_cast<HuginBase::PanoramaOptions::ProjectionFormat>(settings.panoProjection));
+    opts.outputFormat = HuginBase::PanoramaOptions::TIFF_m;
+    pano.setOptions(opts);
+    HuginBase::CalculateFitPanorama fitPano(pano);
+    fitPano.run();
+    opts.setHFOV(fitPano.getResultHorizontalFOV());
+    opts.setHeight(hugin_utils::roundi(fitPano.getResultHeight()));
+    pano.setOptions(opts);
+    const double scale = HuginBase::CalculateOptimalScale::calcOptimalScale(pano);
+    opts.setWidth(hugin_utils::roundi(opts.getWidth() * scale), true);
+    pano.setOptions(opts);
+}
+
+/** add control points for all overlapping images, the positions are calculated
+ *  from the exact geometry on a regular grid in the panorama */
+static void CreateControlPoints(HuginBase::Panorama& pano)
+{
+    const HuginBase::PanoramaOptions& opts = pano.getOptions();
+    std::vector<std::unique_ptr<HuginBase::PTools::Transform> > transforms;
+    for (unsigned int i = 0; i < pano.getNrOfImages(); ++i)
+    {
+        transforms.push_back(std::unique_ptr<HuginBase::PTools::Transform>(new HuginBase::PTools::Transform));
+        transforms.back()->createTransform(pano.getImage(i), opts);
+    };
+    const vigra::Rect2D roi = opts.getROI();
+    const int step = std::max(4, std::max(roi.width(), roi.height()) / 150);
+    for (int y = roi.top() + step / 2; y < roi.bottom(); y += step)
+    {
+        for (int x = roi.left() + step / 2; x < roi.right(); x += step)
+        {
+            std::vector<unsigned int> imgs;
+            std::vector<hugin_utils::FDiff2D> pos;
+            for (unsigned int i = 0; i < pano.getNrOfImages(); ++i)
+            {
+                hugin_utils::FDiff2D p;
+                if (transforms[i]->transformImgCoord(p.x, p.y, x, y) && pano.getImage(i).isInside(vigra::Point2D(hugin_utils::roundi(p.x), hugin_utils::roundi(p.y))))
+                {
+                    imgs.push_back(i);
+                    pos.push_back(p);
+                };
+            };
+            for (size_t i = 0; i + 1 < imgs.size(); ++i)
+            {
+                pano.addCtrlPoint(HuginBase::ControlPoint(imgs[i], pos[i].x, pos[i].y, imgs[i + 1], pos[i + 1].x, pos[i + 1].y));
+            };
+        };
+    };
+}
+
+/** benchmark the coordinate transformations, which are used for remapping */
+static void BenchTransform(BenchRunner& runner, const HuginBase::Panorama& pano, const std::vector<vigra::Rect2D>& rois)
+{
+    const HuginBase::PanoramaOptions& opts = pano.getOptions();
+    double pixels = 0;
+    for (size_t i = 0; i < rois.size(); ++i)
+    {
+        pixels += rois[i].area();
+    };
+    // sum of the results, so the compiler can't remove the calculations
+    volatile double checksum = 0;
+    // the fused stacks and the generic interpreter of the SpaceTransform
+    for (int useFused = 1; useFused >= 0; --useFused)
+    {
+        runner.run(useFused ? "spacetransform" : "spacetransform_interpreted", pixels, "pixel", [&]()
+        {
+            double sum = 0;
+            for (size_t i = 0; i < rois.size(); ++i)
+            {
+                HuginBase::Nona::SpaceTransform transf;
+                transf.createTransform(pano.getImage(i), opts);
+                transf.setUseFused(useFused != 0);
+#pragma omp parallel for schedule(dynamic) reduction(+:sum)
+                for (int y = rois[i].top(); y < rois[i].bottom(); ++y)
+                {
+                    for (int x = rois[i].left(); x < rois[i].right(); ++x)
+                    {
+                        double sx;
+                        double sy;
+                        if (transf.transformImgCoord(sx, sy, x, y))
+                        {
+                            sum += sx + sy;
+                        };
+                    };
+                };
+            };
+            checksum = checksum + sum;
+        });
+    };
+    runner.run("spacetransform_batch", pixels, "pixel", [&]()
+    {
+        double sum = 0;
+        for (size_t i = 0; i < rois.size(); ++i)
+        {
+            HuginBase::Nona::SpaceTransform transf;
+            transf.createTransform(pano.getImage(i), opts);
+            const int width = rois[i].width();
+            if (width <= 0)
+            {
+                continue;
+            };
+#pragma omp parallel reduction(+:sum)
+            {
+                std::vector<double> xpos(width);
+                std::vector<double> ypos(width);
+                std::vector<double> sx(width);
+                std::vector<double> sy(width);
+                std::vector<unsigned char> valid(width);
+                for (int x = 0; x < width; ++x)
+                {
+                    xpos[x] = rois[i].left() + x;
+                };
+#pragma omp for schedule(dynamic)
+                for (int y = rois[i].top(); y < rois[i].bottom(); ++y)
+                {
+                    std::fill(ypos.begin(), ypos.end(), y);
+                    transf.transformImgCoords(&xpos[0], &ypos[0], &sx[0], &sy[0], &valid[0], width);
+                    for (int x = 0; x < width; ++x)
+                    {
+                        if (valid[x])
+                        {
+                            sum += sx[x] + sy[x];
+                        };
+                    };
+                };
+            }
+        };
+        checksum = checksum + sum;
+    });
+    runner.run("ptools_transform", pixels, "pixel", [&]()
+    {
+        double sum = 0;
+        for (size_t i = 0; i < rois.size(); ++i)
+        {
+            HuginBase::PTools::Transform transf;
+            transf.createTransform(pano.getImage(i), opts);
+#pragma omp parallel for schedule(dynamic) reduction(+:sum)
+            for (int y = rois[i].top(); y < rois[i].bottom(); ++y)
+            {
+                for (int x = rois[i].left(); x < rois[i].right(); ++x)
+                {
+                    double sx;
+                    double sy;
+                    if (transf.transformImgCoord(sx, sy, x, y))
+                    {
+                        sum += sx + sy;
+                    };
+                };
+            };
+        };
+        checksum = checksum + sum;
+    });
+}
+
+typedef HuginBase::Nona::RemappedPanoImage<vigra::BRGBImage, vigra::BImage> RemappedImage;
+typedef std::vector<std::unique_ptr<RemappedImage> > RemappedImageVector;
+
+/** remap all images with the given interpolator */
+template <class ImageType>
+static void RemapImages(const HuginBase::Panorama& pano, const std::vector<ImageType>& images,
+                        const std::vector<vigra::Rect2D>& rois, vigra_ext::Interpolator interpol,
+                        std::vector<std::unique_ptr<HuginBase::Nona::RemappedPanoImage<ImageType, vigra::BImage> > >& remapped)
+{
+    typedef HuginBase::Nona::RemappedPanoImage<ImageType, vigra::BImage> Remapped;
+    AppBase::DummyProgressDisplay progress;
+    remapped.clear();
+    for (size_t i = 0; i < images.size(); ++i)
+    {
+        remapped.push_back(std::unique_ptr<Remapped>(new Remapped));
+        remapped.back()->setPanoImage(pano.getSrcImage(i), pano.getOptions(), rois[i]);
+        remapped.back()->remapImage(vigra::srcImageRange(images[i]), interpol, &progress);
+    };
+}
+
+/** convert the 8 bit RGB image into another RGB pixel type, the values are not scaled */
+template <class T>
+static void ConvertImage(const vigra::BRGBImage& image, vigra::BasicImage<vigra::RGBValue<T> >& converted)
+{
+    converted.resize(image.size());
+    vigra::copyImage(vigra::srcImageRange(image), vigra::destImage(converted));
+}
+
+/** convert the 8 bit RGB image into a grayscale image */
+template <class T>
+static void ConvertImage(const vigra::BRGBImage& image, vigra::BasicImage<T>& converted)
+{
+    converted.resize(image.size());
+    vigra::copyImage(vigra::srcImageRange(image, vigra::RGBToGrayAccessor<vigra::RGBValue<vigra::UInt8> >()),
+        vigra::destImage(converted));
+}
+
+/** benchmark the remapping of images with the given pixel type, each pixel type
+ *  uses its own instantiation of the interpolators */
+template <class ImageType>
+static void BenchRemapPixelType(BenchRunner& runner, const HuginBase::Panorama& pano, const std::vector<vigra::BRGBImage>& images,
+                                const std::vector<vigra::Rect2D>& rois, double pixels, const std::string& typeName)
+{
+    std::vector<ImageType> converted(images.size());
+    for (size_t i = 0; i < images.size(); ++i)
+    {
+        ConvertImage(images[i], converted[i]);
+    };
+    const struct
+    {
+        vigra_ext::Interpolator interpol;
+        const char* name;
+    } interpolators[] = {
+        { vigra_ext::INTERP_CUBIC, "remap_cubic_" },
+        { vigra_ext::INTERP_SPLINE_36, "remap_spline36_" },
+        { vigra_ext::INTERP_SINC_256, "remap_sinc256_" }
+    };
+    for (size_t i = 0; i < sizeof(interpolators) / sizeof(interpolators[0]); ++i)
+    {
+        std::vector<std::unique_ptr<HuginBase::Nona::RemappedPanoImage<ImageType, vigra::BImage> > > remapped;
+        runner.run(interpolators[i].name + typeName, pixels, "pixel", [&]()
+        {
+            RemapImages(pano, converted, rois, interpolators[i].interpol, remapped);
+        });
+    };
+}
+
+/** remap all images with an alpha channel, which excludes a disc in the centre
+ *  of each image, so the interpolators need to handle partially masked
+ *  neighbourhoods */
+static void BenchRemapMasked(BenchRunner& runner, const HuginBase::Panorama& pano, const std::vector<vigra::BRGBImage>& images,
+                             const std::vector<vigra::Rect2D>& rois, double pixels)
+{
+    std::vector<vigra::BImage> alpha(images.size());
+    for (size_t i = 0; i < images.size(); ++i)
+    {
+        const vigra::Size2D size(images[i].size());
+        const double radius = 0.25 * std::min(size.width(), size.height());
+        alpha[i].resize(size, 255);
+        for (int y = 0; y < size.height(); ++y)
+        {
+            for (int x = 0; x < size.width(); ++x)
+            {
+                if (hugin_utils::sqr(x - 0.5 * size.width()) + hugin_utils::sqr(y - 0.5 * size.height()) < radius * radius)
+                {
+                    alpha[i](x, y) = 0;
+                };
+            };
+        };
+    };
+    const struct
+    {
+        vigra_ext::Interpolator interpol;
+        const char* name;
+    } interpolators[] = {
+        { vigra_ext::INTERP_BILINEAR, "remap_bilinear_masked" },
+        { vigra_ext::INTERP_CUBIC, "remap_cubic_masked" },
+        { vigra_ext::INTERP_SPLINE_36, "remap_spline36_masked" },
+        { vigra_ext::INTERP_SINC_256, "remap_sinc256_masked" }
+    };
+    AppBase::DummyProgressDisplay progress;
+    for (size_t i = 0; i < sizeof(interpolators) / sizeof(interpolators[0]); ++i)
+    {
+        RemappedImageVector remapped;
+        runner.run(interpolators[i].name, pixels, "pixel", [&]()
+        {
+            remapped.clear();
+            for (size_t j = 0; j < images.size(); ++j)
+            {
+                remapped.push_back(std::unique_ptr<RemappedImage>(new RemappedImage));
+                remapped.back()->setPanoImage(pano.getSrcImage(j), pano.getOptions(), rois[j]);
+                remapped.back()->remapImage(vigra::srcImageRange(images[j]), vigra::srcImage(alpha[j]),
+                    interpolators[i].interpol, &progress);
+            };
+        });
+    };
+}
+
+/** remap the image with the given coordinate transformation and the cubic interpolator */
+template <class TRANSFORM>
+static void RemapWithTransform(const HuginBase::SrcPanoImage& srcImg, const HuginBase::PanoramaOptions& opts,
+                               const vigra::BRGBImage& image, const vigra::Rect2D& roi, TRANSFORM& transf,
+                               vigra::BRGBImage& dest, vigra::BImage& destAlpha)
+{
+    AppBase::DummyProgressDisplay progress;
+    HuginBase::Photometric::InvResponseTransform<vigra::UInt8, double> invResponse(srcImg);
+    invResponse.setOutput(1.0 / pow(2.0, opts.outputExposureValue), std::vector<double>(), 255.0);
+    invResponse.precompute();
+    dest.resize(roi.size());
+    destAlpha.resize(roi.size());
+    vigra_ext::transformImage(vigra::srcImageRange(image), vigra::destImageRange(dest), vigra::destImage(destAlpha),
+        roi.upperLeft(), transf, invResponse, srcImg.horizontalWarpNeeded(), vigra_ext::INTERP_CUBIC, &progress);
+}
+
+/** compare the whole remapping with the fused and the interpreted SpaceTransform
+ *  and with the libpano13 transformation, which is used by nona */
+static void BenchRemapTransforms(BenchRunner& runner, const HuginBase::Panorama& pano, const std::vector<vigra::BRGBImage>& images,
+                                 const std::vector<vigra::Rect2D>& rois, double pixels)
+{
+    const HuginBase::PanoramaOptions& opts = pano.getOptions();
+    vigra::BRGBImage dest;
+    vigra::BImage destAlpha;
+    for (int useFused = 1; useFused >= 0; --useFused)
+    {
+        runner.run(useFused ? "remap_cubic_spacetransform" : "remap_cubic_spacetransform_interpreted", pixels, "pixel", [&]()
+        {
+            for (size_t i = 0; i < images.size(); ++i)
+            {
+                HuginBase::Nona::SpaceTransform transf;
+                transf.createTransform(pano.getImage(i), opts);
+                transf.setUseFused(useFused != 0);
+                RemapWithTransform(pano.getImage(i), opts, images[i], rois[i], transf, dest, destAlpha);
+            };
+        });
+    };
+    runner.run("remap_cubic_ptools", pixels, "pixel", [&]()
+    {
+        for (size_t i = 0; i < images.size(); ++i)
+        {
+            HuginBase::PTools::Transform transf;
+            transf.createTransform(pano.getImage(i), opts);
+            RemapWithTransform(pano.getImage(i), opts, images[i], rois[i], transf, dest, destAlpha);
+        };
+    });
+}
+
+/** benchmark the remapping with all interpolators */
+static void BenchRemap(BenchRunner& runner, const HuginBase::Panorama& pano, const std::vector<vigra::BRGBImage>& images,
+                       const std::vector<vigra::Rect2D>& rois)
+{
+    const struct
+    {
+        vigra_ext::Interpolator interpol;
+        const char* name;
+    } interpolators[] = {
+        { vigra_ext::INTERP_NEAREST_NEIGHBOUR, "remap_nearest" },
+        { vigra_ext::INTERP_BILINEAR, "remap_bilinear" },
+        { vigra_ext::INTERP_CUBIC, "remap_cubic" },
+        { vigra_ext::INTERP_SPLINE_16, "remap_spline16" },
+        { vigra_ext::INTERP_SPLINE_36, "remap_spline36" },
+        { vigra_ext::INTERP_SPLINE_64, "remap_spline64" },
+        { vigra_ext::INTERP_SINC_256, "remap_sinc256" },
+        { vigra_ext::INTERP_SINC_1024, "remap_sinc1024" }
+    };
+    double pixels = 0;
+    for (size_t i = 0; i < rois.size(); ++i)
+    {
+        pixels += rois[i].area();
+    };
+    for (size_t i = 0; i < sizeof(interpolators) / sizeof(interpolators[0]); ++i)
+    {
+        RemappedImageVector remapped;
+        runner.run(interpolators[i].name, pixels, "pixel", [&]()
+        {
+            RemapImages(pano, images, rois, interpolators[i].interpol, remapped);
+        });
+    };
+    // the other pixel types, which have a fast interpolation path
+    BenchRemapPixelType<vigra::UInt16RGBImage>(runner, pano, images, rois, pixels, "uint16_rgb");
+    BenchRemapPixelType<vigra::FRGBImage>(runner, pano, images, rois, pixels, "float_rgb");
+    BenchRemapPixelType<vigra::BImage>(runner, pano, images, rois, pixels, "uint8_gray");
+    BenchRemapPixelType<vigra::FImage>(runner, pano, images, rois, pixels, "float_gray");
+    BenchRemapMasked(runner, pano, images, rois, pixels);
+    BenchRemapTransforms(runner, pano, images, rois, pixels);
+}
+
+/** merge all remapped images with the watershed seam finder */
+static void MergeRemappedImages(const HuginBase::PanoramaOptions& opts, const RemappedImageVector& remapped,
+                                vigra::BRGBImage& panoImage, vigra::BImage& panoMask)
+{
+    const bool wrap = (opts.getHFOV() == 360.0) && (opts.getWidth() == opts.getROI().width());
+    for (size_t i = 0; i < remapped.size(); ++i)
+    {
+        if (remapped[i]->boundingBox().isEmpty())
+        {
+            continue;
+        };
+        vigra_ext::MergeImages(panoImage, panoMask, remapped[i]->m_image, remapped[i]->m_mask,
+            vigra::Diff2D(remapped[i]->boundingBox().upperLeft()), wrap, false);
+    };
+}
+
+/** benchmark the point sampler for the photometric optimisation */
+static void BenchSampler(BenchRunner& runner, HuginBase::Panorama& pano, const std::vector<vigra::BRGBImage>& images)
+{
+    std::vector<vigra::FRGBImage> floatImages(images.size());
+    std::vector<vigra::FRGBImage*> imagePtrs;
+    HuginBase::LimitIntensityVector limits;
+    for (size_t i = 0; i < images.size(); ++i)
+    {
+        floatImages[i].resize(images[i].size());
+        vigra::copyImage(vigra::srcImageRange(images[i]), vigra::destImage(floatImages[i]));
+        imagePtrs.push_back(&floatImages[i]);
+        limits.push_back(HuginBase::LimitIntensity(HuginBase::LimitIntensity::LIMIT_UINT8));
+    };
+    const int nPoints = 200 * static_cast<int>(images.size());
+    AppBase::DummyProgressDisplay progress;
+    runner.run("pointsampler_random", nPoints, "point", [&]()
+    {
+        HuginBase::RandomPointSampler(pano, &progress, imagePtrs, limits, nPoints).execute();
+    });
+    runner.run("pointsampler_all", nPoints, "point", [&]()
+    {
+        HuginBase::AllPointSampler(pano, &progress, imagePtrs, limits, nPoints).execute();
+    });
+}
+
+/** benchmark the geometric optimiser, starting from a disturbed position */
+static void BenchOptimize(BenchRunner& runner, const HuginBase::Panorama& pano, unsigned int seed)
+{
+    std::unique_ptr<HuginBase::Panorama> optPano;
+    runner.run("ptools_optimize", pano.getNrOfCtrlPoints(), "controlpoint", [&]()
+    {
+        HuginBase::PTools::optimize(*optPano);
+    },
+    [&]()
+    {
+        optPano.reset(new HuginBase::Panorama(pano.duplicate()));
+        // always use the same start values
+        std::mt19937 rng(seed);
+        std::normal_distribution<double> disturb(0, 1);
+        HuginBase::OptimizeVector optVec(optPano->getNrOfImages());
+        for (unsigned int i = 1; i < optPano->getNrOfImages(); ++i)
+        {
+            HuginBase::SrcPanoImage img = optPano->getSrcImage(i);
+            img.setYaw(img.getYaw() + disturb(rng));
+            img.setPitch(img.getPitch() + disturb(rng));
+            img.setRoll(img.getRoll() + disturb(rng));
+            optPano->setSrcImage(i, img);
+            optVec[i].insert("y");
+            optVec[i].insert("p");
+            optVec[i].insert("r");
+        };
+        optPano->setOptimizeVector(optVec);
+    });
+}
+
+// define a Keypoint insertor
+class KeyPointVectInsertor : public lfeat::KeyPointInsertor
+{
+public:
+    explicit KeyPointVectInsertor(lfeat::KeyPointVect_t& iVect) : _v(iVect) {};
+    inline virtual void operator()(const lfeat::KeyPoint& k)
+    {
+        _v.push_back(lfeat::KeyPointPtr(new lfeat::KeyPoint(k)));
+    }
+
+private:
+    lfeat::KeyPointVect_t& _v;
+};
+
+// define a sieve extractor
+class SieveExtractorKP : public lfeat::SieveExtractor<lfeat::KeyPointPtr>
+{
+public:
+    explicit SieveExtractorKP(lfeat::KeyPointVect_t& iV) : _v(iV) {};
+    inline virtual void operator()(const lfeat::KeyPointPtr& k)
+    {
+        _v.push_back(k);
+    }
+private:
+    lfeat::KeyPointVect_t& _v;
+};
+
+/** benchmark building the kd-trees and the matching of consecutive images, this
+ *  corresponds to the linear matching strategy of cpfind with the default settings */
+template <class ElementType, class DataFunctor>
+static void BenchCPFindMatching(BenchRunner& runner, const std::string& typeName, std::vector<lfeat::DescriptorSet>& descriptors,
+    const size_t nrDescriptors, const int descLength, DataFunctor getData)
+{
+    typedef flann::Index<DescriptorL2<ElementType> > FlannIndex;
+    const size_t nrImages = descriptors.size();
+    std::vector<std::unique_ptr<FlannIndex> > indices(nrImages);
+    runner.run("cpfind_kdtree" + typeName, nrDescriptors, "keypoint", [&]()
+    {
+        for (size_t i = 0; i < nrImages; ++i)
+        {
+            if (descriptors[i].empty())
+            {
+                continue;
+            };
+            indices[i].reset(new FlannIndex(flann::Matrix<ElementType>(getData(descriptors[i]), descriptors[i].size(), descLength),
+                flann::KDTreeIndexParams(4)));
+            indices[i]->buildIndex();
+        };
+    });
+    runner.run("cpfind_match" + typeName, nrDescriptors, "keypoint", [&]()
+    {
+        for (size_t i = 0; i < nrImages; ++i)
+        {
+            const size_t j = (i + 1) % nrImages;
+            if (i == j || descriptors[i].empty() || !indices[j])
+            {
+                continue;
+            };
+            flann::Matrix<ElementType> query(getData(descriptors[i]), descriptors[i].size(), descLength);
+            std::vector<int> indicesData(query.rows * 2);
+            std::vector<float> distsData(query.rows * 2);
+            flann::Matrix<int> nnIndices(indicesData.data(), query.rows, 2);
+            flann::Matrix<float> nnDists(distsData.data(), query.rows, 2);
+            indices[j]->knnSearch(query, nnIndices, nnDists, 2, flann::SearchParams(200));
+        };
+    });
+}
+
+/** benchmark the feature detection and matching of cpfind with its default settings */
+static void BenchCPFind(BenchRunner& runner, const std::vector<vigra::BRGBImage>& images)
+{
+    const size_t nrImages = images.size();
+    std::vector<vigra::DImage> grayImages(nrImages);
+    double pixels = 0;
+    for (size_t i = 0; i < nrImages; ++i)
+    {
+        grayImages[i].resize(images[i].size());
+        vigra::copyImage(vigra::srcImageRange(images[i], vigra::RGBToGrayAccessor<vigra::RGBValue<vigra::UInt8> >()),
+            vigra::destImage(grayImages[i]));
+        pixels += images[i].width() * images[i].height();
+    };
+    std::vector<std::unique_ptr<lfeat::Image> > integralImages(nrImages);
+    runner.run("cpfind_integralimage", pixels, "pixel", [&]()
+    {
+        for (size_t i = 0; i < nrImages; ++i)
+        {
+            integralImages[i].reset(new lfeat::Image(grayImages[i]));
+        };
+    });
+    std::vector<lfeat::KeyPointVect_t> keypoints(nrImages);
+    runner.run("cpfind_detect", pixels, "pixel", [&]()
+    {
+        for (size_t i = 0; i < nrImages; ++i)
+        {
+            lfeat::KeyPointDetector detector;
+            KeyPointVectInsertor insertor(keypoints[i]);
+            detector.detectKeypoints(*integralImages[i], insertor);
+        };
+    },
+    [&]()
+    {
+        for (size_t i = 0; i < nrImages; ++i)
+        {
+            keypoints[i].clear();
+        };
+    });
+    // filter the keypoints like cpfind's default sieve settings
+    std::vector<lfeat::KeyPointVect_t> filteredKeypoints(nrImages);
+    size_t nrKeypoints = 0;
+    for (size_t i = 0; i < nrImages; ++i)
+    {
+        lfeat::Sieve<lfeat::KeyPointPtr, lfeat::KeyPointPtrSort > sieve(10, 10, 100);
+        const double xf = 10.0 / images[i].width();
+        const double yf = 10.0 / images[i].height();
+        for (size_t j = 0; j < keypoints[i].size(); ++j)
+        {
+            sieve.insert(keypoints[i][j], static_cast<int>(keypoints[i][j]->_x * xf), static_cast<int>(keypoints[i][j]->_y * yf));
+        };
+        SieveExtractorKP extractor(filteredKeypoints[i]);
+        sieve.extract(extractor);
+        nrKeypoints += filteredKeypoints[i].size();
+    };
+    int descLength = 0;
+    runner.run("cpfind_describe", nrKeypoints, "keypoint", [&]()
+    {
+        for (size_t i = 0; i < nrImages; ++i)
+        {
+            lfeat::CircularKeyPointDescriptor descriptor(*integralImages[i]);
+            lfeat::KeyPointVect_t kpNewOri;
+            for (size_t j = 0; j < keypoints[i].size(); ++j)
+            {
+                double angles[4];
+                const int nAngles = descriptor.assignOrientation(*keypoints[i][j], angles);
+                for (int k = 0; k < nAngles; ++k)
+                {
+                    // duplicate Keypoint with additional angles
+                    lfeat::KeyPointPtr newKeypoint(new lfeat::KeyPoint(*keypoints[i][j]));
+                    newKeypoint->_ori = angles[k];
+                    kpNewOri.push_back(newKeypoint);
+                };
+            };
+            keypoints[i].insert(keypoints[i].end(), kpNewOri.begin(), kpNewOri.end());
+            for (size_t j = 0; j < keypoints[i].size(); ++j)
+            {
+                descriptor.makeDescriptor(*keypoints[i][j]);
+            };
+            descLength = descriptor.getDescriptorLength();
+        };
+    },
+    [&]()
+    {
+        // work on a copy of the filtered keypoints, new orientations are appended
+        for (size_t i = 0; i < nrImages; ++i)
+        {
+            keypoints[i].clear();
+            for (size_t j = 0; j < filteredKeypoints[i].size(); ++j)
+            {
+                keypoints[i].push_back(lfeat::KeyPointPtr(new lfeat::KeyPoint(*filteredKeypoints[i][j])));
+            };
+        };
+    });
+    // store the descriptors compactly and match them with the same index and
+    // distance as cpfind, for both descriptor types
+    const lfeat::DescriptorSet::Type types[2] = { lfeat::DescriptorSet::FLOAT, lfeat::DescriptorSet::UINT8 };
+    for (size_t t = 0; t < 2; ++t)
+    {
+        const std::string typeName = "_" + lfeat::DescriptorSet::GetTypeName(types[t]);
+        std::vector<lfeat::DescriptorSet> descriptors(nrImages);
+        size_t nrDescriptors = 0;
+        for (size_t i = 0; i < nrImages; ++i)
+        {
+            descriptors[i].assign(keypoints[i], descLength, types[t], false);
+            nrDescriptors += descriptors[i].size();
+        };
+        if (types[t] == lfeat::DescriptorSet::UINT8)
+        {
+            BenchCPFindMatching<unsigned char>(runner, typeName, descriptors, nrDescriptors, descLength,
+                [](lfeat::DescriptorSet& d) { return d.getUInt8Data(); });
+        }
+        else
+        {
+            BenchCPFindMatching<float>(runner, typeName, descriptors, nrDescriptors, descLength,
+                [](lfeat::DescriptorSet& d) { return d.getFloatData(); });
+        };
+    };
+}
+
+int main(int argc, char* argv[])
+{
+    // parse arguments
+    const char* optstring = "o:n:h";
+    enum
+    {
+        SIZE = 1000,
+        HFOV,
+        SRCPROJECTION,
+        PROJECTION,
+        DISTORTION,
+        MASKS,
+        REPEAT,
+        SEED,
+        BENCHMARKS
+    };
+    static struct option longOptions[] =
+    {
+        { "output", required_argument, NULL, 'o' },
+        { "images", required_argument, NULL, 'n' },
+        { "size", required_argument, NULL, SIZE },
+        { "hfov", required_argument, NULL, HFOV },
+        { "src-projection", required_argument, NULL, SRCPROJECTION },
+        { "projection", required_argument, NULL, PROJECTION },
+        { "distortion", required_argument, NULL, DISTORTION },
+        { "masks", no_argument, NULL, MASKS },
+        { "repeat", required_argument, NULL, REPEAT },
+        { "seed", required_argument, NULL, SEED },
+        { "benchmarks", required_argument, NULL, BENCHMARKS },
+        { "help", no_argument, NULL, 'h' },
+        0
+    };
+    BenchSettings settings;
+    std::string output;
+    int c;
+    while ((c = getopt_long(argc, argv, optstring, longOptions, nullptr)) != -1)
+    {
+        switch (c)
+        {
+            case 'o':
+                output = optarg;
+                break;
+            case 'n':
+                if (!hugin_utils::stringToInt(optarg, settings.nrImages) || settings.nrImages < 2)
+                {
+                    std::cerr << hugin_utils::stripPath(argv[0]) << ": Invalid number of images given." << std::endl;
+                    return 1;
+                };
+                break;
+            case SIZE:
+                {
+                    const std::vector<std::string> values = hugin_utils::SplitString(optarg, "x");
+                    int width;
+                    int height;
+                    if (values.size() != 2 || !hugin_utils::stringToInt(values[0], width) || !hugin_utils::stringToInt(values[1], height)
+                        || width < 16 || height < 16)
+                    {
+                        std::cerr << hugin_utils::stripPath(argv[0]) << ": Invalid image size given." << std::endl;
+                        return 1;
+                    };
+                    settings.size = vigra::Size2D(width, height);
+                };
+                break;
+            case HFOV:
+                if (!hugin_utils::stringToDouble(optarg, settings.hfov) || settings.hfov <= 0 || settings.hfov > 360)
+                {
+                    std::cerr << hugin_utils::stripPath(argv[0]) << ": Invalid field of view given." << std::endl;
+                    return 1;
+                };
+                break;
+            case SRCPROJECTION:
+                if (!hugin_utils::stringToInt(optarg, settings.srcProjection) || settings.srcProjection < 0)
+                {
+                    std::cerr << hugin_utils::stripPath(argv[0]) << ": Invalid source projection given." << std::endl;
+                    return 1;
+                };
+                break;
+            case PROJECTION:
+                if (!hugin_utils::stringToInt(optarg, settings.panoProjection) || settings.panoProjection < 0)
+                {
+                    std::cerr << hugin_utils::stripPath(argv[0]) << ": Invalid projection given." << std::endl;
+                    return 1;
+                };
+                break;
+            case DISTORTION:
+                {
+                    const std::vector<std::string> values = hugin_utils::SplitString(optarg, ",");
+                    if (values.size() != 3)
+                    {
+                        std::cerr << hugin_utils::stripPath(argv[0]) << ": Distortion needs exactly 3 values." << std::endl;
+                        return 1;
+                    };
+                    for (size_t i = 0; i < 3; ++i)
+                    {
+                        if (!hugin_utils::stringToDouble(values[i], settings.distortion[i]))
+                        {
+                            std::cerr << hugin_utils::stripPath(argv[0]) << ": Invalid distortion value \"" << values[i] << "\" given." << std::endl;
+                            return 1;
+                        };
+                    };
+                };
+                break;
+            case MASKS:
+                settings.masks = true;
+                break;
+            case REPEAT:
+                if (!hugin_utils::stringToInt(optarg, settings.repeat) || settings.repeat < 1)
+                {
+                    std::cerr << hugin_utils::stripPath(argv[0]) << ": Invalid number of repetitions given." << std::endl;
+                    return 1;
+                };
+                break;
+            case SEED:
+                {
+                    int seed;
+                    if (!hugin_utils::stringToInt(optarg, seed) || seed < 0)
+                    {
+                        std::cerr << hugin_utils::stripPath(argv[0]) << ": Invalid seed given." << std::endl;
+                        return 1;
+                    };
+                    settings.seed = seed;
+                };
+                break;
+            case BENCHMARKS:
+                {
+                    const std::vector<std::string> values = hugin_utils::SplitString(optarg, ",");
+                    for (size_t i = 0; i < values.size(); ++i)
+                    {
+                        const std::string group = hugin_utils::tolower(values[i]);
+                        if (std::find(std::begin(BenchmarkGroups), std::end(BenchmarkGroups), group) == std::end(BenchmarkGroups))
+                        {
+                            std::cerr << hugin_utils::stripPath(argv[0]) << ": Unknown benchmark \"" << values[i] << "\"." << std::endl;
+                            return 1;
+                        };
+                        settings.groups.insert(group);
+                    };
+                };
+                break;
+            case 'h':
+                usage(hugin_utils::stripPath(argv[0]).c_str());
+                return 0;
+            case ':':
+            case '?':
+                // missing argument or invalid switch
+                return 1;
+                break;
+            default:
+                // this should not happen
+                abort();
+        }
+    }
+    if (argc - optind != 0)
+    {
+        std::cerr << hugin_utils::stripPath(argv[0]) << ": No positional arguments expected." << std::endl;
+        return 1;
+    };
+    if (settings.groups.empty())
+    {
+        settings.groups.insert(std::begin(BenchmarkGroups), std::end(BenchmarkGroups));
+    };
+
+    // create the synthetic panorama
+    std::cerr << "Creating synthetic panorama with " << settings.nrImages << " images..." << std::endl;
+    HuginBase::Panorama pano;
+    CreatePanorama(settings, pano);
+    std::mt19937 rng(settings.seed);
+    vigra::FRGBImage world;
+    CreateWorldImage(world, rng);
+    std::vector<vigra::BRGBImage> images(pano.getNrOfImages());
+    std::vector<vigra::Rect2D> rois;
+    for (unsigned int i = 0; i < pano.getNrOfImages(); ++i)
+    {
+        RenderSourceImage(world, pano.getImage(i), images[i]);
+        rois.push_back(HuginBase::estimateOutputROI(pano, pano.getOptions(), i));
+    };
+    world.resize(0, 0);
+    CreateControlPoints(pano);
+    std::cerr << "Panorama size " << pano.getOptions().getWidth() << "x" << pano.getOptions().getHeight()
+        << ", " << pano.getNrOfCtrlPoints() << " control points" << std::endl;
+
+    BenchRunner runner(settings.repeat);
+    if (settings.groups.count("transform"))
+    {
+        BenchTransform(runner, pano, rois);
+    };
+    if (settings.groups.count("remap"))
+    {
+        BenchRemap(runner, pano, images, rois);
+    };
+    if (settings.groups.count("merge") || settings.groups.count("reduce"))
+    {
+        const HuginBase::PanoramaOptions& opts = pano.getOptions();
+        RemappedImageVector remapped;
+        RemapImages(pano, images, rois, vigra_ext::INTERP_CUBIC, remapped);
+        double pixels = opts.getWidth() * static_cast<double>(opts.getHeight());
+        vigra::BRGBImage panoImage;
+        vigra::BImage panoMask;
+        const std::function<void()> merge = [&]()
+        {
+            MergeRemappedImages(opts, remapped, panoImage, panoMask);
+        };
+        const std::function<void()> resetPano = [&]()
+        {
+            panoImage.resize(opts.getSize());
+            panoMask.resize(opts.getSize());
+        };
+        if (settings.groups.count("merge"))
+        {
+            runner.run("merge_watershed", pixels, "pixel", merge, resetPano);
+        }
+        else
+        {
+            resetPano();
+            merge();
+        };
+        if (settings.groups.count("reduce"))
+        {
+            vigra::BRGBImage reducedImage;
+            vigra::BImage reducedMask;
+            runner.run("reduce_3", pixels, "pixel", [&]()
+            {
+                vigra_ext::reduceNTimes(panoImage, reducedImage, 3);
+            });
+            runner.run("reduce_3_mask", pixels, "pixel", [&]()
+            {
+                vigra_ext::reduceNTimes(panoImage, panoMask, reducedImage, reducedMask, 3);
+            });
+        };
+    };
+    if (settings.groups.count("sampler"))
+    {
+        BenchSampler(runner, pano, images);
+    };
+    if (settings.groups.count("overlap"))
+    {
+        runner.run("calculate_overlap", pano.getNrOfImages(), "image", [&]()
+        {
+            HuginBase::CalculateImageOverlap overlap(&pano);
+            overlap.calculate(10);
+        });
+    };
+    if (settings.groups.count("optimize"))
+    {
+        BenchOptimize(runner, pano, settings.seed);
+    };
+    if (settings.groups.count("cpfind"))
+    {
+        BenchCPFind(runner, images);
+    };
+
+    if (output.empty())
+    {
+        runner.writeJSON(std::cout, settings, pano.getOptions());
+    }
+    else
+    {
+        std::ofstream out(output.c_str());
+        if (!out.good())
+        {
+            std::cerr << hugin_utils::stripPath(argv[0]) << ": Could not write to " << output << std::endl;
+            return 1;
+        };
+        runner.writeJSON(out, settings, pano.getOptions());
+    };
+    return 0;
+}
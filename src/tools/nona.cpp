@@ -106,6 +106,26 @@ static void usage(const char* name)
          << "                   lower and upper cutoff (specify in range 0...1," << std::endl
          << "                   relative the full range)" << std::endl
          << "      --seam=hard|blend   select the blend mode for the seam" << std::endl
+         << "      --grid-remap[=tolerance]  calculate the exact transformation only" << std::endl
+         << "                   on an adaptive grid and interpolate in between" << std::endl
+         << "                   optionally you can specify the maximal error in" << std::endl
+         << "                   pixel (default: 0.05)" << std::endl
+         << "      --tile-size=SIZE  stitch the panorama in tiles of SIZE x SIZE" << std::endl
+         << "                   pixel and write a tiled TIFF file (only for TIFF" << std::endl
+         << "                   output), needs less memory for huge panoramas" << std::endl
+         << "      --tile-cache=MB  limit the memory used for keeping source images" << std::endl
+         << "                   between the tiles (only with --tile-size," << std::endl
+         << "                   default: 1024)" << std::endl
+         << "      --parallel-images=N  remap up to N images concurrently" << std::endl
+         << "      --parallel-memory=MB  limit the memory used by the concurrently" << std::endl
+         << "                   remapped images (only with --parallel-images)" << std::endl
+         << "      --stream-input[=cache size]  read only the needed rows of TIFF" << std::endl
+         << "                   input images instead of loading the whole image" << std::endl
+         << "                   optionally you can specify the size of the strip" << std::endl
+         << "                   cache in MB (default: 64)" << std::endl
+         << "      --remap-cache=DIR  store the calculated source coordinates of each" << std::endl
+         << "                   image in DIR and reuse them, if the same images are" << std::endl
+         << "                   stitched again with the same geometry" << std::endl
          << std::endl;
 }
 
@@ -139,7 +159,14 @@ int main(int argc, char* argv[])
         EXPOSURELAYERS,
         MASKCLIPEXPOSURE,
         SEAMMODE,
-        USE_BIGTIFF
+        USE_BIGTIFF,
+        GRIDREMAP,
+        TILESIZE,
+        TILECACHE,
+        PARALLELIMAGES,
+        PARALLELMEMORY,
+        STREAMINPUT,
+        REMAPCACHE
     };
     static struct option longOptions[] =
     {
@@ -152,6 +179,13 @@ int main(int argc, char* argv[])
         { "seam", required_argument, NULL, SEAMMODE},
         { "gpu", no_argument, NULL, 'g'},
         { "bigtiff", no_argument, NULL, USE_BIGTIFF },
+        { "grid-remap", optional_argument, NULL, GRIDREMAP },
+        { "tile-size", required_argument, NULL, TILESIZE },
+        { "tile-cache", required_argument, NULL, TILECACHE },
+        { "parallel-images", required_argument, NULL, PARALLELIMAGES },
+        { "parallel-memory", required_argument, NULL, PARALLELMEMORY },
+        { "stream-input", optional_argument, NULL, STREAMINPUT },
+        { "remap-cache", required_argument, NULL, REMAPCACHE },
         { "help", no_argument, NULL, 'h'},
         0
     };
@@ -299,6 +333,90 @@ int main(int argc, char* argv[])
             case USE_BIGTIFF:
                 HuginBase::Nona::SetAdvancedOption(advOptions, "useBigTIFF", true);
                 break;
+            case GRIDREMAP:
+                HuginBase::Nona::SetAdvancedOption(advOptions, "gridRemap", true);
+                if (optarg != NULL && *optarg != 0)
+                {
+                    double tolerance;
+                    if (!hugin_utils::stringToDouble(std::string(optarg), tolerance) || tolerance <= 0)
+                    {
+                        std::cerr << hugin_utils::stripPath(argv[0]) << ": Argument \"" << optarg << "\" is not a valid tolerance for --grid-remap." << std::endl
+                            << "      Expected a positive number (in pixel)." << std::endl;
+                        return 1;
+                    };
+                    HuginBase::Nona::SetAdvancedOption(advOptions, "gridRemapTolerance", static_cast<float>(tolerance));
+                };
+                break;
+            case TILESIZE:
+                {
+                    int tileSize;
+                    if (!hugin_utils::stringToInt(std::string(optarg), tileSize) || tileSize <= 0)
+                    {
+                        std::cerr << hugin_utils::stripPath(argv[0]) << ": Argument \"" << optarg << "\" is not a valid tile size." << std::endl
+                            << "      Expected a positive number (in pixel)." << std::endl;
+                        return 1;
+                    };
+                    HuginBase::Nona::SetAdvancedOption(advOptions, "tileSize", static_cast<float>(tileSize));
+                };
+                break;
+            case TILECACHE:
+                {
+                    double cacheSize;
+                    if (!hugin_utils::stringToDouble(std::string(optarg), cacheSize) || cacheSize <= 0)
+                    {
+                        std::cerr << hugin_utils::stripPath(argv[0]) << ": Argument \"" << optarg << "\" is not a valid cache size for --tile-cache." << std::endl
+                            << "      Expected a positive number (in MB)." << std::endl;
+                        return 1;
+                    };
+                    HuginBase::Nona::SetAdvancedOption(advOptions, "tileCacheSize", static_cast<float>(cacheSize));
+                };
+                break;
+            case PARALLELIMAGES:
+                {
+                    int parallelImages;
+                    if (!hugin_utils::stringToInt(std::string(optarg), parallelImages) || parallelImages <= 0)
+                    {
+                        std::cerr << hugin_utils::stripPath(argv[0]) << ": Argument \"" << optarg << "\" is not a valid number of images." << std::endl
+                            << "      Expected a positive number." << std::endl;
+                        return 1;
+                    };
+                    HuginBase::Nona::SetAdvancedOption(advOptions, "parallelImages", static_cast<float>(parallelImages));
+                };
+                break;
+            case PARALLELMEMORY:
+                {
+                    double memoryLimit;
+                    if (!hugin_utils::stringToDouble(std::string(optarg), memoryLimit) || memoryLimit <= 0)
+                    {
+                        std::cerr << hugin_utils::stripPath(argv[0]) << ": Argument \"" << optarg << "\" is not a valid memory limit." << std::endl
+                            << "      Expected a positive number (in MB)." << std::endl;
+                        return 1;
+                    };
+                    HuginBase::Nona::SetAdvancedOption(advOptions, "parallelImagesMemory", static_cast<float>(memoryLimit));
+                };
+                break;
+            case STREAMINPUT:
+                HuginBase::Nona::SetAdvancedOption(advOptions, "streamSourceImages", true);
+                if (optarg != NULL && *optarg != 0)
+                {
+                    double cacheSize;
+                    if (!hugin_utils::stringToDouble(std::string(optarg), cacheSize) || cacheSize <= 0)
+                    {
+                        std::cerr << hugin_utils::stripPath(argv[0]) << ": Argument \"" << optarg << "\" is not a valid cache size for --stream-input." << std::endl
+                            << "      Expected a positive number (in MB)." << std::endl;
+                        return 1;
+                    };
+                    HuginBase::Nona::SetAdvancedOption(advOptions, "streamCacheSize", static_cast<float>(cacheSize));
+                };
+                break;
+            case REMAPCACHE:
+                if (*optarg == 0)
+                {
+                    std::cerr << hugin_utils::stripPath(argv[0]) << ": --remap-cache requires a directory." << std::endl;
+                    return 1;
+                };
+                HuginBase::Nona::SetAdvancedOption(advOptions, "remapCacheDir", std::string(optarg));
+                break;
             case ':':
             case '?':
                 // missing argument or invalid switch